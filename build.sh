@@ -25,9 +25,9 @@ esac
 PLATFORM="[linux|pi|android|ios]"
 
 #basic libraries
-BASIC_LIBS="libposix libtime liblog libdarray libthread libgevent libworkq libdict libhash libsort \
+BASIC_LIBS="libposix libmempool libbitmap libtime liblog libdarray libthread libgevent libworkq libhash libdict \
 	    librbtree libringbuffer libvector libstrex libmedia-io \
-            libdebug libfile libqueue libplugin libhal libsubmask"
+            libdebug libfile libsort libqueue libplugin libhal libsubmask"
 MEDIA_LIBS="libavcap"
 FRAMEWORK_LIBS="libipc"
 NETWORK_LIBS="libsock libptcp librpc librtsp librtmpc"
@@ -13,6 +13,6 @@ LIBRARIES_DIR	:= $(LOCAL_PATH)/../
 LOCAL_C_INCLUDES := $(LOCAL_PATH)
 
 # Add your application source files here...
-LOCAL_SRC_FILES := libbitmap.c
+LOCAL_SRC_FILES := libbitmap.c hweight.c find_bit.c bitmap_simd.c libbitmap_ida.c libbitmap_roaring.c
 
 include $(BUILD_SHARED_LIBRARY)
@@ -4,6 +4,31 @@
 
 #include <asm/types.h>
 
+/*
+ * use popcnt instruction if compiled with -mpopcnt, otherwise the
+ * software version, see bitmap_simd_set() for runtime dispatch
+ */
+#if defined(__GNUC__) && defined(__POPCNT__)
+static inline unsigned int __arch_hweight32(unsigned int w)
+{
+	return __builtin_popcount(w);
+}
+
+static inline unsigned int __arch_hweight16(unsigned int w)
+{
+	return __builtin_popcount(w & 0xffff);
+}
+
+static inline unsigned int __arch_hweight8(unsigned int w)
+{
+	return __builtin_popcount(w & 0xff);
+}
+
+static inline unsigned long __arch_hweight64(__u64 w)
+{
+	return __builtin_popcountll(w);
+}
+#else
 static inline unsigned int __arch_hweight32(unsigned int w)
 {
 	return __sw_hweight32(w);
@@ -23,4 +48,5 @@ static inline unsigned long __arch_hweight64(__u64 w)
 {
 	return __sw_hweight64(w);
 }
+#endif
 #endif /* _ASM_GENERIC_BITOPS_HWEIGHT_H_ */
@@ -0,0 +1,528 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libbitmap.h"
+#include "bitmap_simd.h"
+
+/*
+ * each level is compiled with target attribute, so the library itself
+ * is built for baseline cpu, the best level is chosen by cpuid at first
+ * use, or forced by bitmap_simd_set().
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BITMAP_SIMD_X86
+#include <immintrin.h>
+#if (__GNUC__ >= 8) || defined(__clang__)
+#define BITMAP_SIMD_X86_AVX512
+#endif
+#endif
+
+const struct bitmap_simd_ops *_bitmap_simd_ops = NULL;
+
+/******************************************************************************
+ * generic, one unsigned long at a time
+ ******************************************************************************/
+static unsigned long generic_and(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords)
+{
+	unsigned int k;
+	unsigned long result = 0;
+
+	for (k = 0; k < nwords; k++)
+		result |= (dst[k] = src1[k] & src2[k]);
+	return result;
+}
+
+static void generic_or(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords)
+{
+	unsigned int k;
+
+	for (k = 0; k < nwords; k++)
+		dst[k] = src1[k] | src2[k];
+}
+
+static void generic_xor(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords)
+{
+	unsigned int k;
+
+	for (k = 0; k < nwords; k++)
+		dst[k] = src1[k] ^ src2[k];
+}
+
+static unsigned long generic_andnot(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords)
+{
+	unsigned int k;
+	unsigned long result = 0;
+
+	for (k = 0; k < nwords; k++)
+		result |= (dst[k] = src1[k] & ~src2[k]);
+	return result;
+}
+
+static unsigned long generic_weight(const unsigned long *src, unsigned int nwords)
+{
+	unsigned int k;
+	unsigned long w = 0;
+
+	for (k = 0; k < nwords; k++)
+		w += hweight_long(src[k]);
+	return w;
+}
+
+static unsigned long generic_scan(const unsigned long *addr, unsigned long from,
+			unsigned long end, unsigned long invert)
+{
+	for (; from < end; from++)
+		if (addr[from] != invert)
+			return from;
+	return from;
+}
+
+static const struct bitmap_simd_ops generic_ops = {
+	BITMAP_SIMD_GENERIC,
+	"generic",
+	generic_and,
+	generic_or,
+	generic_xor,
+	generic_andnot,
+	generic_weight,
+	generic_scan,
+};
+
+#ifdef BITMAP_SIMD_X86
+/******************************************************************************
+ * popcnt, weight only
+ ******************************************************************************/
+__attribute__((target("popcnt")))
+static unsigned long popcnt_weight(const unsigned long *src, unsigned int nwords)
+{
+	unsigned int k;
+	unsigned long w0 = 0, w1 = 0, w2 = 0, w3 = 0;
+
+	/* four accumulators, popcnt has latency 3 */
+	for (k = 0; k + 4 <= nwords; k += 4) {
+		w0 += __builtin_popcountl(src[k]);
+		w1 += __builtin_popcountl(src[k + 1]);
+		w2 += __builtin_popcountl(src[k + 2]);
+		w3 += __builtin_popcountl(src[k + 3]);
+	}
+	for (; k < nwords; k++)
+		w0 += __builtin_popcountl(src[k]);
+	return w0 + w1 + w2 + w3;
+}
+
+static const struct bitmap_simd_ops popcnt_ops = {
+	BITMAP_SIMD_POPCNT,
+	"popcnt",
+	generic_and,
+	generic_or,
+	generic_xor,
+	generic_andnot,
+	popcnt_weight,
+	generic_scan,
+};
+
+/******************************************************************************
+ * avx2, 256 bits a time
+ ******************************************************************************/
+#define AVX2_WORDS	(32 / sizeof(unsigned long))
+
+__attribute__((target("avx2")))
+static unsigned long avx2_and(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords)
+{
+	unsigned int k;
+	unsigned long result = 0;
+	__m256i acc = _mm256_setzero_si256();
+
+	for (k = 0; k + AVX2_WORDS <= nwords; k += AVX2_WORDS) {
+		__m256i r = _mm256_and_si256(
+				_mm256_loadu_si256((const __m256i *)(src1 + k)),
+				_mm256_loadu_si256((const __m256i *)(src2 + k)));
+		_mm256_storeu_si256((__m256i *)(dst + k), r);
+		acc = _mm256_or_si256(acc, r);
+	}
+	for (; k < nwords; k++)
+		result |= (dst[k] = src1[k] & src2[k]);
+	return result | !_mm256_testz_si256(acc, acc);
+}
+
+__attribute__((target("avx2")))
+static void avx2_or(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords)
+{
+	unsigned int k;
+
+	for (k = 0; k + AVX2_WORDS <= nwords; k += AVX2_WORDS) {
+		_mm256_storeu_si256((__m256i *)(dst + k), _mm256_or_si256(
+				_mm256_loadu_si256((const __m256i *)(src1 + k)),
+				_mm256_loadu_si256((const __m256i *)(src2 + k))));
+	}
+	for (; k < nwords; k++)
+		dst[k] = src1[k] | src2[k];
+}
+
+__attribute__((target("avx2")))
+static void avx2_xor(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords)
+{
+	unsigned int k;
+
+	for (k = 0; k + AVX2_WORDS <= nwords; k += AVX2_WORDS) {
+		_mm256_storeu_si256((__m256i *)(dst + k), _mm256_xor_si256(
+				_mm256_loadu_si256((const __m256i *)(src1 + k)),
+				_mm256_loadu_si256((const __m256i *)(src2 + k))));
+	}
+	for (; k < nwords; k++)
+		dst[k] = src1[k] ^ src2[k];
+}
+
+__attribute__((target("avx2")))
+static unsigned long avx2_andnot(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords)
+{
+	unsigned int k;
+	unsigned long result = 0;
+	__m256i acc = _mm256_setzero_si256();
+
+	for (k = 0; k + AVX2_WORDS <= nwords; k += AVX2_WORDS) {
+		/* andnot_si256(a, b) is ~a & b */
+		__m256i r = _mm256_andnot_si256(
+				_mm256_loadu_si256((const __m256i *)(src2 + k)),
+				_mm256_loadu_si256((const __m256i *)(src1 + k)));
+		_mm256_storeu_si256((__m256i *)(dst + k), r);
+		acc = _mm256_or_si256(acc, r);
+	}
+	for (; k < nwords; k++)
+		result |= (dst[k] = src1[k] & ~src2[k]);
+	return result | !_mm256_testz_si256(acc, acc);
+}
+
+/*
+ * popcount of each nibble by pshufb lookup, bytes summed by psadbw,
+ * see Mula, Kurz, Lemire, "Faster Population Counts Using AVX2 Instructions"
+ */
+__attribute__((target("avx2,popcnt")))
+static unsigned long avx2_weight(const unsigned long *src, unsigned int nwords)
+{
+	const __m256i lookup = _mm256_setr_epi8(
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0f);
+	__m256i acc = _mm256_setzero_si256();
+	unsigned int k = 0, i;
+	uint64_t sum[4];
+	unsigned long w;
+
+	while (k + AVX2_WORDS <= nwords) {
+		/* each byte counter takes at most 8 per round, flush before 255 */
+		__m256i local = _mm256_setzero_si256();
+		for (i = 0; i < 31 && k + AVX2_WORDS <= nwords; i++, k += AVX2_WORDS) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)(src + k));
+			__m256i lo = _mm256_and_si256(v, low);
+			__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+			local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, lo));
+			local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, hi));
+		}
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(local, _mm256_setzero_si256()));
+	}
+	_mm256_storeu_si256((__m256i *)sum, acc);
+	w = (unsigned long)(sum[0] + sum[1] + sum[2] + sum[3]);
+	for (; k < nwords; k++)
+		w += __builtin_popcountl(src[k]);
+	return w;
+}
+
+__attribute__((target("avx2")))
+static unsigned long avx2_scan(const unsigned long *addr, unsigned long from,
+			unsigned long end, unsigned long invert)
+{
+	const __m256i inv = _mm256_set1_epi32((int)invert);
+
+	/* word by word up to 2 vectors, then 2 vectors a time */
+	while (from < end && (end - from) % (2 * AVX2_WORDS)) {
+		if (addr[from] != invert)
+			return from;
+		from++;
+	}
+	for (; from < end; from += 2 * AVX2_WORDS) {
+		__m256i v0 = _mm256_xor_si256(inv,
+				_mm256_loadu_si256((const __m256i *)(addr + from)));
+		__m256i v1 = _mm256_xor_si256(inv,
+				_mm256_loadu_si256((const __m256i *)(addr + from + AVX2_WORDS)));
+		__m256i v = _mm256_or_si256(v0, v1);
+		if (!_mm256_testz_si256(v, v))
+			return generic_scan(addr, from, end, invert);
+	}
+	return from;
+}
+
+static const struct bitmap_simd_ops avx2_ops = {
+	BITMAP_SIMD_AVX2,
+	"avx2",
+	avx2_and,
+	avx2_or,
+	avx2_xor,
+	avx2_andnot,
+	avx2_weight,
+	avx2_scan,
+};
+
+#ifdef BITMAP_SIMD_X86_AVX512
+/******************************************************************************
+ * avx512, 512 bits a time, needs avx512f and avx512bw
+ ******************************************************************************/
+#define AVX512_WORDS	(64 / sizeof(unsigned long))
+
+__attribute__((target("avx512f")))
+static unsigned long avx512_and(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords)
+{
+	unsigned int k;
+	unsigned long result = 0;
+	__m512i acc = _mm512_setzero_si512();
+
+	for (k = 0; k + AVX512_WORDS <= nwords; k += AVX512_WORDS) {
+		__m512i r = _mm512_and_si512(
+				_mm512_loadu_si512((const void *)(src1 + k)),
+				_mm512_loadu_si512((const void *)(src2 + k)));
+		_mm512_storeu_si512((void *)(dst + k), r);
+		acc = _mm512_or_si512(acc, r);
+	}
+	for (; k < nwords; k++)
+		result |= (dst[k] = src1[k] & src2[k]);
+	return result | (_mm512_test_epi64_mask(acc, acc) != 0);
+}
+
+__attribute__((target("avx512f")))
+static void avx512_or(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords)
+{
+	unsigned int k;
+
+	for (k = 0; k + AVX512_WORDS <= nwords; k += AVX512_WORDS) {
+		_mm512_storeu_si512((void *)(dst + k), _mm512_or_si512(
+				_mm512_loadu_si512((const void *)(src1 + k)),
+				_mm512_loadu_si512((const void *)(src2 + k))));
+	}
+	for (; k < nwords; k++)
+		dst[k] = src1[k] | src2[k];
+}
+
+__attribute__((target("avx512f")))
+static void avx512_xor(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords)
+{
+	unsigned int k;
+
+	for (k = 0; k + AVX512_WORDS <= nwords; k += AVX512_WORDS) {
+		_mm512_storeu_si512((void *)(dst + k), _mm512_xor_si512(
+				_mm512_loadu_si512((const void *)(src1 + k)),
+				_mm512_loadu_si512((const void *)(src2 + k))));
+	}
+	for (; k < nwords; k++)
+		dst[k] = src1[k] ^ src2[k];
+}
+
+__attribute__((target("avx512f")))
+static unsigned long avx512_andnot(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords)
+{
+	unsigned int k;
+	unsigned long result = 0;
+	__m512i acc = _mm512_setzero_si512();
+
+	for (k = 0; k + AVX512_WORDS <= nwords; k += AVX512_WORDS) {
+		__m512i r = _mm512_andnot_si512(
+				_mm512_loadu_si512((const void *)(src2 + k)),
+				_mm512_loadu_si512((const void *)(src1 + k)));
+		_mm512_storeu_si512((void *)(dst + k), r);
+		acc = _mm512_or_si512(acc, r);
+	}
+	for (; k < nwords; k++)
+		result |= (dst[k] = src1[k] & ~src2[k]);
+	return result | (_mm512_test_epi64_mask(acc, acc) != 0);
+}
+
+/* nibble lookup as avx2_weight, for cpu without avx512vpopcntdq */
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static unsigned long avx512_weight(const unsigned long *src, unsigned int nwords)
+{
+	const __m512i lookup = _mm512_broadcast_i32x4(_mm_setr_epi8(
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+	const __m512i low = _mm512_set1_epi8(0x0f);
+	__m512i acc = _mm512_setzero_si512();
+	unsigned int k = 0, i;
+	unsigned long w;
+
+	while (k + AVX512_WORDS <= nwords) {
+		__m512i local = _mm512_setzero_si512();
+		for (i = 0; i < 31 && k + AVX512_WORDS <= nwords; i++, k += AVX512_WORDS) {
+			__m512i v = _mm512_loadu_si512((const void *)(src + k));
+			__m512i lo = _mm512_and_si512(v, low);
+			__m512i hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), low);
+			local = _mm512_add_epi8(local, _mm512_shuffle_epi8(lookup, lo));
+			local = _mm512_add_epi8(local, _mm512_shuffle_epi8(lookup, hi));
+		}
+		acc = _mm512_add_epi64(acc, _mm512_sad_epu8(local, _mm512_setzero_si512()));
+	}
+	w = (unsigned long)_mm512_reduce_add_epi64(acc);
+	for (; k < nwords; k++)
+		w += __builtin_popcountl(src[k]);
+	return w;
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt")))
+static unsigned long avx512_vpopcnt_weight(const unsigned long *src, unsigned int nwords)
+{
+	__m512i acc = _mm512_setzero_si512();
+	unsigned int k;
+	unsigned long w;
+
+	for (k = 0; k + AVX512_WORDS <= nwords; k += AVX512_WORDS) {
+		acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(
+				_mm512_loadu_si512((const void *)(src + k))));
+	}
+	w = (unsigned long)_mm512_reduce_add_epi64(acc);
+	for (; k < nwords; k++)
+		w += __builtin_popcountl(src[k]);
+	return w;
+}
+
+__attribute__((target("avx512f")))
+static unsigned long avx512_scan(const unsigned long *addr, unsigned long from,
+			unsigned long end, unsigned long invert)
+{
+	const __m512i inv = _mm512_set1_epi32((int)invert);
+
+	while (from < end && (end - from) % (2 * AVX512_WORDS)) {
+		if (addr[from] != invert)
+			return from;
+		from++;
+	}
+	for (; from < end; from += 2 * AVX512_WORDS) {
+		__m512i v = _mm512_or_si512(
+			_mm512_xor_si512(inv, _mm512_loadu_si512((const void *)(addr + from))),
+			_mm512_xor_si512(inv, _mm512_loadu_si512((const void *)(addr + from + AVX512_WORDS))));
+		if (_mm512_test_epi64_mask(v, v))
+			return generic_scan(addr, from, end, invert);
+	}
+	return from;
+}
+
+static const struct bitmap_simd_ops avx512_ops = {
+	BITMAP_SIMD_AVX512,
+	"avx512",
+	avx512_and,
+	avx512_or,
+	avx512_xor,
+	avx512_andnot,
+	avx512_weight,
+	avx512_scan,
+};
+
+static const struct bitmap_simd_ops avx512_vpopcnt_ops = {
+	BITMAP_SIMD_AVX512,
+	"avx512+vpopcnt",
+	avx512_and,
+	avx512_or,
+	avx512_xor,
+	avx512_andnot,
+	avx512_vpopcnt_weight,
+	avx512_scan,
+};
+#endif
+#endif
+
+static const struct bitmap_simd_ops *simd_ops_of(int level)
+{
+#ifdef BITMAP_SIMD_X86
+	__builtin_cpu_init();
+	switch (level) {
+	case BITMAP_SIMD_GENERIC:
+		return &generic_ops;
+	case BITMAP_SIMD_POPCNT:
+		if (__builtin_cpu_supports("popcnt"))
+			return &popcnt_ops;
+		break;
+	case BITMAP_SIMD_AVX2:
+		if (__builtin_cpu_supports("avx2") &&
+		    __builtin_cpu_supports("popcnt"))
+			return &avx2_ops;
+		break;
+#ifdef BITMAP_SIMD_X86_AVX512
+	case BITMAP_SIMD_AVX512:
+		if (!__builtin_cpu_supports("avx512f") ||
+		    !__builtin_cpu_supports("avx512bw") ||
+		    !__builtin_cpu_supports("popcnt"))
+			break;
+		if (__builtin_cpu_supports("avx512vpopcntdq"))
+			return &avx512_vpopcnt_ops;
+		return &avx512_ops;
+#endif
+	default:
+		break;
+	}
+	return NULL;
+#else
+	return level == BITMAP_SIMD_GENERIC ? &generic_ops : NULL;
+#endif
+}
+
+const struct bitmap_simd_ops *bitmap_simd_detect(void)
+{
+	const struct bitmap_simd_ops *ops = NULL;
+	int level;
+
+	for (level = BITMAP_SIMD_AVX512; level >= 0 && !ops; level--)
+		ops = simd_ops_of(level);
+	/* every thread detects the same, no lock is needed */
+	_bitmap_simd_ops = ops;
+	return ops;
+}
+
+int bitmap_simd_get(void)
+{
+	return bitmap_simd()->level;
+}
+
+int bitmap_simd_supported(int level)
+{
+	return simd_ops_of(level) != NULL;
+}
+
+int bitmap_simd_set(int level)
+{
+	const struct bitmap_simd_ops *ops = simd_ops_of(level);
+	if (!ops)
+		return -1;
+	_bitmap_simd_ops = ops;
+	return 0;
+}
+
+const char *bitmap_simd_name(int level)
+{
+	const struct bitmap_simd_ops *ops = simd_ops_of(level);
+	return ops ? ops->name : "unsupported";
+}
@@ -0,0 +1,61 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef BITMAP_SIMD_H
+#define BITMAP_SIMD_H
+
+/*
+ * internal, word kernels of bitmap operations. all of them work on whole
+ * unsigned longs, tail bits of the last partial word are handled by caller.
+ */
+struct bitmap_simd_ops {
+	int level;
+	const char *name;
+	/* return non-zero if any bit of dst is set */
+	unsigned long (*and_words)(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords);
+	void (*or_words)(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords);
+	void (*xor_words)(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords);
+	unsigned long (*andnot_words)(unsigned long *dst, const unsigned long *src1,
+			const unsigned long *src2, unsigned int nwords);
+	unsigned long (*weight)(const unsigned long *src, unsigned int nwords);
+	/*
+	 * index of first word in [from, end) which is not equal to invert,
+	 * or max(from, end) if there is none
+	 */
+	unsigned long (*scan)(const unsigned long *addr, unsigned long from,
+			unsigned long end, unsigned long invert);
+};
+
+extern const struct bitmap_simd_ops *_bitmap_simd_ops;
+const struct bitmap_simd_ops *bitmap_simd_detect(void);
+
+static inline const struct bitmap_simd_ops *bitmap_simd(void)
+{
+	const struct bitmap_simd_ops *ops = _bitmap_simd_ops;
+	if (UNLIKELY(!ops))
+		ops = bitmap_simd_detect();
+	return ops;
+}
+
+#endif
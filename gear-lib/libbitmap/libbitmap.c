@@ -22,6 +22,8 @@
 #define _GNU_SOURCE
 #include <string.h>
 #include "libbitmap.h"
+#include "bitmap_simd.h"
+#include <stdio.h>
 #include <stdbool.h>
 
 /**
@@ -52,6 +54,16 @@
  * for the best explanations of this ordering.
  */
 
+int __bitmap_empty(const unsigned long *bitmap, unsigned int bits)
+{
+	return find_first_bit(bitmap, bits) >= bits;
+}
+
+int __bitmap_full(const unsigned long *bitmap, unsigned int bits)
+{
+	return find_first_zero_bit(bitmap, bits) >= bits;
+}
+
 int __bitmap_equal(const unsigned long *bitmap1,
 		const unsigned long *bitmap2, unsigned int bits)
 {
@@ -155,14 +167,12 @@ void __bitmap_shift_left(unsigned long *dst, const unsigned long *src,
 int __bitmap_and(unsigned long *dst, const unsigned long *bitmap1,
 				const unsigned long *bitmap2, unsigned int bits)
 {
-	unsigned int k;
 	unsigned int lim = bits/BITS_PER_LONG;
-	unsigned long result = 0;
+	unsigned long result;
 
-	for (k = 0; k < lim; k++)
-		result |= (dst[k] = bitmap1[k] & bitmap2[k]);
+	result = bitmap_simd()->and_words(dst, bitmap1, bitmap2, lim);
 	if (bits % BITS_PER_LONG)
-		result |= (dst[k] = bitmap1[k] & bitmap2[k] &
+		result |= (dst[lim] = bitmap1[lim] & bitmap2[lim] &
 			   BITMAP_LAST_WORD_MASK(bits));
 	return result != 0;
 }
@@ -170,34 +180,28 @@ int __bitmap_and(unsigned long *dst, const unsigned long *bitmap1,
 void __bitmap_or(unsigned long *dst, const unsigned long *bitmap1,
 				const unsigned long *bitmap2, unsigned int bits)
 {
-	unsigned int k;
 	unsigned int nr = BITS_TO_LONGS(bits);
 
-	for (k = 0; k < nr; k++)
-		dst[k] = bitmap1[k] | bitmap2[k];
+	bitmap_simd()->or_words(dst, bitmap1, bitmap2, nr);
 }
 
 void __bitmap_xor(unsigned long *dst, const unsigned long *bitmap1,
 				const unsigned long *bitmap2, unsigned int bits)
 {
-	unsigned int k;
 	unsigned int nr = BITS_TO_LONGS(bits);
 
-	for (k = 0; k < nr; k++)
-		dst[k] = bitmap1[k] ^ bitmap2[k];
+	bitmap_simd()->xor_words(dst, bitmap1, bitmap2, nr);
 }
 
 int __bitmap_andnot(unsigned long *dst, const unsigned long *bitmap1,
 				const unsigned long *bitmap2, unsigned int bits)
 {
-	unsigned int k;
 	unsigned int lim = bits/BITS_PER_LONG;
-	unsigned long result = 0;
+	unsigned long result;
 
-	for (k = 0; k < lim; k++)
-		result |= (dst[k] = bitmap1[k] & ~bitmap2[k]);
+	result = bitmap_simd()->andnot_words(dst, bitmap1, bitmap2, lim);
 	if (bits % BITS_PER_LONG)
-		result |= (dst[k] = bitmap1[k] & ~bitmap2[k] &
+		result |= (dst[lim] = bitmap1[lim] & ~bitmap2[lim] &
 			   BITMAP_LAST_WORD_MASK(bits));
 	return result != 0;
 }
@@ -232,14 +236,12 @@ int __bitmap_subset(const unsigned long *bitmap1,
 
 int __bitmap_weight(const unsigned long *bitmap, unsigned int bits)
 {
-	unsigned int k, lim = bits/BITS_PER_LONG;
-	int w = 0;
-
-	for (k = 0; k < lim; k++)
-		w += hweight_long(bitmap[k]);
+	unsigned int lim = bits/BITS_PER_LONG;
+	int w;
 
+	w = bitmap_simd()->weight(bitmap, lim);
 	if (bits % BITS_PER_LONG)
-		w += hweight_long(bitmap[k] & BITMAP_LAST_WORD_MASK(bits));
+		w += hweight_long(bitmap[lim] & BITMAP_LAST_WORD_MASK(bits));
 
 	return w;
 }
@@ -464,15 +466,72 @@ int bitmap_parse_user(const char __user *ubuf,
  * sufficient storage remains at @buf to accommodate the
  * bitmap_print_to_pagebuf() output.
  */
+/*
+ * %*pb and %*pbl of kernel vsnprintf are not in libc, print them here.
+ * hex is in 32 bits chunks separated by comma, most significant first.
+ */
+static int bitmap_scnprintf(char *buf, size_t size,
+			    const unsigned long *maskp, int nmaskbits)
+{
+	int chunk, len = 0, n;
+	uint32_t word;
+
+	if (size == 0)
+		return 0;
+	buf[0] = '\0';
+	for (chunk = (nmaskbits - 1) / 32; chunk >= 0 && nmaskbits > 0; chunk--) {
+		unsigned int bits = min(32, nmaskbits - chunk * 32);
+		word = maskp[chunk * 32 / BITS_PER_LONG] >> (chunk * 32 % BITS_PER_LONG);
+		if (bits < 32)
+			word &= (1U << bits) - 1;
+		n = snprintf(buf + len, size - len, "%s%0*x",
+			     len ? "," : "", (int)DIV_ROUND_UP(bits, 4), word);
+		if (n < 0 || (size_t)n >= size - len)
+			return size - 1;
+		len += n;
+	}
+	return len;
+}
+
+static int bitmap_scnlistprintf(char *buf, size_t size,
+				const unsigned long *maskp, int nmaskbits)
+{
+	unsigned long cur, rbot, rtop;
+	int len = 0, n;
+
+	if (size == 0)
+		return 0;
+	buf[0] = '\0';
+	cur = find_first_bit(maskp, nmaskbits);
+	while (cur < (unsigned long)nmaskbits) {
+		rbot = cur;
+		rtop = find_next_zero_bit(maskp, nmaskbits, cur + 1) - 1;
+		if (rbot == rtop)
+			n = snprintf(buf + len, size - len, "%s%lu",
+				     len ? "," : "", rbot);
+		else
+			n = snprintf(buf + len, size - len, "%s%lu-%lu",
+				     len ? "," : "", rbot, rtop);
+		if (n < 0 || (size_t)n >= size - len)
+			return size - 1;
+		len += n;
+		cur = find_next_bit(maskp, nmaskbits, rtop + 1);
+	}
+	return len;
+}
+
 int bitmap_print_to_pagebuf(bool list, char *buf, const unsigned long *maskp,
 			    int nmaskbits)
 {
 	ptrdiff_t len = PTR_ALIGN(buf + PAGE_SIZE - 1, PAGE_SIZE) - buf;
 	int n = 0;
 
-	if (len > 1)
-		n = list ? scnprintf(buf, len, "%*pbl\n", nmaskbits, maskp) :
-			   scnprintf(buf, len, "%*pb\n", nmaskbits, maskp);
+	if (len > 1) {
+		n = list ? bitmap_scnlistprintf(buf, len - 1, maskp, nmaskbits) :
+			   bitmap_scnprintf(buf, len - 1, maskp, nmaskbits);
+		buf[n++] = '\n';
+		buf[n] = '\0';
+	}
 	return n;
 }
 
@@ -1112,7 +1171,7 @@ unsigned long *bitmap_alloc(unsigned int nbits)
 
 unsigned long *bitmap_zalloc(unsigned int nbits)
 {
-	return calloc(nbits, 1);
+	return calloc(BITS_TO_LONGS(nbits), sizeof(unsigned long));
 }
 
 void bitmap_free(const unsigned long *bitmap)
@@ -30,7 +30,7 @@
 #include <string.h>
 #include <ctype.h>
 
-#define LIBBITMAP_VERSION "0.0.1"
+#define LIBBITMAP_VERSION "0.1.0"
 
 #ifdef __cplusplus
 extern "C" {
@@ -140,6 +140,23 @@ unsigned long *bitmap_alloc(unsigned int nbits);
 unsigned long *bitmap_zalloc(unsigned int nbits);
 void bitmap_free(const unsigned long *bitmap);
 
+/*
+ * bitmap_and/or/xor/andnot, bitmap_weight and find_*_bit run on the best
+ * SIMD level of the cpu, detected at first use, generic code is fallback.
+ * bitmap_simd_set() forces a level, it is for test and benchmark.
+ */
+enum bitmap_simd_level {
+	BITMAP_SIMD_GENERIC = 0,
+	BITMAP_SIMD_POPCNT,
+	BITMAP_SIMD_AVX2,
+	BITMAP_SIMD_AVX512,
+};
+
+int bitmap_simd_get(void);
+int bitmap_simd_set(int level);
+int bitmap_simd_supported(int level);
+const char *bitmap_simd_name(int level);
+
 /*
  * lib/bitmap.c provides these functions:
  */
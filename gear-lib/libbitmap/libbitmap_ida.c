@@ -0,0 +1,388 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libbitmap.h"
+#include "libbitmap_ida.h"
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#define IDA_MAX_LEVEL	8
+#define IDA_TOP_BITS	(BITS_PER_LONG * 8)
+#define IDA_PAIR_MASK	(~0UL / 3)
+
+struct ida {
+	uint32_t base;
+	uint32_t count;
+	uint32_t used;
+	uint32_t key;
+	int flags;
+	int nlevel;
+	unsigned long nbits[IDA_MAX_LEVEL];
+	unsigned long *map[IDA_MAX_LEVEL];
+	unsigned long cursor;
+	uint64_t seed;
+	pthread_mutex_t lock;
+};
+
+static uint64_t ida_rand(struct ida *ida)
+{
+	/* xorshift64*, not for crypto, only to spread the start offset */
+	ida->seed ^= ida->seed >> 12;
+	ida->seed ^= ida->seed << 25;
+	ida->seed ^= ida->seed >> 27;
+	return ida->seed * 0x2545F4914F6CDD1DULL;
+}
+
+/* murmur3 fmix32 keyed by xor, a bijection on uint32 */
+static uint32_t ida_mix(struct ida *ida, uint32_t x)
+{
+	x ^= ida->key;
+	x ^= x >> 16;
+	x *= 0x85ebca6b;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35;
+	x ^= x >> 16;
+	return x;
+}
+
+static uint32_t ida_unmix(struct ida *ida, uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7ed1b41d;
+	x ^= (x >> 13) ^ (x >> 26);
+	x *= 0xa5cb9243;
+	x ^= x >> 16;
+	return x ^ ida->key;
+}
+
+static inline unsigned long ida_word_mask(struct ida *ida, int k,
+					  unsigned long w)
+{
+	if (w == BIT_WORD(ida->nbits[k] - 1))
+		return BITMAP_LAST_WORD_MASK(ida->nbits[k]);
+	return ~0UL;
+}
+
+/* set bit at level 0, a word that becomes full sets its bit one level up */
+static void ida_mark(struct ida *ida, unsigned long bit)
+{
+	unsigned long w;
+	int k;
+
+	for (k = 0; k < ida->nlevel; k++) {
+		w = BIT_WORD(bit);
+		ida->map[k][w] |= BIT_MASK(bit);
+		if (ida->map[k][w] != ida_word_mask(ida, k, w))
+			break;
+		bit = w;
+	}
+}
+
+/* clear bit at level 0, a word that was full clears its bit one level up */
+static void ida_unmark(struct ida *ida, unsigned long bit)
+{
+	unsigned long w;
+	int k, full;
+
+	for (k = 0; k < ida->nlevel; k++) {
+		w = BIT_WORD(bit);
+		full = (ida->map[k][w] == ida_word_mask(ida, k, w));
+		ida->map[k][w] &= ~BIT_MASK(bit);
+		if (!full)
+			break;
+		bit = w;
+	}
+}
+
+/*
+ * first zero bit >= pos at level k, or nbits[k]. the rest of the current
+ * word is checked first, then the level above gives the next word that is
+ * not full, so only the top level is ever scanned linearly.
+ */
+static unsigned long ida_next_zero(struct ida *ida, int k, unsigned long pos)
+{
+	unsigned long n = ida->nbits[k];
+	unsigned long w, word;
+
+	if (pos >= n)
+		return n;
+	if (k == ida->nlevel - 1)
+		return find_next_zero_bit(ida->map[k], n, pos);
+
+	w = BIT_WORD(pos);
+	word = ~ida->map[k][w] & ida_word_mask(ida, k, w) &
+		BITMAP_FIRST_WORD_MASK(pos);
+	if (!word) {
+		w = ida_next_zero(ida, k + 1, w + 1);
+		if (w >= ida->nbits[k + 1])
+			return n;
+		word = ~ida->map[k][w] & ida_word_mask(ida, k, w);
+	}
+	return w * BITS_PER_LONG + __ffs(word);
+}
+
+/* first free aligned pair >= pos (pos is even), or nbits[0] */
+static unsigned long ida_next_pair(struct ida *ida, unsigned long pos)
+{
+	unsigned long n = ida->nbits[0];
+	unsigned long w, word;
+
+	for (;;) {
+		pos = ida_next_zero(ida, 0, pos);
+		if (pos >= n)
+			return n;
+		w = BIT_WORD(pos);
+		word = ~ida->map[0][w] & ida_word_mask(ida, 0, w) &
+			BITMAP_FIRST_WORD_MASK(pos & ~1UL);
+		word &= (word >> 1) & IDA_PAIR_MASK;
+		if (word)
+			return w * BITS_PER_LONG + __ffs(word);
+		pos = (w + 1) * BITS_PER_LONG;
+	}
+}
+
+static unsigned long ida_find(struct ida *ida, int pair)
+{
+	unsigned long n = ida->nbits[0];
+	unsigned long start, idx;
+
+	if (ida->flags & IDA_RANDOM)
+		start = ida_rand(ida) % n;
+	else
+		start = ida->cursor;
+	if (pair) {
+		start &= ~1UL;
+		idx = ida_next_pair(ida, start);
+		if (idx >= n && start)
+			idx = ida_next_pair(ida, 0);
+	} else {
+		idx = ida_next_zero(ida, 0, start);
+		if (idx >= n && start)
+			idx = ida_next_zero(ida, 0, 0);
+	}
+	return idx;
+}
+
+static int ida_index(struct ida *ida, uint32_t id, unsigned long *idx)
+{
+	uint32_t i;
+
+	if (ida->flags & IDA_SCRAMBLE)
+		i = ida_unmix(ida, id);
+	else
+		i = id - ida->base;
+	if (i >= ida->count)
+		return -1;
+	*idx = i;
+	return 0;
+}
+
+static uint32_t ida_id(struct ida *ida, unsigned long idx)
+{
+	if (ida->flags & IDA_SCRAMBLE)
+		return ida_mix(ida, (uint32_t)idx);
+	return ida->base + (uint32_t)idx;
+}
+
+struct ida *ida_create(uint32_t base, uint32_t count, int flags)
+{
+	struct ida *ida;
+	unsigned long nbits;
+	int k;
+
+	if (count == 0 ||
+	    (!(flags & IDA_SCRAMBLE) && (uint64_t)base + count > 0x100000000ULL)) {
+		printf("%s: invalid range base=%u count=%u\n", __func__, base, count);
+		return NULL;
+	}
+	ida = calloc(1, sizeof(struct ida));
+	if (!ida) {
+		printf("malloc failed!\n");
+		return NULL;
+	}
+	ida->base = base;
+	ida->count = count;
+	ida->flags = flags;
+
+	nbits = count;
+	for (k = 0; k < IDA_MAX_LEVEL; k++) {
+		ida->nbits[k] = nbits;
+		ida->map[k] = bitmap_zalloc(nbits);
+		if (!ida->map[k]) {
+			printf("malloc failed!\n");
+			goto failed;
+		}
+		ida->nlevel = k + 1;
+		if (nbits <= IDA_TOP_BITS)
+			break;
+		nbits = BITS_TO_LONGS(nbits);
+	}
+
+	ida->seed = (uint64_t)time(NULL) ^ ((uint64_t)(uintptr_t)ida << 16) ^
+		    ((uint64_t)clock() << 40) ^ 0x9E3779B97F4A7C15ULL;
+	ida->key = (uint32_t)(ida_rand(ida) >> 32);
+	ida->cursor = ida_rand(ida) % count;
+	pthread_mutex_init(&ida->lock, NULL);
+	return ida;
+
+failed:
+	for (k = 0; k < ida->nlevel; k++)
+		bitmap_free(ida->map[k]);
+	free(ida);
+	return NULL;
+}
+
+void ida_destroy(struct ida *ida)
+{
+	int k;
+
+	if (!ida)
+		return;
+	for (k = 0; k < ida->nlevel; k++)
+		bitmap_free(ida->map[k]);
+	pthread_mutex_destroy(&ida->lock);
+	free(ida);
+}
+
+int ida_alloc(struct ida *ida, uint32_t *id)
+{
+	unsigned long idx;
+
+	if (!ida || !id) {
+		printf("invalid paraments!\n");
+		return -1;
+	}
+	pthread_mutex_lock(&ida->lock);
+	idx = ida_find(ida, 0);
+	if (idx >= ida->nbits[0]) {
+		pthread_mutex_unlock(&ida->lock);
+		return -1;
+	}
+	ida_mark(ida, idx);
+	ida->used++;
+	ida->cursor = (idx + 1 < ida->nbits[0]) ? idx + 1 : 0;
+	*id = ida_id(ida, idx);
+	pthread_mutex_unlock(&ida->lock);
+	return 0;
+}
+
+int ida_alloc_pair(struct ida *ida, uint32_t *id)
+{
+	unsigned long idx;
+
+	if (!ida || !id || (ida->flags & IDA_SCRAMBLE)) {
+		printf("invalid paraments!\n");
+		return -1;
+	}
+	pthread_mutex_lock(&ida->lock);
+	idx = ida_find(ida, 1);
+	if (idx >= ida->nbits[0]) {
+		pthread_mutex_unlock(&ida->lock);
+		return -1;
+	}
+	ida_mark(ida, idx);
+	ida_mark(ida, idx + 1);
+	ida->used += 2;
+	ida->cursor = (idx + 2 < ida->nbits[0]) ? idx + 2 : 0;
+	*id = ida_id(ida, idx);
+	pthread_mutex_unlock(&ida->lock);
+	return 0;
+}
+
+int ida_reserve(struct ida *ida, uint32_t id)
+{
+	unsigned long idx;
+	int ret = -1;
+
+	if (!ida || ida_index(ida, id, &idx) < 0)
+		return -1;
+	pthread_mutex_lock(&ida->lock);
+	if (!test_bit(idx, ida->map[0])) {
+		ida_mark(ida, idx);
+		ida->used++;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&ida->lock);
+	return ret;
+}
+
+int ida_free(struct ida *ida, uint32_t id)
+{
+	unsigned long idx;
+	int ret = -1;
+
+	if (!ida || ida_index(ida, id, &idx) < 0)
+		return -1;
+	pthread_mutex_lock(&ida->lock);
+	if (test_bit(idx, ida->map[0])) {
+		ida_unmark(ida, idx);
+		ida->used--;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&ida->lock);
+	return ret;
+}
+
+int ida_free_pair(struct ida *ida, uint32_t id)
+{
+	unsigned long idx;
+	int ret = -1;
+
+	if (!ida || (ida->flags & IDA_SCRAMBLE) ||
+	    ida_index(ida, id, &idx) < 0 || (idx & 1) ||
+	    idx + 1 >= ida->nbits[0])
+		return -1;
+	pthread_mutex_lock(&ida->lock);
+	if (test_bit(idx, ida->map[0]) && test_bit(idx + 1, ida->map[0])) {
+		ida_unmark(ida, idx);
+		ida_unmark(ida, idx + 1);
+		ida->used -= 2;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&ida->lock);
+	return ret;
+}
+
+int ida_is_used(struct ida *ida, uint32_t id)
+{
+	unsigned long idx;
+	int ret;
+
+	if (!ida || ida_index(ida, id, &idx) < 0)
+		return -1;
+	pthread_mutex_lock(&ida->lock);
+	ret = test_bit(idx, ida->map[0]) ? 1 : 0;
+	pthread_mutex_unlock(&ida->lock);
+	return ret;
+}
+
+uint32_t ida_used(struct ida *ida)
+{
+	uint32_t used;
+
+	if (!ida)
+		return 0;
+	pthread_mutex_lock(&ida->lock);
+	used = ida->used;
+	pthread_mutex_unlock(&ida->lock);
+	return used;
+}
@@ -0,0 +1,73 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef LIBBITMAP_IDA_H
+#define LIBBITMAP_IDA_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * ida: id allocator on a hierarchy of summary bitmaps
+ *
+ * level 0 has one bit per id, level k+1 has one bit per unsigned long of
+ * level k, set when that word is full. levels are added until the top one
+ * fits in a few words, so a lookup walks down at most one word per level
+ * (3 levels for 2^24 ids, 5 for 2^32) and alloc/free of a single id or an
+ * aligned pair is O(1) expected.
+ *
+ * ids are in [base, base + count), pairs are aligned on an even offset
+ * from base, so an even base gives even/odd rtp/rtcp port pairs.
+ *
+ * the start of the first search is random, then each search continues
+ * after the last allocated id (next-fit), so freed ids are not reused at
+ * once. IDA_RANDOM starts every search at a random offset instead.
+ *
+ * IDA_SCRAMBLE maps the allocated index through a keyed 32-bit bijection,
+ * the returned ids look random over the whole uint32 range but never
+ * collide, for ssrc and session ids. base is ignored then.
+ *
+ * all calls are thread safe.
+ */
+
+#define IDA_RANDOM      (1 << 0)
+#define IDA_SCRAMBLE    (1 << 1)
+
+struct ida;
+
+struct ida *ida_create(uint32_t base, uint32_t count, int flags);
+void ida_destroy(struct ida *ida);
+
+int ida_alloc(struct ida *ida, uint32_t *id);
+int ida_alloc_pair(struct ida *ida, uint32_t *id);
+int ida_reserve(struct ida *ida, uint32_t id);
+int ida_free(struct ida *ida, uint32_t id);
+int ida_free_pair(struct ida *ida, uint32_t id);
+int ida_is_used(struct ida *ida, uint32_t id);
+uint32_t ida_used(struct ida *ida);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,1369 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libbitmap.h"
+#include "libbitmap_roaring.h"
+#include <stdio.h>
+
+#define RC_ARRAY	1
+#define RC_BITSET	2
+#define RC_RUN		3
+
+#define RC_BITS		65536
+#define RC_ARRAY_MAX	4096
+#define RC_LONGS	(RC_BITS / BITS_PER_LONG)
+
+#define SERIAL_COOKIE_NO_RUN	12346
+#define SERIAL_COOKIE		12347
+#define NO_OFFSET_THRESHOLD	4
+
+/* values [start, start + len] */
+struct rc_run {
+	uint16_t start;
+	uint16_t len;
+};
+
+struct rc {
+	uint16_t key;
+	uint16_t type;
+	uint32_t card;
+	uint32_t n;	/* values of array, runs of run */
+	uint32_t cap;
+	union {
+		uint16_t *array;
+		unsigned long *bitset;
+		struct rc_run *runs;
+	} u;
+};
+
+struct roaring {
+	uint32_t size;
+	uint32_t cap;
+	struct rc *c;	/* sorted by key */
+};
+
+/******************************************************************************
+ * container
+ ******************************************************************************/
+static int rc_init(struct rc *c, uint16_t key, int type, uint32_t cap)
+{
+	c->key = key;
+	c->type = type;
+	c->card = 0;
+	c->n = 0;
+	c->cap = cap;
+	switch (type) {
+	case RC_ARRAY:
+		c->u.array = malloc(cap * sizeof(uint16_t));
+		break;
+	case RC_BITSET:
+		c->cap = RC_LONGS;
+		c->u.bitset = calloc(RC_LONGS, sizeof(unsigned long));
+		break;
+	case RC_RUN:
+		c->u.runs = malloc(cap * sizeof(struct rc_run));
+		break;
+	}
+	if (!c->u.array) {
+		printf("malloc failed!\n");
+		return -1;
+	}
+	return 0;
+}
+
+static void rc_deinit(struct rc *c)
+{
+	free(c->u.array);
+	c->u.array = NULL;
+}
+
+static int rc_reserve(struct rc *c, uint32_t need)
+{
+	size_t unit = (c->type == RC_RUN) ? sizeof(struct rc_run) : sizeof(uint16_t);
+	uint32_t cap = c->cap ? c->cap : 4;
+	void *p;
+
+	if (need <= c->cap)
+		return 0;
+	while (cap < need)
+		cap *= 2;
+	p = realloc(c->u.array, cap * unit);
+	if (!p) {
+		printf("malloc failed!\n");
+		return -1;
+	}
+	c->u.array = p;
+	c->cap = cap;
+	return 0;
+}
+
+static int rc_copy(struct rc *dst, const struct rc *src)
+{
+	size_t bytes;
+
+	*dst = *src;
+	switch (src->type) {
+	case RC_ARRAY:
+		bytes = src->card * sizeof(uint16_t);
+		dst->cap = src->card;
+		break;
+	case RC_RUN:
+		bytes = src->n * sizeof(struct rc_run);
+		dst->cap = src->n;
+		break;
+	default:
+		bytes = RC_LONGS * sizeof(unsigned long);
+		break;
+	}
+	dst->u.array = malloc(bytes ? bytes : 1);
+	if (!dst->u.array) {
+		printf("malloc failed!\n");
+		return -1;
+	}
+	memcpy(dst->u.array, src->u.array, bytes);
+	return 0;
+}
+
+/* index of val, or -(insert position + 1) */
+static int32_t array_find(const uint16_t *a, uint32_t n, uint16_t val)
+{
+	int32_t lo = 0, hi = (int32_t)n - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) >> 1;
+		if (a[mid] < val)
+			lo = mid + 1;
+		else if (a[mid] > val)
+			hi = mid - 1;
+		else
+			return mid;
+	}
+	return -(lo + 1);
+}
+
+/* index of the last run starting at or before val, or -1 */
+static int32_t run_find(const struct rc_run *r, uint32_t n, uint16_t val)
+{
+	int32_t lo = 0, hi = (int32_t)n - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) >> 1;
+		if (r[mid].start <= val)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return lo - 1;
+}
+
+static int rc_contains(const struct rc *c, uint16_t val)
+{
+	int32_t i;
+
+	switch (c->type) {
+	case RC_ARRAY:
+		return array_find(c->u.array, c->card, val) >= 0;
+	case RC_BITSET:
+		return test_bit(val, c->u.bitset);
+	case RC_RUN:
+		i = run_find(c->u.runs, c->n, val);
+		return i >= 0 && val <= c->u.runs[i].start + c->u.runs[i].len;
+	}
+	return 0;
+}
+
+static uint32_t bitset_nruns(const unsigned long *b)
+{
+	unsigned long w, prev = 0;
+	uint32_t k, n = 0;
+
+	for (k = 0; k < RC_LONGS; k++) {
+		w = b[k];
+		/* a run starts at every set bit whose lower neighbour is clear */
+		n += hweight_long(w & ~((w << 1) | prev));
+		prev = w >> (BITS_PER_LONG - 1);
+	}
+	return n;
+}
+
+static uint32_t rc_nruns(const struct rc *c)
+{
+	uint32_t i, n;
+
+	switch (c->type) {
+	case RC_ARRAY:
+		for (i = 1, n = c->card ? 1 : 0; i < c->card; i++)
+			n += (c->u.array[i] != c->u.array[i - 1] + 1);
+		return n;
+	case RC_BITSET:
+		return bitset_nruns(c->u.bitset);
+	}
+	return c->n;
+}
+
+static int rc_to_bitset(struct rc *c)
+{
+	struct rc b;
+	uint32_t i;
+
+	if (c->type == RC_BITSET)
+		return 0;
+	if (rc_init(&b, c->key, RC_BITSET, 0) < 0)
+		return -1;
+	if (c->type == RC_ARRAY) {
+		for (i = 0; i < c->card; i++)
+			__set_bit(c->u.array[i], b.u.bitset);
+	} else {
+		for (i = 0; i < c->n; i++)
+			bitmap_set(b.u.bitset, c->u.runs[i].start,
+				   c->u.runs[i].len + 1);
+	}
+	b.card = c->card;
+	rc_deinit(c);
+	*c = b;
+	return 0;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ROARING_X86
+#define rc_popcount(w)	__builtin_popcountl(w)
+#else
+#define rc_popcount(w)	hweight_long(w)
+#endif
+
+/*
+ * set bits of a bitset to uint16 values. four values are written per step
+ * whatever the popcount of the word and n only advances by the popcount,
+ * so the loop branches on words, not on bits. out needs 4 spare slots.
+ */
+static __always_inline uint32_t bitset_to_array_body(const unsigned long *b,
+						     uint16_t *out)
+{
+	const unsigned long top = 1UL << (BITS_PER_LONG - 1);
+	unsigned long w;
+	uint32_t k, n = 0, p, base;
+
+	for (k = 0; k < RC_LONGS; k++) {
+		w = b[k];
+		base = k * BITS_PER_LONG;
+		p = n;
+		n += rc_popcount(w);
+		do {
+			out[p] = (uint16_t)(base + __ffs(w | top));
+			w &= w - 1;
+			out[p + 1] = (uint16_t)(base + __ffs(w | top));
+			w &= w - 1;
+			out[p + 2] = (uint16_t)(base + __ffs(w | top));
+			w &= w - 1;
+			out[p + 3] = (uint16_t)(base + __ffs(w | top));
+			w &= w - 1;
+			p += 4;
+		} while (w);
+	}
+	return n;
+}
+
+static uint32_t bitset_to_array_generic(const unsigned long *b, uint16_t *out)
+{
+	return bitset_to_array_body(b, out);
+}
+
+#ifdef ROARING_X86
+/* same code with the popcnt instruction, picked by the simd level */
+__attribute__((target("popcnt")))
+static uint32_t bitset_to_array_popcnt(const unsigned long *b, uint16_t *out)
+{
+	return bitset_to_array_body(b, out);
+}
+#endif
+
+static uint32_t bitset_to_array(const unsigned long *b, uint16_t *out)
+{
+#ifdef ROARING_X86
+	if (bitmap_simd_get() >= BITMAP_SIMD_POPCNT)
+		return bitset_to_array_popcnt(b, out);
+#endif
+	return bitset_to_array_generic(b, out);
+}
+
+static int rc_to_array(struct rc *c)
+{
+	struct rc a;
+	uint32_t i, v, end;
+
+	if (c->type == RC_ARRAY)
+		return 0;
+	if (rc_init(&a, c->key, RC_ARRAY, c->card + 4) < 0)
+		return -1;
+	if (c->type == RC_BITSET) {
+		a.card = bitset_to_array(c->u.bitset, a.u.array);
+	} else {
+		for (i = 0; i < c->n; i++) {
+			end = c->u.runs[i].start + c->u.runs[i].len;
+			for (v = c->u.runs[i].start; v <= end; v++)
+				a.u.array[a.card++] = (uint16_t)v;
+		}
+	}
+	rc_deinit(c);
+	*c = a;
+	return 0;
+}
+
+static int rc_to_run(struct rc *c, uint32_t nruns)
+{
+	struct rc r;
+	unsigned long start, end;
+	uint32_t i;
+
+	if (c->type == RC_RUN)
+		return 0;
+	if (rc_init(&r, c->key, RC_RUN, nruns ? nruns : 1) < 0)
+		return -1;
+	if (c->type == RC_ARRAY) {
+		for (i = 0; i < c->card; i++) {
+			if (r.n && c->u.array[i] ==
+			    r.u.runs[r.n - 1].start + r.u.runs[r.n - 1].len + 1) {
+				r.u.runs[r.n - 1].len++;
+			} else {
+				r.u.runs[r.n].start = c->u.array[i];
+				r.u.runs[r.n].len = 0;
+				r.n++;
+			}
+		}
+	} else {
+		start = find_first_bit(c->u.bitset, RC_BITS);
+		while (start < RC_BITS) {
+			end = find_next_zero_bit(c->u.bitset, RC_BITS, start);
+			r.u.runs[r.n].start = (uint16_t)start;
+			r.u.runs[r.n].len = (uint16_t)(end - start - 1);
+			r.n++;
+			start = find_next_bit(c->u.bitset, RC_BITS, end);
+		}
+	}
+	r.card = c->card;
+	rc_deinit(c);
+	*c = r;
+	return 0;
+}
+
+/* run containers are only kept while they are not modified one by one */
+static int rc_unrun(struct rc *c)
+{
+	if (c->type != RC_RUN)
+		return 0;
+	return c->card > RC_ARRAY_MAX ? rc_to_bitset(c) : rc_to_array(c);
+}
+
+/* bitset with few values back to array */
+static int rc_shrink(struct rc *c)
+{
+	if (c->type == RC_BITSET && c->card <= RC_ARRAY_MAX)
+		return rc_to_array(c);
+	return 0;
+}
+
+/* 1 added, 0 already in, -1 error */
+static int rc_add(struct rc *c, uint16_t val)
+{
+	int32_t i;
+
+	if (rc_unrun(c) < 0)
+		return -1;
+	if (c->type == RC_BITSET) {
+		if (test_bit(val, c->u.bitset))
+			return 0;
+		__set_bit(val, c->u.bitset);
+		c->card++;
+		return 1;
+	}
+	i = array_find(c->u.array, c->card, val);
+	if (i >= 0)
+		return 0;
+	if (c->card == RC_ARRAY_MAX) {
+		if (rc_to_bitset(c) < 0)
+			return -1;
+		__set_bit(val, c->u.bitset);
+		c->card++;
+		return 1;
+	}
+	if (rc_reserve(c, c->card + 1) < 0)
+		return -1;
+	i = -i - 1;
+	memmove(c->u.array + i + 1, c->u.array + i,
+		(c->card - i) * sizeof(uint16_t));
+	c->u.array[i] = val;
+	c->card++;
+	return 1;
+}
+
+static int rc_remove(struct rc *c, uint16_t val)
+{
+	int32_t i;
+
+	if (!rc_contains(c, val))
+		return 0;
+	if (rc_unrun(c) < 0)
+		return -1;
+	if (c->type == RC_BITSET) {
+		__clear_bit(val, c->u.bitset);
+		c->card--;
+		return rc_shrink(c) < 0 ? -1 : 1;
+	}
+	i = array_find(c->u.array, c->card, val);
+	memmove(c->u.array + i, c->u.array + i + 1,
+		(c->card - i - 1) * sizeof(uint16_t));
+	c->card--;
+	return 1;
+}
+
+/* OR the values of c into bitset b */
+static void bitset_or_rc(unsigned long *b, const struct rc *c)
+{
+	uint32_t i;
+
+	switch (c->type) {
+	case RC_ARRAY:
+		for (i = 0; i < c->card; i++)
+			__set_bit(c->u.array[i], b);
+		break;
+	case RC_BITSET:
+		__bitmap_or(b, b, c->u.bitset, RC_BITS);
+		break;
+	case RC_RUN:
+		for (i = 0; i < c->n; i++)
+			bitmap_set(b, c->u.runs[i].start, c->u.runs[i].len + 1);
+		break;
+	}
+}
+
+static void run_append(struct rc *out, uint32_t start, uint32_t end)
+{
+	struct rc_run *last = out->n ? &out->u.runs[out->n - 1] : NULL;
+
+	if (last && start <= (uint32_t)last->start + last->len + 1) {
+		if (end > (uint32_t)last->start + last->len) {
+			out->card += end - (last->start + last->len);
+			last->len = (uint16_t)(end - last->start);
+		}
+		return;
+	}
+	out->u.runs[out->n].start = (uint16_t)start;
+	out->u.runs[out->n].len = (uint16_t)(end - start);
+	out->n++;
+	out->card += end - start + 1;
+}
+
+static int run_or(const struct rc *a, const struct rc *b, struct rc *out)
+{
+	const struct rc_run *r;
+	uint32_t i = 0, j = 0;
+
+	if (rc_init(out, a->key, RC_RUN, a->n + b->n) < 0)
+		return -1;
+	while (i < a->n || j < b->n) {
+		if (j >= b->n || (i < a->n && a->u.runs[i].start <= b->u.runs[j].start))
+			r = &a->u.runs[i++];
+		else
+			r = &b->u.runs[j++];
+		run_append(out, r->start, (uint32_t)r->start + r->len);
+	}
+	return 0;
+}
+
+static int run_and(const struct rc *a, const struct rc *b, struct rc *out)
+{
+	uint32_t i = 0, j = 0, s, e, ea, eb;
+
+	if (rc_init(out, a->key, RC_RUN, a->n + b->n) < 0)
+		return -1;
+	while (i < a->n && j < b->n) {
+		ea = (uint32_t)a->u.runs[i].start + a->u.runs[i].len;
+		eb = (uint32_t)b->u.runs[j].start + b->u.runs[j].len;
+		s = max(a->u.runs[i].start, b->u.runs[j].start);
+		e = min(ea, eb);
+		if (s <= e)
+			run_append(out, s, e);
+		if (ea < eb)
+			i++;
+		else
+			j++;
+	}
+	return 0;
+}
+
+static int array_or(const struct rc *a, const struct rc *b, struct rc *out)
+{
+	const uint16_t *x = a->u.array, *y = b->u.array;
+	uint32_t i = 0, j = 0;
+	uint16_t *o, vx, vy;
+
+	if (rc_init(out, a->key, RC_ARRAY, a->card + b->card) < 0)
+		return -1;
+	o = out->u.array;
+	/* branchless, random input mispredicts a compare per value */
+	while (i < a->card && j < b->card) {
+		vx = x[i];
+		vy = y[j];
+		o[out->card++] = vx < vy ? vx : vy;
+		i += vx <= vy;
+		j += vy <= vx;
+	}
+	while (i < a->card)
+		o[out->card++] = x[i++];
+	while (j < b->card)
+		o[out->card++] = y[j++];
+	return 0;
+}
+
+static int rc_or(const struct rc *a, const struct rc *b, struct rc *out)
+{
+	if (a->type == RC_RUN && b->type == RC_RUN)
+		return run_or(a, b, out);
+	if (a->type == RC_ARRAY && b->type == RC_ARRAY &&
+	    a->card + b->card <= RC_ARRAY_MAX)
+		return array_or(a, b, out);
+	if (b->type == RC_BITSET) {
+		const struct rc *t = a;
+		a = b;
+		b = t;
+	}
+	if (a->type == RC_BITSET) {
+		if (rc_copy(out, a) < 0)
+			return -1;
+	} else {
+		if (rc_init(out, a->key, RC_BITSET, 0) < 0)
+			return -1;
+		bitset_or_rc(out->u.bitset, a);
+	}
+	bitset_or_rc(out->u.bitset, b);
+	out->card = __bitmap_weight(out->u.bitset, RC_BITS);
+	return rc_shrink(out);
+}
+
+static int rc_and(const struct rc *a, const struct rc *b, struct rc *out)
+{
+	struct rc t;
+	uint32_t i, j;
+	uint16_t vx, vy;
+
+	if (b->type == RC_ARRAY) {
+		const struct rc *s = a;
+		a = b;
+		b = s;
+	}
+	if (a->type == RC_ARRAY) {
+		if (rc_init(out, a->key, RC_ARRAY, a->card ? a->card : 1) < 0)
+			return -1;
+		if (b->type == RC_ARRAY) {
+			for (i = 0, j = 0; i < a->card && j < b->card;) {
+				vx = a->u.array[i];
+				vy = b->u.array[j];
+				out->u.array[out->card] = vx;
+				out->card += vx == vy;
+				i += vx <= vy;
+				j += vy <= vx;
+			}
+		} else {
+			for (i = 0; i < a->card; i++)
+				if (rc_contains(b, a->u.array[i]))
+					out->u.array[out->card++] = a->u.array[i];
+		}
+		return 0;
+	}
+	if (a->type == RC_RUN && b->type == RC_RUN)
+		return run_and(a, b, out);
+	if (a->type == RC_RUN) {
+		const struct rc *s = a;
+		a = b;
+		b = s;
+	}
+	/* a is bitset, b is bitset or run */
+	if (rc_copy(out, a) < 0)
+		return -1;
+	if (b->type == RC_BITSET) {
+		out->card = __bitmap_and(out->u.bitset, a->u.bitset,
+					 b->u.bitset, RC_BITS) ?
+			    __bitmap_weight(out->u.bitset, RC_BITS) : 0;
+	} else {
+		if (rc_init(&t, a->key, RC_BITSET, 0) < 0) {
+			rc_deinit(out);
+			return -1;
+		}
+		bitset_or_rc(t.u.bitset, b);
+		__bitmap_and(out->u.bitset, a->u.bitset, t.u.bitset, RC_BITS);
+		out->card = __bitmap_weight(out->u.bitset, RC_BITS);
+		rc_deinit(&t);
+	}
+	return rc_shrink(out);
+}
+
+/* smallest of array, bitset and run, as in the serialized format */
+static int rc_optimize(struct rc *c)
+{
+	uint32_t nruns = rc_nruns(c);
+	size_t run_bytes = 2 + 4 * (size_t)nruns;
+	size_t other_bytes = c->card > RC_ARRAY_MAX ? 8192 : 2 * (size_t)c->card;
+
+	if (run_bytes < other_bytes)
+		return rc_to_run(c, nruns);
+	if (rc_unrun(c) < 0)
+		return -1;
+	return c->card > RC_ARRAY_MAX ? rc_to_bitset(c) : rc_to_array(c);
+}
+
+/******************************************************************************
+ * roaring
+ ******************************************************************************/
+static int32_t key_find(const struct roaring *r, uint16_t key)
+{
+	int32_t lo = 0, hi = (int32_t)r->size - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) >> 1;
+		if (r->c[mid].key < key)
+			lo = mid + 1;
+		else if (r->c[mid].key > key)
+			hi = mid - 1;
+		else
+			return mid;
+	}
+	return -(lo + 1);
+}
+
+static int roaring_reserve(struct roaring *r, uint32_t need)
+{
+	uint32_t cap = r->cap ? r->cap : 4;
+	void *p;
+
+	if (need <= r->cap)
+		return 0;
+	while (cap < need)
+		cap *= 2;
+	p = realloc(r->c, cap * sizeof(struct rc));
+	if (!p) {
+		printf("malloc failed!\n");
+		return -1;
+	}
+	r->c = p;
+	r->cap = cap;
+	return 0;
+}
+
+/* container of key, created as empty array if absent */
+static struct rc *roaring_get(struct roaring *r, uint16_t key)
+{
+	int32_t i = key_find(r, key);
+
+	if (i >= 0)
+		return &r->c[i];
+	if (roaring_reserve(r, r->size + 1) < 0)
+		return NULL;
+	i = -i - 1;
+	memmove(&r->c[i + 1], &r->c[i], (r->size - i) * sizeof(struct rc));
+	if (rc_init(&r->c[i], key, RC_ARRAY, 4) < 0) {
+		memmove(&r->c[i], &r->c[i + 1], (r->size - i) * sizeof(struct rc));
+		return NULL;
+	}
+	r->size++;
+	return &r->c[i];
+}
+
+static void roaring_drop(struct roaring *r, int32_t i)
+{
+	rc_deinit(&r->c[i]);
+	memmove(&r->c[i], &r->c[i + 1], (r->size - i - 1) * sizeof(struct rc));
+	r->size--;
+}
+
+/* append a container built by or/and, takes its storage */
+static int roaring_push(struct roaring *r, struct rc *c)
+{
+	if (c->card == 0) {
+		rc_deinit(c);
+		return 0;
+	}
+	if (roaring_reserve(r, r->size + 1) < 0) {
+		rc_deinit(c);
+		return -1;
+	}
+	r->c[r->size++] = *c;
+	return 0;
+}
+
+struct roaring *roaring_create(void)
+{
+	struct roaring *r = calloc(1, sizeof(struct roaring));
+	if (!r) {
+		printf("malloc failed!\n");
+		return NULL;
+	}
+	return r;
+}
+
+void roaring_destroy(struct roaring *r)
+{
+	uint32_t i;
+
+	if (!r)
+		return;
+	for (i = 0; i < r->size; i++)
+		rc_deinit(&r->c[i]);
+	free(r->c);
+	free(r);
+}
+
+struct roaring *roaring_copy(const struct roaring *r)
+{
+	struct roaring *n;
+	struct rc c;
+	uint32_t i;
+
+	if (!r)
+		return NULL;
+	n = roaring_create();
+	if (!n)
+		return NULL;
+	for (i = 0; i < r->size; i++) {
+		if (rc_copy(&c, &r->c[i]) < 0 || roaring_push(n, &c) < 0) {
+			roaring_destroy(n);
+			return NULL;
+		}
+	}
+	return n;
+}
+
+int roaring_add(struct roaring *r, uint32_t val)
+{
+	struct rc *c;
+
+	if (!r)
+		return -1;
+	c = roaring_get(r, val >> 16);
+	if (!c)
+		return -1;
+	return rc_add(c, val & 0xffff) < 0 ? -1 : 0;
+}
+
+/* add [start, end) */
+int roaring_add_range(struct roaring *r, uint64_t start, uint64_t end)
+{
+	struct rc *c, run, out;
+	uint64_t lo, hi;
+
+	if (!r || end > 0x100000000ULL || start > end)
+		return -1;
+	for (; start < end; start = hi + 1) {
+		hi = min(end - 1, start | 0xffff);
+		lo = start & 0xffff;
+		c = roaring_get(r, (uint16_t)(start >> 16));
+		if (!c)
+			return -1;
+		if (rc_init(&run, c->key, RC_RUN, 1) < 0)
+			return -1;
+		run_append(&run, (uint32_t)lo, (uint32_t)(hi & 0xffff));
+		if (c->card == 0) {
+			rc_deinit(c);
+			*c = run;
+		} else {
+			if ((c->type != RC_RUN && rc_to_run(c, rc_nruns(c)) < 0) ||
+			    run_or(c, &run, &out) < 0) {
+				rc_deinit(&run);
+				return -1;
+			}
+			rc_deinit(&run);
+			rc_deinit(c);
+			*c = out;
+		}
+		if (rc_optimize(c) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+int roaring_remove(struct roaring *r, uint32_t val)
+{
+	int32_t i;
+	int ret;
+
+	if (!r)
+		return -1;
+	i = key_find(r, val >> 16);
+	if (i < 0)
+		return 0;
+	ret = rc_remove(&r->c[i], val & 0xffff);
+	if (ret < 0)
+		return -1;
+	if (r->c[i].card == 0)
+		roaring_drop(r, i);
+	return 0;
+}
+
+int roaring_contains(const struct roaring *r, uint32_t val)
+{
+	int32_t i;
+
+	if (!r)
+		return 0;
+	i = key_find(r, val >> 16);
+	return i >= 0 && rc_contains(&r->c[i], val & 0xffff);
+}
+
+uint64_t roaring_cardinality(const struct roaring *r)
+{
+	uint64_t card = 0;
+	uint32_t i;
+
+	if (!r)
+		return 0;
+	for (i = 0; i < r->size; i++)
+		card += r->c[i].card;
+	return card;
+}
+
+int roaring_run_optimize(struct roaring *r)
+{
+	uint32_t i;
+
+	if (!r)
+		return -1;
+	for (i = 0; i < r->size; i++)
+		if (rc_optimize(&r->c[i]) < 0)
+			return -1;
+	return 0;
+}
+
+struct roaring *roaring_or(const struct roaring *a, const struct roaring *b)
+{
+	struct roaring *r;
+	struct rc c;
+	uint32_t i = 0, j = 0;
+	int ret;
+
+	if (!a || !b)
+		return NULL;
+	r = roaring_create();
+	if (!r)
+		return NULL;
+	while (i < a->size || j < b->size) {
+		if (j >= b->size || (i < a->size && a->c[i].key < b->c[j].key))
+			ret = rc_copy(&c, &a->c[i++]);
+		else if (i >= a->size || b->c[j].key < a->c[i].key)
+			ret = rc_copy(&c, &b->c[j++]);
+		else
+			ret = rc_or(&a->c[i++], &b->c[j++], &c);
+		if (ret < 0 || roaring_push(r, &c) < 0) {
+			roaring_destroy(r);
+			return NULL;
+		}
+	}
+	return r;
+}
+
+struct roaring *roaring_and(const struct roaring *a, const struct roaring *b)
+{
+	struct roaring *r;
+	struct rc c;
+	uint32_t i = 0, j = 0;
+
+	if (!a || !b)
+		return NULL;
+	r = roaring_create();
+	if (!r)
+		return NULL;
+	while (i < a->size && j < b->size) {
+		if (a->c[i].key < b->c[j].key) {
+			i++;
+		} else if (a->c[i].key > b->c[j].key) {
+			j++;
+		} else {
+			if (rc_and(&a->c[i++], &b->c[j++], &c) < 0 ||
+			    roaring_push(r, &c) < 0) {
+				roaring_destroy(r);
+				return NULL;
+			}
+		}
+	}
+	return r;
+}
+
+void roaring_iter_init(struct roaring_iter *it, const struct roaring *r)
+{
+	memset(it, 0, sizeof(*it));
+	it->r = r;
+}
+
+int roaring_iter_next(struct roaring_iter *it, uint32_t *val)
+{
+	const struct rc *c;
+	unsigned long bit, word;
+
+	while (it->r && it->ci < it->r->size) {
+		c = &it->r->c[it->ci];
+		switch (c->type) {
+		case RC_ARRAY:
+			if (it->pos < c->card) {
+				*val = ((uint32_t)c->key << 16) | c->u.array[it->pos++];
+				return 1;
+			}
+			break;
+		case RC_BITSET:
+			if (it->pos >= RC_BITS)
+				break;
+			/* rest of the current word first, scan only past it */
+			word = c->u.bitset[BIT_WORD(it->pos)] &
+			       BITMAP_FIRST_WORD_MASK(it->pos);
+			if (word)
+				bit = (it->pos & ~(BITS_PER_LONG - 1)) + __ffs(word);
+			else
+				bit = find_next_bit(c->u.bitset, RC_BITS,
+					(it->pos | (BITS_PER_LONG - 1)) + 1);
+			if (bit < RC_BITS) {
+				it->pos = bit + 1;
+				*val = ((uint32_t)c->key << 16) | bit;
+				return 1;
+			}
+			break;
+		case RC_RUN:
+			if (it->pos < c->n) {
+				*val = ((uint32_t)c->key << 16) |
+				       (c->u.runs[it->pos].start + it->off);
+				if (it->off++ == c->u.runs[it->pos].len) {
+					it->pos++;
+					it->off = 0;
+				}
+				return 1;
+			}
+			break;
+		}
+		it->ci++;
+		it->pos = 0;
+		it->off = 0;
+	}
+	return 0;
+}
+
+uint64_t roaring_to_array(const struct roaring *r, uint32_t *out)
+{
+	const struct rc *c;
+	uint64_t n = 0;
+	uint32_t i, k, v, end, hi;
+	unsigned long w;
+
+	if (!r)
+		return 0;
+	for (i = 0; i < r->size; i++) {
+		c = &r->c[i];
+		hi = (uint32_t)c->key << 16;
+		switch (c->type) {
+		case RC_ARRAY:
+			for (k = 0; k < c->card; k++)
+				out[n++] = hi | c->u.array[k];
+			break;
+		case RC_BITSET:
+			for (k = 0; k < RC_LONGS; k++) {
+				for (w = c->u.bitset[k]; w; w &= w - 1)
+					out[n++] = hi | (k * BITS_PER_LONG + __ffs(w));
+			}
+			break;
+		case RC_RUN:
+			for (k = 0; k < c->n; k++) {
+				end = c->u.runs[k].start + c->u.runs[k].len;
+				for (v = c->u.runs[k].start; v <= end; v++)
+					out[n++] = hi | v;
+			}
+			break;
+		}
+	}
+	return n;
+}
+
+/*
+ * one container per 65536 bits that has any bit set, picking array,
+ * bitset or run by size
+ */
+struct roaring *roaring_from_bitmap(const unsigned long *map, uint64_t nbits)
+{
+	struct roaring *r;
+	struct rc c;
+	uint64_t base;
+	uint32_t bits, longs;
+
+	if (!map || nbits > 0x100000000ULL)
+		return NULL;
+	r = roaring_create();
+	if (!r)
+		return NULL;
+	for (base = 0; base < nbits; base += RC_BITS) {
+		bits = (uint32_t)min(nbits - base, (uint64_t)RC_BITS);
+		longs = BITS_TO_LONGS(bits);
+		if (__bitmap_empty(map + base / BITS_PER_LONG, bits))
+			continue;
+		if (rc_init(&c, (uint16_t)(base >> 16), RC_BITSET, 0) < 0)
+			goto failed;
+		memcpy(c.u.bitset, map + base / BITS_PER_LONG,
+		       longs * sizeof(unsigned long));
+		if (bits % BITS_PER_LONG)
+			c.u.bitset[longs - 1] &= BITMAP_LAST_WORD_MASK(bits);
+		c.card = __bitmap_weight(c.u.bitset, RC_BITS);
+		if (rc_optimize(&c) < 0 || roaring_push(r, &c) < 0)
+			goto failed;
+	}
+	return r;
+
+failed:
+	roaring_destroy(r);
+	return NULL;
+}
+
+/* set_bit() takes int, values here go up to 2^32 */
+static inline void map_set(unsigned long *map, uint64_t nr)
+{
+	map[nr / BITS_PER_LONG] |= 1UL << (nr % BITS_PER_LONG);
+}
+
+/* bits >= nbits are dropped */
+int roaring_to_bitmap(const struct roaring *r, unsigned long *map, uint64_t nbits)
+{
+	const struct rc *c;
+	uint64_t base, v, end;
+	uint32_t i, k, bits;
+	unsigned long bit;
+
+	if (!r || !map)
+		return -1;
+	memset(map, 0, BITS_TO_LONGS(nbits) * sizeof(unsigned long));
+	for (i = 0; i < r->size; i++) {
+		c = &r->c[i];
+		base = (uint64_t)c->key << 16;
+		if (base >= nbits)
+			break;
+		bits = (uint32_t)min(nbits - base, (uint64_t)RC_BITS);
+		switch (c->type) {
+		case RC_ARRAY:
+			for (k = 0; k < c->card && c->u.array[k] < bits; k++)
+				map_set(map, base + c->u.array[k]);
+			break;
+		case RC_BITSET:
+			if (bits == RC_BITS) {
+				memcpy(map + base / BITS_PER_LONG, c->u.bitset,
+				       RC_LONGS * sizeof(unsigned long));
+				break;
+			}
+			for_each_set_bit(bit, c->u.bitset, bits)
+				map_set(map, base + bit);
+			break;
+		case RC_RUN:
+			for (k = 0; k < c->n && c->u.runs[k].start < bits; k++) {
+				v = c->u.runs[k].start;
+				end = min(v + c->u.runs[k].len + 1, (uint64_t)bits);
+				bitmap_set(map, base + v, end - v);
+			}
+			break;
+		}
+	}
+	return 0;
+}
+
+size_t roaring_memory_usage(const struct roaring *r)
+{
+	size_t bytes;
+	uint32_t i;
+
+	if (!r)
+		return 0;
+	bytes = sizeof(*r) + r->cap * sizeof(struct rc);
+	for (i = 0; i < r->size; i++) {
+		switch (r->c[i].type) {
+		case RC_ARRAY:
+			bytes += r->c[i].cap * sizeof(uint16_t);
+			break;
+		case RC_BITSET:
+			bytes += RC_LONGS * sizeof(unsigned long);
+			break;
+		case RC_RUN:
+			bytes += r->c[i].cap * sizeof(struct rc_run);
+			break;
+		}
+	}
+	return bytes;
+}
+
+/******************************************************************************
+ * portable serialization, RoaringFormatSpec
+ ******************************************************************************/
+static inline void put_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void put_le32(uint8_t *p, uint32_t v)
+{
+	put_le16(p, (uint16_t)v);
+	put_le16(p + 2, (uint16_t)(v >> 16));
+}
+
+static inline uint16_t get_le16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get_le32(const uint8_t *p)
+{
+	return get_le16(p) | ((uint32_t)get_le16(p + 2) << 16);
+}
+
+static int roaring_has_run(const struct roaring *r)
+{
+	uint32_t i;
+
+	for (i = 0; i < r->size; i++)
+		if (r->c[i].type == RC_RUN)
+			return 1;
+	return 0;
+}
+
+static size_t rc_serialized_size(const struct rc *c)
+{
+	switch (c->type) {
+	case RC_ARRAY:
+		return 2 * (size_t)c->card;
+	case RC_BITSET:
+		return RC_BITS / 8;
+	}
+	return 2 + 4 * (size_t)c->n;
+}
+
+static size_t roaring_header_size(const struct roaring *r)
+{
+	if (roaring_has_run(r)) {
+		return 4 + (r->size + 7) / 8 + 4 * (size_t)r->size +
+		       (r->size >= NO_OFFSET_THRESHOLD ? 4 * (size_t)r->size : 0);
+	}
+	return 8 + 8 * (size_t)r->size;
+}
+
+size_t roaring_serialized_size(const struct roaring *r)
+{
+	size_t bytes;
+	uint32_t i;
+
+	if (!r)
+		return 0;
+	bytes = roaring_header_size(r);
+	for (i = 0; i < r->size; i++)
+		bytes += rc_serialized_size(&r->c[i]);
+	return bytes;
+}
+
+static void bitset_store(uint8_t *p, const unsigned long *b)
+{
+	uint32_t k, i;
+	unsigned long w;
+
+	for (k = 0; k < RC_LONGS; k++) {
+		w = b[k];
+		for (i = 0; i < sizeof(unsigned long); i++, w >>= 8)
+			*p++ = (uint8_t)w;
+	}
+}
+
+static void bitset_load(unsigned long *b, const uint8_t *p)
+{
+	uint32_t k, i;
+	unsigned long w;
+
+	for (k = 0; k < RC_LONGS; k++) {
+		w = 0;
+		for (i = 0; i < sizeof(unsigned long); i++)
+			w |= (unsigned long)p[i] << (8 * i);
+		b[k] = w;
+		p += sizeof(unsigned long);
+	}
+}
+
+size_t roaring_serialize(const struct roaring *r, void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	const struct rc *c;
+	size_t offset;
+	uint32_t i, k;
+	int has_run;
+
+	if (!r || !buf || len < roaring_serialized_size(r))
+		return 0;
+	has_run = roaring_has_run(r);
+	if (has_run) {
+		put_le32(p, SERIAL_COOKIE | ((r->size - 1) << 16));
+		p += 4;
+		memset(p, 0, (r->size + 7) / 8);
+		for (i = 0; i < r->size; i++)
+			if (r->c[i].type == RC_RUN)
+				p[i / 8] |= 1 << (i % 8);
+		p += (r->size + 7) / 8;
+	} else {
+		put_le32(p, SERIAL_COOKIE_NO_RUN);
+		put_le32(p + 4, r->size);
+		p += 8;
+	}
+	for (i = 0; i < r->size; i++) {
+		put_le16(p, r->c[i].key);
+		put_le16(p + 2, (uint16_t)(r->c[i].card - 1));
+		p += 4;
+	}
+	offset = roaring_header_size(r);
+	if (!has_run || r->size >= NO_OFFSET_THRESHOLD) {
+		for (i = 0; i < r->size; i++) {
+			put_le32(p, (uint32_t)offset);
+			offset += rc_serialized_size(&r->c[i]);
+			p += 4;
+		}
+	}
+	for (i = 0; i < r->size; i++) {
+		c = &r->c[i];
+		switch (c->type) {
+		case RC_ARRAY:
+			for (k = 0; k < c->card; k++, p += 2)
+				put_le16(p, c->u.array[k]);
+			break;
+		case RC_BITSET:
+			bitset_store(p, c->u.bitset);
+			p += RC_BITS / 8;
+			break;
+		case RC_RUN:
+			put_le16(p, (uint16_t)c->n);
+			p += 2;
+			for (k = 0; k < c->n; k++, p += 4) {
+				put_le16(p, c->u.runs[k].start);
+				put_le16(p + 2, c->u.runs[k].len);
+			}
+			break;
+		}
+	}
+	return p - (uint8_t *)buf;
+}
+
+struct roaring *roaring_deserialize(const void *buf, size_t len)
+{
+	const uint8_t *p = buf, *end = p + len, *keys, *runflag = NULL;
+	struct roaring *r;
+	struct rc c;
+	uint32_t cookie, size, i, k, card, n, prev_end;
+	int is_run;
+
+	if (!buf || len < 4)
+		return NULL;
+	cookie = get_le32(p);
+	if ((cookie & 0xffff) == SERIAL_COOKIE) {
+		size = (cookie >> 16) + 1;
+		p += 4;
+		if (end - p < (ptrdiff_t)(size + 7) / 8) {
+			printf("%s: truncated header\n", __func__);
+			return NULL;
+		}
+		runflag = p;
+		p += (size + 7) / 8;
+	} else if (cookie == SERIAL_COOKIE_NO_RUN) {
+		if (len < 8)
+			return NULL;
+		size = get_le32(p + 4);
+		p += 8;
+	} else {
+		printf("%s: bad cookie %08x\n", __func__, cookie);
+		return NULL;
+	}
+	if (size > 65536 || end - p < 4 * (ptrdiff_t)size) {
+		printf("%s: truncated header\n", __func__);
+		return NULL;
+	}
+	keys = p;
+	p += 4 * size;
+	if (!runflag || size >= NO_OFFSET_THRESHOLD) {
+		if (end - p < 4 * (ptrdiff_t)size)
+			return NULL;
+		p += 4 * size;
+	}
+	r = roaring_create();
+	if (!r)
+		return NULL;
+	for (i = 0; i < size; i++) {
+		card = get_le16(keys + 4 * i + 2) + 1;
+		is_run = runflag && (runflag[i / 8] & (1 << (i % 8)));
+		if (i && get_le16(keys + 4 * i) <= r->c[r->size - 1].key)
+			goto bad;
+		if (is_run) {
+			if (end - p < 2)
+				goto bad;
+			n = get_le16(p);
+			p += 2;
+			if ((size_t)(end - p) < 4 * (size_t)n)
+				goto bad;
+			if (rc_init(&c, get_le16(keys + 4 * i), RC_RUN, n ? n : 1) < 0)
+				goto failed;
+			for (k = 0, prev_end = 0; k < n; k++, p += 4) {
+				c.u.runs[k].start = get_le16(p);
+				c.u.runs[k].len = get_le16(p + 2);
+				if ((k && c.u.runs[k].start <= prev_end) ||
+				    (uint32_t)c.u.runs[k].start + c.u.runs[k].len >= RC_BITS) {
+					rc_deinit(&c);
+					goto bad;
+				}
+				prev_end = (uint32_t)c.u.runs[k].start + c.u.runs[k].len;
+				c.card += c.u.runs[k].len + 1;
+			}
+			c.n = n;
+		} else if (card > RC_ARRAY_MAX) {
+			if (end - p < RC_BITS / 8)
+				goto bad;
+			if (rc_init(&c, get_le16(keys + 4 * i), RC_BITSET, 0) < 0)
+				goto failed;
+			bitset_load(c.u.bitset, p);
+			p += RC_BITS / 8;
+			c.card = __bitmap_weight(c.u.bitset, RC_BITS);
+		} else {
+			if ((size_t)(end - p) < 2 * (size_t)card)
+				goto bad;
+			if (rc_init(&c, get_le16(keys + 4 * i), RC_ARRAY, card) < 0)
+				goto failed;
+			for (k = 0; k < card; k++, p += 2) {
+				c.u.array[k] = get_le16(p);
+				if (k && c.u.array[k] <= c.u.array[k - 1]) {
+					rc_deinit(&c);
+					goto bad;
+				}
+			}
+			c.card = card;
+		}
+		if (c.card != card) {
+			rc_deinit(&c);
+			goto bad;
+		}
+		if (roaring_push(r, &c) < 0)
+			goto failed;
+	}
+	return r;
+
+bad:
+	printf("%s: corrupted data\n", __func__);
+failed:
+	roaring_destroy(r);
+	return NULL;
+}
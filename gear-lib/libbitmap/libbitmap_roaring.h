@@ -0,0 +1,89 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef LIBBITMAP_ROARING_H
+#define LIBBITMAP_ROARING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * roaring: compressed bitmap of uint32 values
+ *
+ * values are split by their high 16 bits into containers, each container
+ * holds the low 16 bits as one of:
+ *   array   sorted uint16 values, up to 4096 of them
+ *   bitset  65536 bits, when more than 4096 values
+ *   run     sorted (start, length - 1) pairs, made by roaring_run_optimize,
+ *           roaring_add_range and roaring_from_bitmap when smaller
+ *
+ * bitset containers are plain unsigned long bitmaps, so union, intersection
+ * and cardinality of them run on the simd kernels of libbitmap.
+ *
+ * roaring_serialize writes the portable format of RoaringFormatSpec
+ * (little endian, cookie 12346/12347), readable by the other roaring
+ * implementations.
+ */
+
+struct roaring;
+
+struct roaring_iter {
+    const struct roaring *r;
+    uint32_t ci;
+    uint32_t pos;
+    uint32_t off;
+};
+
+struct roaring *roaring_create(void);
+void roaring_destroy(struct roaring *r);
+struct roaring *roaring_copy(const struct roaring *r);
+
+int roaring_add(struct roaring *r, uint32_t val);
+int roaring_add_range(struct roaring *r, uint64_t start, uint64_t end);
+int roaring_remove(struct roaring *r, uint32_t val);
+int roaring_contains(const struct roaring *r, uint32_t val);
+uint64_t roaring_cardinality(const struct roaring *r);
+int roaring_run_optimize(struct roaring *r);
+
+struct roaring *roaring_or(const struct roaring *a, const struct roaring *b);
+struct roaring *roaring_and(const struct roaring *a, const struct roaring *b);
+
+void roaring_iter_init(struct roaring_iter *it, const struct roaring *r);
+int roaring_iter_next(struct roaring_iter *it, uint32_t *val);
+uint64_t roaring_to_array(const struct roaring *r, uint32_t *out);
+
+struct roaring *roaring_from_bitmap(const unsigned long *map, uint64_t nbits);
+int roaring_to_bitmap(const struct roaring *r, unsigned long *map, uint64_t nbits);
+
+size_t roaring_serialized_size(const struct roaring *r);
+size_t roaring_serialize(const struct roaring *r, void *buf, size_t len);
+struct roaring *roaring_deserialize(const void *buf, size_t len);
+
+size_t roaring_memory_usage(const struct roaring *r);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -20,10 +20,652 @@
  * SOFTWARE.
  ******************************************************************************/
 #include "libbitmap.h"
+#include "libbitmap_ida.h"
+#include "libbitmap_roaring.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static double epoch_double(void)
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + (t.tv_usec * 1.0) / 1000000.0;
+}
+
+static void random_fill(unsigned long *map, unsigned int nbits, int density)
+{
+    unsigned int i;
+    bitmap_zero(map, nbits);
+    for (i = 0; i < nbits; i++) {
+        if (rand() % 100 < density) {
+            __set_bit(i, map);
+        }
+    }
+}
+
+static unsigned long ref_find_next(const unsigned long *map, unsigned long nbits,
+                                   unsigned long start, int val)
+{
+    for (; start < nbits; start++) {
+        if (!!test_bit(start, map) == val) {
+            break;
+        }
+    }
+    return start < nbits ? start : nbits;
+}
+
+/* every level must give the same result as generic */
+static int test_simd(void)
+{
+    static const unsigned int sizes[] = {1, 63, 64, 65, 200, 511, 512, 1000, 4096, 10007};
+    unsigned long *a, *b, *d0, *d1;
+    unsigned int i, j, nbits, start;
+    int best = bitmap_simd_get();
+    int level, err = 0, r0, r1;
+
+    for (level = BITMAP_SIMD_GENERIC; level <= BITMAP_SIMD_AVX512; level++) {
+        if (!bitmap_simd_supported(level)) {
+            printf("%15s: not supported\n", bitmap_simd_name(level));
+            continue;
+        }
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            nbits = sizes[i];
+            a = bitmap_zalloc(nbits);
+            b = bitmap_zalloc(nbits);
+            d0 = bitmap_zalloc(nbits);
+            d1 = bitmap_zalloc(nbits);
+            for (j = 0; j <= 20; j++) {
+                random_fill(a, nbits, j * 5);
+                random_fill(b, nbits, 100 - j * 5);
+
+                bitmap_simd_set(BITMAP_SIMD_GENERIC);
+                r0 = __bitmap_and(d0, a, b, nbits);
+                bitmap_simd_set(level);
+                r1 = __bitmap_and(d1, a, b, nbits);
+                err += (r0 != r1) || !bitmap_equal(d0, d1, nbits);
+
+                bitmap_simd_set(BITMAP_SIMD_GENERIC);
+                r0 = __bitmap_andnot(d0, a, b, nbits);
+                bitmap_simd_set(level);
+                r1 = __bitmap_andnot(d1, a, b, nbits);
+                err += (r0 != r1) || !bitmap_equal(d0, d1, nbits);
+
+                bitmap_simd_set(BITMAP_SIMD_GENERIC);
+                __bitmap_or(d0, a, b, nbits);
+                bitmap_simd_set(level);
+                __bitmap_or(d1, a, b, nbits);
+                err += !bitmap_equal(d0, d1, nbits);
+
+                bitmap_simd_set(BITMAP_SIMD_GENERIC);
+                __bitmap_xor(d0, a, b, nbits);
+                r0 = __bitmap_weight(a, nbits);
+                bitmap_simd_set(level);
+                __bitmap_xor(d1, a, b, nbits);
+                r1 = __bitmap_weight(a, nbits);
+                err += (r0 != r1) || !bitmap_equal(d0, d1, nbits);
+
+                bitmap_simd_set(level);
+                for (start = 0; start < nbits; start += 1 + rand() % 97) {
+                    err += find_next_bit(a, nbits, start) != ref_find_next(a, nbits, start, 1);
+                    err += find_next_zero_bit(a, nbits, start) != ref_find_next(a, nbits, start, 0);
+                }
+            }
+            bitmap_free(a);
+            bitmap_free(b);
+            bitmap_free(d0);
+            bitmap_free(d1);
+        }
+        printf("%15s: %s\n", bitmap_simd_name(level), err ? "failed" : "ok");
+    }
+    bitmap_simd_set(best);
+    return err;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int test_ida(void)
+{
+    struct ida *ida;
+    unsigned long *ref;
+    uint32_t *ids, id, count, i, n;
+    int flags, err = 0;
+
+    /* random alloc/free against a plain bitmap, both search modes */
+    count = 100003;
+    ref = bitmap_zalloc(count);
+    for (flags = 0; flags <= IDA_RANDOM; flags += IDA_RANDOM) {
+        ida = ida_create(1000, count, flags);
+        bitmap_zero(ref, count);
+        for (i = 0; i < 4 * count; i++) {
+            if (rand() % 3) {
+                if (ida_alloc(ida, &id) < 0) {
+                    if (!bitmap_full(ref, count)) {
+                        err++;
+                    }
+                    continue;
+                }
+                id -= 1000;
+                if (id >= count || test_bit(id, ref)) {
+                    err++;
+                }
+                __set_bit(id, ref);
+            } else {
+                id = rand() % count;
+                if ((ida_free(ida, id + 1000) == 0) != !!test_bit(id, ref)) {
+                    err++;
+                }
+                __clear_bit(id, ref);
+            }
+        }
+        if (ida_used(ida) != (uint32_t)bitmap_weight(ref, count)) {
+            err++;
+        }
+        ida_destroy(ida);
+    }
+    bitmap_free(ref);
+
+    /* rtp port pairs, even/odd, until the range is exhausted */
+    ida = ida_create(20000, 30000, 0);
+    for (n = 0; ida_alloc_pair(ida, &id) == 0; n++) {
+        if ((id & 1) || id < 20000 || id + 1 >= 50000 ||
+            ida_is_used(ida, id) != 1 || ida_is_used(ida, id + 1) != 1) {
+            err++;
+        }
+    }
+    if (n != 15000 || ida_used(ida) != 30000) {
+        err++;
+    }
+    if (ida_free_pair(ida, 20001) == 0 || ida_free_pair(ida, 30000) < 0 ||
+        ida_free(ida, 30003) < 0 || ida_alloc_pair(ida, &id) < 0 ||
+        id != 30000 || ida_alloc_pair(ida, &id) == 0 ||
+        ida_reserve(ida, 30003) < 0 || ida_reserve(ida, 30003) == 0) {
+        err++;
+    }
+    ida_destroy(ida);
+
+    /* scrambled ids never collide and free back to their index */
+    count = 1 << 16;
+    ids = calloc(count, sizeof(uint32_t));
+    ida = ida_create(0, count, IDA_SCRAMBLE | IDA_RANDOM);
+    for (i = 0; i < count; i++) {
+        if (ida_alloc(ida, &ids[i]) < 0) {
+            err++;
+        }
+    }
+    if (ida_alloc(ida, &id) == 0) {
+        err++;
+    }
+    qsort(ids, count, sizeof(uint32_t), cmp_u32);
+    for (i = 1; i < count; i++) {
+        if (ids[i] == ids[i - 1]) {
+            err++;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        if (ida_free(ida, ids[i]) < 0) {
+            err++;
+        }
+    }
+    if (ida_used(ida) != 0) {
+        err++;
+    }
+    ida_destroy(ida);
+    free(ids);
+
+    printf("%15s: %s\n", "ida", err ? "failed" : "ok");
+    return err;
+}
+
+#define ROARING_TEST_BITS   (1UL << 20)
+
+/* r holds exactly the bits of ref, checked through every accessor */
+static int roaring_check(const struct roaring *r, const unsigned long *ref)
+{
+    unsigned long *tmp = bitmap_zalloc(ROARING_TEST_BITS);
+    struct roaring_iter it;
+    unsigned long bit;
+    uint32_t val;
+    int err = 0;
+
+    roaring_to_bitmap(r, tmp, ROARING_TEST_BITS);
+    if (!bitmap_equal(tmp, ref, ROARING_TEST_BITS) ||
+        roaring_cardinality(r) != (uint64_t)bitmap_weight(ref, ROARING_TEST_BITS)) {
+        err++;
+    }
+    roaring_iter_init(&it, r);
+    for_each_set_bit(bit, ref, ROARING_TEST_BITS) {
+        if (!roaring_iter_next(&it, &val) || val != bit ||
+            !roaring_contains(r, bit)) {
+            err++;
+            break;
+        }
+    }
+    if (roaring_iter_next(&it, &val)) {
+        err++;
+    }
+    bitmap_free(tmp);
+    return err;
+}
+
+static void roaring_random(struct roaring *r, unsigned long *ref)
+{
+    unsigned long i, start, len;
+    int chunk;
+
+    for (chunk = 0; chunk < 16; chunk++) {
+        switch (rand() % 4) {
+        case 0: /* sparse, array */
+            for (i = 0; i < 1000; i++) {
+                start = (chunk << 16) | (rand() & 0xffff);
+                roaring_add(r, start);
+                __set_bit(start, ref);
+            }
+            break;
+        case 1: /* dense, bitset */
+            for (i = 0; i < 30000; i++) {
+                start = (chunk << 16) | (rand() & 0xffff);
+                roaring_add(r, start);
+                __set_bit(start, ref);
+            }
+            break;
+        case 2: /* ranges, run */
+            for (i = 0; i < 20; i++) {
+                start = (chunk << 16) | (rand() & 0xffff);
+                len = rand() % 5000;
+                len = min(len, ROARING_TEST_BITS - start);
+                roaring_add_range(r, start, start + len);
+                bitmap_set(ref, start, len);
+            }
+            break;
+        default:
+            break;
+        }
+        for (i = 0; i < 100; i++) {
+            start = (chunk << 16) | (rand() & 0xffff);
+            roaring_remove(r, start);
+            __clear_bit(start, ref);
+        }
+    }
+}
+
+static int test_roaring(void)
+{
+    /* RoaringFormatSpec: {1,2,3} and [0, 100000) after run_optimize */
+    static const uint8_t spec_array[] = {
+        0x3a, 0x30, 0, 0, 1, 0, 0, 0, 0, 0, 2, 0, 16, 0, 0, 0,
+        1, 0, 2, 0, 3, 0,
+    };
+    static const uint8_t spec_run[] = {
+        0x3b, 0x30, 1, 0, 3, 0, 0, 0xff, 0xff, 1, 0, 0x9f, 0x86,
+        1, 0, 0, 0, 0xff, 0xff, 1, 0, 0, 0, 0x9f, 0x86,
+    };
+    struct roaring *a, *b, *r;
+    unsigned long *ra, *rb, *rr;
+    uint8_t *buf;
+    size_t len;
+    int round, err = 0;
+
+    ra = bitmap_zalloc(ROARING_TEST_BITS);
+    rb = bitmap_zalloc(ROARING_TEST_BITS);
+    rr = bitmap_zalloc(ROARING_TEST_BITS);
+    for (round = 0; round < 8; round++) {
+        a = roaring_create();
+        b = roaring_create();
+        bitmap_zero(ra, ROARING_TEST_BITS);
+        bitmap_zero(rb, ROARING_TEST_BITS);
+        roaring_random(a, ra);
+        roaring_random(b, rb);
+        if (round & 1) {
+            roaring_run_optimize(a);
+        }
+        if (round & 2) {
+            roaring_run_optimize(b);
+        }
+        err += roaring_check(a, ra);
+        err += roaring_check(b, rb);
+
+        r = roaring_or(a, b);
+        bitmap_or(rr, ra, rb, ROARING_TEST_BITS);
+        err += roaring_check(r, rr);
+        roaring_destroy(r);
+
+        r = roaring_and(a, b);
+        bitmap_and(rr, ra, rb, ROARING_TEST_BITS);
+        err += roaring_check(r, rr);
+        roaring_destroy(r);
+
+        r = roaring_from_bitmap(ra, ROARING_TEST_BITS - round);
+        bitmap_copy(rr, ra, ROARING_TEST_BITS);
+        bitmap_clear(rr, ROARING_TEST_BITS - round, round);
+        err += roaring_check(r, rr);
+
+        len = roaring_serialized_size(r);
+        buf = malloc(len);
+        if (roaring_serialize(r, buf, len) != len) {
+            err++;
+        }
+        roaring_destroy(r);
+        r = roaring_deserialize(buf, len);
+        err += roaring_check(r, rr);
+        if (roaring_deserialize(buf, len - 1)) {
+            err++;
+        }
+        roaring_destroy(r);
+        free(buf);
+        roaring_destroy(a);
+        roaring_destroy(b);
+    }
+    bitmap_free(ra);
+    bitmap_free(rb);
+    bitmap_free(rr);
+
+    a = roaring_create();
+    roaring_add(a, 1);
+    roaring_add(a, 2);
+    roaring_add(a, 3);
+    buf = malloc(64);
+    len = roaring_serialize(a, buf, 64);
+    if (len != sizeof(spec_array) || memcmp(buf, spec_array, len)) {
+        err++;
+    }
+    roaring_destroy(a);
+    a = roaring_create();
+    roaring_add_range(a, 0, 100000);
+    roaring_run_optimize(a);
+    len = roaring_serialize(a, buf, 64);
+    if (len != sizeof(spec_run) || memcmp(buf, spec_run, len)) {
+        err++;
+    }
+    roaring_destroy(a);
+
+    /* truncated headers: run cookie with 65536 containers, no-run cookie */
+    memcpy(buf, "\x3b\x30\xff\xff", 4);
+    if (roaring_deserialize(buf, 4)) {
+        err++;
+    }
+    memcpy(buf, "\x3a\x30\x00\x00\x02\x00\x00\x00", 8);
+    if (roaring_deserialize(buf, 8) || roaring_deserialize(buf, 12)) {
+        err++;
+    }
+    free(buf);
+
+    /* top of the uint32 range */
+    a = roaring_create();
+    roaring_add_range(a, 0xfffffff0UL, 0x100000000ULL);
+    roaring_add(a, 0xffffffffUL);
+    if (!roaring_contains(a, 0xffffffffUL) || roaring_contains(a, 0xffffffefUL) ||
+        roaring_cardinality(a) != 16) {
+        err++;
+    }
+    roaring_destroy(a);
+
+    printf("%15s: %s\n", "roaring", err ? "failed" : "ok");
+    return err;
+}
+
+static int test_print(void)
+{
+    DECLARE_BITMAP(map, 100);
+    char *buf = (char *)calloc(1, PAGE_SIZE);
+    int err = 0;
+
+    bitmap_zero(map, 100);
+    bitmap_set(map, 0, 3);
+    bitmap_set(map, 64, 1);
+    bitmap_set(map, 96, 4);
+    bitmap_print_to_pagebuf(true, buf, map, 100);
+    err += strcmp(buf, "0-2,64,96-99\n") != 0;
+    printf("%15s: %s", "list", buf);
+    bitmap_print_to_pagebuf(false, buf, map, 100);
+    err += strcmp(buf, "f,00000001,00000000,00000007\n") != 0;
+    printf("%15s: %s", "mask", buf);
+    free(buf);
+    return err;
+}
+
+#define BENCH_BITS  (1UL << 30)
+
+/* Gbit/s of each op on each level, every cell processes BENCH_BITS */
+static void bench(int max_exp)
+{
+    unsigned long *a, *b, *d;
+    unsigned long nbits, loops, n, bit, sum = 0;
+    int exp, level;
+    double t1, t2;
+
+    a = bitmap_alloc(1UL << max_exp);
+    b = bitmap_alloc(1UL << max_exp);
+    d = bitmap_alloc(1UL << max_exp);
+    memset(a, 0x5a, BITS_TO_LONGS(1UL << max_exp) * sizeof(long));
+    memset(b, 0xa5, BITS_TO_LONGS(1UL << max_exp) * sizeof(long));
+    memset(d, 0, BITS_TO_LONGS(1UL << max_exp) * sizeof(long));
+
+    printf("\n%10s %15s %10s %10s %10s %10s %10s\n", "bits", "level",
+           "and", "xor", "weight", "next_bit", "zero_area");
+    for (exp = 6; exp <= max_exp; exp += 3) {
+        nbits = 1UL << exp;
+        loops = BENCH_BITS / nbits;
+        for (level = BITMAP_SIMD_GENERIC; level <= BITMAP_SIMD_AVX512; level++) {
+            if (bitmap_simd_set(level) < 0) {
+                continue;
+            }
+            printf("%10lu %15s", nbits, bitmap_simd_name(level));
+
+            t1 = epoch_double();
+            for (n = 0; n < loops; n++) {
+                sum += __bitmap_and(d, a, b, nbits);
+            }
+            t2 = epoch_double();
+            printf(" %10.2f", BENCH_BITS / (t2 - t1) / 1e9);
+
+            t1 = epoch_double();
+            for (n = 0; n < loops; n++) {
+                __bitmap_xor(d, a, b, nbits);
+            }
+            t2 = epoch_double();
+            printf(" %10.2f", BENCH_BITS / (t2 - t1) / 1e9);
+
+            t1 = epoch_double();
+            for (n = 0; n < loops; n++) {
+                sum += __bitmap_weight(a, nbits);
+            }
+            t2 = epoch_double();
+            printf(" %10.2f", BENCH_BITS / (t2 - t1) / 1e9);
+
+            /* sparse, one bit in the middle and one at the end */
+            bitmap_zero(d, nbits);
+            __set_bit(nbits / 2, d);
+            __set_bit(nbits - 1, d);
+            t1 = epoch_double();
+            for (n = 0; n < loops; n++) {
+                for_each_set_bit(bit, d, nbits) {
+                    sum += bit;
+                }
+            }
+            t2 = epoch_double();
+            printf(" %10.2f", BENCH_BITS / (t2 - t1) / 1e9);
+
+            /* almost full, the only free area is at the end */
+            bitmap_fill(d, nbits);
+            bitmap_clear(d, nbits - 8, 8);
+            t1 = epoch_double();
+            for (n = 0; n < loops; n++) {
+                sum += bitmap_find_next_zero_area(d, nbits, 0, 8, 0);
+            }
+            t2 = epoch_double();
+            printf(" %10.2f\n", BENCH_BITS / (t2 - t1) / 1e9);
+        }
+    }
+    printf("(Gbit/s, checksum %lu)\n", sum);
+    bitmap_free(a);
+    bitmap_free(b);
+    bitmap_free(d);
+}
+
+/*
+ * free a random used id then alloc one, with ida or with a linear
+ * find_next_zero_bit from a random start, ns per free+alloc
+ */
+static double bench_ida_run(uint32_t count, uint32_t used, int linear)
+{
+    struct ida *ida = ida_create(0, count, 0);
+    unsigned long *map = bitmap_zalloc(count);
+    uint32_t *ids = calloc(used, sizeof(uint32_t));
+    uint32_t i, n, loops = 1000000;
+    unsigned long bit;
+    double t1, t2;
+
+    for (n = 0; n < used; n++) {
+        ida_alloc(ida, &ids[n]);
+        __set_bit(ids[n], map);
+    }
+    t1 = epoch_double();
+    for (i = 0; i < loops; i++) {
+        n = rand() % used;
+        if (linear) {
+            __clear_bit(ids[n], map);
+            bit = find_next_zero_bit(map, count, rand() % count);
+            if (bit >= count) {
+                bit = find_first_zero_bit(map, count);
+            }
+            __set_bit(bit, map);
+            ids[n] = bit;
+        } else {
+            ida_free(ida, ids[n]);
+            ida_alloc(ida, &ids[n]);
+        }
+    }
+    t2 = epoch_double();
+    ida_destroy(ida);
+    bitmap_free(map);
+    free(ids);
+    return (t2 - t1) * 1e9 / loops;
+}
+
+static void bench_ida(void)
+{
+    uint32_t count;
+    int exp;
+
+    printf("\n%10s %12s %12s %12s %12s (ns)\n", "ids", "ida 90%",
+           "linear 90%", "ida full", "linear full");
+    for (exp = 12; exp <= 24; exp += 4) {
+        count = 1U << exp;
+        printf("%10u %12.2f %12.2f %12.2f %12.2f\n", count,
+               bench_ida_run(count, count / 10 * 9, 0),
+               bench_ida_run(count, count / 10 * 9, 1),
+               bench_ida_run(count, count, 0),
+               bench_ida_run(count, count, 1));
+    }
+}
+
+/*
+ * two random sets of 2^24 bits at several densities, dense bitmap against
+ * roaring: memory, or, and, iteration (us per op)
+ */
+static void bench_roaring(void)
+{
+    static const int density[] = {1, 10, 100, 1000};  /* per mille */
+    unsigned long nbits = 1UL << 24;
+    unsigned long *a, *b, *d, bit, i, sum = 0;
+    struct roaring *ra, *rb, *r;
+    struct roaring_iter it;
+    uint32_t val;
+    double t1, t2, t3;
+    int k, loops = 20;
+
+    a = bitmap_zalloc(nbits);
+    b = bitmap_zalloc(nbits);
+    d = bitmap_alloc(nbits);
+    printf("\n%8s %12s %12s %10s %10s %10s %10s %10s %10s\n", "density",
+           "dense KB", "roaring KB", "or", "roaring", "and", "roaring",
+           "iter", "roaring");
+    for (k = 0; k < (int)ARRAY_SIZE(density) + 1; k++) {
+        bitmap_zero(a, nbits);
+        bitmap_zero(b, nbits);
+        if (k < (int)ARRAY_SIZE(density)) {
+            for (i = 0; i < nbits / 1000 * density[k]; i++) {
+                __set_bit(rand() % nbits, a);
+                __set_bit(rand() % nbits, b);
+            }
+            printf("%7.1f%%", 100.0 * bitmap_weight(a, nbits) / nbits);
+        } else {
+            /* 1000 ranges of up to 4096 bits */
+            for (i = 0; i < 1000; i++) {
+                bit = rand() % (nbits - 4096);
+                bitmap_set(a, bit, rand() % 4096);
+                bit = rand() % (nbits - 4096);
+                bitmap_set(b, bit, rand() % 4096);
+            }
+            printf("%8s", "ranges");
+        }
+        ra = roaring_from_bitmap(a, nbits);
+        rb = roaring_from_bitmap(b, nbits);
+        printf(" %12lu %12lu", nbits / 8 / 1024,
+               (unsigned long)roaring_memory_usage(ra) / 1024);
+
+        t1 = epoch_double();
+        for (i = 0; i < loops; i++) {
+            bitmap_or(d, a, b, nbits);
+        }
+        t2 = epoch_double();
+        for (i = 0; i < loops; i++) {
+            r = roaring_or(ra, rb);
+            roaring_destroy(r);
+        }
+        t3 = epoch_double();
+        printf(" %10.1f %10.1f", (t2 - t1) * 1e6 / loops, (t3 - t2) * 1e6 / loops);
+
+        t1 = epoch_double();
+        for (i = 0; i < loops; i++) {
+            sum += bitmap_and(d, a, b, nbits);
+        }
+        t2 = epoch_double();
+        for (i = 0; i < loops; i++) {
+            r = roaring_and(ra, rb);
+            roaring_destroy(r);
+        }
+        t3 = epoch_double();
+        printf(" %10.1f %10.1f", (t2 - t1) * 1e6 / loops, (t3 - t2) * 1e6 / loops);
+
+        t1 = epoch_double();
+        for_each_set_bit(bit, a, nbits) {
+            sum += bit;
+        }
+        t2 = epoch_double();
+        roaring_iter_init(&it, ra);
+        while (roaring_iter_next(&it, &val)) {
+            sum += val;
+        }
+        t3 = epoch_double();
+        printf(" %10.1f %10.1f\n", (t2 - t1) * 1e6, (t3 - t2) * 1e6);
+        roaring_destroy(ra);
+        roaring_destroy(rb);
+    }
+    printf("(us, checksum %lu)\n", sum);
+    bitmap_free(a);
+    bitmap_free(b);
+    bitmap_free(d);
+}
 
 int main(int argc, char **argv)
 {
-    return 0;
+    int err = 0;
+    printf("%15s: %s\n", "simd level", bitmap_simd_name(bitmap_simd_get()));
+    err += test_simd();
+    err += test_print();
+    err += test_ida();
+    err += test_roaring();
+    if (argc > 1) {
+        bench(atoi(argv[1]));
+        bench_ida();
+        bench_roaring();
+    }
+    return err;
 }
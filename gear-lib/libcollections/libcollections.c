@@ -12,6 +12,9 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
 //////////
 // lifo //
 //////////
@@ -250,6 +253,8 @@ void list_pop_front(list_t *ptr, void *data)
 
     if (tmp->next_ptr) {
         tmp->next_ptr->prev_ptr = NULL;
+    } else {
+        ptr->tail_ptr = NULL;
     }
     ptr->head_ptr = tmp->next_ptr;
     ptr->size -= 1;
@@ -264,7 +269,11 @@ void list_pop_back(list_t *ptr, void *data)
         memcpy(data, tmp->data, ptr->data_len);
     }
 
-    tmp->prev_ptr->next_ptr = NULL;
+    if (tmp->prev_ptr) {
+        tmp->prev_ptr->next_ptr = NULL;
+    } else {
+        ptr->head_ptr = NULL;
+    }
     ptr->tail_ptr = tmp->prev_ptr;
     ptr->size -= 1;
     free(tmp);
@@ -477,3 +486,486 @@ void iterator_set(list_t *ptr, list_lnk_t *lnk, void *data)
 {
     memcpy(lnk->data, data, ptr->data_len);
 }
+
+///////////
+// ulist //
+///////////
+
+#define ULIST_ELEM(p, n, i) ((n)->data + ((n)->off + (i)) * (p)->data_len)
+
+static void *ulist_node_malloc(size_t size)
+{
+#if defined(_WIN32)
+    return _aligned_malloc(size, ULIST_CACHE_LINE);
+#else
+    void *p = NULL;
+    if (posix_memalign(&p, ULIST_CACHE_LINE, size)) {
+        return NULL;
+    }
+    return p;
+#endif
+}
+
+static void ulist_node_mfree(void *p)
+{
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+static ulist_node_t *ulist_node_alloc(ulist_t *ptr)
+{
+    ulist_node_t *n = ptr->pool_ptr;
+
+    if (n) {
+        ptr->pool_ptr = n->next_ptr;
+        ptr->pool_len -= 1;
+    } else {
+        n = (ulist_node_t *) ulist_node_malloc(ptr->node_size);
+        assert(NULL != n);
+    }
+
+    n->next_ptr = NULL;
+    n->prev_ptr = NULL;
+    n->off = 0;
+    n->len = 0;
+    return n;
+}
+
+static void ulist_node_release(ulist_t *ptr, ulist_node_t *n)
+{
+    if (ptr->pool_len < ULIST_POOL_MAX) {
+        n->next_ptr = ptr->pool_ptr;
+        ptr->pool_ptr = n;
+        ptr->pool_len += 1;
+    } else {
+        ulist_node_mfree(n);
+    }
+}
+
+// link n after pos, or at the head when pos is NULL
+static void ulist_link_after(ulist_t *ptr, ulist_node_t *pos, ulist_node_t *n)
+{
+    n->prev_ptr = pos;
+    n->next_ptr = pos ? pos->next_ptr : ptr->head_ptr;
+
+    if (n->next_ptr) {
+        n->next_ptr->prev_ptr = n;
+    } else {
+        ptr->tail_ptr = n;
+    }
+
+    if (pos) {
+        pos->next_ptr = n;
+    } else {
+        ptr->head_ptr = n;
+    }
+}
+
+static void ulist_unlink(ulist_t *ptr, ulist_node_t *n)
+{
+    if (n->prev_ptr) {
+        n->prev_ptr->next_ptr = n->next_ptr;
+    } else {
+        ptr->head_ptr = n->next_ptr;
+    }
+
+    if (n->next_ptr) {
+        n->next_ptr->prev_ptr = n->prev_ptr;
+    } else {
+        ptr->tail_ptr = n->prev_ptr;
+    }
+
+    ulist_node_release(ptr, n);
+}
+
+// index must be < size, returns the node and the index inside it
+static ulist_node_t *ulist_locate(ulist_t *ptr, size_t *index)
+{
+    ulist_node_t *n;
+    size_t i = *index;
+
+    if (i < (ptr->size >> 1)) {
+        for (n = ptr->head_ptr; i >= n->len; n = n->next_ptr) {
+            i -= n->len;
+        }
+    } else {
+        i = ptr->size - i;
+        for (n = ptr->tail_ptr; i > n->len; n = n->prev_ptr) {
+            i -= n->len;
+        }
+        i = n->len - i;
+    }
+
+    *index = i;
+    return n;
+}
+
+// insert before a valid cursor, a full node is split in half first
+static void ulist_insert_at(ulist_t *ptr, ulist_cursor_t *cur, void *data)
+{
+    ulist_node_t *n = cur->node;
+    size_t idx = cur->idx;
+    size_t data_len = ptr->data_len;
+
+    if (n->len == ptr->node_cap) {
+        ulist_node_t *m = ulist_node_alloc(ptr);
+        size_t half = n->len >> 1;
+
+        memcpy(m->data, ULIST_ELEM(ptr, n, half), (n->len - half) * data_len);
+        m->len = n->len - half;
+        n->len = half;
+        ulist_link_after(ptr, n, m);
+
+        if (idx >= half) {
+            n = m;
+            idx -= half;
+        }
+    }
+
+    if (n->off && ((n->off + n->len == ptr->node_cap) || (idx < (n->len >> 1)))) {
+        n->off -= 1;
+        memmove(ULIST_ELEM(ptr, n, 0), ULIST_ELEM(ptr, n, 1), idx * data_len);
+    } else {
+        memmove(ULIST_ELEM(ptr, n, idx + 1), ULIST_ELEM(ptr, n, idx),
+                (n->len - idx) * data_len);
+    }
+
+    memcpy(ULIST_ELEM(ptr, n, idx), data, data_len);
+    n->len += 1;
+    ptr->size += 1;
+
+    cur->node = n;
+    cur->idx = idx + 1;
+}
+
+// append src (dst->next_ptr) to dst and drop src
+static void ulist_merge(ulist_t *ptr, ulist_node_t *dst, ulist_node_t *src, ulist_cursor_t *cur)
+{
+    if (dst->off + dst->len + src->len > ptr->node_cap) {
+        memmove(dst->data, ULIST_ELEM(ptr, dst, 0), dst->len * ptr->data_len);
+        dst->off = 0;
+    }
+
+    memcpy(ULIST_ELEM(ptr, dst, dst->len), ULIST_ELEM(ptr, src, 0), src->len * ptr->data_len);
+
+    if (cur->node == src) {
+        cur->node = dst;
+        cur->idx += dst->len;
+    }
+
+    dst->len += src->len;
+    ulist_unlink(ptr, src);
+}
+
+static void ulist_remove_at(ulist_t *ptr, ulist_cursor_t *cur, void *data)
+{
+    ulist_node_t *n = cur->node, *m;
+    size_t idx = cur->idx;
+    size_t data_len = ptr->data_len;
+
+    if (data) {
+        memcpy(data, ULIST_ELEM(ptr, n, idx), data_len);
+    }
+
+    if (idx < (n->len >> 1)) {
+        memmove(ULIST_ELEM(ptr, n, 1), ULIST_ELEM(ptr, n, 0), idx * data_len);
+        n->off += 1;
+    } else {
+        memmove(ULIST_ELEM(ptr, n, idx), ULIST_ELEM(ptr, n, idx + 1),
+                (n->len - idx - 1) * data_len);
+    }
+
+    n->len -= 1;
+    ptr->size -= 1;
+
+    if (!n->len) {
+        cur->node = n->next_ptr;
+        cur->idx = 0;
+        ulist_unlink(ptr, n);
+        return;
+    }
+
+    if (idx == n->len) {
+        cur->node = n->next_ptr;
+        cur->idx = 0;
+    } else {
+        cur->idx = idx;
+    }
+
+    // keep nodes at least half full so index walks stay short
+    if ((m = n->next_ptr) && (n->len + m->len <= (ptr->node_cap >> 1))) {
+        ulist_merge(ptr, n, m, cur);
+    } else if ((m = n->prev_ptr) && (m->len + n->len <= (ptr->node_cap >> 1))) {
+        ulist_merge(ptr, m, n, cur);
+    }
+}
+
+void ulist_init(ulist_t *ptr, size_t data_len)
+{
+    size_t hdr = offsetof(ulist_node_t, data);
+    size_t cap;
+
+    assert(data_len);
+    cap = (ULIST_NODE_SIZE > hdr) ? (ULIST_NODE_SIZE - hdr) / data_len : 0;
+    if (cap < 4) {
+        cap = 4;
+    }
+
+    ptr->head_ptr = NULL;
+    ptr->tail_ptr = NULL;
+    ptr->pool_ptr = NULL;
+    ptr->size = 0;
+    ptr->pool_len = 0;
+    ptr->data_len = data_len;
+    ptr->node_size = (hdr + cap * data_len + ULIST_CACHE_LINE - 1) & ~((size_t)ULIST_CACHE_LINE - 1);
+    ptr->node_cap = (ptr->node_size - hdr) / data_len;
+}
+
+void ulist_free(ulist_t *ptr)
+{
+    ulist_clear(ptr);
+    ulist_shrink(ptr);
+}
+
+void ulist_clear(ulist_t *ptr)
+{
+    for (ulist_node_t *i = ptr->head_ptr; i; ) {
+        ulist_node_t *j = i->next_ptr;
+        ulist_node_release(ptr, i);
+        i = j;
+    }
+
+    ptr->head_ptr = NULL;
+    ptr->tail_ptr = NULL;
+    ptr->size = 0;
+}
+
+void ulist_reserve(ulist_t *ptr, size_t num)
+{
+    size_t nodes = (num + ptr->node_cap - 1) / ptr->node_cap;
+
+    while (ptr->pool_len < nodes) {
+        ulist_node_t *n = (ulist_node_t *) ulist_node_malloc(ptr->node_size);
+        assert(NULL != n);
+        n->next_ptr = ptr->pool_ptr;
+        ptr->pool_ptr = n;
+        ptr->pool_len += 1;
+    }
+}
+
+void ulist_shrink(ulist_t *ptr)
+{
+    for (ulist_node_t *i = ptr->pool_ptr; i; ) {
+        ulist_node_t *j = i->next_ptr;
+        ulist_node_mfree(i);
+        i = j;
+    }
+
+    ptr->pool_ptr = NULL;
+    ptr->pool_len = 0;
+}
+
+size_t ulist_size(ulist_t *ptr)
+{
+    return ptr->size;
+}
+
+void ulist_push_front(ulist_t *ptr, void *data)
+{
+    ulist_node_t *n = ptr->head_ptr;
+
+    if (!n || !n->off) {
+        n = ulist_node_alloc(ptr);
+        n->off = ptr->node_cap;
+        ulist_link_after(ptr, NULL, n);
+    }
+
+    n->off -= 1;
+    n->len += 1;
+    ptr->size += 1;
+    memcpy(ULIST_ELEM(ptr, n, 0), data, ptr->data_len);
+}
+
+void ulist_push_back(ulist_t *ptr, void *data)
+{
+    ulist_node_t *n = ptr->tail_ptr;
+
+    if (!n || (n->off + n->len == ptr->node_cap)) {
+        n = ulist_node_alloc(ptr);
+        ulist_link_after(ptr, ptr->tail_ptr, n);
+    }
+
+    memcpy(ULIST_ELEM(ptr, n, n->len), data, ptr->data_len);
+    n->len += 1;
+    ptr->size += 1;
+}
+
+void ulist_pop_front(ulist_t *ptr, void *data)
+{
+    ulist_node_t *n = ptr->head_ptr;
+
+    if (data) {
+        memcpy(data, ULIST_ELEM(ptr, n, 0), ptr->data_len);
+    }
+
+    n->off += 1;
+    n->len -= 1;
+    ptr->size -= 1;
+
+    if (!n->len) {
+        ulist_unlink(ptr, n);
+    }
+}
+
+void ulist_pop_back(ulist_t *ptr, void *data)
+{
+    ulist_node_t *n = ptr->tail_ptr;
+
+    if (data) {
+        memcpy(data, ULIST_ELEM(ptr, n, n->len - 1), ptr->data_len);
+    }
+
+    n->len -= 1;
+    ptr->size -= 1;
+
+    if (!n->len) {
+        ulist_unlink(ptr, n);
+    }
+}
+
+void ulist_get_front(ulist_t *ptr, void *data)
+{
+    memcpy(data, ULIST_ELEM(ptr, ptr->head_ptr, 0), ptr->data_len);
+}
+
+void ulist_get_back(ulist_t *ptr, void *data)
+{
+    memcpy(data, ULIST_ELEM(ptr, ptr->tail_ptr, ptr->tail_ptr->len - 1), ptr->data_len);
+}
+
+void ulist_set_front(ulist_t *ptr, void *data)
+{
+    memcpy(ULIST_ELEM(ptr, ptr->head_ptr, 0), data, ptr->data_len);
+}
+
+void ulist_set_back(ulist_t *ptr, void *data)
+{
+    memcpy(ULIST_ELEM(ptr, ptr->tail_ptr, ptr->tail_ptr->len - 1), data, ptr->data_len);
+}
+
+void ulist_insert(ulist_t *ptr, void *data, size_t index)
+{
+    if (index == 0) {
+        ulist_push_front(ptr, data);
+    } else if (index >= ptr->size) {
+        ulist_push_back(ptr, data);
+    } else {
+        ulist_cursor_t cur;
+        ulist_cursor_at(ptr, &cur, index);
+        ulist_insert_at(ptr, &cur, data);
+    }
+}
+
+void ulist_remove(ulist_t *ptr, void *data, size_t index)
+{
+    if (index == 0) {
+        ulist_pop_front(ptr, data);
+    } else if (index >= (ptr->size - 1)) {
+        ulist_pop_back(ptr, data);
+    } else {
+        ulist_cursor_t cur;
+        ulist_cursor_at(ptr, &cur, index);
+        ulist_remove_at(ptr, &cur, data);
+    }
+}
+
+void ulist_get(ulist_t *ptr, void *data, size_t index)
+{
+    ulist_node_t *n = ulist_locate(ptr, &index);
+    memcpy(data, ULIST_ELEM(ptr, n, index), ptr->data_len);
+}
+
+void ulist_set(ulist_t *ptr, void *data, size_t index)
+{
+    ulist_node_t *n = ulist_locate(ptr, &index);
+    memcpy(ULIST_ELEM(ptr, n, index), data, ptr->data_len);
+}
+
+void ulist_cursor_head(ulist_t *ptr, ulist_cursor_t *cur)
+{
+    cur->node = ptr->head_ptr;
+    cur->idx = 0;
+}
+
+void ulist_cursor_tail(ulist_t *ptr, ulist_cursor_t *cur)
+{
+    cur->node = ptr->tail_ptr;
+    cur->idx = cur->node ? cur->node->len - 1 : 0;
+}
+
+void ulist_cursor_at(ulist_t *ptr, ulist_cursor_t *cur, size_t index)
+{
+    if (index >= ptr->size) {
+        cur->node = NULL;
+        cur->idx = 0;
+        return;
+    }
+
+    cur->node = ulist_locate(ptr, &index);
+    cur->idx = index;
+}
+
+bool ulist_cursor_valid(ulist_cursor_t *cur)
+{
+    return cur->node;
+}
+
+void ulist_cursor_next(ulist_cursor_t *cur)
+{
+    if (++cur->idx >= cur->node->len) {
+        cur->node = cur->node->next_ptr;
+        cur->idx = 0;
+    }
+}
+
+void ulist_cursor_prev(ulist_cursor_t *cur)
+{
+    if (cur->idx) {
+        cur->idx -= 1;
+    } else {
+        cur->node = cur->node->prev_ptr;
+        cur->idx = cur->node ? cur->node->len - 1 : 0;
+    }
+}
+
+void *ulist_cursor_data(ulist_t *ptr, ulist_cursor_t *cur)
+{
+    return ULIST_ELEM(ptr, cur->node, cur->idx);
+}
+
+void ulist_cursor_get(ulist_t *ptr, ulist_cursor_t *cur, void *data)
+{
+    memcpy(data, ULIST_ELEM(ptr, cur->node, cur->idx), ptr->data_len);
+}
+
+void ulist_cursor_set(ulist_t *ptr, ulist_cursor_t *cur, void *data)
+{
+    memcpy(ULIST_ELEM(ptr, cur->node, cur->idx), data, ptr->data_len);
+}
+
+void ulist_cursor_insert(ulist_t *ptr, ulist_cursor_t *cur, void *data)
+{
+    if (!cur->node) {
+        ulist_push_back(ptr, data);
+        return;
+    }
+    ulist_insert_at(ptr, cur, data);
+}
+
+void ulist_cursor_remove(ulist_t *ptr, ulist_cursor_t *cur, void *data)
+{
+    ulist_remove_at(ptr, cur, data);
+}
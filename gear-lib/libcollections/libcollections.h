@@ -109,6 +109,84 @@ list_lnk_t *iterator_next(list_lnk_t *lnk);
 list_lnk_t *iterator_prev(list_lnk_t *lnk);
 void iterator_get(list_t *ptr, list_lnk_t *lnk, void *data);
 void iterator_set(list_t *ptr, list_lnk_t *lnk, void *data);
+
+///////////
+// ulist //
+///////////
+
+// Unrolled list: each node is a cache line aligned block holding several
+// elements in [off, off + len). Emptied nodes go to a small free pool, so
+// queue-like use (push_back/pop_front) does not hit malloc in steady state.
+
+#ifndef ULIST_CACHE_LINE
+#define ULIST_CACHE_LINE    64
+#endif
+
+#ifndef ULIST_NODE_SIZE
+#define ULIST_NODE_SIZE     256
+#endif
+
+#ifndef ULIST_POOL_MAX
+#define ULIST_POOL_MAX      64
+#endif
+
+typedef struct ulist_node
+{
+    struct ulist_node *next_ptr, *prev_ptr;
+    size_t off, len;
+    char data[];
+}
+ulist_node_t;
+
+typedef struct ulist
+{
+    ulist_node_t *head_ptr, *tail_ptr, *pool_ptr;
+    size_t size, data_len, node_cap, node_size, pool_len;
+}
+ulist_t;
+
+// A cursor is a (node, index in node) pair. node == NULL is the end position.
+// Inserting or removing through one cursor invalidates all other cursors.
+typedef struct ulist_cursor
+{
+    ulist_node_t *node;
+    size_t idx;
+}
+ulist_cursor_t;
+
+void ulist_init(ulist_t *ptr, size_t data_len);
+void ulist_free(ulist_t *ptr);
+void ulist_clear(ulist_t *ptr);
+void ulist_reserve(ulist_t *ptr, size_t num);
+void ulist_shrink(ulist_t *ptr);
+size_t ulist_size(ulist_t *ptr);
+void ulist_push_front(ulist_t *ptr, void *data);
+void ulist_push_back(ulist_t *ptr, void *data);
+void ulist_pop_front(ulist_t *ptr, void *data);
+void ulist_pop_back(ulist_t *ptr, void *data);
+void ulist_get_front(ulist_t *ptr, void *data);
+void ulist_get_back(ulist_t *ptr, void *data);
+void ulist_set_front(ulist_t *ptr, void *data);
+void ulist_set_back(ulist_t *ptr, void *data);
+void ulist_insert(ulist_t *ptr, void *data, size_t index);
+void ulist_remove(ulist_t *ptr, void *data, size_t index);
+void ulist_get(ulist_t *ptr, void *data, size_t index);
+void ulist_set(ulist_t *ptr, void *data, size_t index);
+
+void ulist_cursor_head(ulist_t *ptr, ulist_cursor_t *cur);
+void ulist_cursor_tail(ulist_t *ptr, ulist_cursor_t *cur);
+void ulist_cursor_at(ulist_t *ptr, ulist_cursor_t *cur, size_t index);
+bool ulist_cursor_valid(ulist_cursor_t *cur);
+void ulist_cursor_next(ulist_cursor_t *cur);
+void ulist_cursor_prev(ulist_cursor_t *cur);
+void *ulist_cursor_data(ulist_t *ptr, ulist_cursor_t *cur);
+void ulist_cursor_get(ulist_t *ptr, ulist_cursor_t *cur, void *data);
+void ulist_cursor_set(ulist_t *ptr, ulist_cursor_t *cur, void *data);
+// insert before the cursor; the cursor keeps pointing at the same element
+// (end stays end, so repeated inserts at end append in order)
+void ulist_cursor_insert(ulist_t *ptr, ulist_cursor_t *cur, void *data);
+// remove the element under the cursor; the cursor moves to the next element
+void ulist_cursor_remove(ulist_t *ptr, ulist_cursor_t *cur, void *data);
 #ifdef __cplusplus
 }
 #endif
@@ -22,6 +22,9 @@
 #include "libcollections.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
 
 void test_lifo()
 {
@@ -117,11 +120,340 @@ void test_iterator()
     printf("this list size:%d\n", (int)list_size(&tmp));
 }
 
+void test_ulist()
+{
+    printf("------------------test ulist------------------\n");
+    ulist_t tmp;
+    ulist_cursor_t cur;
+    char tmp_c;
+    ulist_init(&tmp, 1);
+    printf("this ulist size:%d, %d per node\n", (int)ulist_size(&tmp), (int)tmp.node_cap);
+    tmp_c = 'i',ulist_push_back(&tmp, &tmp_c);
+    tmp_c = 'a',ulist_push_back(&tmp, &tmp_c);
+    tmp_c = 'o',ulist_push_back(&tmp, &tmp_c);
+    tmp_c = 'n',ulist_push_front(&tmp, &tmp_c);
+    tmp_c = 'h',ulist_insert(&tmp, &tmp_c, 2);
+    printf("this ulist size:%d\n", (int)ulist_size(&tmp));
+    for (ulist_cursor_head(&tmp, &cur); ulist_cursor_valid(&cur); ulist_cursor_next(&cur))
+    {
+        ulist_cursor_get(&tmp, &cur, &tmp_c);
+        printf("this char is :%c\n", tmp_c);
+    }
+    ulist_free(&tmp);
+}
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint64_t rnd(void)
+{
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return rnd_state;
+}
+
+static int ulist_check(ulist_t *ul, int *ref, size_t n, int step)
+{
+    ulist_cursor_t cur;
+    size_t i = 0;
+    int v;
+
+    if (ulist_size(ul) != n) {
+        printf("step %d: size %d != %d\n", step, (int)ulist_size(ul), (int)n);
+        return -1;
+    }
+    for (ulist_cursor_head(ul, &cur); ulist_cursor_valid(&cur); ulist_cursor_next(&cur), i++) {
+        if (i >= n || *(int *)ulist_cursor_data(ul, &cur) != ref[i]) {
+            printf("step %d: mismatch at %d\n", step, (int)i);
+            return -1;
+        }
+    }
+    if (i != n) {
+        printf("step %d: walked %d of %d\n", step, (int)i, (int)n);
+        return -1;
+    }
+    for (ulist_cursor_tail(ul, &cur); ulist_cursor_valid(&cur); ulist_cursor_prev(&cur)) {
+        ulist_cursor_get(ul, &cur, &v);
+        if (v != ref[--i]) {
+            printf("step %d: reverse mismatch at %d\n", step, (int)i);
+            return -1;
+        }
+    }
+    if (n) {
+        i = rnd() % n;
+        ulist_get(ul, &v, i);
+        if (v != ref[i]) {
+            printf("step %d: get(%d) mismatch\n", step, (int)i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// random operations against a plain array model
+int test_ulist_random()
+{
+    printf("------------------test ulist random------------------\n");
+    const size_t max = 2000;
+    int *ref = (int *)calloc(max + 1, sizeof(int));
+    ulist_t ul;
+    ulist_cursor_t cur;
+    size_t n = 0, i;
+    int step, v, out, ret = -1;
+
+    ulist_init(&ul, sizeof(int));
+    for (step = 0; step < 200000; step++) {
+        int op = rnd() % 10;
+        v = (int)(rnd() & 0xffffff);
+        if (n >= max && op < 5) {
+            op += 5;
+        }
+        switch (op) {
+        case 0:
+            ulist_push_back(&ul, &v);
+            ref[n++] = v;
+            break;
+        case 1:
+            ulist_push_front(&ul, &v);
+            memmove(ref + 1, ref, n * sizeof(int));
+            ref[0] = v;
+            n++;
+            break;
+        case 2:
+        case 3:
+            i = rnd() % (n + 1);
+            ulist_insert(&ul, &v, i);
+            memmove(ref + i + 1, ref + i, (n - i) * sizeof(int));
+            ref[i] = v;
+            n++;
+            break;
+        case 4:
+            i = rnd() % (n + 1);
+            ulist_cursor_at(&ul, &cur, i);
+            ulist_cursor_insert(&ul, &cur, &v);
+            if ((i < n && *(int *)ulist_cursor_data(&ul, &cur) != ref[i]) ||
+                (i == n && ulist_cursor_valid(&cur))) {
+                printf("step %d: cursor lost after insert\n", step);
+                goto out;
+            }
+            memmove(ref + i + 1, ref + i, (n - i) * sizeof(int));
+            ref[i] = v;
+            n++;
+            break;
+        case 5:
+            if (!n) break;
+            ulist_pop_front(&ul, &out);
+            if (out != ref[0]) {
+                printf("step %d: pop_front mismatch\n", step);
+                goto out;
+            }
+            memmove(ref, ref + 1, --n * sizeof(int));
+            break;
+        case 6:
+            if (!n) break;
+            ulist_pop_back(&ul, &out);
+            if (out != ref[--n]) {
+                printf("step %d: pop_back mismatch\n", step);
+                goto out;
+            }
+            break;
+        case 7:
+            if (!n) break;
+            i = rnd() % n;
+            ulist_remove(&ul, &out, i);
+            if (out != ref[i]) {
+                printf("step %d: remove mismatch\n", step);
+                goto out;
+            }
+            memmove(ref + i, ref + i + 1, (--n - i) * sizeof(int));
+            break;
+        case 8:
+            if (!n) break;
+            i = rnd() % n;
+            ulist_cursor_at(&ul, &cur, i);
+            ulist_cursor_remove(&ul, &cur, &out);
+            if (out != ref[i]) {
+                printf("step %d: cursor remove mismatch\n", step);
+                goto out;
+            }
+            memmove(ref + i, ref + i + 1, (--n - i) * sizeof(int));
+            if ((i < n && *(int *)ulist_cursor_data(&ul, &cur) != ref[i]) ||
+                (i == n && ulist_cursor_valid(&cur))) {
+                printf("step %d: cursor lost after remove\n", step);
+                goto out;
+            }
+            break;
+        case 9:
+            if (!n) break;
+            i = rnd() % n;
+            ulist_set(&ul, &v, i);
+            ref[i] = v;
+            break;
+        }
+        if ((step % 97) == 0 && ulist_check(&ul, ref, n, step)) {
+            goto out;
+        }
+        if ((step % 50000) == 49999) {
+            // drain and refill from the pool
+            ulist_clear(&ul);
+            n = 0;
+        }
+    }
+    if (ulist_check(&ul, ref, n, step)) {
+        goto out;
+    }
+
+    // filter through the cursor: drop odd values, duplicate even ones
+    for (ulist_cursor_head(&ul, &cur); ulist_cursor_valid(&cur); ) {
+        ulist_cursor_get(&ul, &cur, &v);
+        if (v & 1) {
+            ulist_cursor_remove(&ul, &cur, NULL);
+        } else {
+            ulist_cursor_insert(&ul, &cur, &v);
+            ulist_cursor_next(&cur);
+        }
+    }
+    for (i = 0, out = 0; i < n; i++) {
+        if (!(ref[i] & 1)) {
+            ref[out++] = ref[i];
+            ref[out++] = ref[i];
+            if ((size_t)out > max) break;
+        }
+    }
+    if ((size_t)out <= max && ulist_check(&ul, ref, out, step)) {
+        goto out;
+    }
+    printf("ulist random ops ok, %d nodes pooled\n", (int)ul.pool_len);
+    ret = 0;
+out:
+    ulist_free(&ul);
+    free(ref);
+    return ret;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#define BENCH(name, ops, code)                                            \
+    do {                                                                  \
+        double t0 = now_ns();                                             \
+        code;                                                             \
+        printf("  %-34s %8.2f ns/op\n", name, (now_ns() - t0) / (ops));   \
+    } while (0)
+
+void bench_collections(size_t num)
+{
+    const size_t win = 1024;
+    size_t i, n, mid = 20000;
+    uint64_t v = 0, sum = 0;
+    list_t l;
+    ulist_t ul;
+    fifo_t f;
+    lifo_t s;
+    ulist_cursor_t cur;
+
+    printf("queue, window %d, %d ops, 8-byte elements:\n", (int)win, (int)num);
+    list_init(&l, sizeof(v));
+    BENCH("list_t push_back/pop_front", num,
+        for (i = 0; i < num; i++) {
+            list_push_back(&l, &v);
+            if (list_size(&l) > win) list_pop_front(&l, &v);
+        });
+    list_clear(&l);
+    ulist_init(&ul, sizeof(v));
+    BENCH("ulist_t push_back/pop_front", num,
+        for (i = 0; i < num; i++) {
+            ulist_push_back(&ul, &v);
+            if (ulist_size(&ul) > win) ulist_pop_front(&ul, &v);
+        });
+    ulist_free(&ul);
+    fifo_alloc(&f, win + 1, sizeof(v));
+    BENCH("fifo_t enqueue/dequeue", num,
+        for (i = 0; i < num; i++) {
+            fifo_enqueue(&f, &v);
+            if (fifo_size(&f) > win) fifo_dequeue(&f, &v);
+        });
+    fifo_free(&f);
+
+    printf("stack, fill/drain %d, %d ops:\n", (int)win, (int)num);
+    BENCH("list_t push_back/pop_back", num,
+        for (i = 0; i < num / win; i++) {
+            for (n = 0; n < win; n++) list_push_back(&l, &v);
+            for (n = 0; n < win; n++) list_pop_back(&l, &v);
+        });
+    list_clear(&l);
+    ulist_init(&ul, sizeof(v));
+    BENCH("ulist_t push_back/pop_back", num,
+        for (i = 0; i < num / win; i++) {
+            for (n = 0; n < win; n++) ulist_push_back(&ul, &v);
+            for (n = 0; n < win; n++) ulist_pop_back(&ul, &v);
+        });
+    ulist_free(&ul);
+    lifo_alloc(&s, win, sizeof(v));
+    BENCH("lifo_t enqueue/dequeue", num,
+        for (i = 0; i < num / win; i++) {
+            for (n = 0; n < win; n++) lifo_enqueue(&s, &v);
+            for (n = 0; n < win; n++) lifo_dequeue(&s, &v);
+        });
+    lifo_free(&s);
+
+    printf("build and walk %d elements:\n", (int)num);
+    BENCH("list_t push_back", num,
+        for (v = 0; v < num; v++) list_push_back(&l, &v));
+    BENCH("list_t iterator walk", num,
+        for (list_lnk_t *it = iterator_start_from_head(&l); it; it = iterator_next(it)) {
+            iterator_get(&l, it, &v);
+            sum += v;
+        });
+    list_clear(&l);
+    ulist_init(&ul, sizeof(v));
+    BENCH("ulist_t push_back", num,
+        for (v = 0; v < num; v++) ulist_push_back(&ul, &v));
+    BENCH("ulist_t cursor walk", num,
+        for (ulist_cursor_head(&ul, &cur); ulist_cursor_valid(&cur); ulist_cursor_next(&cur))
+            sum += *(uint64_t *)ulist_cursor_data(&ul, &cur));
+    BENCH("ulist_t cursor insert every 2nd", num,
+        for (ulist_cursor_head(&ul, &cur); ulist_cursor_valid(&cur); ulist_cursor_next(&cur))
+            ulist_cursor_insert(&ul, &cur, &v));
+    BENCH("ulist_t cursor remove every 2nd", num,
+        for (ulist_cursor_head(&ul, &cur); ulist_cursor_valid(&cur); ulist_cursor_next(&cur))
+            ulist_cursor_remove(&ul, &cur, NULL));
+    ulist_free(&ul);
+
+    printf("random index insert/get/remove, %d elements:\n", (int)mid);
+    list_init(&l, sizeof(v));
+    BENCH("list_t insert(i)", mid,
+        for (i = 0; i < mid; i++) list_insert(&l, &i, rnd() % (i + 1)));
+    BENCH("list_t get(i)", mid,
+        for (i = 0; i < mid; i++) { list_get(&l, &v, rnd() % mid); sum += v; });
+    BENCH("list_t remove(i)", mid,
+        for (i = mid; i > 0; i--) list_remove(&l, &v, rnd() % i));
+    list_clear(&l);
+    ulist_init(&ul, sizeof(v));
+    BENCH("ulist_t insert(i)", mid,
+        for (i = 0; i < mid; i++) ulist_insert(&ul, &i, rnd() % (i + 1)));
+    BENCH("ulist_t get(i)", mid,
+        for (i = 0; i < mid; i++) { ulist_get(&ul, &v, rnd() % mid); sum += v; });
+    BENCH("ulist_t remove(i)", mid,
+        for (i = mid; i > 0; i--) ulist_remove(&ul, &v, rnd() % i));
+    ulist_free(&ul);
+    printf("(checksum %llu)\n", (unsigned long long)sum);
+}
+
 int main(int argc, char **argv)
 {
+    if (argc > 2 && !strcmp(argv[1], "bench")) {
+        bench_collections(strtoul(argv[2], NULL, 0));
+        return 0;
+    }
     test_lifo();
     test_fifo();
     test_list();
     test_iterator();
-    return 0;
+    test_ulist();
+    return test_ulist_random();
 }
@@ -24,6 +24,8 @@
 #include <stdlib.h>
 
 #define DARRAY_INVALID ((size_t)-1)
+/* stack temporary for swap and move, bigger items are handled in pieces */
+#define DARRAY_TMP_LEN  256
 
 void darray_init(struct darray *dst)
 {
@@ -61,41 +63,48 @@ void *darray_end(const size_t element_size,
     return darray_item(element_size, da, da->num - 1);
 }
 
-void darray_reserve(const size_t element_size, struct darray *dst,
+/*
+ * realloc can extend in place, and glibc grows chunks above mmap threshold
+ * by mremap without copying, which malloc + memcpy + free never does
+ */
+static int darray_realloc(const size_t element_size, struct darray *dst,
                 const size_t capacity)
 {
     void *ptr;
+    if (capacity > ((size_t)-1) / element_size) {
+            return -1;
+    }
+    ptr = realloc(dst->array, element_size * capacity);
+    if (!ptr) {
+            printf("%s: realloc %zu failed\n", __func__, element_size * capacity);
+            return -1;
+    }
+    dst->array = ptr;
+    dst->capacity = capacity;
+    return 0;
+}
+
+void darray_reserve(const size_t element_size, struct darray *dst,
+                const size_t capacity)
+{
     if (capacity == 0 || capacity <= dst->num)
             return;
 
-    ptr = malloc(element_size * capacity);
-    if (dst->num)
-            memcpy(ptr, dst->array, element_size * dst->num);
-    if (dst->array)
-            free(dst->array);
-    dst->array = ptr;
-    dst->capacity = capacity;
+    darray_realloc(element_size, dst, capacity);
 }
 
-static void darray_ensure_capacity(const size_t element_size,
+static int darray_ensure_capacity(const size_t element_size,
                 struct darray *dst,
                 const size_t new_size)
 {
     size_t new_cap;
-    void *ptr;
     if (new_size <= dst->capacity)
-            return;
+            return 0;
 
     new_cap = (!dst->capacity) ? new_size : dst->capacity * 2;
     if (new_size > new_cap)
             new_cap = new_size;
-    ptr = malloc(element_size * new_cap);
-    if (dst->capacity)
-            memcpy(ptr, dst->array, element_size * dst->capacity);
-    if (dst->array)
-            free(dst->array);
-    dst->array = ptr;
-    dst->capacity = new_cap;
+    return darray_realloc(element_size, dst, new_cap);
 }
 
 void darray_resize(const size_t element_size, struct darray *dst,
@@ -114,7 +123,8 @@ void darray_resize(const size_t element_size, struct darray *dst,
     b_clear = size > dst->num;
     old_num = dst->num;
 
-    darray_ensure_capacity(element_size, dst, size);
+    if (darray_ensure_capacity(element_size, dst, size) < 0)
+            return;
     dst->num = size;
 
     if (b_clear)
@@ -122,7 +132,7 @@ void darray_resize(const size_t element_size, struct darray *dst,
                             element_size * (dst->num - old_num));
 }
 
-static void darray_copy(const size_t element_size, struct darray *dst,
+void darray_copy(const size_t element_size, struct darray *dst,
                 const struct darray *da)
 {
     if (da->num == 0) {
@@ -133,7 +143,7 @@ static void darray_copy(const size_t element_size, struct darray *dst,
     }
 }
 
-static void darray_copy_array(const size_t element_size,
+void darray_copy_array(const size_t element_size,
                 struct darray *dst, const void *array,
                 const size_t num)
 {
@@ -172,18 +182,22 @@ size_t darray_find(const size_t element_size,
 size_t darray_push_back(const size_t element_size,
                 struct darray *dst, const void *item)
 {
-    darray_ensure_capacity(element_size, dst, ++dst->num);
+    if (darray_ensure_capacity(element_size, dst, dst->num + 1) < 0)
+            return DARRAY_INVALID;
+    dst->num++;
     memcpy(darray_end(element_size, dst), item, element_size);
 
     return dst->num - 1;
 }
 
-static void *darray_push_back_new(const size_t element_size,
+void *darray_push_back_new(const size_t element_size,
                 struct darray *dst)
 {
     void *last;
 
-    darray_ensure_capacity(element_size, dst, ++dst->num);
+    if (darray_ensure_capacity(element_size, dst, dst->num + 1) < 0)
+            return NULL;
+    dst->num++;
 
     last = darray_end(element_size, dst);
     memset(last, 0, element_size);
@@ -202,13 +216,15 @@ size_t darray_push_back_array(const size_t element_size,
 
     old_num = dst->num;
     darray_resize(element_size, dst, dst->num + num);
+    if (dst->num != old_num + num)
+            return DARRAY_INVALID;
     memcpy(darray_item(element_size, dst, old_num), array,
                     element_size * num);
 
     return old_num;
 }
 
-static size_t darray_push_back_darray(const size_t element_size,
+size_t darray_push_back_darray(const size_t element_size,
                 struct darray *dst,
                 const struct darray *da)
 {
@@ -231,7 +247,9 @@ void darray_insert(const size_t element_size, struct darray *dst,
     }
 
     move_count = dst->num - idx;
-    darray_ensure_capacity(element_size, dst, ++dst->num);
+    if (darray_ensure_capacity(element_size, dst, dst->num + 1) < 0)
+            return;
+    dst->num++;
 
     new_item = darray_item(element_size, dst, idx);
 
@@ -252,10 +270,11 @@ void *darray_insert_new(const size_t element_size,
     if (idx == dst->num)
             return darray_push_back_new(element_size, dst);
 
-    item = darray_item(element_size, dst, idx);
-
     move_count = dst->num - idx;
-    darray_ensure_capacity(element_size, dst, ++dst->num);
+    if (darray_ensure_capacity(element_size, dst, dst->num + 1) < 0)
+            return NULL;
+    dst->num++;
+    item = darray_item(element_size, dst, idx);
     memmove(darray_item(element_size, dst, idx + 1), item,
                     move_count * element_size);
 
@@ -263,7 +282,7 @@ void *darray_insert_new(const size_t element_size,
     return item;
 }
 
-static void darray_insert_array(const size_t element_size,
+void darray_insert_array(const size_t element_size,
                 struct darray *dst, const size_t idx,
                 const void *array, const size_t num)
 {
@@ -278,6 +297,8 @@ static void darray_insert_array(const size_t element_size,
 
     old_num = dst->num;
     darray_resize(element_size, dst, dst->num + num);
+    if (dst->num != old_num + num)
+            return;
 
     memmove(darray_item(element_size, dst, idx + num),
                     darray_item(element_size, dst, idx),
@@ -392,19 +413,56 @@ void darray_split(const size_t element_size, struct darray *dst1,
     darray_free(&temp);
 }
 
+/* swap in pieces through a stack buffer, no allocation for any size */
+static void darray_swap_item(const size_t element_size, void *a, void *b)
+{
+    uint8_t temp[DARRAY_TMP_LEN];
+    uint8_t *pa = (uint8_t *)a;
+    uint8_t *pb = (uint8_t *)b;
+    size_t left, n;
+
+    for (left = element_size; left > 0; left -= n) {
+            n = left < sizeof(temp) ? left : sizeof(temp);
+            memcpy(temp, pa, n);
+            memcpy(pa, pb, n);
+            memcpy(pb, temp, n);
+            pa += n;
+            pb += n;
+    }
+}
+
 void darray_move_item(const size_t element_size,
                 struct darray *dst, const size_t from,
                 const size_t to)
 {
-    void *temp, *p_from, *p_to;
+    uint8_t temp[DARRAY_TMP_LEN];
+    void *p_from, *p_to;
+    size_t i;
 
     if (from == to)
             return;
+    if (from >= dst->num || to >= dst->num)
+            return;
 
-    temp = malloc(element_size);
     p_from = darray_item(element_size, dst, from);
     p_to = darray_item(element_size, dst, to);
 
+    if (element_size > sizeof(temp)) {
+            /* big element, bubble it to the place by swaps */
+            if (to < from) {
+                    for (i = from; i > to; i--)
+                            darray_swap_item(element_size,
+                                            darray_item(element_size, dst, i),
+                                            darray_item(element_size, dst, i - 1));
+            } else {
+                    for (i = from; i < to; i++)
+                            darray_swap_item(element_size,
+                                            darray_item(element_size, dst, i),
+                                            darray_item(element_size, dst, i + 1));
+            }
+            return;
+    }
+
     memcpy(temp, p_from, element_size);
 
     if (to < from)
@@ -415,14 +473,11 @@ void darray_move_item(const size_t element_size,
                             element_size * (to - from));
 
     memcpy(p_to, temp, element_size);
-    free(temp);
 }
 
 void darray_swap(const size_t element_size, struct darray *dst,
                 const size_t a, const size_t b)
 {
-    void *temp, *a_ptr, *b_ptr;
-
     if (a >= dst->num)
             return;
     if (b >= dst->num)
@@ -431,13 +486,6 @@ void darray_swap(const size_t element_size, struct darray *dst,
     if (a == b)
             return;
 
-    temp = malloc(element_size);
-    a_ptr = darray_item(element_size, dst, a);
-    b_ptr = darray_item(element_size, dst, b);
-
-    memcpy(temp, a_ptr, element_size);
-    memcpy(a_ptr, b_ptr, element_size);
-    memcpy(b_ptr, temp, element_size);
-
-    free(temp);
+    darray_swap_item(element_size, darray_item(element_size, dst, a),
+                    darray_item(element_size, dst, b));
 }
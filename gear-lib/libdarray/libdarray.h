@@ -28,7 +28,7 @@
 #include <stdint.h>
 #include <string.h>
 
-#define LIBDARRAY_VERSION "0.1.0"
+#define LIBDARRAY_VERSION "0.2.0"
 
 #ifdef __cplusplus
 extern "C" {
@@ -58,6 +58,34 @@ GEAR_API void darray_erase_item(const size_t element_size,
                 struct darray *dst, const void *item);
 GEAR_API void darray_resize(const size_t element_size, struct darray *dst,
                 const size_t size);
+GEAR_API void darray_copy(const size_t element_size, struct darray *dst,
+                const struct darray *da);
+GEAR_API void darray_copy_array(const size_t element_size,
+                struct darray *dst, const void *array, const size_t num);
+GEAR_API void darray_move(struct darray *dst, struct darray *src);
+GEAR_API void *darray_push_back_new(const size_t element_size,
+                struct darray *dst);
+GEAR_API size_t darray_push_back_darray(const size_t element_size,
+                struct darray *dst, const struct darray *da);
+GEAR_API void *darray_insert_new(const size_t element_size,
+                struct darray *dst, const size_t idx);
+GEAR_API void darray_insert_array(const size_t element_size,
+                struct darray *dst, const size_t idx,
+                const void *array, const size_t num);
+GEAR_API void darray_insert_darray(const size_t element_size,
+                struct darray *dst, const size_t idx,
+                const struct darray *da);
+GEAR_API void darray_erase_range(const size_t element_size,
+                struct darray *dst, const size_t start, const size_t end);
+GEAR_API void darray_join(const size_t element_size, struct darray *dst,
+                struct darray *da);
+GEAR_API void darray_split(const size_t element_size, struct darray *dst1,
+                struct darray *dst2, const struct darray *da,
+                const size_t idx);
+GEAR_API void darray_move_item(const size_t element_size,
+                struct darray *dst, const size_t from, const size_t to);
+GEAR_API void darray_swap(const size_t element_size, struct darray *dst,
+                const size_t a, const size_t b);
 
 
 /*
@@ -80,7 +108,13 @@ GEAR_API void darray_resize(const size_t element_size, struct darray *dst,
 
 #define da_alloc_size(v) (sizeof(*v.array) * v.num)
 
-#define da_end(v) darray_end(sizeof(*v.array), &v.da)
+/*
+ * element size is known at compile time in macros, so when there is room
+ * the common operations are done inline, memcpy of constant size becomes
+ * direct load/store instead of a function call
+ */
+#define da_end(v) \
+        ((v).num ? (void *)&(v).array[(v).num - 1] : NULL)
 
 #define da_reserve(v, capacity) \
         darray_reserve(sizeof(*v.array), &v.da, capacity)
@@ -96,7 +130,11 @@ GEAR_API void darray_resize(const size_t element_size, struct darray *dst,
 
 #define da_find(v, item, idx) darray_find(sizeof(*v.array), &v.da, item, idx)
 
-#define da_push_back(v, item) darray_push_back(sizeof(*v.array), &v.da, item)
+#define da_push_back(v, item)                                           \
+        (((v).num < (v).capacity) ?                                     \
+         (memcpy(&(v).array[(v).num], (item), sizeof(*(v).array)),     \
+          (v).num++) :                                                  \
+         darray_push_back(sizeof(*(v).array), &(v).da, item))
 
 #define da_push_back_new(v) darray_push_back_new(sizeof(*v.array), &v.da)
 
@@ -125,7 +163,8 @@ GEAR_API void darray_resize(const size_t element_size, struct darray *dst,
 #define da_erase_range(dst, from, to) \
         darray_erase_range(sizeof(*dst.array), &dst.da, from, to)
 
-#define da_pop_back(dst) darray_pop_back(sizeof(*dst.array), &dst.da);
+#define da_pop_back(dst) \
+        do { if ((dst).num) (dst).num--; } while (0)
 
 #define da_join(dst, src) darray_join(sizeof(*dst.array), &dst.da, &src.da)
 
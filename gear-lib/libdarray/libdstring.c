@@ -164,17 +164,26 @@ int wstrcmpi_n(const wchar_t *str1, const wchar_t *str2, size_t n)
 
 char *astrstri(const char *str, const char *find)
 {
+	char first[3];
 	size_t len;
 
 	if (!str || !find)
 		return NULL;
 
 	len = strlen(find);
+	if (!len)
+		return (char *)str;
 
-	do {
-		if (astrcmpi_n(str, find, len) == 0)
+	/* only compare where the first char matches, strpbrk scans for it */
+	first[0] = (char)tolower((unsigned char)*find);
+	first[1] = (char)toupper((unsigned char)*find);
+	first[2] = '\0';
+
+	while ((str = strpbrk(str, first)) != NULL) {
+		if (astrcmpi_n(str + 1, find + 1, len - 1) == 0)
 			return (char *)str;
-	} while (*str++);
+		str++;
+	}
 
 	return NULL;
 }
@@ -616,30 +625,38 @@ void dstr_replace(struct dstr *str, const char *find, const char *replace)
 	replace_len = strlen(replace);
 	temp = str->array;
 
+	if (!find_len)
+		return;
+
+	/*
+	 * one pass with a read and a write position, so the tail is moved
+	 * once instead of once per match
+	 */
 	if (replace_len < find_len) {
-		unsigned long count = 0;
+		char *out = temp;
+		char *match;
+
+		while ((match = strstr(temp, find)) != NULL) {
+			if (out != temp)
+				memmove(out, temp, match - temp);
+			out += match - temp;
+			memcpy(out, replace, replace_len);
+			out += replace_len;
+			temp = match + find_len;
+		}
 
-		while ((temp = strstr(temp, find)) != NULL) {
-			char *end = temp + find_len;
-			size_t end_len = strlen(end);
-
-			if (end_len) {
-				memmove(temp + replace_len, end, end_len + 1);
-				if (replace_len)
-					memcpy(temp, replace, replace_len);
-			} else {
-				strcpy(temp, replace);
-			}
+		if (out != temp) {
+			size_t tail = strlen(temp);
 
-			temp += replace_len;
-			++count;
+			memmove(out, temp, tail + 1);
+			str->len = out + tail - str->array;
 		}
 
-		if (count)
-			str->len += (replace_len - find_len) * count;
-
 	} else if (replace_len > find_len) {
 		unsigned long count = 0;
+		size_t shift;
+		char *out;
+		char *match;
 
 		while ((temp = strstr(temp, find)) != NULL) {
 			temp += find_len;
@@ -649,23 +666,25 @@ void dstr_replace(struct dstr *str, const char *find, const char *replace)
 		if (!count)
 			return;
 
-		str->len += (replace_len - find_len) * count;
-		dstr_ensure_capacity(str, str->len + 1);
-		temp = str->array;
-
-		while ((temp = strstr(temp, find)) != NULL) {
-			char *end = temp + find_len;
-			size_t end_len = strlen(end);
-
-			if (end_len) {
-				memmove(temp + replace_len, end, end_len + 1);
-				memcpy(temp, replace, replace_len);
-			} else {
-				strcpy(temp, replace);
-			}
-
-			temp += replace_len;
+		/*
+		 * move the string to the end of the grown buffer, then copy it
+		 * forward, the write position catches up with the read position
+		 * only after the last match
+		 */
+		shift = (replace_len - find_len) * count;
+		dstr_ensure_capacity(str, str->len + shift + 1);
+		memmove(str->array + shift, str->array, str->len + 1);
+		out = str->array;
+		temp = str->array + shift;
+
+		while ((match = strstr(temp, find)) != NULL) {
+			memmove(out, temp, match - temp);
+			out += match - temp;
+			memcpy(out, replace, replace_len);
+			out += replace_len;
+			temp = match + find_len;
 		}
+		str->len += shift;
 
 	} else {
 		while ((temp = strstr(temp, find)) != NULL) {
@@ -744,6 +763,39 @@ void dstr_from_wcs(struct dstr *dst, const wchar_t *wstr)
 	}
 }
 
+/* no multibyte char, so the string can be converted in place */
+static bool astr_is_ascii(const char *str, size_t len)
+{
+	unsigned long acc = 0;
+	unsigned long word;
+	size_t i = 0;
+
+	for (; i + sizeof(word) <= len; i += sizeof(word)) {
+		memcpy(&word, str + i, sizeof(word));
+		acc |= word;
+	}
+	for (; i < len; i++)
+		acc |= (unsigned char)str[i];
+
+	return !(acc & ((unsigned long)-1 / 0xFF * 0x80));
+}
+
+static void astr_to_upper(char *str, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		str[i] -= ((unsigned)(str[i] - 'a') < 26) << 5;
+}
+
+static void astr_to_lower(char *str, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		str[i] += ((unsigned)(str[i] - 'A') < 26) << 5;
+}
+
 void dstr_to_upper(struct dstr *str)
 {
 	wchar_t *wstr;
@@ -752,6 +804,11 @@ void dstr_to_upper(struct dstr *str)
 	if (dstr_is_empty(str))
 		return;
 
+	if (astr_is_ascii(str->array, str->len)) {
+		astr_to_upper(str->array, str->len);
+		return;
+	}
+
 	wstr = dstr_to_wcs(str);
 	temp = wstr;
 
@@ -775,6 +832,11 @@ void dstr_to_lower(struct dstr *str)
 	if (dstr_is_empty(str))
 		return;
 
+	if (astr_is_ascii(str->array, str->len)) {
+		astr_to_lower(str->array, str->len);
+		return;
+	}
+
 	wstr = dstr_to_wcs(str);
 	temp = wstr;
 
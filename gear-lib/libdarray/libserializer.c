@@ -82,6 +82,181 @@ void serializer_array_deinit(struct serializer *s)
     memset(s, 0, sizeof(struct serializer));
 }
 
+/* payload smaller than this is copied, an iovec entry costs more */
+#define CHAIN_REF_MIN   256
+
+struct chain_chunk {
+    struct chain_chunk *next;
+    size_t used;
+    uint8_t data[SERIALIZER_CHUNK_SIZE];
+};
+
+struct chain_data {
+    struct chain_chunk *head;
+    struct chain_chunk *tail;
+    struct chain_chunk *pool;
+    DARRAY(struct iovec) iov;
+    size_t pos;
+};
+
+static struct chain_chunk *chain_chunk_get(struct chain_data *cd)
+{
+    struct chain_chunk *c = cd->pool;
+    if (c) {
+        cd->pool = c->next;
+    } else {
+        c = malloc(sizeof(struct chain_chunk));
+        if (!c) {
+            printf("%s: malloc chunk failed\n", __func__);
+            return NULL;
+        }
+    }
+    c->next = NULL;
+    c->used = 0;
+    if (cd->tail) {
+        cd->tail->next = c;
+    } else {
+        cd->head = c;
+    }
+    cd->tail = c;
+    return c;
+}
+
+static int chain_iov_append(struct chain_data *cd, const void *base, size_t len)
+{
+    struct iovec *last = da_end(cd->iov);
+    struct iovec v;
+    if (last && (uint8_t *)last->iov_base + last->iov_len == base) {
+        last->iov_len += len;
+        return 0;
+    }
+    v.iov_base = (void *)base;
+    v.iov_len = len;
+    if (da_push_back(cd->iov, &v) == (size_t)-1) {
+        return -1;
+    }
+    return 0;
+}
+
+static size_t chain_write(void *param, const void *data, size_t size)
+{
+    struct chain_data *cd = param;
+    struct chain_chunk *c = cd->tail;
+    const uint8_t *p = data;
+    size_t left = size;
+    size_t n;
+
+    while (left > 0) {
+        if (!c || c->used == SERIALIZER_CHUNK_SIZE) {
+            c = chain_chunk_get(cd);
+            if (!c) {
+                break;
+            }
+        }
+        n = SERIALIZER_CHUNK_SIZE - c->used;
+        if (n > left) {
+            n = left;
+        }
+        memcpy(c->data + c->used, p, n);
+        if (chain_iov_append(cd, c->data + c->used, n) < 0) {
+            break;
+        }
+        c->used += n;
+        p += n;
+        left -= n;
+    }
+    cd->pos += size - left;
+    return size - left;
+}
+
+static size_t chain_write_ref(void *param, const void *data, size_t size)
+{
+    struct chain_data *cd = param;
+    if (size < CHAIN_REF_MIN) {
+        return chain_write(param, data, size);
+    }
+    if (chain_iov_append(cd, data, size) < 0) {
+        return 0;
+    }
+    cd->pos += size;
+    return size;
+}
+
+static size_t chain_getpos(void *param)
+{
+    struct chain_data *cd = param;
+    return cd->pos;
+}
+
+/* give chunks back to pool, keep memory for next message */
+static void chain_recycle(struct chain_data *cd)
+{
+    if (cd->tail) {
+        cd->tail->next = cd->pool;
+        cd->pool = cd->head;
+    }
+    cd->head = NULL;
+    cd->tail = NULL;
+    cd->iov.num = 0;
+    cd->pos = 0;
+}
+
+static void chain_free(void *param)
+{
+    struct chain_data *cd = param;
+    struct chain_chunk *c, *next;
+    chain_recycle(cd);
+    for (c = cd->pool; c; c = next) {
+        next = c->next;
+        free(c);
+    }
+    cd->pool = NULL;
+    da_free(cd->iov);
+}
+
+int serializer_chain_init(struct serializer *s)
+{
+    struct chain_data *data = calloc(1, sizeof(struct chain_data));
+    memset(s, 0, sizeof(struct serializer));
+    if (!data) {
+        return -1;
+    }
+    da_init(data->iov);
+    s->data      = data;
+    s->read      = NULL;
+    s->write     = chain_write;
+    s->write_ref = chain_write_ref;
+    s->getpos    = chain_getpos;
+    s->free      = chain_free;
+    return 0;
+}
+
+int serializer_chain_get_iov(struct serializer *s, struct iovec **iov, int *iovcnt)
+{
+    struct chain_data *data = s->data;
+    if (!data || !iov || !iovcnt) {
+        return -1;
+    }
+    *iov = data->iov.array;
+    *iovcnt = (int)data->iov.num;
+    return 0;
+}
+
+void serializer_chain_reset(struct serializer *s)
+{
+    if (s->data) {
+        chain_recycle(s->data);
+    }
+}
+
+void serializer_chain_deinit(struct serializer *s)
+{
+    if (s->data)
+        s->free(s->data);
+    free(s->data);
+    memset(s, 0, sizeof(struct serializer));
+}
+
 static size_t file_read(void *file, void *data, size_t size)
 {
     return fread(data, 1, size, file);
@@ -131,6 +306,13 @@ size_t s_write(struct serializer *s, const void *data, size_t size)
     return 0;
 }
 
+size_t s_write_ref(struct serializer *s, const void *data, size_t size)
+{
+    if (s && s->write_ref && data && size)
+        return s->write_ref(s->data, data, size);
+    return s_write(s, data, size);
+}
+
 size_t s_getpos(struct serializer *s)
 {
     if (s && s->getpos)
@@ -34,6 +34,7 @@ struct serializer {
     size_t  (*write)(void *, const void *, size_t);
     size_t  (*getpos)(void *);
     void    (*free)(void *);
+    size_t  (*write_ref)(void *, const void *, size_t);
 };
 
 GEAR_API int serializer_array_init(struct serializer *s);
@@ -41,11 +42,26 @@ GEAR_API void serializer_array_deinit(struct serializer *s);
 GEAR_API int serializer_array_get_data(struct serializer *s, uint8_t **output, size_t *size);
 GEAR_API void serializer_array_reset(struct serializer *s);
 
+/*
+ * chain serializer appends into fixed size chunks, chunks are kept in pool
+ * of serializer and reused after reset, so steady state writes allocate
+ * nothing. s_write_ref only references payload without copy, it must stay
+ * valid until reset/deinit. output is an iovec array for writev/sendmsg.
+ */
+#define SERIALIZER_CHUNK_SIZE   4096
+
+GEAR_API int serializer_chain_init(struct serializer *s);
+GEAR_API void serializer_chain_deinit(struct serializer *s);
+GEAR_API int serializer_chain_get_iov(struct serializer *s, struct iovec **iov, int *iovcnt);
+GEAR_API void serializer_chain_reset(struct serializer *s);
+
 GEAR_API int serializer_file_init(struct serializer *s, const char *path);
 GEAR_API void serializer_file_deinit(struct serializer *s);
 
 GEAR_API size_t s_read(struct serializer *s, void *data, size_t size);
 GEAR_API size_t s_write(struct serializer *s, const void *data, size_t size);
+/* reference data if serializer supports it, otherwise copy as s_write */
+GEAR_API size_t s_write_ref(struct serializer *s, const void *data, size_t size);
 GEAR_API size_t s_getpos(struct serializer *s);
 
 GEAR_API void s_w8(struct serializer *s, uint8_t u8);
@@ -21,8 +21,287 @@
  ******************************************************************************/
 #include "libdarray.h"
 #include "libserializer.h"
+#include "libdstring.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static double epoch_double(void)
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + (t.tv_usec * 1.0) / 1000000.0;
+}
+
+static void write_tag(struct serializer *s, const uint8_t *payload, size_t size)
+{
+    s_w8(s, 9);
+    s_wb24(s, size + 5);
+    s_wb24(s, 0);
+    s_w8(s, 0);
+    s_wb24(s, 0);
+    s_w8(s, 0x17);
+    s_w8(s, 1);
+    s_wb24(s, 0);
+    s_write_ref(s, payload, size);
+    s_wb32(s, s_getpos(s) - 1);
+}
+
+static int test_chain(void)
+{
+    struct serializer sa, sc;
+    struct iovec *iov;
+    uint8_t payload[10000];
+    uint8_t *data, *p;
+    size_t size;
+    int i, cnt, err = 0;
+
+    for (i = 0; i < (int)sizeof(payload); i++) {
+        payload[i] = (uint8_t)i;
+    }
+    serializer_array_init(&sa);
+    serializer_chain_init(&sc);
+    for (i = 0; i < 3; i++) {
+        write_tag(&sa, payload, 100 + i * 4000);
+        write_tag(&sc, payload, 100 + i * 4000);
+    }
+    serializer_array_get_data(&sa, &data, &size);
+    serializer_chain_get_iov(&sc, &iov, &cnt);
+    if (s_getpos(&sc) != size) {
+        err++;
+    }
+    for (i = 0, p = data; i < cnt && !err; i++) {
+        if (p + iov[i].iov_len > data + size ||
+            memcmp(p, iov[i].iov_base, iov[i].iov_len)) {
+            err++;
+        }
+        p += iov[i].iov_len;
+    }
+    serializer_chain_reset(&sc);
+    if (s_getpos(&sc) != 0) {
+        err++;
+    }
+    serializer_array_deinit(&sa);
+    serializer_chain_deinit(&sc);
+    printf("chain serializer test %s, %d iov\n", err ? "failed" : "ok", cnt);
+    return err;
+}
+
+/* flv video tags of 64KB, output to /dev/null like a socket */
+static void bench_serializer(int n)
+{
+    struct serializer s;
+    struct iovec *iov;
+    static uint8_t payload[65536];
+    uint8_t *data, *out;
+    size_t size;
+    double t1, t2;
+    int i, cnt;
+    int fd = open("/dev/null", O_WRONLY);
+
+    out = malloc(sizeof(payload) + 64);
+    serializer_array_init(&s);
+    t1 = epoch_double();
+    for (i = 0; i < n; i++) {
+        write_tag(&s, payload, sizeof(payload));
+        serializer_array_get_data(&s, &data, &size);
+        memcpy(out, data, size);
+        if (write(fd, out, size) < 0) {
+            break;
+        }
+        serializer_array_reset(&s);
+    }
+    t2 = epoch_double();
+    serializer_array_deinit(&s);
+    printf("%15s: %.0f tags/s\n", "array", n / (t2 - t1));
+
+    serializer_chain_init(&s);
+    t1 = epoch_double();
+    for (i = 0; i < n; i++) {
+        write_tag(&s, payload, sizeof(payload));
+        serializer_chain_get_iov(&s, &iov, &cnt);
+        if (writev(fd, iov, cnt) < 0) {
+            break;
+        }
+        serializer_chain_reset(&s);
+    }
+    t2 = epoch_double();
+    serializer_chain_deinit(&s);
+    printf("%15s: %.0f tags/s\n", "chain", n / (t2 - t1));
+    free(out);
+    close(fd);
+}
+
+struct big_item {
+    int id;
+    char payload[1000];
+};
+
+static int test_swap(void)
+{
+    DARRAY(struct big_item) b;
+    DARRAY(int) a;
+    struct big_item item;
+    int j, err = 0;
+
+    da_init(a);
+    for (j = 0; j < 10; j++) {
+        da_push_back(a, &j);
+    }
+    da_swap(a, 0, 9);
+    da_move_item(a, 1, 8);
+    /* 9 2 3 4 5 6 7 8 1 0 */
+    if (a.array[0] != 9 || a.array[1] != 2 || a.array[8] != 1 || a.array[9] != 0) {
+        err++;
+    }
+    da_pop_back(a);
+    if (a.num != 9 || *(int *)da_end(a) != 1) {
+        err++;
+    }
+    da_free(a);
+
+    da_init(b);
+    for (j = 0; j < 4; j++) {
+        memset(&item, j, sizeof(item));
+        item.id = j;
+        da_push_back(b, &item);
+    }
+    da_swap(b, 0, 3);
+    da_move_item(b, 3, 1);
+    /* 3 0 1 2 */
+    if (b.array[0].id != 3 || b.array[1].id != 0 || b.array[3].id != 2 ||
+        b.array[1].payload[999] != 0 || b.array[0].payload[999] != 3) {
+        err++;
+    }
+    da_free(b);
+    printf("swap/move test %s\n", err ? "failed" : "ok");
+    return err;
+}
+
+/* growth that cannot be allocated leaves the array untouched */
+static int test_grow_fail(void)
+{
+    const size_t huge = (size_t)-1 / 2 + 1;
+    struct darray da;
+    char one[16] = "untouched";
+    int err = 0;
+
+    da.array = one;
+    da.num = 1;
+    da.capacity = 1;
+    if (darray_insert_new(huge, &da, 0) || darray_push_back_new(huge, &da)) {
+        err++;
+    }
+    darray_insert(huge, &da, 0, one);
+    if (da.num != 1 || da.capacity != 1 || da.array != one ||
+        strcmp(one, "untouched")) {
+        err++;
+    }
+    printf("grow fail test %s\n", err ? "failed" : "ok");
+    return err;
+}
+
+static void bench(int n)
+{
+    DARRAY(uint32_t) a;
+    DARRAY(uint8_t) bytes;
+    uint8_t buf[1500];
+    double t1, t2, t3;
+    uint32_t j;
+
+    da_init(a);
+    t1 = epoch_double();
+    for (j = 0; j < (uint32_t)n; j++) {
+        da_push_back(a, &j);
+    }
+    t2 = epoch_double();
+    for (j = 0; j < (uint32_t)n; j++) {
+        da_swap(a, j, n - 1 - j);
+    }
+    t3 = epoch_double();
+    printf("%15s: %.1f Mops/s\n", "push_back", n / (t2 - t1) / 1e6);
+    printf("%15s: %.1f Mops/s\n", "swap", n / (t3 - t2) / 1e6);
+    da_free(a);
+
+    /* grow a byte buffer like flv/serializer output */
+    memset(buf, 0, sizeof(buf));
+    da_init(bytes);
+    t1 = epoch_double();
+    for (j = 0; j < (uint32_t)n / 100; j++) {
+        da_push_back_array(bytes, buf, sizeof(buf));
+    }
+    t2 = epoch_double();
+    printf("%15s: %.1f MB/s (%zu bytes)\n", "append", bytes.num / (t2 - t1) / 1e6, bytes.num);
+    da_free(bytes);
+}
+
+/* replace every non-overlapping find from left to right, into out */
+static void ref_replace(char *out, const char *in, const char *find, const char *rep)
+{
+    size_t flen = strlen(find);
+    while (*in) {
+        if (!strncmp(in, find, flen)) {
+            strcpy(out, rep);
+            out += strlen(rep);
+            in += flen;
+        } else {
+            *out++ = *in++;
+        }
+    }
+    *out = '\0';
+}
+
+static int test_dstring(void)
+{
+    static const char *finds[] = {"a", "ab", "aba", "$1", "xyz"};
+    static const char *reps[] = {"", "B", "cd", "long replacement", "aba"};
+    struct dstr str;
+    char in[256], ref[256 * 16];
+    const char *p;
+    int i, j, k, err = 0;
+
+    for (i = 0; i < 500; i++) {
+        int len = rand() % 200;
+        for (j = 0; j < len; j++) {
+            in[j] = "ab$1x"[rand() % 5];
+        }
+        in[len] = '\0';
+        for (j = 0; j < 5; j++) {
+            for (k = 0; k < 5; k++) {
+                dstr_init_copy(&str, in);
+                dstr_replace(&str, finds[j], reps[k]);
+                ref_replace(ref, in, finds[j], reps[k]);
+                if (len && (strcmp(str.array, ref) || str.len != strlen(ref))) {
+                    err++;
+                }
+                dstr_free(&str);
+            }
+        }
+        p = astrstri(in, "B$1X");
+        for (j = 0; j + 4 <= len; j++) {
+            if (!astrcmpi_n(in + j, "B$1X", 4)) {
+                break;
+            }
+        }
+        if (p != (j + 4 <= len ? in + j : NULL)) {
+            err++;
+        }
+    }
+
+    dstr_init_copy(&str, "Content-Length: 10");
+    dstr_to_upper(&str);
+    err += strcmp(str.array, "CONTENT-LENGTH: 10") != 0;
+    dstr_to_lower(&str);
+    err += strcmp(str.array, "content-length: 10") != 0;
+    err += dstr_find_i(&str, "LENGTH") != str.array + 8;
+    err += astrstri("abc", "") == NULL;
+    dstr_free(&str);
+    printf("dstring test %s\n", err ? "failed" : "ok");
+    return err;
+}
 
 static int foo()
 {
@@ -51,9 +330,16 @@ int main(int argc, char **argv)
     for (j = 10; j < 20; j++) {
         da_push_back_array(i, &j, 1);
     }
-    for (j = 0; j < 20; j++) {
+    for (j = 0; j < (int)i.num; j++) {
         printf("tmp=%x\n", i.array[j]);
     }
     da_free(i);
+    if (test_swap() || test_grow_fail() || test_chain() || test_dstring()) {
+        return -1;
+    }
+    if (argc > 1) {
+        bench(atoi(argv[1]));
+        bench_serializer(atoi(argv[1]) / 100);
+    }
     return 0;
 }
@@ -20,6 +20,7 @@
  * SOFTWARE.
  ******************************************************************************/
 #include <libposix.h>
+#include <libhash.h>
 #include "libdict.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,16 +28,42 @@
 #include <stdint.h>
 #include <errno.h>
 
+/*
+ * [index]   slot -> entry id, open addressing, probed like python dict
+ * [segs]    seg0: |entry0|entry1|...|  seg1: |...|   fixed size, never moved
+ * [arena]   chunk -> chunk -> ...       key strings, freed at once
+ *
+ * live entries are linked in insertion order, so enumeration is O(1) per
+ * item. When index is too full, a bigger index is allocated and slots of
+ * the old index are moved a few per operation (incremental rehash), lookups
+ * check the new index first and then the not yet moved part of the old one.
+ */
 
 /** Minimum dictionary size to start with */
 #define DICT_MIN_SZ     64
 
-/** Dummy pointer to reference deleted keys */
-#define DUMMY_PTR       ((void*)-1)
+/** Index slot values, entry id is stored as id + DICT_IX_BASE */
+#define DICT_IX_EMPTY   0
+#define DICT_IX_DUMMY   1
+#define DICT_IX_BASE    2
+/** End of entry list */
+#define DICT_NIL        0xFFFFFFFF
 /** Used to hash further when handling collisions */
 #define PERTURB_SHIFT   5
 /** Beyond this size, a dictionary will not be grown by the same factor */
 #define DICT_BIGSZ      64000
+/** Entries per segment */
+#define DICT_SEG_BITS   8
+#define DICT_SEG_SIZE   (1 << DICT_SEG_BITS)
+/** Minimum slots of old index moved per operation while rehashing */
+#define DICT_REHASH_STEP    16
+/** Key arena chunk size */
+#define DICT_ARENA_MIN  4096
+#define DICT_ARENA_MAX  (1024 * 1024)
+/** Compact arena on resize when deleted keys waste more than this and live keys */
+#define DICT_ARENA_WASTE    (64 * 1024)
+/** Cursor returned after last item */
+#define DICT_CURSOR_END 0x7FFFFFFF
 
 /** Define this to:
     0 for no debugging
@@ -45,16 +72,12 @@
  */
 #define DEBUG           0
 
-/*
- * Specify which hash function to use
- * MurmurHash is fast but may not work on all architectures
- * Dobbs is a tad bit slower but not by much and works everywhere
- */
-#define dict_hash   dict_hash_murmur
-/* #define dict_hash   dict_hash_dobbs */
-
-/* Forward definitions */
-static int dict_resize(dict *d);
+struct dict_arena {
+    struct dict_arena *next;
+    size_t size;
+    size_t used;
+    char data[1];
+};
 
 /** Replacement for strdup() which is not always provided by libc */
 static char *xstrdup(char *s)
@@ -69,236 +92,320 @@ static char *xstrdup(char *s)
     return t;
 }
 
-/**
-  This hash function has been taken from an Article in Dr Dobbs Journal.
-  There are probably better ones out there but this one does the job.
+/*
+ * hash functions are shared with libhash, murmur by default,
+ * see dict_set_hash_fn
  */
-#if 0
-static uint32_t dict_hash_dobbs(char *key, size_t len)
+static inline uint32_t dict_hash(dict *d, char *key, size_t len)
 {
-    int len, i;
-    uint32_t hash;
-    if (!key || !len) {
-        printf("%s: invalid paraments!\n", __func__);
-        return 0;
-    }
-    for (hash = 0, i=0; i < len; i++) {
-        hash += (uint32_t)key[i];
-        hash += (hash<<10);
-        hash ^= (hash>>6);
-    }
-    hash += (hash <<3);
-    hash ^= (hash >>11);
-    hash += (hash <<15);
-    return hash;
+    return hash_fn32(d->hash_fn, key, len, d->seed);
 }
-#endif
 
-/* Murmurhash */
-static uint32_t dict_hash_murmur(char *key, size_t len)
+static inline keypair *dict_entry(dict *d, uint32_t id)
 {
-    uint32_t h, k;
-    uint8_t *data;
-    uint32_t seed = 0x0badcafe;//magic number
-    uint32_t m = 0x5bd1e995;//magic number
-    uint32_t r = 24;//magic number
+    return &d->segs[id >> DICT_SEG_BITS][id & (DICT_SEG_SIZE - 1)];
+}
 
-    if (!key || !len) {
-        return 0;
+/** Copy a key into the arena of dict */
+static char *arena_strdup(dict *d, char *s)
+{
+    size_t len = strlen(s) + 1;
+    size_t size;
+    struct dict_arena *a = d->arena;
+    char *p;
+
+    if (!a || a->size - a->used < len) {
+        size = a ? a->size * 2 : DICT_ARENA_MIN;
+        if (size > DICT_ARENA_MAX) {
+            size = DICT_ARENA_MAX;
+        }
+        while (size < len) {
+            size *= 2;
+        }
+        a = (struct dict_arena *)malloc(sizeof(*a) + size);
+        if (!a) {
+            printf("%s: malloc failed %s\n", __func__, strerror(errno));
+            return NULL;
+        }
+        a->next = d->arena;
+        a->size = size;
+        a->used = 0;
+        d->arena = a;
     }
+    p = a->data + a->used;
+    memcpy(p, s, len);
+    a->used += len;
+    d->arena_bytes += len;
+    d->arena_live += len;
+    return p;
+}
 
-    h = seed ^ len;
-    data = (uint8_t *)key;
-    while (len >= 4) {
-        k = *(uint32_t *)data;
-
-        k *= m;
-        k ^= k >> r;
-        k *= m;
-
-        h *= m;
-        h ^= k;
-
-        data += 4;
-        len -= 4;
+static void arena_free(struct dict_arena *a)
+{
+    struct dict_arena *next;
+    for (; a; a = next) {
+        next = a->next;
+        free(a);
     }
-    switch (len) {
-        case 3: h ^= data[2] << 16;
-        case 2: h ^= data[1] << 8;
-        case 1: h ^= data[0];
-                h *= m;
-    };
-    h ^= h >> 13;
-    h *= m;
-    h ^= h >> 15;
-    return h;
 }
 
-/** Lookup an element in a dict
-    This implementation copied almost verbatim from the Python dictionary
-    object, without the Pythonisms.
-    */
-static keypair *dict_lookup(dict *d, char *key, uint32_t hash)
+/** Copy live keys into a fresh arena when most of the arena is garbage */
+static void arena_compact(dict *d)
 {
-    keypair * freeslot;
-    keypair * ep;
-    uint32_t i;
-    uint32_t perturb;
-
-    if (!d || !key) {
-        return NULL;
-    }
+    struct dict_arena *old = d->arena;
+    uint32_t id;
+    keypair *kp;
+    char *key;
 
-    i = hash & (d->size-1);
-    /* Look for empty slot */
-    ep = d->table + i;
-    if (ep->key == NULL || ep->key == key) {
-        return ep ;
-    }
-    if (ep->key == DUMMY_PTR) {
-        freeslot = ep;
-    } else {
-        if (ep->hash == hash &&
-            !strcmp(key, ep->key)) {
-                return ep;
-        }
-        freeslot = NULL;
-    }
-    for (perturb = hash; perturb > 0; perturb >>= PERTURB_SHIFT) {
-        i = (i<<2) + i + perturb + 1;
-        i &= (d->size-1);
-        ep = d->table + i;
-        if (ep->key == NULL) {
-            return freeslot == NULL ? ep : freeslot;
-        }
-        if ((ep->key == key) ||
-            (ep->hash == hash &&
-             ep->key  != DUMMY_PTR &&
-             !strcmp(ep->key, key))) {
-            return ep;
-        }
-        if (ep->key == DUMMY_PTR && freeslot == NULL) {
-            freeslot = ep;
+    d->arena = NULL;
+    d->arena_bytes = 0;
+    d->arena_live = 0;
+    for (id = d->head; id != DICT_NIL; id = kp->next) {
+        kp = dict_entry(d, id);
+        key = arena_strdup(d, kp->key);
+        if (!key) {
+            /* keep the old arena, retry on next resize */
+            arena_free(d->arena);
+            d->arena = old;
+            return;
         }
+        kp->key = key;
     }
-    return NULL;
+    arena_free(old);
 }
 
-/** Add an item to a dictionary without copying key/val
-    Used by dict_resize() only.
- */
-static int dict_add_p(dict *d, char *key, char *val)
+/** Find key in one index, return the slot or NULL, skip slots < start */
+static uint32_t *index_lookup(dict *d, uint32_t *index, uint32_t size,
+                uint32_t start, char *key, uint32_t hash)
 {
-    uint32_t hash;
-    keypair * slot;
-
-    if (!d || !key) {
-        return -1;
-    }
+    uint32_t mask = size - 1;
+    uint32_t i = hash & mask;
+    uint32_t perturb = hash;
+    uint32_t ix;
+    keypair *kp;
 
-#if DEBUG>2
-    printf("dict_add_p[%s][%s]\n", key, val ? val : "UNDEF");
-#endif
-    hash = dict_hash(key, strlen(key));
-    slot = dict_lookup(d, key, hash);
-    if (slot) {
-        slot->key = key;
-        slot->val = val;
-        slot->hash = hash;
-        d->used++;
-        d->fill++;
-        if ((3*d->fill) >= (d->size*2)) {
-            if (dict_resize(d) != 0) {
-                return -1;
+    for (;;) {
+        ix = index[i];
+        if (ix == DICT_IX_EMPTY) {
+            return NULL;
+        }
+        if (ix != DICT_IX_DUMMY && i >= start) {
+            kp = dict_entry(d, ix - DICT_IX_BASE);
+            if (kp->key == key ||
+                (kp->hash == hash && !strcmp(kp->key, key))) {
+                return &index[i];
             }
         }
+        perturb >>= PERTURB_SHIFT;
+        i = (i * 5 + perturb + 1) & mask;
     }
-    return 0;
 }
 
-/** Add an item to a dictionary by copying key/val into the dict. */
-int dict_add(dict *d, char *key, char *val)
+/** Find a free slot in the current index for a key known to be absent */
+static uint32_t *index_free_slot(dict *d, uint32_t hash)
 {
-    uint32_t hash;
-    keypair *slot;
+    uint32_t mask = d->size - 1;
+    uint32_t i = hash & mask;
+    uint32_t perturb = hash;
 
-    if (!d || !key) {
-        return -1;
+    while (d->index[i] != DICT_IX_EMPTY && d->index[i] != DICT_IX_DUMMY) {
+        perturb >>= PERTURB_SHIFT;
+        i = (i * 5 + perturb + 1) & mask;
     }
+    return &d->index[i];
+}
 
-#if DEBUG>2
-    printf("dict_add[%s][%s]\n", key, val ? val : "UNDEF");
-#endif
-    hash = dict_hash(key, strlen(key));
-    slot = dict_lookup(d, key, hash);
-    if (slot) {
-        slot->key = xstrdup(key);
-        if (!(slot->key)) {
-            return -1;
+/** Move a few slots of the old index into the current one */
+static void dict_rehash_step(dict *d, uint32_t step)
+{
+    uint32_t end, ix;
+    uint32_t *slot;
+
+    if (!d->old_index) {
+        return;
+    }
+    end = d->rehash_idx + step;
+    if (end > d->old_size || end < d->rehash_idx) {
+        end = d->old_size;
+    }
+    for (; d->rehash_idx < end; d->rehash_idx++) {
+        ix = d->old_index[d->rehash_idx];
+        if (ix == DICT_IX_EMPTY || ix == DICT_IX_DUMMY) {
+            continue;
         }
-#if 0
-        slot->val = val ? xstrdup(val) : val;
-        if (val && !(slot->val)) {
-            free(slot->key);
-            return -1;
+        slot = index_free_slot(d, dict_entry(d, ix - DICT_IX_BASE)->hash);
+        if (*slot == DICT_IX_EMPTY) {
+            d->fill++;
         }
+        *slot = ix;
+    }
+    if (d->rehash_idx == d->old_size) {
+#if DEBUG>2
+        printf("rehash of %d slots done\n", d->old_size);
 #endif
-        slot->val = val;
-        slot->hash = hash;
-        d->used++;
-        d->fill++;
-        if ((3*d->fill) >= (d->size*2)) {
-            if (dict_resize(d) != 0) {
-                return -1;
-            }
-        }
+        free(d->old_index);
+        d->old_index = NULL;
+        d->old_size = 0;
+        d->rehash_idx = 0;
     }
-    return 0;
 }
 
-/** Resize a dictionary */
+/** Start to resize the index, entries are moved by dict_rehash_step */
 static int dict_resize(dict *d)
 {
     uint32_t newsize;
-    keypair *oldtable;
-    uint32_t i;
-    uint32_t oldsize;
     uint32_t factor;
+    uint32_t *index;
+
+    /* only one rehash at a time */
+    dict_rehash_step(d, d->old_size);
 
-    newsize = d->size;
+    /* key pointers are only moved here, never from dict_del */
+    if (d->arena_bytes - d->arena_live > DICT_ARENA_WASTE &&
+        d->arena_bytes - d->arena_live > d->arena_live) {
+        arena_compact(d);
+    }
+
+    newsize = DICT_MIN_SZ;
     /*
      * Re-sizing factor depends on the current dict size.
-     * Small dicts will expand 4 times, bigger ones only 2 times
+     * Small dicts will expand 4 times, bigger ones only 2 times.
+     * If most of the fill are deleted slots, it is rebuilt in same size.
      */
     factor = (d->size>DICT_BIGSZ) ? 2 : 4;
     while (newsize <= (factor*d->used)) {
         newsize *= 2;
     }
-    /* Exit early if no re-sizing needed */
-    if (newsize == d->size)
-        return 0;
 #if DEBUG>2
     printf("resizing %d to %d (used: %d)\n", d->size, newsize, d->used);
 #endif
-    /* Shuffle pointers, re-allocate new table, re-insert data */
-    oldtable = d->table;
-    d->table = (keypair *)calloc(newsize, sizeof(keypair));
-    if (!(d->table)) {
+    index = (uint32_t *)calloc(newsize, sizeof(uint32_t));
+    if (!index) {
         /* Memory allocation failure */
         printf("%s: malloc failed %s\n", __func__, strerror(errno));
         return -1;
     }
-    oldsize = d->size;
+    d->old_index = d->index;
+    d->old_size = d->size;
+    d->rehash_idx = 0;
+    d->index = index;
     d->size = newsize;
-    d->used = 0;
     d->fill = 0;
-    for (i = 0; i < oldsize; i++) {
-        if (oldtable[i].key && (oldtable[i].key!=DUMMY_PTR)) {
-            dict_add_p(d, oldtable[i].key, oldtable[i].val);
+    /*
+     * new index is at least twice of used, so it takes more than size/6
+     * adds to fill it up again, the old index must be drained before that
+     */
+    d->rehash_step = DICT_REHASH_STEP + 8 * (d->old_size / newsize);
+    dict_rehash_step(d, d->rehash_step);
+    return 0;
+}
+
+/** Lookup key in both index, return the slot or NULL */
+static uint32_t *dict_lookup(dict *d, char *key, uint32_t hash)
+{
+    uint32_t *slot;
+
+    dict_rehash_step(d, d->rehash_step);
+    slot = index_lookup(d, d->index, d->size, 0, key, hash);
+    if (!slot && d->old_index) {
+        slot = index_lookup(d, d->old_index, d->old_size, d->rehash_idx, key, hash);
+    }
+    return slot;
+}
+
+static uint32_t dict_entry_alloc(dict *d)
+{
+    uint32_t id;
+    keypair **segs;
+    uint32_t nsegs;
+
+    if (d->free_list != DICT_NIL) {
+        id = d->free_list;
+        d->free_list = dict_entry(d, id)->next;
+        return id;
+    }
+    if ((d->nentries >> DICT_SEG_BITS) == d->nsegs) {
+        nsegs = d->nsegs ? d->nsegs * 2 : 4;
+        segs = (keypair **)realloc(d->segs, nsegs * sizeof(keypair *));
+        if (!segs) {
+            printf("%s: malloc failed %s\n", __func__, strerror(errno));
+            return DICT_NIL;
         }
+        memset(segs + d->nsegs, 0, (nsegs - d->nsegs) * sizeof(keypair *));
+        d->segs = segs;
+        d->nsegs = nsegs;
     }
-    free(oldtable);
-    return 0 ;
+    if (!d->segs[d->nentries >> DICT_SEG_BITS]) {
+        d->segs[d->nentries >> DICT_SEG_BITS] =
+            (keypair *)calloc(DICT_SEG_SIZE, sizeof(keypair));
+        if (!d->segs[d->nentries >> DICT_SEG_BITS]) {
+            printf("%s: malloc failed %s\n", __func__, strerror(errno));
+            return DICT_NIL;
+        }
+    }
+    return d->nentries++;
+}
+
+/** Add an item to a dictionary by copying key into the dict. */
+int dict_add(dict *d, char *key, char *val)
+{
+    uint32_t hash;
+    uint32_t *slot;
+    uint32_t id;
+    keypair *kp;
+
+    if (!d || !key) {
+        return -1;
+    }
+
+#if DEBUG>2
+    printf("dict_add[%s][%s]\n", key, val ? val : "UNDEF");
+#endif
+    if (d->image) {
+        printf("%s: dict image is read-only\n", __func__);
+        return -1;
+    }
+    hash = dict_hash(d, key, strlen(key));
+    slot = dict_lookup(d, key, hash);
+    if (slot) {
+        /* same key, only replace val, val is not copied */
+        dict_entry(d, *slot - DICT_IX_BASE)->val = val;
+        return 0;
+    }
+    id = dict_entry_alloc(d);
+    if (id == DICT_NIL) {
+        return -1;
+    }
+    kp = dict_entry(d, id);
+    kp->key = arena_strdup(d, key);
+    if (!kp->key) {
+        kp->next = d->free_list;
+        d->free_list = id;
+        return -1;
+    }
+    kp->val = val;
+    kp->hash = hash;
+    kp->next = DICT_NIL;
+    kp->prev = d->tail;
+    if (d->tail != DICT_NIL) {
+        dict_entry(d, d->tail)->next = id;
+    } else {
+        d->head = id;
+    }
+    d->tail = id;
+
+    slot = index_free_slot(d, hash);
+    if (*slot == DICT_IX_EMPTY) {
+        d->fill++;
+    }
+    *slot = id + DICT_IX_BASE;
+    d->used++;
+    if ((3*d->fill) >= (d->size*2)) {
+        if (dict_resize(d) != 0) {
+            return -1;
+        }
+    }
+    return 0;
 }
 
 /** Public: allocate a new dict */
@@ -310,54 +417,71 @@ dict *dict_new(void)
         return NULL;
     }
     d->size = DICT_MIN_SZ;
+    d->hash_fn = HASH_MURMUR;
     d->used = 0;
     d->fill = 0;
-    d->table = (keypair *)calloc(DICT_MIN_SZ, sizeof(keypair));
-    if (!d->table) {
+    d->head = DICT_NIL;
+    d->tail = DICT_NIL;
+    d->free_list = DICT_NIL;
+    d->index = (uint32_t *)calloc(DICT_MIN_SZ, sizeof(uint32_t));
+    if (!d->index) {
         printf("%s: malloc failed %s\n", __func__, strerror(errno));
         free(d);
         return NULL;
     }
-    memset(d->table, -1, DICT_MIN_SZ*sizeof(keypair));
     return d;
 }
 
-/** Public: deallocate a dict */
+/** Public: deallocate a dict, val is not copyed, no need to free */
 void dict_free(dict *d)
 {
-    int i;
+    uint32_t i;
     if (!d)
         return;
 
-    for (i = 0; i < (int)d->size; i++) {
-        if (d->table[i].key && d->table[i].key != DUMMY_PTR) {
-            free(d->table[i].key);
-#if 0
-//val is not copyed, no need to free
-            if (d->table[i].val)
-                free(d->table[i].val);
-#endif
-        }
+    hash_close_image(d->image);
+    for (i = 0; i < d->nsegs; i++) {
+        free(d->segs[i]);
     }
-    free(d->table);
+    free(d->segs);
+    arena_free(d->arena);
+    free(d->old_index);
+    free(d->index);
     free(d);
     return ;
 }
 
+/** Public: select hash function, only allowed on empty dict */
+int dict_set_hash_fn(dict *d, enum hash_fn_id id, uint32_t seed)
+{
+    if (!d || d->used > 0) {
+        return -1;
+    }
+    d->hash_fn = id;
+    d->seed = seed;
+    return 0;
+}
+
 /** Public: get an item from a dict */
 char *dict_get(dict *d, char *key, char *defval)
 {
-    keypair *kp;
+    uint32_t *slot;
     uint32_t hash;
 
     if (!d || !key) {
         return defval;
     }
+    if (d->image) {
+        if (!hash_image_has(d->image, key)) {
+            return defval;
+        }
+        return (char *)hash_image_get(d->image, key, NULL);
+    }
 
-    hash = dict_hash(key, strlen(key));
-    kp = dict_lookup(d, key, hash);
-    if (kp) {
-        return kp->val;
+    hash = dict_hash(d, key, strlen(key));
+    slot = dict_lookup(d, key, hash);
+    if (slot) {
+        return dict_entry(d, *slot - DICT_IX_BASE)->val;
     }
     return defval;
 }
@@ -366,49 +490,78 @@ char *dict_get(dict *d, char *key, char *defval)
 int dict_del(dict *d, char *key)
 {
     uint32_t hash;
+    uint32_t *slot;
+    uint32_t id;
     keypair *kp;
 
     if (!d || !key) {
         return -1;
     }
 
-    hash = dict_hash(key, strlen(key));
-    kp = dict_lookup(d, key, hash);
-    if (!kp)
+    if (d->image) {
+        printf("%s: dict image is read-only\n", __func__);
         return -1;
-    if (kp->key && kp->key != DUMMY_PTR)
-        free(kp->key);
-    kp->key = (char *)DUMMY_PTR;
-#if 0
-    if (kp->val)
-        free(kp->val);
-#endif
+    }
+    hash = dict_hash(d, key, strlen(key));
+    slot = dict_lookup(d, key, hash);
+    if (!slot)
+        return -1;
+    id = *slot - DICT_IX_BASE;
+    *slot = DICT_IX_DUMMY;
+    kp = dict_entry(d, id);
+    if (kp->prev != DICT_NIL) {
+        dict_entry(d, kp->prev)->next = kp->next;
+    } else {
+        d->head = kp->next;
+    }
+    if (kp->next != DICT_NIL) {
+        dict_entry(d, kp->next)->prev = kp->prev;
+    } else {
+        d->tail = kp->prev;
+    }
+    d->arena_live -= strlen(kp->key) + 1;
+    kp->key = NULL;
     kp->val = NULL;
+    kp->next = d->free_list;
+    d->free_list = id;
     d->used--;
     return 0;
 }
 
-/** Public: enumerate a dictionary */
+/**
+ * Public: enumerate a dictionary in insertion order
+ * rank is a cursor, start from 0, pass the returned value to get next item,
+ * -1 is returned when no more item. Deleting the item just returned is
+ * allowed, other modifications invalidate the cursor.
+ */
 int dict_enumerate(dict * d, int rank, char ** key, char ** val)
 {
+    uint32_t id;
+    keypair *kp;
+
     if (!d || !key || !val || (rank<0)) {
         return -1 ;
     }
+    if (d->image) {
+        rank = hash_image_enumerate(d->image, rank, (const char **)key,
+                                    (const void **)val, NULL);
+        if (rank < 0) {
+            *key = NULL;
+            *val = NULL;
+        }
+        return rank;
+    }
 
-    while ((d->table[rank].key == NULL || d->table[rank].key == DUMMY_PTR)
-            && (rank < (int)d->size))
-        rank++;
-
-    if (rank >= (int)d->size) {
+    id = (rank == 0) ? d->head : (uint32_t)rank - 1;
+    if (rank == DICT_CURSOR_END || id == DICT_NIL) {
         *key = NULL;
         *val = NULL;
-        rank = -1;
-    } else {
-        *key = d->table[rank].key;
-        *val = d->table[rank].val;
-        rank++;
+        return -1;
     }
-    return rank;
+    kp = dict_entry(d, id);
+    *key = kp->key;
+    *val = kp->val;
+    return (kp->next == DICT_NIL) ? DICT_CURSOR_END : (int)kp->next + 1;
 }
 
 /** Public: dump a dict to a file pointer */
@@ -461,3 +614,55 @@ void dict_get_key_list(dict *d, key_list **klist)
         //fprintf(stderr, "%20s: %s\n", key, val ? val : "UNDEF");
     }
 }
+
+/** Public: save a dict into a read-only image file */
+int dict_save_image(dict *d, const char *path)
+{
+    struct hash_image_item *items;
+    char *key, *val;
+    int rank = 0;
+    uint32_t n = 0;
+    int ret;
+
+    if (!d || !path) {
+        return -1;
+    }
+    items = (struct hash_image_item *)calloc(d->used ? d->used : 1,
+                                             sizeof(struct hash_image_item));
+    if (!items) {
+        printf("%s: malloc failed %s\n", __func__, strerror(errno));
+        return -1;
+    }
+    while (n < d->used) {
+        rank = dict_enumerate(d, rank, &key, &val);
+        if (rank < 0)
+            break;
+        items[n].key = key;
+        items[n].val = val;
+        items[n].len = val ? strlen(val) : 0;
+        n++;
+    }
+    ret = hash_image_write(path, d->hash_fn, d->seed, items, n);
+    free(items);
+    return ret;
+}
+
+/** Public: open a read-only dict from image file */
+dict *dict_open_image(const char *path)
+{
+    dict *d = (dict *)calloc(1, sizeof(dict));
+    if (!d) {
+        printf("%s: malloc failed %s\n", __func__, strerror(errno));
+        return NULL;
+    }
+    d->image = hash_open_image(path);
+    if (!d->image) {
+        free(d);
+        return NULL;
+    }
+    d->used = hash_image_count(d->image);
+    d->head = DICT_NIL;
+    d->tail = DICT_NIL;
+    d->free_list = DICT_NIL;
+    return d;
+}
@@ -25,24 +25,45 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <libhash.h>
 
-#define LIBDICT_VERSION "0.1.0"
+#define LIBDICT_VERSION "0.3.0"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct _keypair_ {
-    char *key;
-    char *val;
+    char *key;          /* NULL if entry is free, points into dict arena */
+    char *val;          /* not copied, owned by caller */
     uint32_t hash;
+    uint32_t prev;      /* insertion order list */
+    uint32_t next;
 } keypair;
 
+struct dict_arena;
+
 typedef struct _dict_ {
     uint32_t fill;
     uint32_t used;
     uint32_t size;
-    keypair *table;
+    uint32_t *index;            /* slot -> entry id */
+    uint32_t *old_index;        /* index being rehashed into index */
+    uint32_t old_size;
+    uint32_t rehash_idx;
+    uint32_t rehash_step;
+    keypair **segs;             /* fixed size entry segments */
+    uint32_t nsegs;
+    uint32_t nentries;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t free_list;
+    struct dict_arena *arena;   /* key strings */
+    size_t arena_bytes;
+    size_t arena_live;
+    enum hash_fn_id hash_fn;
+    uint32_t seed;
+    struct hash_image *image;   /* read-only dict opened by dict_open_image */
 } dict;
 
 typedef struct _key_list_ {
@@ -53,6 +74,12 @@ typedef struct _key_list_ {
 
 dict *dict_new(void);
 void dict_free(dict *d);
+int dict_set_hash_fn(dict *d, enum hash_fn_id id, uint32_t seed);
+/*
+ * keys returned by dict_enumerate point into the dict, they stay valid
+ * until the key is deleted or a dict_add resizes the index, which may
+ * compact the key arena and move every key.
+ */
 int dict_add(dict *d, char *key, char *val);
 int dict_del(dict *d, char * key);
 char *dict_get(dict *d, char *key, char *defval);
@@ -60,6 +87,15 @@ int dict_enumerate(dict *d, int rank, char **key, char **val);
 void dict_dump(dict *d, FILE *out);
 void dict_get_key_list(dict *d, key_list **klist);
 
+/*
+ * save dict to a read-only image file, val is saved as string.
+ * dict_open_image maps image and returns a read-only dict, dict_get and
+ * dict_enumerate work in place on the mapping, dict_add/dict_del fail.
+ * release it by dict_free.
+ */
+int dict_save_image(dict *d, const char *path);
+dict *dict_open_image(const char *path);
+
 #ifdef __cplusplus
 }
 #endif
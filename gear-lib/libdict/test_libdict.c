@@ -37,11 +37,16 @@ double epoch_double()
 int test(int argc, char * argv[])
 {
     dict * d;
+    dict * di;
     double t1, t2;
     int i;
     int nkeys;
+    int rank, cnt, miss;
     char * buffer;
+    char * key;
     char * val;
+    char * last;
+    double t, worst;
 
     nkeys = (argc>1) ? (int)atoi(argv[1]) : NKEYS;
     printf("%15s: %d\n", "values", nkeys);
@@ -59,18 +64,29 @@ int test(int argc, char * argv[])
     t2 = epoch_double();
     printf(ALIGN, "initialization", t2 - t1);
 
+    worst = 0;
     t1 = epoch_double();
     for(i = 0; i < nkeys; i++) {
+        t = epoch_double();
         dict_add(d, buffer + i*9, buffer +i*9);
+        t = epoch_double() - t;
+        if (t > worst) {
+            worst = t;
+        }
         //printf("hash_set: key=%p, val=%p\n", buffer + i*9, buffer + i*9);
     }
     //dict_dump(d, stdout);
     t2 = epoch_double();
     printf(ALIGN, "adding", t2 - t1);
+    printf(ALIGN, "worst add", worst);
 
     t1 = epoch_double();
+    miss = 0;
     for(i = 0; i < nkeys; i++) {
         val = dict_get(d, buffer + i*9, (char *)"UNDEF");
+        if (val != buffer + i*9) {
+            miss++;
+        }
         if (0) {
         printf("hash_get: key=%p, val=%p\n", buffer + i*9, val);
         }
@@ -83,13 +99,67 @@ int test(int argc, char * argv[])
     }
     t2 = epoch_double();
     printf(ALIGN, "lookup", t2 - t1);
+    if (miss) {
+        printf("lookup failed: %d keys missing\n", miss);
+    }
+
+    t1 = epoch_double();
+    cnt = 0;
+    rank = 0;
+    while (1) {
+        rank = dict_enumerate(d, rank, &key, &val);
+        if (rank < 0)
+            break;
+        cnt++;
+    }
+    t2 = epoch_double();
+    printf(ALIGN, "enumerate", t2 - t1);
+    if (cnt != nkeys) {
+        printf("enumerate failed: got %d items, expect %d\n", cnt, nkeys);
+    }
 
 //    if (nkeys<100)
 //        dict_dump(d, stdout);
 
+    t1 = epoch_double();
+    dict_save_image(d, "test_libdict.img");
+    t2 = epoch_double();
+    printf(ALIGN, "save image", t2 - t1);
+    t1 = epoch_double();
+    di = dict_open_image("test_libdict.img");
+    t2 = epoch_double();
+    printf(ALIGN, "open image", t2 - t1);
+    if (di) {
+        miss = 0;
+        t1 = epoch_double();
+        for(i = 0; i < nkeys; i++) {
+            val = dict_get(di, buffer + i*9, NULL);
+            if (!val || strcmp(val, buffer + i*9)) {
+                miss++;
+            }
+        }
+        t2 = epoch_double();
+        printf(ALIGN, "image lookup", t2 - t1);
+        if (miss || dict_add(di, (char *)"x", NULL) == 0) {
+            printf("image failed: %d keys missing\n", miss);
+        }
+        dict_free(di);
+    } else {
+        printf("open image failed\n");
+    }
+    remove("test_libdict.img");
+
+    /* a key pointer from dict_enumerate must survive deleting the others */
+    last = NULL;
+    for (rank = 0; (rank = dict_enumerate(d, rank, &key, &val)) >= 0; ) {
+        last = key;
+    }
     t1 = epoch_double();
     for(i = 0; i < nkeys; i++) {
         //printf("dict_del %d, string = %s\n", i, buffer+i*9);
+        if (i == nkeys - 1 && (!last || strcmp(last, buffer + i*9))) {
+            printf("delete moved key %s\n", last ? last : "(null)");
+        }
         dict_del(d, buffer + i*9);
     }
     t2 = epoch_double();
@@ -158,6 +158,10 @@ struct file *file_open(const char *path, file_open_mode_t mode)
     }
     file->ops = file_ops[backend];
     file->fd = file->ops->_open(path, mode);
+    if (!file->fd) {
+        free(file);
+        return NULL;
+    }
     return file;
 }
 
@@ -13,6 +13,6 @@ LIBRARIES_DIR	:= $(LOCAL_PATH)/../
 LOCAL_C_INCLUDES := $(LOCAL_PATH)
 
 # Add your application source files here...
-LOCAL_SRC_FILES := libhash.c
+LOCAL_SRC_FILES := libhash.c hash_open.c hash_list.c hash_concurrent.c hash_image.c
 
 include $(BUILD_SHARED_LIBRARY)
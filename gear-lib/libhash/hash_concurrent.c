@@ -0,0 +1,532 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libhash.h"
+#include <libposix.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+/*
+ * [table]
+ * [bucket0] -> node -> node -> ...
+ * [bucket1] -> node -> ...
+ * ...
+ *
+ * readers walk the chains without lock, writers take the stripe lock of
+ * hash, so writers of different keys rarely contend.
+ *
+ * memory reclamation is epoch based: reader increases counter of current
+ * epoch parity when enter and decreases it when leave. Unlinked nodes are
+ * retired to a list, when list is long enough the epoch is flipped and the
+ * writer waits all readers of previous parity to leave before freeing them.
+ *
+ * when table is overloaded, all stripe locks are taken and chains are
+ * copied into a bigger table, old table is retired like nodes so readers
+ * still walking it are safe.
+ */
+
+#define HASH_MAX_KEY_STRLEN 32
+#define CHASH_STRIPES       64
+#define CHASH_READERS       16
+#define CHASH_RETIRE_BATCH  64
+#define CHASH_MAX_LOAD      2
+#define CACHELINE_SIZE      64
+
+#if defined (__GNUC__)
+#define ATOMIC_LOAD(p)          __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v)      __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define ATOMIC_ADD(p, v)        __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST)
+#define ATOMIC_LOAD_SEQ(p)      __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#elif defined (OS_WINDOWS)
+#define ATOMIC_LOAD(p)          (MemoryBarrier(), *(p))
+#define ATOMIC_STORE(p, v)      do { MemoryBarrier(); *(p) = (v); } while (0)
+#define ATOMIC_ADD(p, v)        (InterlockedExchangeAdd((volatile LONG *)(p), (v)) + (v))
+#define ATOMIC_LOAD_SEQ(p)      (MemoryBarrier(), *(p))
+#endif
+
+struct chash_node {
+    struct chash_node *next;
+    struct chash_node *retire_next;
+    uint32_t hash;
+    void *val;
+    char key[1];
+};
+
+struct chash_table {
+    uint32_t bucket;
+    struct chash_node **heads;
+    struct chash_table *retire_next;
+};
+
+struct chash_reader {
+    long cnt[2];
+    char pad[CACHELINE_SIZE - 2 * sizeof(long)];
+};
+
+struct chash {
+    struct chash_table *table;
+    long count;
+    unsigned long epoch;
+    struct chash_reader reader[CHASH_READERS];
+    pthread_mutex_t lock[CHASH_STRIPES];
+    pthread_mutex_t retire_lock;
+    struct chash_node *retire_nodes;
+    struct chash_table *retire_tables;
+    int retire_cnt;
+    void (*destory)(void *val);
+};
+
+static int reader_shard(void)
+{
+    /* no TLS in every platform, threads run on different stacks instead */
+    int local;
+    uintptr_t addr = (uintptr_t)&local;
+    return (int)((addr >> 12) ^ (addr >> 16) ^ (addr >> 24)) & (CHASH_READERS - 1);
+}
+
+static int reader_enter(struct chash *h, int *shard)
+{
+    unsigned long epoch;
+    int idx;
+    *shard = reader_shard();
+    for (;;) {
+        epoch = ATOMIC_LOAD(&h->epoch);
+        idx = epoch & 1;
+        ATOMIC_ADD(&h->reader[*shard].cnt[idx], 1);
+        /*
+         * if epoch flipped before counter visible, writer may have missed
+         * this reader, leave and enter again with new epoch
+         */
+        if (ATOMIC_LOAD_SEQ(&h->epoch) == epoch) {
+            return idx;
+        }
+        ATOMIC_ADD(&h->reader[*shard].cnt[idx], -1);
+    }
+}
+
+static void reader_leave(struct chash *h, int shard, int idx)
+{
+    ATOMIC_ADD(&h->reader[shard].cnt[idx], -1);
+}
+
+/* wait all readers which may see retired memory, call with retire_lock */
+static void synchronize(struct chash *h)
+{
+    int i;
+    int idx = ATOMIC_LOAD(&h->epoch) & 1;
+    ATOMIC_ADD(&h->epoch, 1);
+    for (i = 0; i < CHASH_READERS; i++) {
+        while (ATOMIC_LOAD_SEQ(&h->reader[i].cnt[idx]) != 0) {
+            sched_yield();
+        }
+    }
+}
+
+static void table_free(struct chash_table *t, int free_nodes)
+{
+    struct chash_node *n, *next;
+    uint32_t i;
+    if (free_nodes) {
+        for (i = 0; i < t->bucket; i++) {
+            for (n = t->heads[i]; n; n = next) {
+                next = n->next;
+                free(n);
+            }
+        }
+    }
+    free(t->heads);
+    free(t);
+}
+
+static void reclaim(struct chash *h)
+{
+    struct chash_node *n, *next_n;
+    struct chash_table *t, *next_t;
+
+    n = h->retire_nodes;
+    t = h->retire_tables;
+    h->retire_nodes = NULL;
+    h->retire_tables = NULL;
+    h->retire_cnt = 0;
+    synchronize(h);
+    for (; n; n = next_n) {
+        next_n = n->retire_next;
+        free(n);
+    }
+    for (; t; t = next_t) {
+        next_t = t->retire_next;
+        table_free(t, 1);
+    }
+}
+
+static void retire(struct chash *h, struct chash_node *n, struct chash_table *t)
+{
+    pthread_mutex_lock(&h->retire_lock);
+    if (n) {
+        n->retire_next = h->retire_nodes;
+        h->retire_nodes = n;
+        h->retire_cnt++;
+    }
+    if (t) {
+        t->retire_next = h->retire_tables;
+        h->retire_tables = t;
+        h->retire_cnt += CHASH_RETIRE_BATCH;
+    }
+    if (h->retire_cnt >= CHASH_RETIRE_BATCH) {
+        reclaim(h);
+    }
+    pthread_mutex_unlock(&h->retire_lock);
+}
+
+static struct chash_table *table_alloc(uint32_t bucket)
+{
+    struct chash_table *t = (struct chash_table *)calloc(1, sizeof(*t));
+    if (!t) {
+        return NULL;
+    }
+    t->heads = (struct chash_node **)calloc(bucket, sizeof(struct chash_node *));
+    if (!t->heads) {
+        free(t);
+        return NULL;
+    }
+    t->bucket = bucket;
+    return t;
+}
+
+static struct chash_node *node_alloc(const char *key, size_t len,
+                uint32_t hash, void *val)
+{
+    struct chash_node *n;
+    n = (struct chash_node *)malloc(sizeof(*n) + len);
+    if (!n) {
+        printf("malloc chash_node failed!\n");
+        return NULL;
+    }
+    n->next = NULL;
+    n->retire_next = NULL;
+    n->hash = hash;
+    n->val = val;
+    memcpy(n->key, key, len + 1);
+    return n;
+}
+
+static void grow(struct chash *h)
+{
+    struct chash_table *old, *t;
+    struct chash_node *n, *c;
+    uint32_t i, b;
+
+    for (i = 0; i < CHASH_STRIPES; i++) {
+        pthread_mutex_lock(&h->lock[i]);
+    }
+    old = h->table;
+    if (ATOMIC_LOAD(&h->count) <= (long)old->bucket * CHASH_MAX_LOAD) {
+        goto exit; /* other writer has done it */
+    }
+    t = table_alloc(old->bucket * 2);
+    if (!t) {
+        goto exit;
+    }
+    /* copy instead of relink, readers may still be walking old chains */
+    for (i = 0; i < old->bucket; i++) {
+        for (n = old->heads[i]; n; n = n->next) {
+            c = node_alloc(n->key, strlen(n->key), n->hash, n->val);
+            if (!c) {
+                table_free(t, 1);
+                goto exit;
+            }
+            b = c->hash & (t->bucket - 1);
+            c->next = t->heads[b];
+            t->heads[b] = c;
+        }
+    }
+    ATOMIC_STORE(&h->table, t);
+    for (i = 0; i < CHASH_STRIPES; i++) {
+        pthread_mutex_unlock(&h->lock[CHASH_STRIPES - 1 - i]);
+    }
+    retire(h, NULL, old);
+    return;
+
+exit:
+    for (i = 0; i < CHASH_STRIPES; i++) {
+        pthread_mutex_unlock(&h->lock[CHASH_STRIPES - 1 - i]);
+    }
+}
+
+struct chash *chash_create(int bucket)
+{
+    int i;
+    uint32_t n = 16;
+    struct chash *h = (struct chash *)calloc(1, sizeof(*h));
+    if (!h) {
+        return NULL;
+    }
+    while (n < (uint32_t)bucket) {
+        n <<= 1;
+    }
+    h->table = table_alloc(n);
+    if (!h->table) {
+        free(h);
+        return NULL;
+    }
+    for (i = 0; i < CHASH_STRIPES; i++) {
+        pthread_mutex_init(&h->lock[i], NULL);
+    }
+    pthread_mutex_init(&h->retire_lock, NULL);
+    return h;
+}
+
+void chash_destroy(struct chash *h)
+{
+    struct chash_node *n;
+    uint32_t i;
+    if (!h) {
+        return;
+    }
+    pthread_mutex_lock(&h->retire_lock);
+    reclaim(h);
+    pthread_mutex_unlock(&h->retire_lock);
+    if (h->destory) {
+        for (i = 0; i < h->table->bucket; i++) {
+            for (n = h->table->heads[i]; n; n = n->next) {
+                h->destory(n->val);
+            }
+        }
+    }
+    table_free(h->table, 1);
+    for (i = 0; i < CHASH_STRIPES; i++) {
+        pthread_mutex_destroy(&h->lock[i]);
+    }
+    pthread_mutex_destroy(&h->retire_lock);
+    free(h);
+}
+
+void chash_set_destory(struct chash *h, void (*destory)(void *val))
+{
+    h->destory = destory;
+}
+
+/* call with stripe lock, or inside reader section */
+static struct chash_node *chash_lookup(struct chash_table *t, const char *key,
+                uint32_t hash, struct chash_node ***prev)
+{
+    struct chash_node **pn = &t->heads[hash & (t->bucket - 1)];
+    struct chash_node *n;
+    for (n = ATOMIC_LOAD(pn); n; pn = &n->next, n = ATOMIC_LOAD(pn)) {
+        if (n->hash == hash && strcmp(n->key, key) == 0) {
+            break;
+        }
+    }
+    if (prev) {
+        *prev = pn;
+    }
+    return n;
+}
+
+void *chash_get(struct chash *h, const char *key)
+{
+    struct chash_node *n;
+    void *val = NULL;
+    uint32_t hash = hash_gen32(key, strlen(key));
+    int shard;
+    int idx = reader_enter(h, &shard);
+    n = chash_lookup(ATOMIC_LOAD(&h->table), key, hash, NULL);
+    if (n) {
+        val = ATOMIC_LOAD(&n->val);
+    }
+    reader_leave(h, shard, idx);
+    return val;
+}
+
+/*
+ * all writers go through here: find key under stripe lock, call cb to get
+ * the new val, then update, insert or remove node.
+ */
+static void *chash_update(struct chash *h, const char *key,
+                chash_compute_cb cb, void *arg, int *ret)
+{
+    struct chash_table *t;
+    struct chash_node *n, **prev;
+    struct chash_node *removed = NULL;
+    size_t len = strlen(key);
+    uint32_t hash = hash_gen32(key, len);
+    pthread_mutex_t *lock = &h->lock[hash & (CHASH_STRIPES - 1)];
+    void *cur, *val;
+    int need_grow = 0;
+
+    *ret = 0;
+    pthread_mutex_lock(lock);
+    t = h->table;
+    n = chash_lookup(t, key, hash, &prev);
+    cur = n ? n->val : NULL;
+    val = cb(key, cur, arg);
+    if (n && val) {
+        ATOMIC_STORE(&n->val, val);
+    } else if (n) {
+        ATOMIC_STORE(prev, n->next);
+        ATOMIC_ADD(&h->count, -1);
+        removed = n;
+    } else if (val) {
+        n = node_alloc(key, len, hash, val);
+        if (!n) {
+            *ret = -1;
+            val = NULL;
+        } else {
+            n->next = *prev;
+            ATOMIC_STORE(prev, n);
+            need_grow = ATOMIC_ADD(&h->count, 1) > (long)t->bucket * CHASH_MAX_LOAD;
+        }
+    }
+    pthread_mutex_unlock(lock);
+
+    if (removed) {
+        retire(h, removed, NULL);
+    }
+    if (need_grow) {
+        grow(h);
+    }
+    return val;
+}
+
+struct chash_arg {
+    void *val;
+    void *old;
+    int exist;
+};
+
+static void *set_cb(const char *key, void *val, void *arg)
+{
+    struct chash_arg *a = (struct chash_arg *)arg;
+    a->old = val;
+    a->exist = (val != NULL);
+    return a->val;
+}
+
+static void *get_or_insert_cb(const char *key, void *val, void *arg)
+{
+    struct chash_arg *a = (struct chash_arg *)arg;
+    a->exist = (val != NULL);
+    if (val) {
+        a->old = val;
+        return val;
+    }
+    return a->val;
+}
+
+int chash_set(struct chash *h, const char *key, void *val)
+{
+    struct chash_arg a = {val, NULL, 0};
+    int ret;
+    chash_update(h, key, set_cb, &a, &ret);
+    return ret;
+}
+
+void *chash_get_and_del(struct chash *h, const char *key)
+{
+    struct chash_arg a = {NULL, NULL, 0};
+    int ret;
+    chash_update(h, key, set_cb, &a, &ret);
+    return a.old;
+}
+
+int chash_del(struct chash *h, const char *key)
+{
+    struct chash_arg a = {NULL, NULL, 0};
+    int ret;
+    chash_update(h, key, set_cb, &a, &ret);
+    return a.exist ? 0 : -1;
+}
+
+void *chash_get_or_insert(struct chash *h, const char *key, void *val, int *inserted)
+{
+    struct chash_arg a = {val, NULL, 0};
+    int ret;
+    void *cur = chash_get(h, key);
+    if (cur) {
+        if (inserted) {
+            *inserted = 0;
+        }
+        return cur;
+    }
+    cur = chash_update(h, key, get_or_insert_cb, &a, &ret);
+    if (inserted) {
+        *inserted = (!a.exist && !ret);
+    }
+    return cur;
+}
+
+void *chash_compute(struct chash *h, const char *key, chash_compute_cb cb, void *arg)
+{
+    int ret;
+    return chash_update(h, key, cb, arg, &ret);
+}
+
+int chash_get_all_cnt(struct chash *h)
+{
+    return (int)ATOMIC_LOAD(&h->count);
+}
+
+void *chash_get32(struct chash *h, uint32_t key)
+{
+    char key_str[HASH_MAX_KEY_STRLEN];
+    snprintf(key_str, sizeof(key_str), "%" PRIu32, key);
+    return chash_get(h, key_str);
+}
+
+int chash_set32(struct chash *h, uint32_t key, void *val)
+{
+    char key_str[HASH_MAX_KEY_STRLEN];
+    snprintf(key_str, sizeof(key_str), "%" PRIu32, key);
+    return chash_set(h, key_str, val);
+}
+
+int chash_del32(struct chash *h, uint32_t key)
+{
+    char key_str[HASH_MAX_KEY_STRLEN];
+    snprintf(key_str, sizeof(key_str), "%" PRIu32, key);
+    return chash_del(h, key_str);
+}
+
+void *chash_get_and_del32(struct chash *h, uint32_t key)
+{
+    char key_str[HASH_MAX_KEY_STRLEN];
+    snprintf(key_str, sizeof(key_str), "%" PRIu32, key);
+    return chash_get_and_del(h, key_str);
+}
+
+void *chash_get_or_insert32(struct chash *h, uint32_t key, void *val, int *inserted)
+{
+    char key_str[HASH_MAX_KEY_STRLEN];
+    snprintf(key_str, sizeof(key_str), "%" PRIu32, key);
+    return chash_get_or_insert(h, key_str, val, inserted);
+}
+
+void *chash_compute32(struct chash *h, uint32_t key, chash_compute_cb cb, void *arg)
+{
+    char key_str[HASH_MAX_KEY_STRLEN];
+    snprintf(key_str, sizeof(key_str), "%" PRIu32, key);
+    return chash_compute(h, key_str, cb, arg);
+}
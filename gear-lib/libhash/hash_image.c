@@ -0,0 +1,508 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libhash.h"
+#include <libposix.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#if defined (OS_WINDOWS)
+#elif defined (OS_RTOS)
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/*
+ * hash image is a read-only hash table file, all references are offsets
+ * from the beginning of file, so it can be mapped at any address and shared
+ * by page cache between processes.
+ *
+ * |header|slot[nslot]|entry[count]|key\0 pad|val\0 pad|key\0 pad|...
+ *
+ * slot is open addressing with linear probing, at most half full.
+ * slot keeps the hash so that a miss does not touch the entries.
+ * key and val are NUL terminated and 8 bytes aligned, so a string or a
+ * struct val can be used directly from mapping.
+ * image is written in host byte order, open fails on other endian.
+ */
+
+#define IMAGE_MAGIC     "GEARHIMG"
+#define IMAGE_VERSION   1
+#define IMAGE_ENDIAN    0x01020304
+#define IMAGE_ALIGN(x)  (((x) + 7) & ~(uint64_t)7)
+
+struct image_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t hash_fn;
+    uint32_t seed;
+    uint32_t count;
+    uint32_t nslot;
+    uint64_t slot_off;
+    uint64_t entry_off;
+    uint64_t data_off;
+    uint64_t size;
+};
+
+struct image_slot {
+    uint32_t hash;
+    uint32_t entry;     /* entry index + 1, 0 is empty */
+};
+
+struct image_entry {
+    uint64_t key_off;
+    uint64_t val_off;
+    uint32_t key_len;
+    uint32_t val_len;   /* HASH_IMAGE_NULL if val is NULL */
+};
+
+struct hash_image {
+    const uint8_t *base;
+    uint64_t size;
+    const struct image_header *hdr;
+    const struct image_slot *slots;
+    const struct image_entry *entries;
+#if defined (OS_WINDOWS)
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+static uint32_t image_nslot(uint32_t count)
+{
+    uint32_t n = 16;
+    while (n < count * 2) {
+        n <<= 1;
+    }
+    return n;
+}
+
+int hash_image_write(const char *path, enum hash_fn_id fn, uint32_t seed,
+                const struct hash_image_item *items, uint32_t count)
+{
+    struct image_header hdr;
+    struct image_slot *slots = NULL;
+    struct image_entry *entries = NULL;
+    char tmp[1024];
+    static const char pad[8] = {0};
+    uint64_t off;
+    uint32_t i, idx, mask, hash;
+    size_t key_len, val_len;
+    FILE *fp = NULL;
+    int ret = -1;
+
+    if (!path || (!items && count)) {
+        return -1;
+    }
+    if (count >= 0x7FFFFFFF / 2) {
+        printf("%s: too many items %u\n", __func__, count);
+        return -1;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, IMAGE_MAGIC, sizeof(hdr.magic));
+    hdr.version = IMAGE_VERSION;
+    hdr.endian = IMAGE_ENDIAN;
+    hdr.hash_fn = fn;
+    hdr.seed = seed;
+    hdr.count = count;
+    hdr.nslot = image_nslot(count);
+    hdr.slot_off = sizeof(hdr);
+    hdr.entry_off = hdr.slot_off + (uint64_t)hdr.nslot * sizeof(struct image_slot);
+    hdr.data_off = hdr.entry_off + (uint64_t)count * sizeof(struct image_entry);
+
+    slots = (struct image_slot *)calloc(hdr.nslot, sizeof(struct image_slot));
+    entries = (struct image_entry *)calloc(count ? count : 1, sizeof(struct image_entry));
+    if (!slots || !entries) {
+        printf("%s: malloc failed %s\n", __func__, strerror(errno));
+        goto exit;
+    }
+    mask = hdr.nslot - 1;
+    off = hdr.data_off;
+    for (i = 0; i < count; i++) {
+        key_len = strlen(items[i].key);
+        val_len = items[i].val ? items[i].len : 0;
+        if (key_len >= HASH_IMAGE_NULL || val_len >= HASH_IMAGE_NULL) {
+            printf("%s: item %s too large\n", __func__, items[i].key);
+            goto exit;
+        }
+        entries[i].key_off = off;
+        entries[i].key_len = (uint32_t)key_len;
+        off = IMAGE_ALIGN(off + key_len + 1);
+        entries[i].val_off = off;
+        entries[i].val_len = items[i].val ? (uint32_t)val_len : HASH_IMAGE_NULL;
+        off = IMAGE_ALIGN(off + val_len + 1);
+
+        hash = hash_fn32(fn, items[i].key, key_len, seed);
+        idx = hash & mask;
+        while (slots[idx].entry) {
+            if (slots[idx].hash == hash &&
+                !strcmp(items[slots[idx].entry - 1].key, items[i].key)) {
+                printf("%s: duplicated key %s\n", __func__, items[i].key);
+                goto exit;
+            }
+            idx = (idx + 1) & mask;
+        }
+        slots[idx].hash = hash;
+        slots[idx].entry = i + 1;
+    }
+    hdr.size = off;
+
+    /* write to a temp file and rename, readers never see a partial image */
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "wb");
+    if (!fp) {
+        printf("%s: fopen %s failed %s\n", __func__, tmp, strerror(errno));
+        goto exit;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(slots, sizeof(struct image_slot), hdr.nslot, fp) != hdr.nslot ||
+        (count && fwrite(entries, sizeof(struct image_entry), count, fp) != count)) {
+        goto io_err;
+    }
+    for (i = 0; i < count; i++) {
+        key_len = entries[i].key_len;
+        val_len = items[i].val ? entries[i].val_len : 0;
+        if (fwrite(items[i].key, 1, key_len, fp) != key_len ||
+            fwrite(pad, 1, entries[i].val_off - entries[i].key_off - key_len, fp) !=
+                entries[i].val_off - entries[i].key_off - key_len ||
+            (val_len && fwrite(items[i].val, 1, val_len, fp) != val_len) ||
+            fwrite(pad, 1, IMAGE_ALIGN(val_len + 1) - val_len, fp) !=
+                IMAGE_ALIGN(val_len + 1) - val_len) {
+            goto io_err;
+        }
+    }
+    if (fflush(fp) != 0) {
+        goto io_err;
+    }
+    fclose(fp);
+    fp = NULL;
+#if defined (OS_WINDOWS)
+    remove(path);
+#endif
+    if (rename(tmp, path) != 0) {
+        printf("%s: rename %s failed %s\n", __func__, path, strerror(errno));
+        remove(tmp);
+        goto exit;
+    }
+    ret = 0;
+    goto exit;
+
+io_err:
+    printf("%s: write %s failed %s\n", __func__, tmp, strerror(errno));
+    fclose(fp);
+    remove(tmp);
+exit:
+    free(slots);
+    free(entries);
+    return ret;
+}
+
+struct save_ctx {
+    struct hash_image_item *items;
+    uint32_t count;
+    uint32_t max;
+    hash_image_val_cb cb;
+};
+
+static int save_item(const char *key, void *val, void *arg)
+{
+    struct save_ctx *ctx = (struct save_ctx *)arg;
+    struct hash_image_item *it;
+
+    if (ctx->count == ctx->max) {
+        return -1;
+    }
+    it = &ctx->items[ctx->count++];
+    it->key = key;
+    it->len = 0;
+    it->val = ctx->cb ? ctx->cb(key, val, &it->len) : NULL;
+    return 0;
+}
+
+int hash_save_image(struct hash *h, const char *path, hash_image_val_cb cb)
+{
+    struct save_ctx ctx;
+    int ret;
+
+    if (!h || !path) {
+        return -1;
+    }
+    ctx.max = hash_get_all_cnt(h);
+    ctx.count = 0;
+    ctx.cb = cb;
+    ctx.items = (struct hash_image_item *)calloc(ctx.max ? ctx.max : 1,
+                                                 sizeof(struct hash_image_item));
+    if (!ctx.items) {
+        printf("%s: malloc failed %s\n", __func__, strerror(errno));
+        return -1;
+    }
+    ret = hash_foreach(h, save_item, &ctx);
+    if (ret == 0) {
+        ret = hash_image_write(path, h->fn, h->seed, ctx.items, ctx.count);
+    }
+    free(ctx.items);
+    return ret;
+}
+
+static int image_map(struct hash_image *img, const char *path)
+{
+#if defined (OS_WINDOWS)
+    LARGE_INTEGER size;
+    img->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (img->file == INVALID_HANDLE_VALUE) {
+        printf("%s: open %s failed %lu\n", __func__, path, GetLastError());
+        return -1;
+    }
+    if (!GetFileSizeEx(img->file, &size) || size.QuadPart == 0) {
+        CloseHandle(img->file);
+        return -1;
+    }
+    img->mapping = CreateFileMappingA(img->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!img->mapping) {
+        CloseHandle(img->file);
+        return -1;
+    }
+    img->base = (const uint8_t *)MapViewOfFile(img->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!img->base) {
+        CloseHandle(img->mapping);
+        CloseHandle(img->file);
+        return -1;
+    }
+    img->size = size.QuadPart;
+    return 0;
+#elif defined (OS_RTOS)
+    /* no mmap, read whole image into memory */
+    long size;
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        printf("%s: fopen %s failed %s\n", __func__, path, strerror(errno));
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    img->base = (const uint8_t *)malloc(size > 0 ? size : 1);
+    if (size <= 0 || !img->base ||
+        fread((void *)img->base, 1, size, fp) != (size_t)size) {
+        free((void *)img->base);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    img->size = size;
+    return 0;
+#else
+    struct stat st;
+    void *p;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        printf("%s: open %s failed %s\n", __func__, path, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        printf("%s: mmap %s failed %s\n", __func__, path, strerror(errno));
+        return -1;
+    }
+    img->base = (const uint8_t *)p;
+    img->size = st.st_size;
+    return 0;
+#endif
+}
+
+static void image_unmap(struct hash_image *img)
+{
+#if defined (OS_WINDOWS)
+    UnmapViewOfFile(img->base);
+    CloseHandle(img->mapping);
+    CloseHandle(img->file);
+#elif defined (OS_RTOS)
+    free((void *)img->base);
+#else
+    munmap((void *)img->base, img->size);
+#endif
+}
+
+struct hash_image *hash_open_image(const char *path)
+{
+    struct hash_image *img;
+    const struct image_header *hdr;
+
+    if (!path) {
+        return NULL;
+    }
+    img = (struct hash_image *)calloc(1, sizeof(struct hash_image));
+    if (!img) {
+        printf("%s: malloc failed %s\n", __func__, strerror(errno));
+        return NULL;
+    }
+    if (image_map(img, path) != 0) {
+        free(img);
+        return NULL;
+    }
+    hdr = (const struct image_header *)img->base;
+    if (img->size < sizeof(*hdr) ||
+        memcmp(hdr->magic, IMAGE_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != IMAGE_VERSION || hdr->endian != IMAGE_ENDIAN ||
+        hdr->size != img->size || hdr->nslot == 0 ||
+        (hdr->nslot & (hdr->nslot - 1)) || hdr->count >= hdr->nslot ||
+        hdr->slot_off != sizeof(*hdr) ||
+        hdr->entry_off != hdr->slot_off + (uint64_t)hdr->nslot * sizeof(struct image_slot) ||
+        hdr->data_off != hdr->entry_off + (uint64_t)hdr->count * sizeof(struct image_entry) ||
+        hdr->data_off > img->size) {
+        printf("%s: %s is not a valid hash image\n", __func__, path);
+        image_unmap(img);
+        free(img);
+        return NULL;
+    }
+    img->hdr = hdr;
+    img->slots = (const struct image_slot *)(img->base + hdr->slot_off);
+    img->entries = (const struct image_entry *)(img->base + hdr->entry_off);
+#if defined (OS_LINUX)
+    madvise((void *)img->base, img->size, MADV_RANDOM);
+#endif
+    return img;
+}
+
+void hash_close_image(struct hash_image *img)
+{
+    if (!img) {
+        return;
+    }
+    image_unmap(img);
+    free(img);
+}
+
+int hash_image_count(struct hash_image *img)
+{
+    return img ? (int)img->hdr->count : 0;
+}
+
+/* entry is checked on access, a corrupted image must not crash reader */
+/* key and value must lie in the data area with their trailing NUL, the
+ * offsets come from the file so the sums are written not to overflow */
+static int image_entry_valid(struct hash_image *img, const struct image_entry *e)
+{
+    uint64_t val_len = (e->val_len == HASH_IMAGE_NULL) ? 0 : e->val_len;
+    return e->key_off >= img->hdr->data_off && e->key_off < img->size &&
+           e->key_len < img->size - e->key_off &&
+           img->base[e->key_off + e->key_len] == '\0' &&
+           e->val_off >= img->hdr->data_off && e->val_off < img->size &&
+           val_len < img->size - e->val_off &&
+           (e->val_len == HASH_IMAGE_NULL ||
+            img->base[e->val_off + val_len] == '\0');
+}
+
+static const struct image_entry *image_find(struct hash_image *img,
+                const char *key)
+{
+    const struct image_entry *e;
+    size_t len = strlen(key);
+    uint32_t hash = hash_fn32((enum hash_fn_id)img->hdr->hash_fn, key, len,
+                              img->hdr->seed);
+    uint32_t mask = img->hdr->nslot - 1;
+    uint32_t idx = hash & mask;
+    uint32_t n;
+
+    for (n = 0; n < img->hdr->nslot; n++) {
+        const struct image_slot *s = &img->slots[idx];
+        if (s->entry == 0 || s->entry > img->hdr->count) {
+            return NULL;
+        }
+        if (s->hash == hash) {
+            e = &img->entries[s->entry - 1];
+            if (e->key_len == len && image_entry_valid(img, e) &&
+                !memcmp(img->base + e->key_off, key, len)) {
+                return e;
+            }
+        }
+        idx = (idx + 1) & mask;
+    }
+    return NULL;
+}
+
+const void *hash_image_get(struct hash_image *img, const char *key, size_t *len)
+{
+    const struct image_entry *e;
+    if (!img || !key) {
+        return NULL;
+    }
+    e = image_find(img, key);
+    if (!e || e->val_len == HASH_IMAGE_NULL) {
+        return NULL;
+    }
+    if (len) {
+        *len = e->val_len;
+    }
+    return img->base + e->val_off;
+}
+
+const void *hash_image_get32(struct hash_image *img, uint32_t key, size_t *len)
+{
+    char key_str[32];
+    snprintf(key_str, sizeof(key_str), "%" PRIu32, key);
+    return hash_image_get(img, key_str, len);
+}
+
+int hash_image_has(struct hash_image *img, const char *key)
+{
+    if (!img || !key) {
+        return 0;
+    }
+    return image_find(img, key) != NULL;
+}
+
+int hash_image_enumerate(struct hash_image *img, int rank,
+                const char **key, const void **val, size_t *len)
+{
+    const struct image_entry *e;
+
+    if (!img || rank < 0 || (uint32_t)rank >= img->hdr->count) {
+        return -1;
+    }
+    e = &img->entries[rank];
+    if (!image_entry_valid(img, e)) {
+        return -1;
+    }
+    if (key) {
+        *key = (const char *)img->base + e->key_off;
+    }
+    if (val) {
+        *val = (e->val_len == HASH_IMAGE_NULL) ? NULL : img->base + e->val_off;
+    }
+    if (len) {
+        *len = (e->val_len == HASH_IMAGE_NULL) ? 0 : e->val_len;
+    }
+    return rank + 1;
+}
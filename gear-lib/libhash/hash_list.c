@@ -0,0 +1,230 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libhash.h"
+#include <libposix.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * [opaque]
+ * [bucket0] -> item[1] -> item[2] -> ... -> item[m0]
+ * [bucket1] -> item[1] -> item[2] -> ... -> item[m1]
+ * [bucket2] -> item[1] -> item[2] -> ... -> item[m2]
+ * ...
+ * [bucketn] -> item[1] -> item[2] -> ... -> item[mn]
+ * 
+ */
+
+struct hash_item {
+    struct hlist_node item;
+    uint32_t hash;
+    char *key;
+    void *val;
+};
+
+static struct hash_item *hash_lookup(struct hash *h, const char *key, uint32_t hash)
+{
+    struct hlist_head *list;
+    struct hash_item *hi;
+    struct hlist_node *next;
+    uint32_t i;
+
+    i = hash & (h->bucket-1);
+    list = &((struct hlist_head *)h->opaque)[i];
+
+#if defined (OS_LINUX) || defined (OS_RTOS)
+    hlist_for_each_entry_safe(hi, next, list, item) {
+#elif defined (OS_WINDOWS)
+    hlist_for_each_entry_safe(hi, struct hash_item, next, struct hlist_node, list, item) {
+#endif
+        if ((hi->hash == hash) && strcmp(hi->key, key) == 0) {
+            return hi;
+        }
+    }
+    return NULL;
+}
+
+static void *hash_list_init(int bucket)
+{
+    int i;
+    struct hlist_head *list;
+    list = (struct hlist_head *)calloc(bucket, sizeof(struct hlist_head));
+    if (!list) {
+        return NULL;
+    }
+    for (i = 0; i < bucket; i++) {
+        INIT_HLIST_HEAD(&list[i]);
+    }
+    return list;
+}
+
+static void hash_list_deinit(struct hash *h)
+{
+    int i;
+    struct hlist_head *list;
+    struct hash_item *hi;
+    struct hlist_node *next;
+    list = h->opaque;
+    for (i = 0; i < h->bucket; i++) {
+#if defined (OS_LINUX) || defined (OS_RTOS)
+        hlist_for_each_entry_safe(hi, next, &list[i], item) {
+#elif defined (OS_WINDOWS)
+        hlist_for_each_entry_safe(hi, struct hash_item, next, struct hlist_node, &list[i], item) {
+#endif
+            hlist_del((struct hlist_node *)hi);
+            free(hi->key);
+            if (h->destory) {
+                h->destory(hi->val);
+            }
+            free(hi);
+        }
+    }
+    free(list);
+}
+
+static void *hash_list_get(struct hash *h, const char *key, uint32_t hash)
+{
+    struct hash_item *hi = hash_lookup(h, key, hash);
+    if (hi) {
+        return hi->val;
+    }
+    return NULL;
+}
+
+static int hash_list_set(struct hash *h, const char *key, uint32_t hash, void *val)
+{
+    struct hlist_head *list = h->opaque;
+    struct hash_item *hi = hash_lookup(h, key, hash);
+    if (hi) {
+        hi->val = val;
+        return 0;
+    }
+
+    hi = (struct hash_item *)calloc(1, sizeof(*hi));
+    if (!hi) {
+        printf("calloc hash_item failed!\n");
+        return -1;
+    }
+
+    hi->key = strdup(key);
+    hi->val = val;
+    hi->hash = hash;
+    INIT_HLIST_NODE(&hi->item);
+    int pos = hash & (h->bucket-1);
+    hlist_add_head(&hi->item, &list[pos]);
+    return 0;
+}
+
+static int hash_list_del(struct hash *h, const char *key, uint32_t hash, void **val)
+{
+    struct hash_item *hi = hash_lookup(h, key, hash);
+    if (!hi) {
+        return -1;
+    }
+    if (val) {
+        *val = hi->val;
+    }
+    hlist_del((struct hlist_node *)hi);
+    free(hi->key);
+    free(hi);
+    return 0;
+}
+
+static int hash_list_count(struct hash *h)
+{
+    struct hlist_head *list;
+    struct hash_item *hi;
+    struct hlist_node *next;
+    uint32_t i;
+    int num = 0;
+
+    for (i = 0; i < h->bucket; i++) {
+        list = &((struct hlist_head *)h->opaque)[i];
+#if defined (OS_LINUX) || defined (OS_RTOS)
+        hlist_for_each_entry_safe(hi, next, list, item) {
+#elif defined (OS_WINDOWS)
+        hlist_for_each_entry_safe(hi, struct hash_item, next, struct hlist_node, list, item) {
+#endif
+            num++;
+        }
+    }
+    return num;
+}
+
+static void hash_list_dump(struct hash *h, int *num, char **key, void **val)
+{
+    struct hlist_head *list;
+    struct hash_item *hi;
+    struct hlist_node *next;
+    uint32_t i;
+    *num = 0;
+
+    for (i = 0; i < h->bucket; i++) {
+        list = &((struct hlist_head *)h->opaque)[i];
+#if defined (OS_LINUX) || defined (OS_RTOS)
+        hlist_for_each_entry_safe(hi, next, list, item) {
+#elif defined (OS_WINDOWS)
+        hlist_for_each_entry_safe(hi, struct hash_item, next, struct hlist_node, list, item) {
+#endif
+            printf("key:val = %s:%p\n", hi->key, hi->val);
+            *(key+*num) = hi->key;
+            *(val+*num) = hi->val;
+            (*num)++;
+        }
+    }
+}
+
+static int hash_list_foreach(struct hash *h, hash_foreach_cb cb, void *arg)
+{
+    struct hlist_head *list;
+    struct hash_item *hi;
+    struct hlist_node *next;
+    uint32_t i;
+    int ret;
+
+    for (i = 0; i < h->bucket; i++) {
+        list = &((struct hlist_head *)h->opaque)[i];
+#if defined (OS_LINUX) || defined (OS_RTOS)
+        hlist_for_each_entry_safe(hi, next, list, item) {
+#elif defined (OS_WINDOWS)
+        hlist_for_each_entry_safe(hi, struct hash_item, next, struct hlist_node, list, item) {
+#endif
+            ret = cb(hi->key, hi->val, arg);
+            if (ret != 0) {
+                return ret;
+            }
+        }
+    }
+    return 0;
+}
+
+const struct hash_ops hash_list_ops = {
+    hash_list_init,
+    hash_list_deinit,
+    hash_list_get,
+    hash_list_set,
+    hash_list_del,
+    hash_list_count,
+    hash_list_dump,
+    hash_list_foreach,
+};
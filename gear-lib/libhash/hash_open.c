@@ -0,0 +1,485 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libhash.h"
+#include <libposix.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HASH_USE_SSE2
+#endif
+
+/*
+ * open addressing hash table, swiss table like
+ *
+ * [ctrl]  |h2|h2|E |D |h2|E |...|h2|  one byte per slot, grouped by 16
+ * [slots] |s0|s1|s2|s3|s4|s5|...|sn|  key/val stored inline in slot
+ *
+ * ctrl byte of full slot is the low 7 bits of hash (h2), the other bits (h1)
+ * select the group to start probing. A whole group of 16 ctrl bytes is
+ * compared with h2 in one SIMD instruction, only candidates need strcmp.
+ *
+ * When table is full, a new table is allocated and entries are migrated from
+ * the old table a few slots per operation, instead of one long rehash.
+ * Migrated slots keep their ctrl byte in the old table, so probe chains of the
+ * old table stay as short as before, lookups just skip slots < migrate_pos.
+ */
+
+#define GROUP_WIDTH         16
+#define CTRL_EMPTY          ((int8_t)-128)
+#define CTRL_DELETED        ((int8_t)-2)
+#define INLINE_KEY_LEN      16
+#define MIGRATE_STEP        64
+#define MIN_CAPACITY        GROUP_WIDTH
+
+#define H1(hash)            ((hash) >> 7)
+#define H2(hash)            ((int8_t)((hash) & 0x7f))
+#define MAX_LOAD(cap)       ((cap) - (cap) / 8)
+
+struct open_slot {
+    uint32_t hash;
+    uint32_t len;
+    void *val;
+    union {
+        char buf[INLINE_KEY_LEN];
+        char *ptr;
+    } key;
+};
+
+struct open_table {
+    int8_t *ctrl;
+    struct open_slot *slots;
+    size_t capacity;
+    size_t size;
+    size_t growth_left;
+};
+
+struct open_hash {
+    struct open_table cur;
+    struct open_table old;  /* entries not migrated yet, capacity 0 if none */
+    size_t migrate_pos;
+};
+
+static inline int bit_ctz(uint32_t mask)
+{
+#if defined (__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int n = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+#if defined (HASH_USE_SSE2)
+static inline uint32_t group_match(const int8_t *ctrl, int8_t h2)
+{
+    __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), g));
+}
+
+static inline uint32_t group_match_free(const int8_t *ctrl)
+{
+    /* empty and deleted have the sign bit set, full slots don't */
+    __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+    return (uint32_t)_mm_movemask_epi8(g);
+}
+#else
+static inline uint32_t group_match(const int8_t *ctrl, int8_t h2)
+{
+    uint32_t mask = 0;
+    int i;
+    for (i = 0; i < GROUP_WIDTH; i++) {
+        mask |= (uint32_t)(ctrl[i] == h2) << i;
+    }
+    return mask;
+}
+
+static inline uint32_t group_match_free(const int8_t *ctrl)
+{
+    uint32_t mask = 0;
+    int i;
+    for (i = 0; i < GROUP_WIDTH; i++) {
+        mask |= (uint32_t)(ctrl[i] < 0) << i;
+    }
+    return mask;
+}
+#endif
+
+static inline uint32_t group_match_empty(const int8_t *ctrl)
+{
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+static inline const char *slot_key(const struct open_slot *s)
+{
+    return (s->len < INLINE_KEY_LEN) ? s->key.buf : s->key.ptr;
+}
+
+static int table_alloc(struct open_table *t, size_t capacity)
+{
+    t->ctrl = (int8_t *)malloc(capacity);
+    if (!t->ctrl) {
+        return -1;
+    }
+    t->slots = (struct open_slot *)malloc(capacity * sizeof(struct open_slot));
+    if (!t->slots) {
+        free(t->ctrl);
+        t->ctrl = NULL;
+        return -1;
+    }
+    memset(t->ctrl, CTRL_EMPTY, capacity);
+    t->capacity = capacity;
+    t->size = 0;
+    t->growth_left = MAX_LOAD(capacity);
+    return 0;
+}
+
+static void table_free(struct open_table *t)
+{
+    free(t->ctrl);
+    free(t->slots);
+    memset(t, 0, sizeof(*t));
+}
+
+/* slots before start are already migrated, skip them */
+static struct open_slot *table_find(struct open_table *t, const char *key,
+                size_t len, uint32_t hash, size_t start)
+{
+    size_t mask, g, i;
+    int8_t h2 = H2(hash);
+    if (!t->capacity) {
+        return NULL;
+    }
+    mask = t->capacity / GROUP_WIDTH - 1;
+    g = H1(hash) & mask;
+    for (i = 0; i <= mask; i++) {
+        const int8_t *ctrl = t->ctrl + g * GROUP_WIDTH;
+        uint32_t m = group_match(ctrl, h2);
+        while (m) {
+            size_t idx = g * GROUP_WIDTH + bit_ctz(m);
+            struct open_slot *s = &t->slots[idx];
+            if (idx >= start && s->hash == hash && s->len == len &&
+                memcmp(slot_key(s), key, len) == 0) {
+                return s;
+            }
+            m &= m - 1;
+        }
+        if (group_match_empty(ctrl)) {
+            break;
+        }
+        g = (g + i + 1) & mask;
+    }
+    return NULL;
+}
+
+/* caller make sure key is not in table and growth_left > 0 */
+static struct open_slot *table_insert(struct open_table *t, uint32_t hash)
+{
+    size_t mask = t->capacity / GROUP_WIDTH - 1;
+    size_t g = H1(hash) & mask;
+    size_t i, idx;
+    for (i = 0; ; i++) {
+        uint32_t m = group_match_free(t->ctrl + g * GROUP_WIDTH);
+        if (m) {
+            idx = g * GROUP_WIDTH + bit_ctz(m);
+            break;
+        }
+        g = (g + i + 1) & mask;
+    }
+    if (t->ctrl[idx] == CTRL_EMPTY) {
+        t->growth_left--;
+    }
+    t->ctrl[idx] = H2(hash);
+    t->size++;
+    return &t->slots[idx];
+}
+
+static void table_erase(struct open_table *t, struct open_slot *s)
+{
+    size_t idx = s - t->slots;
+    const int8_t *group = t->ctrl + (idx & ~(size_t)(GROUP_WIDTH - 1));
+    /*
+     * probing stops at the first group which has an empty slot, so if this
+     * group has one already no probe chain pass through it, slot can be
+     * reused as empty, otherwise leave a tombstone.
+     */
+    if (group_match_empty(group)) {
+        t->ctrl[idx] = CTRL_EMPTY;
+        t->growth_left++;
+    } else {
+        t->ctrl[idx] = CTRL_DELETED;
+    }
+    t->size--;
+}
+
+static void slot_free_key(struct open_slot *s)
+{
+    if (s->len >= INLINE_KEY_LEN) {
+        free(s->key.ptr);
+    }
+}
+
+static void migrate_step(struct hash *h, size_t step)
+{
+    struct open_hash *oh = (struct open_hash *)h->opaque;
+    struct open_table *old = &oh->old;
+    struct open_slot *s;
+    size_t end;
+    if (!old->capacity) {
+        return;
+    }
+    end = oh->migrate_pos + step;
+    if (end > old->capacity) {
+        end = old->capacity;
+    }
+    for (; oh->migrate_pos < end; oh->migrate_pos++) {
+        size_t idx = oh->migrate_pos;
+        if (old->ctrl[idx] < 0) {
+            continue;
+        }
+        s = table_insert(&oh->cur, old->slots[idx].hash);
+        memcpy(s, &old->slots[idx], sizeof(*s));
+        old->size--;
+    }
+    if (oh->migrate_pos == old->capacity) {
+        table_free(old);
+        oh->migrate_pos = 0;
+    }
+}
+
+static int grow(struct hash *h)
+{
+    struct open_hash *oh = (struct open_hash *)h->opaque;
+    struct open_table tmp;
+    size_t capacity = oh->cur.capacity;
+
+    /* finish last migration before start a new one */
+    migrate_step(h, oh->old.capacity);
+
+    /* if most of the used slots are tombstones, rehash in same size */
+    if (oh->cur.size >= MAX_LOAD(capacity) / 2) {
+        capacity *= 2;
+    }
+    if (table_alloc(&tmp, capacity)) {
+        printf("alloc hash table %zu failed!\n", capacity);
+        return -1;
+    }
+    oh->old = oh->cur;
+    oh->cur = tmp;
+    oh->migrate_pos = 0;
+    h->bucket = (int)capacity;
+    migrate_step(h, MIGRATE_STEP);
+    return 0;
+}
+
+static void *hash_open_init(int bucket)
+{
+    size_t capacity = MIN_CAPACITY;
+    struct open_hash *oh = (struct open_hash *)calloc(1, sizeof(*oh));
+    if (!oh) {
+        return NULL;
+    }
+    while (capacity < (size_t)bucket) {
+        capacity <<= 1;
+    }
+    if (table_alloc(&oh->cur, capacity)) {
+        free(oh);
+        return NULL;
+    }
+    return oh;
+}
+
+static void table_deinit(struct hash *h, struct open_table *t, size_t start)
+{
+    size_t i;
+    for (i = start; i < t->capacity; i++) {
+        if (t->ctrl[i] < 0) {
+            continue;
+        }
+        slot_free_key(&t->slots[i]);
+        if (h->destory) {
+            h->destory(t->slots[i].val);
+        }
+    }
+    table_free(t);
+}
+
+static void hash_open_deinit(struct hash *h)
+{
+    struct open_hash *oh = (struct open_hash *)h->opaque;
+    table_deinit(h, &oh->cur, 0);
+    table_deinit(h, &oh->old, oh->migrate_pos);
+    free(oh);
+}
+
+static struct open_slot *hash_open_find(struct hash *h, const char *key,
+                size_t len, uint32_t hash, struct open_table **table)
+{
+    struct open_hash *oh = (struct open_hash *)h->opaque;
+    struct open_slot *s;
+    migrate_step(h, MIGRATE_STEP);
+    s = table_find(&oh->cur, key, len, hash, 0);
+    if (s) {
+        *table = &oh->cur;
+        return s;
+    }
+    s = table_find(&oh->old, key, len, hash, oh->migrate_pos);
+    if (s) {
+        *table = &oh->old;
+    }
+    return s;
+}
+
+static void *hash_open_get(struct hash *h, const char *key, uint32_t hash)
+{
+    struct open_table *t;
+    struct open_slot *s = hash_open_find(h, key, strlen(key), hash, &t);
+    if (s) {
+        return s->val;
+    }
+    return NULL;
+}
+
+static int hash_open_set(struct hash *h, const char *key, uint32_t hash, void *val)
+{
+    struct open_hash *oh = (struct open_hash *)h->opaque;
+    struct open_table *t;
+    size_t len = strlen(key);
+    struct open_slot *s = hash_open_find(h, key, len, hash, &t);
+    char *dup = NULL;
+    if (s) {
+        s->val = val;
+        return 0;
+    }
+    /* copy a long key before a slot is marked used */
+    if (len >= INLINE_KEY_LEN) {
+        dup = strdup(key);
+        if (!dup) {
+            printf("%s: strdup failed\n", __func__);
+            return -1;
+        }
+    }
+    if (!oh->cur.growth_left) {
+        if (grow(h)) {
+            free(dup);
+            return -1;
+        }
+    }
+    s = table_insert(&oh->cur, hash);
+    s->hash = hash;
+    s->len = (uint32_t)len;
+    s->val = val;
+    if (dup) {
+        s->key.ptr = dup;
+    } else {
+        memcpy(s->key.buf, key, len + 1);
+    }
+    return 0;
+}
+
+static int hash_open_del(struct hash *h, const char *key, uint32_t hash, void **val)
+{
+    struct open_table *t;
+    struct open_slot *s = hash_open_find(h, key, strlen(key), hash, &t);
+    if (!s) {
+        return -1;
+    }
+    if (val) {
+        *val = s->val;
+    }
+    slot_free_key(s);
+    table_erase(t, s);
+    return 0;
+}
+
+static int hash_open_count(struct hash *h)
+{
+    struct open_hash *oh = (struct open_hash *)h->opaque;
+    return (int)(oh->cur.size + oh->old.size);
+}
+
+static void table_dump(struct open_table *t, size_t start,
+                int *num, char **key, void **val)
+{
+    size_t i;
+    for (i = start; i < t->capacity; i++) {
+        struct open_slot *s = &t->slots[i];
+        if (t->ctrl[i] < 0) {
+            continue;
+        }
+        printf("key:val = %s:%p\n", slot_key(s), s->val);
+        *(key+*num) = (char *)slot_key(s);
+        *(val+*num) = s->val;
+        (*num)++;
+    }
+}
+
+static void hash_open_dump(struct hash *h, int *num, char **key, void **val)
+{
+    struct open_hash *oh = (struct open_hash *)h->opaque;
+    *num = 0;
+    table_dump(&oh->cur, 0, num, key, val);
+    table_dump(&oh->old, oh->migrate_pos, num, key, val);
+}
+
+static int table_foreach(struct open_table *t, size_t start,
+                hash_foreach_cb cb, void *arg)
+{
+    size_t i;
+    int ret;
+    for (i = start; i < t->capacity; i++) {
+        if (t->ctrl[i] < 0) {
+            continue;
+        }
+        ret = cb(slot_key(&t->slots[i]), t->slots[i].val, arg);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static int hash_open_foreach(struct hash *h, hash_foreach_cb cb, void *arg)
+{
+    struct open_hash *oh = (struct open_hash *)h->opaque;
+    int ret = table_foreach(&oh->cur, 0, cb, arg);
+    if (ret != 0) {
+        return ret;
+    }
+    return table_foreach(&oh->old, oh->migrate_pos, cb, arg);
+}
+
+const struct hash_ops hash_open_ops = {
+    hash_open_init,
+    hash_open_deinit,
+    hash_open_get,
+    hash_open_set,
+    hash_open_del,
+    hash_open_count,
+    hash_open_dump,
+    hash_open_foreach,
+};
@@ -26,41 +26,31 @@
 #include <string.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
-/*
- * [opaque_list]
- * [bucket0] -> item[1] -> item[2] -> ... -> item[m0]
- * [bucket1] -> item[1] -> item[2] -> ... -> item[m1]
- * [bucket2] -> item[1] -> item[2] -> ... -> item[m2]
- * ...
- * [bucketn] -> item[1] -> item[2] -> ... -> item[mn]
- * 
- */
 
 #define HASH_MAX_KEY_STRLEN 32
 
-struct hash_item {
-    struct hlist_node item;
-    uint32_t hash;
-    char *key;
-    void *val;
+extern const struct hash_ops hash_open_ops;
+extern const struct hash_ops hash_list_ops;
+
+struct hash_backend {
+    enum hash_type type;
+    const struct hash_ops *ops;
 };
 
-enum hash_fn_id {
-    HASH_DOBBS,
-    HASH_MURMUR,
-    HASH_CITY,
-    HASH_SPOOKY
+static struct hash_backend hash_backend_list[] = {
+    {HASH_TYPE_OPEN, &hash_open_ops},
+    {HASH_TYPE_LIST, &hash_list_ops},
 };
 
 typedef struct hash_fn_item {
     int id;
-    uint32_t (*func)(const char *key, size_t len);
+    uint32_t (*func)(const char *key, size_t len, uint32_t seed);
 } hash_fn_item;
 
-static uint32_t hash_dobbs(const char *key, size_t len)
+static uint32_t hash_dobbs(const char *key, size_t len, uint32_t seed)
 {
 //https://en.wikipedia.org/wiki/Jenkins_hash_function
-    uint32_t hash = 0;
+    uint32_t hash = seed;
     size_t i = 0;
     for (i = 0; i < len; ++i) {
         hash += key[i];
@@ -73,7 +63,7 @@ static uint32_t hash_dobbs(const char *key, size_t len)
     return hash;
 }
 
-static uint32_t hash_murmur(const char *key, size_t len)
+static uint32_t hash_murmur(const char *key, size_t len, uint32_t seed)
 {
 //https://en.wikipedia.org/wiki/MurmurHash from variety of dict
 //https://github.com/ndevilla/dict
@@ -81,10 +71,10 @@ static uint32_t hash_murmur(const char *key, size_t len)
 #define MURMUR_MAGIC_2  0x0badcafe
     uint32_t h, k;
     unsigned char * data;
-    h = MURMUR_MAGIC_2 ^ len;
+    h = (MURMUR_MAGIC_2 ^ seed) ^ len;
     data = (uint8_t *)key;
     while(len >= 4) {
-        k = *(uint32_t *)data;
+        memcpy(&k, data, sizeof(k));
         k *= MURMUR_MAGIC_1;
         k ^= k >> 24;
         k *= MURMUR_MAGIC_1;
@@ -105,103 +95,225 @@ static uint32_t hash_murmur(const char *key, size_t len)
     return h;
 }
 
-static uint32_t hash_city(const char *key, size_t len)
+/*
+ * xxHash, https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+ * 4 independent lanes consume 16 (xxh32) or 32 (xxh64) bytes per round,
+ * so long keys are hashed several bytes per cycle instead of byte by byte.
+ * input is read as little endian like murmur above.
+ */
+#define XXH_PRIME32_1   0x9E3779B1U
+#define XXH_PRIME32_2   0x85EBCA77U
+#define XXH_PRIME32_3   0xC2B2AE3DU
+#define XXH_PRIME32_4   0x27D4EB2FU
+#define XXH_PRIME32_5   0x165667B1U
+#define XXH_PRIME64_1   0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2   0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3   0x165667B19E3779F9ULL
+#define XXH_PRIME64_4   0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5   0x27D4EB2F165667C5ULL
+
+#define XXH_ROTL32(x, r)    (((x) << (r)) | ((x) >> (32 - (r))))
+#define XXH_ROTL64(x, r)    (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline uint32_t xxh_read32(const uint8_t *p)
 {
-//https://github.com/google/cityhash
-//TODO
-    printf("unsupport yet\n");
-    return 0;
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
 }
 
-static uint32_t hash_spooky(const char *key, size_t len)
+static inline uint64_t xxh_read64(const uint8_t *p)
 {
-//http://burtleburtle.net/bob/hash/spooky.html
-//TODO
-    printf("unsupport yet\n");
-    return 0;
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t xxh32_round(uint32_t acc, uint32_t input)
+{
+    acc += input * XXH_PRIME32_2;
+    acc = XXH_ROTL32(acc, 13);
+    return acc * XXH_PRIME32_1;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc = XXH_ROTL64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh64_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+uint32_t hash_xxh32(const void *key, size_t len, uint32_t seed)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    const uint8_t *end = p + len;
+    uint32_t h;
+
+    if (len >= 16) {
+        const uint8_t *limit = end - 16;
+        uint32_t v1 = seed + XXH_PRIME32_1 + XXH_PRIME32_2;
+        uint32_t v2 = seed + XXH_PRIME32_2;
+        uint32_t v3 = seed;
+        uint32_t v4 = seed - XXH_PRIME32_1;
+        do {
+            v1 = xxh32_round(v1, xxh_read32(p));
+            v2 = xxh32_round(v2, xxh_read32(p + 4));
+            v3 = xxh32_round(v3, xxh_read32(p + 8));
+            v4 = xxh32_round(v4, xxh_read32(p + 12));
+            p += 16;
+        } while (p <= limit);
+        h = XXH_ROTL32(v1, 1) + XXH_ROTL32(v2, 7) +
+            XXH_ROTL32(v3, 12) + XXH_ROTL32(v4, 18);
+    } else {
+        h = seed + XXH_PRIME32_5;
+    }
+    h += (uint32_t)len;
+    while (p + 4 <= end) {
+        h += xxh_read32(p) * XXH_PRIME32_3;
+        h = XXH_ROTL32(h, 17) * XXH_PRIME32_4;
+        p += 4;
+    }
+    while (p < end) {
+        h += (*p) * XXH_PRIME32_5;
+        h = XXH_ROTL32(h, 11) * XXH_PRIME32_1;
+        p++;
+    }
+    h ^= h >> 15;
+    h *= XXH_PRIME32_2;
+    h ^= h >> 13;
+    h *= XXH_PRIME32_3;
+    h ^= h >> 16;
+    return h;
+}
+
+uint64_t hash_xxh64(const void *key, size_t len, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    const uint8_t *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        const uint8_t *limit = end - 32;
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+        do {
+            v1 = xxh64_round(v1, xxh_read64(p));
+            v2 = xxh64_round(v2, xxh_read64(p + 8));
+            v3 = xxh64_round(v3, xxh_read64(p + 16));
+            v4 = xxh64_round(v4, xxh_read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = XXH_ROTL64(v1, 1) + XXH_ROTL64(v2, 7) +
+            XXH_ROTL64(v3, 12) + XXH_ROTL64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += (uint64_t)len;
+    while (p + 8 <= end) {
+        h ^= xxh64_round(0, xxh_read64(p));
+        h = XXH_ROTL64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+        h = XXH_ROTL64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * XXH_PRIME64_5;
+        h = XXH_ROTL64(h, 11) * XXH_PRIME64_1;
+        p++;
+    }
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint32_t hash_xxh32_fn(const char *key, size_t len, uint32_t seed)
+{
+    return hash_xxh32(key, len, seed);
+}
+
+static uint32_t hash_xxh64_fn(const char *key, size_t len, uint32_t seed)
+{
+    uint64_t h = hash_xxh64(key, len, seed);
+    return (uint32_t)(h ^ (h >> 32));
 }
 
 static hash_fn_item hash_fn_table[] = {
     {HASH_DOBBS, &hash_dobbs},
     {HASH_MURMUR, &hash_murmur},
-    {HASH_CITY, &hash_city},
-    {HASH_SPOOKY, &hash_spooky},
+    {HASH_XXH32, &hash_xxh32_fn},
+    {HASH_XXH64, &hash_xxh64_fn},
 };
 
 uint32_t hash_gen32(const char *key, size_t len)
 {
-    return hash_fn_table[HASH_MURMUR].func(key, len);
+    return hash_fn_table[HASH_MURMUR].func(key, len, 0);
 }
 
-static struct hash_item *hash_lookup(struct hash *h, const char *key, uint32_t *hash)
+uint32_t hash_fn32(enum hash_fn_id id, const char *key, size_t len, uint32_t seed)
 {
-    struct hlist_head *list;
-    struct hash_item *hi;
-    struct hlist_node *next;
-    uint32_t i;
-
-    *hash = hash_gen32(key, strlen(key));
-    i = *hash & (h->bucket-1);
-    list = &((struct hlist_head *)h->opaque_list)[i];
-
-#if defined (OS_LINUX) || defined (OS_RTOS)
-    hlist_for_each_entry_safe(hi, next, list, item) {
-#elif defined (OS_WINDOWS)
-    hlist_for_each_entry_safe(hi, struct hash_item, next, struct hlist_node, list, item) {
-#endif
-        if ((hi->hash == *hash) && strcmp(hi->key, key) == 0) {
-            return hi;
-        }
+    if (id < 0 || id >= (int)ARRAY_SIZE(hash_fn_table)) {
+        id = HASH_MURMUR;
     }
-    return NULL;
+    return hash_fn_table[id].func(key, len, seed);
+}
+
+static inline uint32_t hash_key(struct hash *h, const char *key)
+{
+    return hash_fn_table[h->fn].func(key, strlen(key), h->seed);
 }
 
 struct hash *hash_create(int bucket)
 {
-    int i;
-    struct hlist_head *list;
-    struct hash *h = (struct hash *)calloc(1, sizeof(*h));
-    if (!h) {
+    return hash_create_type(bucket, HASH_TYPE_OPEN);
+}
+
+struct hash *hash_create_type(int bucket, enum hash_type type)
+{
+    struct hash *h;
+    if (type < 0 || type >= (int)ARRAY_SIZE(hash_backend_list)) {
+        printf("invalid hash type %d!\n", type);
         return NULL;
     }
-    list = (struct hlist_head *)calloc(bucket, sizeof(struct hlist_head));
-    if (!list) {
-        free(h);
+    h = (struct hash *)calloc(1, sizeof(*h));
+    if (!h) {
         return NULL;
     }
     h->bucket = bucket;
-    for (i = 0; i < bucket; i++) {
-        INIT_HLIST_HEAD(&list[i]);
+    h->type = type;
+    h->fn = HASH_MURMUR;
+    h->ops = hash_backend_list[type].ops;
+    h->opaque = h->ops->init(bucket);
+    if (!h->opaque) {
+        free(h);
+        return NULL;
     }
-    h->opaque_list = list;
     return h;
 }
 
 void hash_destroy(struct hash *h)
 {
-    int i;
-    struct hlist_head *list;
-    struct hash_item *hi;
-    struct hlist_node *next;
     if (!h) {
         return;
     }
-    list = h->opaque_list;
-    for (i = 0; i < h->bucket; i++) {
-#if defined (OS_LINUX) || defined (OS_RTOS)
-        hlist_for_each_entry_safe(hi, next, &list[i], item) {
-#elif defined (OS_WINDOWS)
-        hlist_for_each_entry_safe(hi, struct hash_item, next, struct hlist_node, &list[i], item) {
-#endif
-            hlist_del((struct hlist_node *)hi);
-            free(hi->key);
-            if (h->destory) {
-                h->destory(hi->val);
-            }
-            free(hi);
-        }
-    }
-    free(list);
+    h->ops->deinit(h);
     free(h);
 }
 
@@ -210,14 +322,25 @@ void hash_set_destory(struct hash *h, void (*destory)(void *val))
     h->destory = destory;
 }
 
-void *hash_get(struct hash *h, const char *key)
+int hash_set_fn(struct hash *h, enum hash_fn_id id, uint32_t seed)
 {
-    uint32_t hash = 0;
-    struct hash_item *hi = hash_lookup(h, key, &hash);
-    if (hi) {
-        return hi->val;
+    if (id < 0 || id >= (int)ARRAY_SIZE(hash_fn_table)) {
+        printf("invalid hash fn %d!\n", id);
+        return -1;
+    }
+    if (h->ops->count(h) > 0) {
+        printf("hash fn can only be changed on empty table!\n");
+        return -1;
     }
-    return NULL;
+    h->fn = id;
+    h->seed = seed;
+    return 0;
+}
+
+void *hash_get(struct hash *h, const char *key)
+{
+    uint32_t hash = hash_key(h, key);
+    return h->ops->get(h, key, hash);
 }
 
 void *hash_get32(struct hash *h, uint32_t key)
@@ -229,27 +352,8 @@ void *hash_get32(struct hash *h, uint32_t key)
 
 int hash_set(struct hash *h, const char *key, void *val)
 {
-    uint32_t hash = 0;
-    struct hlist_head *list = h->opaque_list;
-    struct hash_item *hi = hash_lookup(h, key, &hash);
-    if (hi) {
-        hi->val = val;
-        return 0;
-    }
-
-    hi = (struct hash_item *)calloc(1, sizeof(*hi));
-    if (!hi) {
-        printf("calloc hash_item failed!\n");
-        return -1;
-    }
-
-    hi->key = strdup(key);
-    hi->val = val;
-    hi->hash = hash;
-    INIT_HLIST_NODE(&hi->item);
-    int pos = hash & (h->bucket-1);
-    hlist_add_head(&hi->item, &list[pos]);
-    return 0;
+    uint32_t hash = hash_key(h, key);
+    return h->ops->set(h, key, hash, val);
 }
 
 int hash_set32(struct hash *h, uint32_t key, void *val)
@@ -261,16 +365,8 @@ int hash_set32(struct hash *h, uint32_t key, void *val)
 
 int hash_del(struct hash *h, const char *key)
 {
-    uint32_t hash = 0;
-    struct hash_item *hi = hash_lookup(h, key, &hash);
-    if (hi) {
-        hlist_del((struct hlist_node *)hi);
-        free(hi->key);
-        free(hi);
-        return 0;
-    }
-
-    return -1;
+    uint32_t hash = hash_key(h, key);
+    return h->ops->del(h, key, hash, NULL);
 }
 
 int hash_del32(struct hash *h, uint32_t key)
@@ -282,15 +378,12 @@ int hash_del32(struct hash *h, uint32_t key)
 
 void *hash_get_and_del(struct hash *h, const char *key)
 {
-    uint32_t hash = 0;
-    struct hash_item *hi = hash_lookup(h, key, &hash);
-    if (hi) {
-        hlist_del((struct hlist_node *)hi);
-        free(hi->key);
-        free(hi);
+    void *val = NULL;
+    uint32_t hash = hash_key(h, key);
+    if (h->ops->del(h, key, hash, &val)) {
         return NULL;
     }
-    return NULL;
+    return val;
 }
 
 void *hash_get_and_del32(struct hash *h, uint32_t key)
@@ -302,44 +395,18 @@ void *hash_get_and_del32(struct hash *h, uint32_t key)
 
 int hash_get_all_cnt(struct hash *h)
 {
-    struct hlist_head *list;
-    struct hash_item *hi;
-    struct hlist_node *next;
-    uint32_t i;
-    int num = 0;
-
-    for (i = 0; i < h->bucket - 1; i++) {
-        list = &((struct hlist_head *)h->opaque_list)[i];
-#if defined (OS_LINUX) || defined (OS_RTOS)
-        hlist_for_each_entry_safe(hi, next, list, item) {
-#elif defined (OS_WINDOWS)
-        hlist_for_each_entry_safe(hi, struct hash_item, next, struct hlist_node, list, item) {
-#endif
-            num++;
-        }
-    }
-    return num;
+    return h->ops->count(h);
 }
 
 void hash_dump_all(struct hash *h, int *num, char **key, void **val)
 {
-    struct hlist_head *list;
-    struct hash_item *hi;
-    struct hlist_node *next;
-    uint32_t i;
-    *num = 0;
-
-    for (i = 0; i < h->bucket - 1; i++) {
-        list = &((struct hlist_head *)h->opaque_list)[i];
-#if defined (OS_LINUX) || defined (OS_RTOS)
-        hlist_for_each_entry_safe(hi, next, list, item) {
-#elif defined (OS_WINDOWS)
-        hlist_for_each_entry_safe(hi, struct hash_item, next, struct hlist_node, list, item) {
-#endif
-            printf("key:val = %s:%p\n", hi->key, hi->val);
-            *(key+*num) = hi->key;
-            *(val+*num) = hi->val;
-            (*num)++;
-        }
+    h->ops->dump(h, num, key, val);
+}
+
+int hash_foreach(struct hash *h, hash_foreach_cb cb, void *arg)
+{
+    if (!h || !cb) {
+        return -1;
     }
+    return h->ops->foreach(h, cb, arg);
 }
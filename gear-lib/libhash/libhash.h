@@ -25,23 +25,69 @@
 #include <stdio.h>
 #include <stdint.h>
 
-#define LIBHASH_VERSION "0.1.1"
+#define LIBHASH_VERSION "0.3.0"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+enum hash_type {
+    HASH_TYPE_OPEN = 0, /* open addressing with SIMD probing, grows itself */
+    HASH_TYPE_LIST,     /* fixed bucket array of hlist chains */
+};
+
+enum hash_fn_id {
+    HASH_DOBBS,
+    HASH_MURMUR,    /* default */
+    HASH_XXH32,
+    HASH_XXH64,     /* folded to 32 bits for table */
+};
+
+struct hash;
+
+/* return non zero to stop iteration */
+typedef int (*hash_foreach_cb)(const char *key, void *val, void *arg);
+
+struct hash_ops {
+    void *(*init)(int bucket);
+    void (*deinit)(struct hash *h);
+    void *(*get)(struct hash *h, const char *key, uint32_t hash);
+    int (*set)(struct hash *h, const char *key, uint32_t hash, void *val);
+    int (*del)(struct hash *h, const char *key, uint32_t hash, void **val);
+    int (*count)(struct hash *h);
+    void (*dump)(struct hash *h, int *num, char **key, void **val);
+    int (*foreach)(struct hash *h, hash_foreach_cb cb, void *arg);
+};
+
 struct hash {
     int bucket;
-    void *opaque_list;
+    enum hash_type type;
+    enum hash_fn_id fn;
+    uint32_t seed;
+    void *opaque;
+    const struct hash_ops *ops;
     void (*destory)(void *val);
 };
 
+/*
+ * hash_create use HASH_TYPE_OPEN, bucket is only the initial capacity hint,
+ * table will grow automatically and rehash incrementally
+ */
 struct hash *hash_create(int bucket);
+struct hash *hash_create_type(int bucket, enum hash_type type);
 void hash_destroy(struct hash *h);
 void hash_set_destory(struct hash *h, void (*destory)(void *val));
 
+/*
+ * select hash function of table, only allowed when table is empty.
+ * use a random seed for tables keyed by remote input against hash flooding
+ */
+int hash_set_fn(struct hash *h, enum hash_fn_id id, uint32_t seed);
+
 uint32_t hash_gen32(const char *key, size_t len);
+uint32_t hash_fn32(enum hash_fn_id id, const char *key, size_t len, uint32_t seed);
+uint32_t hash_xxh32(const void *key, size_t len, uint32_t seed);
+uint64_t hash_xxh64(const void *key, size_t len, uint64_t seed);
 void *hash_get(struct hash *h, const char *key);
 void *hash_get32(struct hash *h, uint32_t key);
 int hash_set(struct hash *h, const char *key, void *val);
@@ -52,6 +98,81 @@ void *hash_get_and_del(struct hash *h, const char *key);
 void *hash_get_and_del32(struct hash *h, uint32_t key);
 void hash_dump_all(struct hash *h, int *num, char **key, void **val);
 int hash_get_all_cnt(struct hash *h);
+int hash_foreach(struct hash *h, hash_foreach_cb cb, void *arg);
+
+/*
+ * hash image is a read-only snapshot file of a table, it is mapped by mmap
+ * and looked up in place, no parsing on open and page cache is shared by
+ * all processes mapping the same image.
+ * val is saved as bytes, returned pointer is valid until image is closed,
+ * it is NUL terminated and 8 bytes aligned.
+ */
+#define HASH_IMAGE_NULL 0xFFFFFFFF
+
+struct hash_image;
+
+struct hash_image_item {
+    const char *key;
+    const void *val;    /* NULL is kept as NULL */
+    size_t len;
+};
+
+/* return bytes of val to be saved and set len, NULL to save NULL */
+typedef const void *(*hash_image_val_cb)(const char *key, void *val, size_t *len);
+
+int hash_image_write(const char *path, enum hash_fn_id fn, uint32_t seed,
+                const struct hash_image_item *items, uint32_t count);
+int hash_save_image(struct hash *h, const char *path, hash_image_val_cb cb);
+struct hash_image *hash_open_image(const char *path);
+void hash_close_image(struct hash_image *img);
+const void *hash_image_get(struct hash_image *img, const char *key, size_t *len);
+const void *hash_image_get32(struct hash_image *img, uint32_t key, size_t *len);
+int hash_image_has(struct hash_image *img, const char *key);
+int hash_image_count(struct hash_image *img);
+
+/* rank starts from 0, returns next rank, -1 on end */
+int hash_image_enumerate(struct hash_image *img, int rank,
+                const char **key, const void **val, size_t *len);
+
+/*
+ * chash is concurrent hash map for tables shared between threads
+ * get is lock free, set/del/compute are serialized by striped locks,
+ * removed entries are freed after all readers running at that time left.
+ * chash does not free val on del, val lifetime belongs to caller, use
+ * chash_compute to take refcount of val under the lock if needed.
+ * NULL val means no entry, so chash_set(h, key, NULL) removes key.
+ */
+struct chash;
+
+/*
+ * called under lock of key with current val (NULL if key does not exist),
+ * return new val to store, or NULL to remove key.
+ * must not call chash API of same table inside
+ */
+typedef void *(*chash_compute_cb)(const char *key, void *val, void *arg);
+
+struct chash *chash_create(int bucket);
+void chash_destroy(struct chash *h);
+void chash_set_destory(struct chash *h, void (*destory)(void *val));
+
+void *chash_get(struct chash *h, const char *key);
+void *chash_get32(struct chash *h, uint32_t key);
+int chash_set(struct chash *h, const char *key, void *val);
+int chash_set32(struct chash *h, uint32_t key, void *val);
+int chash_del(struct chash *h, const char *key);
+int chash_del32(struct chash *h, uint32_t key);
+void *chash_get_and_del(struct chash *h, const char *key);
+void *chash_get_and_del32(struct chash *h, uint32_t key);
+
+/*
+ * return existing val of key, or insert val and return it
+ * inserted is set to 1 if val is inserted, can be NULL
+ */
+void *chash_get_or_insert(struct chash *h, const char *key, void *val, int *inserted);
+void *chash_get_or_insert32(struct chash *h, uint32_t key, void *val, int *inserted);
+void *chash_compute(struct chash *h, const char *key, chash_compute_cb cb, void *arg);
+void *chash_compute32(struct chash *h, uint32_t key, chash_compute_cb cb, void *arg);
+int chash_get_all_cnt(struct chash *h);
 
 #ifdef __cplusplus
 }
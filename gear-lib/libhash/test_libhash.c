@@ -23,6 +23,9 @@
 #include <libposix.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
 #include <sys/time.h>
 
 #define PALIGN   "%15s: %6.4f sec\n"
@@ -36,31 +39,25 @@ static double epoch_double(void)
     return t.tv_sec + (t.tv_usec * 1.0) / 1000000.0;
 }
 
-int main(int argc, char * argv[])
+static int bench(enum hash_type type, int bucket, int nkeys, char *buffer,
+                int *order)
 {
     struct hash * d;
     double t1, t2;
     int i;
-    int nkeys;
-    char * buffer;
     char * val;
     int num = 0;
     int cnt = 0;
+    int miss = 0;
     char **key;
     void **ptr;
 
-    nkeys = (argc>1) ? (int)atoi(argv[1]) : NKEYS ;
-    printf("%15s: %d\n", "values", nkeys);
-    buffer = (char *)malloc(9 * nkeys);
-
-    //                10000000
-    d = hash_create(2097152);
-    t1 = epoch_double();
-    for(i = 0; i < nkeys; i++) {
-        sprintf(buffer + i * 9, "%08x", i);
+    printf("%15s: %s (bucket %d)\n", "type",
+           type == HASH_TYPE_OPEN ? "open" : "list", bucket);
+    d = hash_create_type(bucket, type);
+    if (!d) {
+        return -1;
     }
-    t2 = epoch_double();
-    printf(PALIGN, "initialization", t2 - t1);
 
     t1 = epoch_double();
     for(i = 0; i < nkeys; i++) {
@@ -73,8 +70,8 @@ int main(int argc, char * argv[])
     t1 = epoch_double();
     for(i = 0; i < nkeys; i++) {
         val = (char *)hash_get(d, buffer + i*9);
-        if (0) {
-        printf("hash_get: key=%p, val=%p\n", buffer + i*9, val);
+        if (val != buffer + i*9) {
+            miss++;
         }
 #if DEBUG>1
         printf("exp[%s] got[%s]\n", buffer+i*9, val);
@@ -85,23 +82,35 @@ int main(int argc, char * argv[])
     }
     t2 = epoch_double();
     printf(PALIGN, "lookup", t2 - t1);
-    cnt = hash_get_all_cnt(d);
 
-    printf("cnt = %d\n", cnt);
-    key = (char **)calloc(cnt, sizeof(char **));
-    ptr = (void **)calloc(cnt, sizeof(void **));
-    hash_dump_all(d, &num, key, ptr);
-    if (num != cnt) {
-        printf("hash cnt %d does not match expect %d\n", num, cnt);
+    t1 = epoch_double();
+    for(i = 0; i < nkeys; i++) {
+        val = (char *)hash_get(d, buffer + order[i]*9);
+        if (val != buffer + order[i]*9) {
+            miss++;
+        }
     }
-    for (i = 0; i < cnt; i++) {
-        printf("dump key:val = %s:%p\n", key[i], ptr[i]);
+    t2 = epoch_double();
+    printf(PALIGN, "random lookup", t2 - t1);
+    if (miss) {
+        printf("lookup miss %d keys\n", miss);
     }
-    free(key);
-    free(ptr);
+    cnt = hash_get_all_cnt(d);
 
-//    if (nkeys<100)
-        //dict_dump(d, stdout);
+    printf("cnt = %d\n", cnt);
+    if (nkeys <= NKEYS) {
+        key = (char **)calloc(cnt, sizeof(char **));
+        ptr = (void **)calloc(cnt, sizeof(void **));
+        hash_dump_all(d, &num, key, ptr);
+        if (num != cnt) {
+            printf("hash cnt %d does not match expect %d\n", num, cnt);
+        }
+        for (i = 0; i < cnt; i++) {
+            printf("dump key:val = %s:%p\n", key[i], ptr[i]);
+        }
+        free(key);
+        free(ptr);
+    }
 
     t1 = epoch_double();
     for(i = 0; i < nkeys; i++) {
@@ -109,6 +118,10 @@ int main(int argc, char * argv[])
     }
     t2 = epoch_double();
     printf(PALIGN, "delete", t2 - t1);
+    if (hash_get_all_cnt(d) != 0) {
+        printf("hash cnt %d after delete all\n", hash_get_all_cnt(d));
+        miss++;
+    }
 
     t1 = epoch_double();
     for(i = 0; i < nkeys; i++) {
@@ -121,8 +134,353 @@ int main(int argc, char * argv[])
     hash_destroy(d);
     t2 = epoch_double();
     printf(PALIGN, "free", t2 - t1);
+    return (miss || cnt != nkeys) ? -1 : 0;
+}
+
+static const char *hash_fn_name[] = {"dobbs", "murmur", "xxh32", "xxh64"};
+
+static void bench_hash_fn(void)
+{
+    static const size_t lens[] = {4, 8, 16, 32, 64, 256, 1024, 4096};
+    char *buf;
+    double t1, t2;
+    size_t i, j, n, total;
+    uint32_t sum = 0;
+    int id;
+
+    buf = (char *)malloc(4096 + 16);
+    for (i = 0; i < 4096 + 16; i++) {
+        buf[i] = (char)(i * 131 + 7);
+    }
+    printf("%15s:", "MB/s keylen");
+    for (j = 0; j < ARRAY_SIZE(lens); j++) {
+        printf(" %7zu", lens[j]);
+    }
+    printf("\n");
+    for (id = HASH_DOBBS; id <= HASH_XXH64; id++) {
+        printf("%15s:", hash_fn_name[id]);
+        for (j = 0; j < ARRAY_SIZE(lens); j++) {
+            total = 16 * 1024 * 1024;
+            n = total / lens[j];
+            t1 = epoch_double();
+            for (i = 0; i < n; i++) {
+                /* vary offset so that unaligned reads are measured too */
+                sum += hash_fn32(id, buf + (i & 15), lens[j], 0);
+            }
+            t2 = epoch_double();
+            printf(" %7.0f", total / (t2 - t1) / (1024 * 1024));
+        }
+        printf("\n");
+    }
+
+    /* quality: sequential short keys into 2^16 buckets, ideal max is ~35 */
+    printf("%15s:\n", "quality");
+    for (id = HASH_DOBBS; id <= HASH_XXH64; id++) {
+        static uint16_t cnt[65536];
+        int max = 0;
+        char key[16];
+        memset(cnt, 0, sizeof(cnt));
+        for (i = 0; i < 1024 * 1024; i++) {
+            int len = snprintf(key, sizeof(key), "%08zx", i);
+            uint32_t h = hash_fn32(id, key, len, 0);
+            if (++cnt[h & 0xffff] > max) {
+                max = cnt[h & 0xffff];
+            }
+        }
+        printf("%15s: max bucket load %d (avg 16)\n", hash_fn_name[id], max);
+    }
+    if (sum == 0x12345678) {
+        printf("\n");
+    }
+    free(buf);
+}
+
+#define CHASH_THREADS   8
+#define CHASH_KEYS      4096
+#define CHASH_LOOPS     100000
+
+struct chash_test {
+    struct chash *h;
+    int id;
+    int err;
+};
+
+static void *counter_cb(const char *key, void *val, void *arg)
+{
+    return (void *)((intptr_t)val + 1);
+}
+
+static void *chash_worker(void *arg)
+{
+    struct chash_test *t = (struct chash_test *)arg;
+    char key[32];
+    void *val;
+    int i, k;
+    unsigned int seed = t->id;
+
+    for (i = 0; i < CHASH_LOOPS; i++) {
+        k = rand_r(&seed) % CHASH_KEYS;
+        snprintf(key, sizeof(key), "key-%d", k);
+        /* key k is owned by thread k % CHASH_THREADS, val encodes the key */
+        if (k % CHASH_THREADS == t->id) {
+            if (rand_r(&seed) & 1) {
+                chash_set(t->h, key, (void *)(intptr_t)(k + 1));
+            } else {
+                chash_del(t->h, key);
+            }
+            if (chash_get(t->h, key) != NULL &&
+                chash_get(t->h, key) != (void *)(intptr_t)(k + 1)) {
+                t->err++;
+            }
+        } else {
+            val = chash_get(t->h, key);
+            if (val != NULL && val != (void *)(intptr_t)(k + 1)) {
+                t->err++;
+            }
+        }
+        chash_compute(t->h, "counter", counter_cb, NULL);
+    }
+    return NULL;
+}
+
+static int test_chash(void)
+{
+    pthread_t tid[CHASH_THREADS];
+    struct chash_test t[CHASH_THREADS];
+    struct chash *h;
+    double t1, t2;
+    int i, err = 0;
+    int inserted;
+
+    h = chash_create(16);
+    if (!h) {
+        return -1;
+    }
+    t1 = epoch_double();
+    for (i = 0; i < CHASH_THREADS; i++) {
+        t[i].h = h;
+        t[i].id = i;
+        t[i].err = 0;
+        pthread_create(&tid[i], NULL, chash_worker, &t[i]);
+    }
+    for (i = 0; i < CHASH_THREADS; i++) {
+        pthread_join(tid[i], NULL);
+        err += t[i].err;
+    }
+    t2 = epoch_double();
+    printf(PALIGN, "chash threads", t2 - t1);
+    if ((intptr_t)chash_get(h, "counter") != CHASH_THREADS * CHASH_LOOPS) {
+        printf("chash counter %d does not match expect %d\n",
+               (int)(intptr_t)chash_get(h, "counter"), CHASH_THREADS * CHASH_LOOPS);
+        err++;
+    }
+    if (chash_get_or_insert(h, "counter", (void *)1, &inserted) == (void *)1 || inserted) {
+        err++;
+    }
+    if (chash_get_or_insert32(h, 12345, (void *)1, &inserted) != (void *)1 || !inserted) {
+        err++;
+    }
+    if (chash_get_and_del32(h, 12345) != (void *)1 || chash_get32(h, 12345)) {
+        err++;
+    }
+    printf("%15s: %d, err %d\n", "chash cnt", chash_get_all_cnt(h), err);
+    chash_destroy(h);
+    return err ? -1 : 0;
+}
+
+static const void *image_val(const char *key, void *val, size_t *len)
+{
+    *len = strlen((char *)val);
+    return val;
+}
+
+static int test_image(int nkeys, char *buffer, int *order)
+{
+    struct hash *h;
+    struct hash_image *img;
+    const char *path = "test_libhash.img";
+    const char *key;
+    const void *val;
+    double t1, t2;
+    size_t len;
+    int i, rank, err = 0;
+
+    h = hash_create(16);
+    if (!h) {
+        return -1;
+    }
+    hash_set_fn(h, HASH_XXH32, 0x5eed);
+    for (i = 0; i < nkeys; i++) {
+        hash_set(h, buffer + i*9, buffer + i*9);
+    }
+    t1 = epoch_double();
+    if (hash_save_image(h, path, image_val) != 0) {
+        hash_destroy(h);
+        return -1;
+    }
+    t2 = epoch_double();
+    printf(PALIGN, "image save", t2 - t1);
+    hash_destroy(h);
+
+    t1 = epoch_double();
+    img = hash_open_image(path);
+    t2 = epoch_double();
+    printf(PALIGN, "image open", t2 - t1);
+    if (!img) {
+        return -1;
+    }
+    t1 = epoch_double();
+    for (i = 0; i < nkeys; i++) {
+        val = hash_image_get(img, buffer + order[i]*9, &len);
+        if (!val || len != 8 || memcmp(val, buffer + order[i]*9, 9)) {
+            err++;
+        }
+    }
+    t2 = epoch_double();
+    printf(PALIGN, "image lookup", t2 - t1);
+    if (hash_image_get(img, "not-exist", NULL)) {
+        err++;
+    }
+    for (i = 0, rank = 0; ; i++) {
+        rank = hash_image_enumerate(img, rank, &key, &val, &len);
+        if (rank < 0) {
+            break;
+        }
+    }
+    if (i != nkeys || hash_image_count(img) != nkeys) {
+        err++;
+    }
+    printf("%15s: %d, err %d\n", "image cnt", hash_image_count(img), err);
+    hash_close_image(img);
+    remove(path);
+    return err ? -1 : 0;
+}
+
+/* patch a saved image: entries pointing outside the file or at a key
+ * without its NUL must not be returned */
+static int test_image_corrupt(void)
+{
+    const char *path = "test_libhash_bad.img";
+    struct hash *h;
+    struct hash_image *img;
+    uint64_t off, bad;
+    char buf[4096];
+    char *p;
+    size_t n, i;
+    FILE *fp;
+    int err = 0, round;
+
+    for (round = 0; round < 3; round++) {
+        h = hash_create(16);
+        if (!h) {
+            return -1;
+        }
+        hash_set(h, "alpha", "first");
+        hash_set(h, "beta", "second");
+        if (hash_save_image(h, path, image_val) != 0) {
+            hash_destroy(h);
+            return -1;
+        }
+        hash_destroy(h);
+        fp = fopen(path, "rb");
+        n = fp ? fread(buf, 1, sizeof(buf), fp) : 0;
+        if (fp) {
+            fclose(fp);
+        }
+        for (p = NULL, i = 0; i + 6 <= n; i++) {
+            if (!memcmp(buf + i, "alpha", 6)) {
+                p = buf + i;
+                break;
+            }
+        }
+        if (!p) {
+            return -1;
+        }
+        if (round == 0) {
+            /* key_off + key_len wraps around to a small offset, the
+             * entry is the last match before the data */
+            off = p - buf;
+            bad = UINT64_MAX - 2;
+            for (i = off - sizeof(off); i > 0; i -= sizeof(off)) {
+                if (!memcmp(buf + i, &off, sizeof(off))) {
+                    memcpy(buf + i, &bad, sizeof(bad));
+                    break;
+                }
+            }
+        } else if (round == 1) {
+            p[5] = 'x';
+        } else {
+            /* the value of alpha follows its key */
+            p = memchr(p, 'f', n - (p - buf));
+            if (!p || memcmp(p, "first", 6)) {
+                return -1;
+            }
+            p[5] = 'x';
+        }
+        fp = fopen(path, "wb");
+        if (!fp || fwrite(buf, 1, n, fp) != n) {
+            return -1;
+        }
+        fclose(fp);
+        img = hash_open_image(path);
+        if (!img) {
+            return -1;
+        }
+        if (hash_image_get(img, "alpha", NULL) ||
+            !hash_image_get(img, "beta", NULL)) {
+            err++;
+        }
+        hash_close_image(img);
+    }
+    remove(path);
+    printf("%15s: err %d\n", "image corrupt", err);
+    return err ? -1 : 0;
+}
+
+int main(int argc, char * argv[])
+{
+    double t1, t2;
+    int i;
+    int nkeys;
+    int ret = 0;
+    char * buffer;
+    int * order;
+
+    nkeys = (argc>1) ? (int)atoi(argv[1]) : NKEYS ;
+    printf("%15s: %d\n", "values", nkeys);
+    buffer = (char *)malloc(9 * nkeys);
+    order = (int *)malloc(sizeof(int) * nkeys);
+
+    t1 = epoch_double();
+    for(i = 0; i < nkeys; i++) {
+        sprintf(buffer + i * 9, "%08x", i);
+        order[i] = i;
+    }
+    /* shuffled lookup order, so that chained items allocated in insertion
+     * order don't get a free ride from the prefetcher */
+    srand(0);
+    for(i = nkeys - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    t2 = epoch_double();
+    printf(PALIGN, "initialization", t2 - t1);
+
+    //                10000000
+    ret |= bench(HASH_TYPE_LIST, 2097152, nkeys, buffer, order);
+    /* start small, let table grow by itself */
+    ret |= bench(HASH_TYPE_OPEN, 16, nkeys, buffer, order);
+    ret |= test_chash();
+    ret |= test_image(nkeys, buffer, order);
+    ret |= test_image_corrupt();
+    if (argc > 2) {
+        bench_hash_fn();
+    }
 
+    free(order);
     free(buffer);
-    return 0 ;
+    return ret;
 
 }
@@ -6,7 +6,7 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := libglog
 
 ifeq ($(MODE), release)
-LOCAL_CFLAGS += -O2
+LOCAL_CFLAGS += -O2 -DLOG_LEVEL_MIN=LOG_INFO
 endif
 
 LIBRARIES_DIR	:= $(LOCAL_PATH)/../
@@ -32,6 +32,7 @@
 #include <time.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sched.h>
 #include <pthread.h>
 #include <inttypes.h>
 #include <sys/types.h>
@@ -41,11 +42,14 @@
 
 #if defined (OS_LINUX) || defined (OS_APPLE)
 #include <syslog.h>
+#include <signal.h>
+#include <sys/mman.h>
 #ifndef __CYGWIN__
 #include <sys/syscall.h>
 #endif
 
 #define USE_SYSLOG
+#define LOG_MMAP_OPS
 
 #elif defined (OS_ANDROID)
 #include <jni.h>
@@ -62,7 +66,34 @@
 #define LOG_PNAME_SIZE      (32)
 #define LOG_TEXT_SIZE       (256)
 #define LOG_LEVEL_DEFAULT   LOG_INFO
+#ifndef LOG_USE_FIO
 #define LOG_IO_OPS
+#endif
+#define LOG_FLUSH_SIZE      (64*1024)   /* FILE backend buffer */
+#define LOG_FLUSH_INTERVAL  (1000)      /* ms a FILE backend record may wait */
+
+#define LOG_CACHELINE       (64)
+#define LOG_ASYNC_RING_MIN  (4096)
+#define LOG_ASYNC_RING_SIZE (256*1024)
+#define LOG_ASYNC_BUDGET    (8*1024*1024UL)
+#define LOG_ASYNC_IOV       (64)
+#define LOG_ASYNC_INTERVAL  (20)        /* ms the writer sleeps when idle */
+
+#define LOG_BIN_MAGIC       "GLOGBIN"
+#define LOG_BIN_VERSION     (1)
+#define LOG_BIN_HEAD        (1)
+#define LOG_BIN_STR         (2)
+#define LOG_BIN_REC         (3)
+#define LOG_BIN_ALIGN(x)    (((x) + 7) & ~(uint32_t)7)
+#define LOG_BIN_STR_MAX     (4096)
+#define LOG_BIN_STR_NULL    (0xFFFFFFFF)
+#define LOG_ARGS_MAX        (16)
+#define LOG_BIN_REC_MAX     (64 + LOG_ARGS_MAX * 24 + LOG_BUF_SIZE)
+#define LOG_BIN_ENTRY_MAX   (4 * (24 + LOG_BIN_STR_MAX) + LOG_BIN_REC_MAX)
+#define LOG_FMT_CACHE       (64)
+#define LOG_BATCH_SIZE      (64*1024)
+#define LOG_DICT_INIT       (256)
+#define LOG_BIN_ZERO_TAIL   (LOG_ARGS_MAX * 16 + 16)    /* zeros an entry may end in */
 
 /*
  *#define LOG_VERBOSE_ENABLE
@@ -105,6 +136,36 @@
 #define is_str_equal(a,b) \
     ((strlen(a) == strlen(b)) && (0 == strcasecmp(a,b)))
 
+#if defined (__GNUC__)
+#define ATOMIC_LOAD(p)          __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v)      __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define ATOMIC_ADD(p, v)        __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST)
+#define ATOMIC_XCHG(p, v)       __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL)
+#define ATOMIC_LOAD_SEQ(p)      __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE_SEQ(p, v)  __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+#define ATOMIC_XCHG64(p, v)     __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL)
+#define ATOMIC_CAS64(p, e, v)   __atomic_compare_exchange_n(p, e, v, 0, \
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#elif defined (OS_WINDOWS)
+#define ATOMIC_LOAD(p)          (MemoryBarrier(), *(p))
+#define ATOMIC_STORE(p, v)      do { MemoryBarrier(); *(p) = (v); } while (0)
+#define ATOMIC_ADD(p, v)        (InterlockedExchangeAdd64((volatile LONG64 *)(p), (v)) + (v))
+#define ATOMIC_XCHG(p, v)       InterlockedExchange((volatile LONG *)(p), (v))
+#define ATOMIC_LOAD_SEQ(p)      (MemoryBarrier(), *(p))
+#define ATOMIC_STORE_SEQ(p, v)  do { *(p) = (v); MemoryBarrier(); } while (0)
+#define ATOMIC_XCHG64(p, v)     InterlockedExchange64((volatile LONG64 *)(p), (v))
+#define ATOMIC_CAS64(p, e, v)   log_atomic_cas64(p, e, v)
+static inline int log_atomic_cas64(volatile uint64_t *p, uint64_t *e, uint64_t v)
+{
+    uint64_t old = InterlockedCompareExchange64((volatile LONG64 *)p, v, *e);
+    if (old == *e) {
+        return 1;
+    }
+    *e = old;
+    return 0;
+}
+#endif
+
 #ifndef NAME_MAX
 #define NAME_MAX         255 /* defined in /usr/include/linux/limits.h */
 #endif
@@ -115,7 +176,9 @@
 
 typedef struct log_ops {
     int (*open)(const char *path);
+    int (*open_rewrite)(const char *path);
     ssize_t (*write)(struct iovec *vec, int n);
+    int (*flush)(void);
     int (*close)(void);
 } log_ops_t;
 
@@ -178,6 +241,7 @@ static char _log_name[FILENAME_LEN];
 static char _log_name_prefix[FILENAME_LEN];
 static char _log_name_time[FILENAME_LEN];
 static pthread_mutex_t _log_mutex;
+static pthread_mutex_t _log_init_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int _log_prefix = 0;
 static int _log_output = 0;
 static int _log_use_io = 0;
@@ -187,29 +251,36 @@ static int _log_type;
 static const char *_log_ident;
 
 static int _log_rotate = 0;
+static int _log_file_track = 0;                 /* a file is open */
+static unsigned long long _log_file_len = 0;    /* bytes in the file */
+static size_t _log_flush_size = LOG_FLUSH_SIZE;
+static int _log_flush_ms = LOG_FLUSH_INTERVAL;
+static size_t _log_flush_pending = 0;
+static uint64_t _log_flush_last = 0;
+static char _log_fbuf[LOG_FLUSH_SIZE];
+
+#if defined (_MSC_VER)
+#define LOG_TLS __declspec(thread)
+#elif defined (__GNUC__) && !defined (OS_RTOS)
+#define LOG_TLS __thread
+#endif
 
 
-static unsigned long long get_file_size(const char *path)
+/* size of a file just opened, afterwards writes are counted */
+static unsigned long long get_file_size_by_fd(int fd)
 {
     struct stat buf;
-    if (stat(path, &buf) < 0) {
+    if (fstat(fd, &buf) < 0) {
         return 0;
     }
     return (unsigned long long)buf.st_size;
 }
 
-static unsigned long long get_file_size_by_fp(FILE *fp)
+static uint64_t log_now_ms(void)
 {
-    long tmp;
-    unsigned long long size;
-    if (!fp || fp == stderr) {
-        return 0;
-    }
-    tmp = ftell(fp);
-    fseek(fp, 0L, SEEK_END);
-    size = ftell(fp);
-    fseek(fp, tmp, SEEK_SET);
-    return size;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
 }
 
 #if defined (OS_APPLE) || defined (OS_RTOS) || defined (OS_RTTHREAD)
@@ -229,6 +300,44 @@ static pid_t gettid(void)
 }
 #endif
 
+/*
+ * "[YYYY-MM-DD HH:MM:SS.mmm]", localtime_r and strftime run once a second
+ * per thread, other calls copy the cached string and patch the milliseconds
+ */
+#define LOG_TIME_MS_OFF     (21)
+#define LOG_TIME_LEN        (26)
+
+static void log_format_time(char *str, int len, const struct timeval *tv)
+{
+#ifdef LOG_TLS
+    static LOG_TLS time_t cache_sec = -1;
+    static LOG_TLS char cache_str[LOG_TIME_LEN];
+#endif
+    char date_fmt[20];
+    struct tm now_tm;
+    time_t now_sec = tv->tv_sec;
+    int ms = (int)(tv->tv_usec/1000);
+
+#ifdef LOG_TLS
+    if (LIKELY(now_sec == cache_sec && len >= LOG_TIME_LEN)) {
+        memcpy(str, cache_str, LOG_TIME_LEN);
+        str[LOG_TIME_MS_OFF] = '0' + ms / 100;
+        str[LOG_TIME_MS_OFF + 1] = '0' + ms / 10 % 10;
+        str[LOG_TIME_MS_OFF + 2] = '0' + ms % 10;
+        return;
+    }
+#endif
+    localtime_r(&now_sec, &now_tm);
+    strftime(date_fmt, 20, "%Y-%m-%d %H:%M:%S", &now_tm);
+    snprintf(str, len, "[%s.%03d]", date_fmt, ms);
+#ifdef LOG_TLS
+    if (strlen(str) == LOG_TIME_LEN - 1) {
+        memcpy(cache_str, str, LOG_TIME_LEN);
+        cache_sec = now_sec;
+    }
+#endif
+}
+
 static void log_get_time(char *str, int len, int flag_name)
 {
     char date_fmt[20];
@@ -238,19 +347,16 @@ static void log_get_time(char *str, int len, int flag_name)
     int now_ms;
     time_t now_sec;
     gettimeofday(&tv, NULL);
+    if (flag_name == 0) {
+        log_format_time(str, len, &tv);
+        return;
+    }
     now_sec = tv.tv_sec;
     now_ms = tv.tv_usec/1000;
     localtime_r(&now_sec, &now_tm);
-
-    if (flag_name == 0) {
-        strftime(date_fmt, 20, "%Y-%m-%d %H:%M:%S", &now_tm);
-        snprintf(date_ms, sizeof(date_ms), "%03d", now_ms);
-        snprintf(str, len, "[%s.%s]", date_fmt, date_ms);
-    } else {
-        strftime(date_fmt, 20, "%Y_%m_%d_%H_%M_%S", &now_tm);
-        snprintf(date_ms, sizeof(date_ms), "%03d", now_ms);
-        snprintf(str, len, "%s_%s.log", date_fmt, date_ms);
-    }
+    strftime(date_fmt, 20, "%Y_%m_%d_%H_%M_%S", &now_tm);
+    snprintf(date_ms, sizeof(date_ms), "%03d", now_ms);
+    snprintf(str, len, "%s_%s.log", date_fmt, date_ms);
 }
 
 static const char *get_dir(const char *path)
@@ -327,6 +433,13 @@ static void check_dir(const char *path)
     }
 }
 
+static void log_file_opened(int fd)
+{
+    _log_file_track = 1;
+    _log_file_len = get_file_size_by_fd(fd);
+    _log_flush_pending = 0;
+}
+
 static int _log_fopen(const char *path)
 {
     check_dir(path);
@@ -335,7 +448,11 @@ static int _log_fopen(const char *path)
         fprintf(stderr, "fopen %s failed: %s\n", path, strerror(errno));
         fprintf(stderr, "use stderr as output\n");
         _log_fp = stderr;
+        _log_file_track = 0;
+        return 0;
     }
+    setvbuf(_log_fp, _log_fbuf, _IOFBF, sizeof(_log_fbuf));
+    log_file_opened(fileno(_log_fp));
     return 0;
 }
 
@@ -347,62 +464,138 @@ static int _log_fopen_rewrite(const char *path)
         fprintf(stderr, "fopen %s failed: %s\n", path, strerror(errno));
         fprintf(stderr, "use stderr as output\n");
         _log_fp = stderr;
+        _log_file_track = 0;
+        return 0;
+    }
+    setvbuf(_log_fp, _log_fbuf, _IOFBF, sizeof(_log_fbuf));
+    log_file_opened(fileno(_log_fp));
+    return 0;
+}
+
+static int _log_fflush(void)
+{
+    _log_flush_pending = 0;
+    if (EOF == fflush(_log_fp)) {
+        fprintf(stderr, "fflush failed: %s\n", strerror(errno));
+        return -1;
     }
     return 0;
 }
 
 static int _log_fclose(void)
 {
+    _log_file_track = 0;
+    _log_flush_pending = 0;
+    if (_log_fp == stderr) {
+        return 0;
+    }
     return fclose(_log_fp);
 }
 
+static void log_file_check(void);
+
+/*
+ * records stay in the stdio buffer until _log_flush_size bytes are pending
+ * or the oldest waited _log_flush_ms, log_flush and errors flush at once
+ */
 static ssize_t _log_fwrite(struct iovec *vec, int n)
 {
-    int i, ret;
-    char log_rename[FILENAME_LEN*3] = {0};
-    unsigned long long tmp_size = get_file_size_by_fp(_log_fp);
-    if (UNLIKELY(tmp_size > _log_file_size)) {
-        if (_log_rotate) {
-            if (EOF == _log_fclose()) {
-                fprintf(stderr, "_log_fclose errno:%d", errno);
-            }
-            _log_fopen_rewrite(_log_name);
-        } else {
-            if (CHECK_LOG_PREFIX(_log_prefix, LOG_VERBOSE_BIT)) {
-                fprintf(stderr, "%s size= %" PRIu64 " reach max %" PRIu64 ", splited\n",
-                    _log_name, (uint64_t)tmp_size, (uint64_t)_log_file_size);
-            }
-            if (EOF == _log_fclose()) {
-                fprintf(stderr, "_log_fclose errno:%d", errno);
-            }
-            log_get_time(_log_name_time, sizeof(_log_name_time), 1);
-            snprintf(log_rename, sizeof(log_rename), "%s%s_%s",
-                    _log_path, _log_name_prefix, _log_name_time);
-            if (-1 == rename(_log_name, log_rename)) {
-                fprintf(stderr, "log file splited %s error: %d:%s\n",
-                        log_rename, errno , strerror(errno));
-            }
-            _log_fopen(_log_name);
-            if (CHECK_LOG_PREFIX(_log_prefix, LOG_VERBOSE_BIT)) {
-                fprintf(stderr, "splited file %s\n", log_rename);
-            }
-        }
+    uint64_t now = log_now_ms();
+    int i, ret, ms = ATOMIC_LOAD(&_log_flush_ms);
+    log_file_check();
+    if (_log_flush_pending == 0) {
+        _log_flush_last = now;
     }
     for (i = 0; i < n; i++) {
-        ret = fprintf(_log_fp, "%s", (char *)vec[i].iov_base);
+        ret = fwrite(vec[i].iov_base, 1, vec[i].iov_len, _log_fp);
         if (ret != (int)vec[i].iov_len) {
-            fprintf(stderr, "fprintf failed: %s\n", strerror(errno));
-            return -1;
-        }
-        if (EOF == fflush(_log_fp)) {
-            fprintf(stderr, "fflush failed: %s\n", strerror(errno));
+            fprintf(stderr, "fwrite failed: %s\n", strerror(errno));
             return -1;
         }
+        _log_file_len += ret;
+        _log_flush_pending += ret;
+    }
+    if (_log_flush_pending >= _log_flush_size ||
+        (ms > 0 && now - _log_flush_last >= (uint64_t)ms)) {
+        return _log_fflush();
     }
     return 0;
 }
 
 
+/*
+ * the FILE backend only checks the age of buffered records when the next
+ * one is written, this thread flushes what a quiet process left behind.
+ * It never blocks on _log_mutex: a busy writer checks the age itself.
+ */
+static struct {
+    int running;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} _log_flusher;
+
+static void *log_flush_loop(void *arg)
+{
+    struct timespec ts;
+    int ms;
+
+    pthread_mutex_lock(&_log_flusher.lock);
+    while (_log_flusher.running) {
+        ms = ATOMIC_LOAD(&_log_flush_ms);
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += (ms > 0 ? ms : LOG_FLUSH_INTERVAL) / 1000;
+        ts.tv_nsec += (ms > 0 ? ms : LOG_FLUSH_INTERVAL) % 1000 * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&_log_flusher.cond, &_log_flusher.lock, &ts);
+        if (!_log_flusher.running || ms <= 0) {
+            continue;
+        }
+        pthread_mutex_unlock(&_log_flusher.lock);
+        if (pthread_mutex_trylock(&_log_mutex) == 0) {
+            if (_log_flush_pending &&
+                log_now_ms() - _log_flush_last >= (uint64_t)ms) {
+                _log_fflush();
+            }
+            pthread_mutex_unlock(&_log_mutex);
+        }
+        pthread_mutex_lock(&_log_flusher.lock);
+    }
+    pthread_mutex_unlock(&_log_flusher.lock);
+    return NULL;
+}
+
+static void log_flush_timer_start(void)
+{
+    pthread_mutex_init(&_log_flusher.lock, NULL);
+    pthread_cond_init(&_log_flusher.cond, NULL);
+    _log_flusher.running = 1;
+    if (pthread_create(&_log_flusher.thread, NULL, log_flush_loop, NULL)) {
+        fprintf(stderr, "create flush thread failed, records wait for the next write\n");
+        _log_flusher.running = 0;
+        pthread_cond_destroy(&_log_flusher.cond);
+        pthread_mutex_destroy(&_log_flusher.lock);
+    }
+}
+
+static void log_flush_timer_stop(void)
+{
+    if (!_log_flusher.running) {
+        return;
+    }
+    pthread_mutex_lock(&_log_flusher.lock);
+    _log_flusher.running = 0;
+    pthread_cond_signal(&_log_flusher.cond);
+    pthread_mutex_unlock(&_log_flusher.lock);
+    pthread_join(_log_flusher.thread, NULL);
+    pthread_cond_destroy(&_log_flusher.cond);
+    pthread_mutex_destroy(&_log_flusher.lock);
+}
+
+
 static int _log_open(const char *path)
 {
     check_dir(path);
@@ -411,7 +604,10 @@ static int _log_open(const char *path)
         fprintf(stderr, "open %s failed: %s\n", path, strerror(errno));
         fprintf(stderr, "use STDERR_FILEIO as output\n");
         _log_fd = STDERR_FILENO;
+        _log_file_track = 0;
+        return 0;
     }
+    log_file_opened(_log_fd);
     return 0;
 }
 
@@ -423,224 +619,2309 @@ static int _log_open_rewrite(const char *path)
         fprintf(stderr, "open %s failed: %s\n", path, strerror(errno));
         fprintf(stderr, "use STDERR_FILEIO as output\n");
         _log_fd = STDERR_FILENO;
+        _log_file_track = 0;
+        return 0;
     }
+    log_file_opened(_log_fd);
+    return 0;
+}
+
+static int _log_flush(void)
+{
     return 0;
 }
+
 static int _log_close(void)
 {
+    _log_file_track = 0;
+    if (_log_fd == STDERR_FILENO) {
+        return 0;
+    }
     return close(_log_fd);
 }
 
 static ssize_t _log_write(struct iovec *vec, int n)
 {
-    char log_rename[FILENAME_LEN*3] = {0};
-    unsigned long long tmp_size = get_file_size(_log_name);
-    if (UNLIKELY(tmp_size > _log_file_size)) {
-        if (_log_rotate) {
-            if (-1 == _log_close()) {
-                fprintf(stderr, "_log_close errno:%d", errno);
-            }
-            _log_open_rewrite(_log_name);
-        } else {
-        fprintf(stderr, "%s size= %" PRIu64 " reach max %" PRIu64 ", splited\n",
-                _log_name, (uint64_t)tmp_size, (uint64_t)_log_file_size);
-            if (-1 == _log_close()) {
-                fprintf(stderr, "_log_close errno:%d", errno);
-            }
-            log_get_time(_log_name_time, sizeof(_log_name_time), 1);
-            snprintf(log_rename, sizeof(log_rename), "%s%s_%s",
-                    _log_path, _log_name_prefix, _log_name_time);
-            if (-1 == rename(_log_name, log_rename)) {
-                fprintf(stderr, "log file splited %s error: %d:%s\n",
-                        log_rename, errno , strerror(errno));
-            }
-            _log_open(_log_name);
-            fprintf(stderr, "splited file %s\n", log_rename);
-        }
+    ssize_t ret;
+    log_file_check();
+    ret = writev(_log_fd, vec, n);
+    if (ret > 0) {
+        _log_file_len += ret;
     }
-
-    return writev(_log_fd, vec, n);
+    return ret;
 }
 
 
 static struct log_ops log_fio_ops = {
     _log_fopen,
+    _log_fopen_rewrite,
     _log_fwrite,
+    _log_fflush,
     _log_fclose,
 };
 
 static struct log_ops log_io_ops = {
     _log_open,
+    _log_open_rewrite,
     _log_write,
+    _log_flush,
     _log_close
 };
 
-static struct log_ops *_log_handle = NULL;
-
+#ifdef LOG_MMAP_OPS
 /*
- *time: level: process[pid]: [tid] tag: message
- *             [verbose          ]
+ * mmap backend: the file grows by preallocated segments mapped MAP_SHARED,
+ * a record is a memcpy into the mapping and stays in the page cache if the
+ * process dies. A helper thread maps the next segment ahead of time and
+ * retires the old one (msync, madvise, munmap) off the logging path. The
+ * file is truncated to the data on close, after a crash the zero filled
+ * tail is skipped by the next open.
  */
-static int _log_print(int lvl, const char *tag,
-                      const char *file, int line,
-                      const char *func, const char *msg)
+static struct {
+    int fd;
+    char *map;              /* current segment */
+    uint64_t map_off;
+    size_t pos;             /* bytes used in the current segment */
+    size_t seg;
+    int broken;             /* preallocation failed, pwrite from now on */
+    int crash;              /* no locks, the crashed thread may hold them */
+    /* handed between the logging path and the helper under lock */
+    char *next;
+    uint64_t next_off;
+    int want_next;
+    char *retire;
+    int running;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} _log_mmap = {-1};
+
+static size_t _log_mmap_seg = 0;    /* 0: mmap backend off */
+
+static int log_mmap_alloc(uint64_t off, size_t len)
 {
-    int ret = 0, i = 0;
-    struct iovec vec[LOG_IOVEC_MAX];
-    char s_time[LOG_TIME_SIZE];
-    char s_lvl[LOG_LEVEL_SIZE];
-    char s_tag[LOG_TAG_SIZE];
-    //char s_pname[LOG_PNAME_SIZE*2];
-    char s_pid[LOG_PNAME_SIZE];
-    char s_tid[LOG_PNAME_SIZE];
-    char s_file[LOG_TEXT_SIZE];
-    char s_msg[LOG_BUF_SIZE];
+#if defined (OS_LINUX)
+    return posix_fallocate(_log_mmap.fd, off, len);
+#else
+    struct stat st;
+    if (fstat(_log_mmap.fd, &st) == 0 && (uint64_t)st.st_size >= off + len) {
+        return 0;
+    }
+    return ftruncate(_log_mmap.fd, off + len) < 0 ? errno : 0;
+#endif
+}
 
-    pthread_mutex_lock(&_log_mutex);
-    log_get_time(s_time, sizeof(s_time), 0);
+static char *log_mmap_segment(uint64_t off)
+{
+    char *p;
+    int err = log_mmap_alloc(off, _log_mmap.seg);
+    if (err) {
+        fprintf(stderr, "fallocate log segment failed: %s\n", strerror(err));
+        return NULL;
+    }
+    p = (char *)mmap(NULL, _log_mmap.seg, PROT_READ|PROT_WRITE, MAP_SHARED,
+                     _log_mmap.fd, off);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "mmap log segment failed: %s\n", strerror(errno));
+        return NULL;
+    }
+    return p;
+}
 
-    if (_log_fp == stderr || _log_fd == STDERR_FILENO) {
-        switch(lvl) {
-        case LOG_EMERG:
-        case LOG_ALERT:
-        case LOG_CRIT:
-        case LOG_ERR:
-            snprintf(s_lvl, sizeof(s_lvl),
-                    B_RED("[%7s]"), _log_level_str[lvl]);
-            snprintf(s_msg, sizeof(s_msg), RED("%s"), msg);
-            break;
-        case LOG_WARNING:
-            snprintf(s_lvl, sizeof(s_lvl),
-                    B_YELLOW("[%7s]"), _log_level_str[lvl]);
-            snprintf(s_msg, sizeof(s_msg), YELLOW("%s"), msg);
-            break;
-        case LOG_INFO:
-            snprintf(s_lvl, sizeof(s_lvl),
-                    B_GREEN("[%7s]"), _log_level_str[lvl]);
-            snprintf(s_msg, sizeof(s_msg), GREEN("%s"), msg);
-            break;
-        case LOG_DEBUG:
-            snprintf(s_lvl, sizeof(s_lvl),
-                    B_WHITE("[%7s]"), _log_level_str[lvl]);
-            snprintf(s_msg, sizeof(s_msg), WHITE("%s"), msg);
-            break;
-        default:
-            snprintf(s_lvl, sizeof(s_lvl),
-                    "[%7s]", _log_level_str[lvl]);
-            snprintf(s_msg, sizeof(s_msg), "%s", msg);
-            break;
+static void log_mmap_retire(char *p)
+{
+    msync(p, _log_mmap.seg, MS_ASYNC);
+#ifdef MADV_DONTNEED
+    madvise(p, _log_mmap.seg, MADV_DONTNEED);
+#endif
+    munmap(p, _log_mmap.seg);
+}
+
+static void *log_mmap_loop(void *arg)
+{
+    char *retire, *next;
+    uint64_t off;
+
+    pthread_mutex_lock(&_log_mmap.lock);
+    while (_log_mmap.running) {
+        if (!_log_mmap.retire && !_log_mmap.want_next) {
+            pthread_cond_wait(&_log_mmap.cond, &_log_mmap.lock);
+            continue;
+        }
+        retire = _log_mmap.retire;
+        _log_mmap.retire = NULL;
+        off = _log_mmap.next_off;
+        next = NULL;
+        if (_log_mmap.want_next && !_log_mmap.next) {
+            _log_mmap.want_next = 0;
+            pthread_mutex_unlock(&_log_mmap.lock);
+            next = log_mmap_segment(off);
+        } else {
+            _log_mmap.want_next = 0;
+            pthread_mutex_unlock(&_log_mmap.lock);
+        }
+        if (retire) {
+            log_mmap_retire(retire);
+        }
+        pthread_mutex_lock(&_log_mmap.lock);
+        if (next && !_log_mmap.next && _log_mmap.next_off == off) {
+            _log_mmap.next = next;
+            next = NULL;
+        }
+        if (next) {
+            /* the logging path mapped it itself meanwhile */
+            pthread_mutex_unlock(&_log_mmap.lock);
+            munmap(next, _log_mmap.seg);
+            pthread_mutex_lock(&_log_mmap.lock);
         }
-    } else {
-        snprintf(s_lvl, sizeof(s_lvl),
-                "[%7s]", _log_level_str[lvl]);
-        snprintf(s_msg, sizeof(s_msg), "%s", msg);
     }
-    if (CHECK_LOG_PREFIX(_log_prefix, LOG_PID_BIT)) {
-        snprintf(s_pid, sizeof(s_pid), "[pid:%d]", getpid());
-        snprintf(s_tag, sizeof(s_tag), "[%s]", tag);
+    pthread_mutex_unlock(&_log_mmap.lock);
+    return NULL;
+}
+
+/* move to the segment after the current one, mapped by the helper if ready */
+static int log_mmap_roll(void)
+{
+    uint64_t off = _log_mmap.map_off + _log_mmap.seg;
+    char *old = _log_mmap.map, *next = NULL, *retire = old, *stale = NULL;
+
+    if (!_log_mmap.crash) {
+        pthread_mutex_lock(&_log_mmap.lock);
+        if (_log_mmap.next && _log_mmap.next_off == off) {
+            next = _log_mmap.next;
+        } else {
+            stale = _log_mmap.next;
+        }
+        _log_mmap.next = NULL;
+        if (!_log_mmap.retire) {
+            _log_mmap.retire = old;
+            retire = NULL;
+        }
+        _log_mmap.next_off = off + _log_mmap.seg;
+        _log_mmap.want_next = 1;
+        pthread_cond_signal(&_log_mmap.cond);
+        pthread_mutex_unlock(&_log_mmap.lock);
+        if (stale) {
+            munmap(stale, _log_mmap.seg);
+        }
+        if (retire) {
+            log_mmap_retire(retire);
+        }
     }
-    if (CHECK_LOG_PREFIX(_log_prefix, LOG_TID_BIT)) {
-        snprintf(s_tid, sizeof(s_tid), "[tid:%d]", (int)gettid());
-        snprintf(s_tag, sizeof(s_tag), "[%s]", tag);
+    if (!next) {
+        next = log_mmap_segment(off);
     }
-    if (CHECK_LOG_PREFIX(_log_prefix, LOG_FUNCLINE_BIT)) {
-        snprintf(s_file, sizeof(s_file), "[%s:%3d: %s] ", file, line, func);
+    if (!next) {
+        _log_mmap.map = NULL;
+        _log_mmap.broken = 1;
+        return -1;
     }
+    _log_mmap.map = next;
+    _log_mmap.map_off = off;
+    _log_mmap.pos = 0;
+    return 0;
+}
 
-    i = -1;
-    if (CHECK_LOG_PREFIX(_log_prefix, LOG_TIMESTAMP_BIT)) {
-        vec[++i].iov_base = (void *)s_time;
-        vec[i].iov_len = strlen(s_time);
-    }
-    if (CHECK_LOG_PREFIX(_log_prefix, LOG_PID_BIT)) {
-        vec[++i].iov_base = (void *)s_pid;
-        vec[i].iov_len = strlen(s_pid);
+static ssize_t log_mmap_append(const struct iovec *vec, int n)
+{
+    const char *src;
+    size_t len, cnt, total = 0;
+    ssize_t ret;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        src = (const char *)vec[i].iov_base;
+        len = vec[i].iov_len;
+        while (len) {
+            if (UNLIKELY(_log_mmap.broken)) {
+                ret = pwrite(_log_mmap.fd, src, len,
+                             _log_mmap.map_off + _log_mmap.pos);
+                if (ret <= 0) {
+                    return total ? (ssize_t)total : -1;
+                }
+                cnt = ret;
+            } else {
+                if (UNLIKELY(_log_mmap.pos == _log_mmap.seg) &&
+                    log_mmap_roll() < 0) {
+                    continue;
+                }
+                cnt = MIN(len, _log_mmap.seg - _log_mmap.pos);
+                memcpy(_log_mmap.map + _log_mmap.pos, src, cnt);
+            }
+            _log_mmap.pos += cnt;
+            src += cnt;
+            len -= cnt;
+            total += cnt;
+        }
     }
-    if (CHECK_LOG_PREFIX(_log_prefix, LOG_TID_BIT)) {
-        vec[++i].iov_base = (void *)s_tid;
-        vec[i].iov_len = strlen(s_tid);
+    return total;
+}
+
+/*
+ * text ends at the last non zero byte, what follows is preallocated. A
+ * binary entry may end in zeros, so leave room for them, log_decode skips
+ * zero words between entries
+ */
+static uint64_t log_mmap_data_end(int fd)
+{
+    char buf[4096];
+    struct stat st;
+    uint64_t end, size;
+    ssize_t len;
+    int binary;
+
+    if (fstat(fd, &st) < 0) {
+        return 0;
     }
-    vec[++i].iov_base = (void *)s_lvl;
-    vec[i].iov_len = strlen(s_lvl);
-    if (CHECK_LOG_PREFIX(_log_prefix, LOG_TAG_BIT)) {
-        vec[++i].iov_base = (void *)s_tag;
-        vec[i].iov_len = strlen(s_tag);
+    end = size = st.st_size;
+    binary = (pread(fd, buf, 16, 0) == 16 &&
+              !memcmp(buf + 8, LOG_BIN_MAGIC, sizeof(LOG_BIN_MAGIC)));
+    while (end > 0) {
+        len = pread(fd, buf, MIN(end, sizeof(buf)), end - MIN(end, sizeof(buf)));
+        if (len <= 0) {
+            break;
+        }
+        while (len > 0 && buf[len - 1] == '\0') {
+            len--;
+            end--;
+        }
+        if (len > 0) {
+            break;
+        }
     }
-    if (CHECK_LOG_PREFIX(_log_prefix, LOG_FUNCLINE_BIT)) {
-        vec[++i].iov_base = (void *)s_file;
-        vec[i].iov_len = strlen(s_file);
+    if (binary && end < size) {
+        end = MIN(((end + 7) & ~7ULL) + LOG_BIN_ZERO_TAIL, size);
     }
-    vec[++i].iov_base = (void *)s_msg;
-    vec[i].iov_len = strlen(s_msg);
+    return end;
+}
 
-    if (UNLIKELY(!_log_syslog)) {
-        ret = _log_handle->write(vec, i+1);
+static int log_mmap_open(const char *path, int flags)
+{
+    uint64_t end;
+
+    check_dir(path);
+    _log_mmap.fd = open(path, O_RDWR|O_CREAT|flags, 0644);
+    if (_log_mmap.fd == -1) {
+        fprintf(stderr, "open %s failed: %s\n", path, strerror(errno));
+        fprintf(stderr, "use STDERR_FILEIO as output\n");
+        _log_fd = STDERR_FILENO;
+        _log_file_track = 0;
+        return 0;
     }
-    pthread_mutex_unlock(&_log_mutex);
-    return ret;
+    _log_fd = _log_mmap.fd;
+    _log_mmap.seg = _log_mmap_seg;
+    _log_mmap.broken = 0;
+    _log_mmap.crash = 0;
+    _log_mmap.next = NULL;
+    _log_mmap.retire = NULL;
+    _log_mmap.want_next = 0;
+    end = log_mmap_data_end(_log_mmap.fd);
+    _log_mmap.map_off = end - end % _log_mmap.seg;
+    _log_mmap.pos = end - _log_mmap.map_off;
+    _log_mmap.map = log_mmap_segment(_log_mmap.map_off);
+    if (!_log_mmap.map) {
+        _log_mmap.broken = 1;
+    }
+    _log_file_track = 1;
+    _log_file_len = end;
+
+    pthread_mutex_init(&_log_mmap.lock, NULL);
+    pthread_cond_init(&_log_mmap.cond, NULL);
+    _log_mmap.running = 1;
+    _log_mmap.next_off = _log_mmap.map_off + _log_mmap.seg;
+    _log_mmap.want_next = !_log_mmap.broken;
+    if (0 != pthread_create(&_log_mmap.thread, NULL, log_mmap_loop, NULL)) {
+        fprintf(stderr, "pthread_create failed\n");
+        _log_mmap.running = 0;
+        _log_mmap.want_next = 0;
+    }
+    return 0;
 }
 
-#ifdef __ANDROID__
+static int _log_mmap_open(const char *path)
+{
+    return log_mmap_open(path, 0);
+}
 
-#undef loge
-#define loge(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
-#undef logw
-#define logw(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
-#undef logi
-#define logi(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#undef logd
-#define logd(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
-#undef logv
-#define logv(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
+static int _log_mmap_open_rewrite(const char *path)
+{
+    return log_mmap_open(path, O_TRUNC);
+}
 
-#else
-int log_print(int lvl, const char *tag, const char *file,
-              int line, const char *func, const char *fmt, ...)
+static ssize_t _log_mmap_write(struct iovec *vec, int n)
 {
-    va_list ap;
-    char buf[LOG_BUF_SIZE] = {0};
-    int n, ret;
+    ssize_t ret;
+    log_file_check();
+    if (UNLIKELY(_log_fd == STDERR_FILENO)) {
+        return writev(_log_fd, vec, n);
+    }
+    ret = log_mmap_append(vec, n);
+    if (ret > 0) {
+        _log_file_len += ret;
+    }
+    return ret;
+}
 
-    if (UNLIKELY(!_is_log_init)) {
-        log_init(0, NULL);
+static int _log_mmap_flush(void)
+{
+    if (_log_mmap.map && _log_mmap.pos) {
+        return msync(_log_mmap.map, _log_mmap.pos, MS_ASYNC);
     }
+    return 0;
+}
 
-    if (lvl > _log_level) {
+static int _log_mmap_close(void)
+{
+    uint64_t end = _log_mmap.map_off + _log_mmap.pos;
+    int ret;
+
+    _log_file_track = 0;
+    if (_log_mmap.fd == -1) {
         return 0;
     }
-
-    va_start(ap, fmt);
-    n = vsnprintf(buf, sizeof(buf), fmt, ap);
-    va_end(ap);
-    if (UNLIKELY(n < 0)) {
-        fprintf(stderr, "vsnprintf errno:%d\n", errno);
-        return -1;
+    if (_log_mmap.running) {
+        pthread_mutex_lock(&_log_mmap.lock);
+        _log_mmap.running = 0;
+        pthread_cond_signal(&_log_mmap.cond);
+        pthread_mutex_unlock(&_log_mmap.lock);
+        pthread_join(_log_mmap.thread, NULL);
     }
-#ifdef USE_SYSLOG
-    if (UNLIKELY(_log_syslog)) {
-        syslog(lvl, "%s", buf);
+    if (_log_mmap.retire) {
+        log_mmap_retire(_log_mmap.retire);
     }
-#endif
-    ret = _log_print(lvl, tag, file, line, func, buf);
-
+    if (_log_mmap.next) {
+        munmap(_log_mmap.next, _log_mmap.seg);
+    }
+    if (_log_mmap.map) {
+        munmap(_log_mmap.map, _log_mmap.seg);
+    }
+    pthread_cond_destroy(&_log_mmap.cond);
+    pthread_mutex_destroy(&_log_mmap.lock);
+    _log_mmap.map = _log_mmap.next = _log_mmap.retire = NULL;
+    if (ftruncate(_log_mmap.fd, end) < 0) {
+        fprintf(stderr, "ftruncate log failed: %s\n", strerror(errno));
+    }
+    ret = close(_log_mmap.fd);
+    _log_mmap.fd = -1;
     return ret;
 }
+
+static struct log_ops log_mmap_ops = {
+    _log_mmap_open,
+    _log_mmap_open_rewrite,
+    _log_mmap_write,
+    _log_mmap_flush,
+    _log_mmap_close,
+};
 #endif
 
-void log_set_level(int level)
-{
-    if (level > LOG_VERB || level < LOG_EMERG) {
+static struct log_ops *_log_handle = NULL;
+static unsigned long long _log_file_gen = 0;
+
+/*
+ * split or rotate the file once it grew past _log_file_size, bumps
+ * _log_file_gen whenever a new file is started. The size is counted by
+ * the write ops, so writes from other processes to the same file are not
+ * seen until it is opened again.
+ */
+static void log_file_check(void)
+{
+    char log_rename[FILENAME_LEN*3] = {0};
+    unsigned long long tmp_size = _log_file_len;
+
+    if (LIKELY(tmp_size <= _log_file_size || !_log_file_track)) {
+        return;
+    }
+    if (_log_rotate) {
+        if (-1 == _log_handle->close()) {
+            fprintf(stderr, "_log_close errno:%d", errno);
+        }
+        _log_handle->open_rewrite(_log_name);
+    } else {
+        if (CHECK_LOG_PREFIX(_log_prefix, LOG_VERBOSE_BIT)) {
+            fprintf(stderr, "%s size= %" PRIu64 " reach max %" PRIu64 ", splited\n",
+                _log_name, (uint64_t)tmp_size, (uint64_t)_log_file_size);
+        }
+        if (-1 == _log_handle->close()) {
+            fprintf(stderr, "_log_close errno:%d", errno);
+        }
+        log_get_time(_log_name_time, sizeof(_log_name_time), 1);
+        snprintf(log_rename, sizeof(log_rename), "%s%s_%s",
+                _log_path, _log_name_prefix, _log_name_time);
+        if (-1 == rename(_log_name, log_rename)) {
+            fprintf(stderr, "log file splited %s error: %d:%s\n",
+                    log_rename, errno , strerror(errno));
+        }
+        _log_handle->open(_log_name);
+        if (CHECK_LOG_PREFIX(_log_prefix, LOG_VERBOSE_BIT)) {
+            fprintf(stderr, "splited file %s\n", log_rename);
+        }
+    }
+    _log_file_gen++;
+}
+
+struct log_line {
+    struct iovec vec[LOG_IOVEC_MAX];
+    int cnt;
+    size_t len;
+    char s_time[LOG_TIME_SIZE];
+    char s_lvl[LOG_LEVEL_SIZE];
+    char s_tag[LOG_TAG_SIZE];
+    char s_pid[LOG_PNAME_SIZE];
+    char s_tid[LOG_PNAME_SIZE];
+    char s_file[LOG_TEXT_SIZE];
+    char s_msg[LOG_BUF_SIZE];
+};
+
+/* what a line is formatted with, pid/tid < 0 and ts == 0 mean the caller */
+struct log_meta {
+    int prefix;
+    int color;
+    int pid;
+    int tid;
+    uint64_t ts;            /* ns since the epoch */
+};
+
+/*
+ * binary records: LOG_FORMAT_DEFERRED keeps them in the rings and formats
+ * them in the writer, LOG_FORMAT_BINARY also writes them to disk. Every
+ * entry starts with log_bin_hdr and is padded to 8 bytes. Strings are
+ * referred to by id, which is their address in the logging process. In a
+ * file a HEAD entry starts a new id space and each id is defined by a STR
+ * entry before the first record using it.
+ */
+struct log_bin_hdr {
+    uint16_t len;
+    uint8_t type;
+    uint8_t lvl;
+    uint32_t tid;
+};
+
+struct log_bin_head {
+    struct log_bin_hdr hdr;
+    char magic[8];
+    uint32_t version;
+    uint32_t pid;
+    uint32_t prefix;
+    uint8_t ptr_size;
+    uint8_t long_size;
+    uint8_t ldbl_size;
+    uint8_t reserved;
+};
+
+struct log_bin_str {
+    struct log_bin_hdr hdr;
+    uint64_t id;
+    /* NUL terminated string */
+};
+
+struct log_bin_rec {
+    struct log_bin_hdr hdr;
+    uint64_t ts;
+    uint64_t fmt;
+    uint64_t tag;
+    uint64_t file;
+    uint64_t func;
+    uint32_t line;
+    uint32_t args_len;
+    /* 8 byte slots, %s is a uint32_t length and the bytes padded to 8 */
+};
+
+enum log_arg_type {
+    LOG_ARG_NONE = 0,       /* %% */
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_SIZE,
+    LOG_ARG_PTRDIFF,
+    LOG_ARG_INTMAX,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_LDOUBLE,
+    LOG_ARG_PTR,
+    LOG_ARG_STR,
+};
+
+struct log_spec {
+    const char *start;      /* at '%' */
+    const char *end;        /* past the conversion */
+    int type;
+    int star_width;
+    int star_prec;
+    int prec;               /* -1 when not given */
+};
+
+struct log_fmt_info {
+    const char *fmt;
+    int nargs;              /* -1 when the caller has to format it */
+    uint8_t type[LOG_ARGS_MAX];
+    int16_t prec[LOG_ARGS_MAX];     /* of %s, -1 none, -2 from '*' */
+};
+
+/* ids seen by the writer, or id to string in log_decode */
+struct log_dict {
+    uint64_t *ids;
+    char **strs;
+    size_t cap;
+    size_t cnt;
+};
+
+static const char _log_fmt_str[] = "%s";
+static const char _log_fmt_dropped[] = "[liblog] %" PRIu64 " records dropped\n";
+
+/*
+ * async ring: the owner thread is the only producer, it appends whole
+ * records at tail. The consumer is whoever holds _log_async.draining, it
+ * writes [head, tail) out and then moves head. Positions are free running
+ * and size is a power of two, head and tail sit on their own cache lines.
+ * Threads past the budget share one ring under shared_lock.
+ */
+struct log_ring {
+    struct log_ring *next;
+    char *buf;
+    uint32_t size;
+    int dead;
+    int shared;
+    int tid;
+    struct log_fmt_info *fmts;      /* parsed formats, NULL when shared */
+    char pad0[LOG_CACHELINE];
+    uint32_t tail;
+    char pad1[LOG_CACHELINE];
+    uint32_t head;
+    char pad2[LOG_CACHELINE];
+};
+
+static struct {
+    int enable;
+    int running;
+    int policy;
+    int format;
+    int active_format;      /* format latched by log_async_start */
+    int defer;
+    unsigned int gen;       /* bumped by log_async_start, see log_async_ring */
+    uint32_t ring_size;
+    size_t budget;
+    size_t used;
+    uint64_t dropped;
+    uint64_t reported;
+    int sleeping;
+    int waiters;
+    int draining;
+    struct log_ring *rings;
+    struct log_ring *shared;
+    pthread_t thread;
+    pthread_key_t key;
+    pthread_mutex_t lock;   /* ring list, writer sleep and blocked producers */
+    pthread_mutex_t shared_lock;
+    pthread_cond_t wake;
+    pthread_cond_t space;
+    /* owned by the consumer */
+    char *batch;
+    size_t batch_len;
+    unsigned long long file_gen;
+    struct log_dict dict;
+} _log_async = {
+    0, 0, LOG_ASYNC_DROP, LOG_FORMAT_TEXT, LOG_FORMAT_TEXT, 0, 0,
+    LOG_ASYNC_RING_SIZE, LOG_ASYNC_BUDGET,
+};
+
+static void log_meta_init(struct log_meta *m)
+{
+    m->prefix = _log_prefix;
+    m->color = (_log_fp == stderr || _log_fd == STDERR_FILENO);
+    m->pid = -1;
+    m->tid = -1;
+    m->ts = 0;
+}
+
+/*
+ *time: level: process[pid]: [tid] tag: message
+ *             [verbose          ]
+ */
+static void log_line_format(struct log_line *l, int lvl, const char *tag,
+                            const char *file, int line, const char *func,
+                            const char *msg, const struct log_meta *m)
+{
+    struct timeval tv;
+    int i;
+
+    if (m->ts) {
+        tv.tv_sec = m->ts / 1000000000ULL;
+        tv.tv_usec = (m->ts % 1000000000ULL) / 1000;
+    } else {
+        gettimeofday(&tv, NULL);
+    }
+    log_format_time(l->s_time, sizeof(l->s_time), &tv);
+
+    if (m->color) {
+        switch(lvl) {
+        case LOG_EMERG:
+        case LOG_ALERT:
+        case LOG_CRIT:
+        case LOG_ERR:
+            snprintf(l->s_lvl, sizeof(l->s_lvl),
+                    B_RED("[%7s]"), _log_level_str[lvl]);
+            snprintf(l->s_msg, sizeof(l->s_msg), RED("%s"), msg);
+            break;
+        case LOG_WARNING:
+            snprintf(l->s_lvl, sizeof(l->s_lvl),
+                    B_YELLOW("[%7s]"), _log_level_str[lvl]);
+            snprintf(l->s_msg, sizeof(l->s_msg), YELLOW("%s"), msg);
+            break;
+        case LOG_INFO:
+            snprintf(l->s_lvl, sizeof(l->s_lvl),
+                    B_GREEN("[%7s]"), _log_level_str[lvl]);
+            snprintf(l->s_msg, sizeof(l->s_msg), GREEN("%s"), msg);
+            break;
+        case LOG_DEBUG:
+            snprintf(l->s_lvl, sizeof(l->s_lvl),
+                    B_WHITE("[%7s]"), _log_level_str[lvl]);
+            snprintf(l->s_msg, sizeof(l->s_msg), WHITE("%s"), msg);
+            break;
+        default:
+            snprintf(l->s_lvl, sizeof(l->s_lvl),
+                    "[%7s]", _log_level_str[lvl]);
+            snprintf(l->s_msg, sizeof(l->s_msg), "%s", msg);
+            break;
+        }
+    } else {
+        snprintf(l->s_lvl, sizeof(l->s_lvl),
+                "[%7s]", _log_level_str[lvl]);
+        snprintf(l->s_msg, sizeof(l->s_msg), "%s", msg);
+    }
+    if (CHECK_LOG_PREFIX(m->prefix, LOG_PID_BIT)) {
+        snprintf(l->s_pid, sizeof(l->s_pid), "[pid:%d]",
+                 m->pid < 0 ? (int)getpid() : m->pid);
+        snprintf(l->s_tag, sizeof(l->s_tag), "[%s]", tag);
+    }
+    if (CHECK_LOG_PREFIX(m->prefix, LOG_TID_BIT)) {
+        snprintf(l->s_tid, sizeof(l->s_tid), "[tid:%d]",
+                 m->tid < 0 ? (int)gettid() : m->tid);
+        snprintf(l->s_tag, sizeof(l->s_tag), "[%s]", tag);
+    }
+    if (CHECK_LOG_PREFIX(m->prefix, LOG_FUNCLINE_BIT)) {
+        snprintf(l->s_file, sizeof(l->s_file), "[%s:%3d: %s] ", file, line, func);
+    }
+
+    i = -1;
+    if (CHECK_LOG_PREFIX(m->prefix, LOG_TIMESTAMP_BIT)) {
+        l->vec[++i].iov_base = (void *)l->s_time;
+    }
+    if (CHECK_LOG_PREFIX(m->prefix, LOG_PID_BIT)) {
+        l->vec[++i].iov_base = (void *)l->s_pid;
+    }
+    if (CHECK_LOG_PREFIX(m->prefix, LOG_TID_BIT)) {
+        l->vec[++i].iov_base = (void *)l->s_tid;
+    }
+    l->vec[++i].iov_base = (void *)l->s_lvl;
+    if (CHECK_LOG_PREFIX(m->prefix, LOG_TAG_BIT)) {
+        l->vec[++i].iov_base = (void *)l->s_tag;
+    }
+    if (CHECK_LOG_PREFIX(m->prefix, LOG_FUNCLINE_BIT)) {
+        l->vec[++i].iov_base = (void *)l->s_file;
+    }
+    l->vec[++i].iov_base = (void *)l->s_msg;
+
+    l->cnt = i + 1;
+    l->len = 0;
+    for (i = 0; i < l->cnt; i++) {
+        l->vec[i].iov_len = strlen((char *)l->vec[i].iov_base);
+        l->len += l->vec[i].iov_len;
+    }
+}
+
+/*
+ * step to the next conversion of a printf format, returns 1 with it in sp,
+ * 0 at the end and -1 for what can not be deferred: %n, wide chars and
+ * positional arguments
+ */
+static int log_fmt_next(const char **ps, struct log_spec *sp)
+{
+    const char *s = strchr(*ps, '%');
+    int mod = 0;
+
+    if (!s) {
+        return 0;
+    }
+    memset(sp, 0, sizeof(*sp));
+    sp->start = s++;
+    sp->prec = -1;
+    if (*s == '%') {
+        sp->type = LOG_ARG_NONE;
+        sp->end = s + 1;
+        *ps = sp->end;
+        return 1;
+    }
+    while (*s && strchr("-+ #0'", *s)) {
+        s++;
+    }
+    if (*s == '*') {
+        sp->star_width = 1;
+        s++;
+    } else {
+        while (*s >= '0' && *s <= '9') {
+            s++;
+        }
+        if (*s == '$') {
+            return -1;
+        }
+    }
+    if (*s == '.') {
+        s++;
+        sp->prec = 0;
+        if (*s == '*') {
+            sp->star_prec = 1;
+            s++;
+        } else {
+            while (*s >= '0' && *s <= '9') {
+                if (sp->prec < LOG_BIN_STR_MAX) {
+                    sp->prec = sp->prec * 10 + (*s - '0');
+                }
+                s++;
+            }
+        }
+    }
+    switch (*s) {
+    case 'h':
+        s += (s[1] == 'h') ? 2 : 1;
+        break;
+    case 'l':
+        mod = (s[1] == 'l') ? 'q' : 'l';
+        s += (s[1] == 'l') ? 2 : 1;
+        break;
+    case 'q':
+    case 'L':
+    case 'j':
+    case 'z':
+    case 't':
+        mod = *s++;
+        break;
+    default:
+        break;
+    }
+    switch (*s) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+        switch (mod) {
+        case 'l': sp->type = LOG_ARG_LONG;    break;
+        case 'q':
+        case 'L': sp->type = LOG_ARG_LLONG;   break;
+        case 'j': sp->type = LOG_ARG_INTMAX;  break;
+        case 'z': sp->type = LOG_ARG_SIZE;    break;
+        case 't': sp->type = LOG_ARG_PTRDIFF; break;
+        default:  sp->type = LOG_ARG_INT;     break;
+        }
+        break;
+    case 'c':
+        if (mod == 'l') {
+            return -1;
+        }
+        sp->type = LOG_ARG_INT;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        sp->type = (mod == 'L') ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+        break;
+    case 'p':
+        sp->type = LOG_ARG_PTR;
+        break;
+    case 's':
+        if (mod == 'l') {
+            return -1;
+        }
+        sp->type = LOG_ARG_STR;
+        break;
+    default:
+        return -1;
+    }
+    sp->end = s + 1;
+    *ps = sp->end;
+    return 1;
+}
+
+static void log_fmt_parse(struct log_fmt_info *fi, const char *fmt)
+{
+    struct log_spec sp;
+    const char *s = fmt;
+    int ret, n = 0;
+
+    while ((ret = log_fmt_next(&s, &sp)) > 0) {
+        if (sp.type == LOG_ARG_NONE) {
+            continue;
+        }
+        if (n + sp.star_width + sp.star_prec + 1 > LOG_ARGS_MAX) {
+            ret = -1;
+            break;
+        }
+        if (sp.star_width) {
+            fi->type[n] = LOG_ARG_INT;
+            fi->prec[n++] = -1;
+        }
+        if (sp.star_prec) {
+            fi->type[n] = LOG_ARG_INT;
+            fi->prec[n++] = -1;
+        }
+        fi->type[n] = sp.type;
+        fi->prec[n++] = sp.star_prec ? -2 : sp.prec;
+    }
+    fi->nargs = (ret < 0) ? -1 : n;
+    fi->fmt = fmt;
+}
+
+/*
+ * copy the arguments described by fi into 8 byte slots, %s is copied up to
+ * its precision and LOG_BUF_SIZE bytes for all strings of the record
+ */
+static uint32_t log_bin_encode(char *out, const struct log_fmt_info *fi,
+                               va_list ap)
+{
+    uint32_t len = 0, slen, max, room = LOG_BUF_SIZE;
+    int64_t v = 0;
+    int i, last = -1;
+    double d;
+    long double ld;
+    const char *str;
+
+    for (i = 0; i < fi->nargs; i++) {
+        switch (fi->type[i]) {
+        case LOG_ARG_INT:
+            v = va_arg(ap, int);
+            last = (int)v;
+            break;
+        case LOG_ARG_LONG:
+            v = va_arg(ap, long);
+            break;
+        case LOG_ARG_LLONG:
+            v = va_arg(ap, long long);
+            break;
+        case LOG_ARG_SIZE:
+            v = va_arg(ap, size_t);
+            break;
+        case LOG_ARG_PTRDIFF:
+            v = va_arg(ap, ptrdiff_t);
+            break;
+        case LOG_ARG_INTMAX:
+            v = va_arg(ap, intmax_t);
+            break;
+        case LOG_ARG_PTR:
+            v = (int64_t)(uintptr_t)va_arg(ap, void *);
+            break;
+        case LOG_ARG_DOUBLE:
+            d = va_arg(ap, double);
+            memcpy(out + len, &d, sizeof(d));
+            len += 8;
+            continue;
+        case LOG_ARG_LDOUBLE:
+            ld = va_arg(ap, long double);
+            memset(out + len, 0, LOG_BIN_ALIGN(sizeof(ld)));
+            memcpy(out + len, &ld, sizeof(ld));
+            len += LOG_BIN_ALIGN(sizeof(ld));
+            continue;
+        case LOG_ARG_STR:
+            str = va_arg(ap, const char *);
+            if (!str) {
+                slen = LOG_BIN_STR_NULL;
+                memcpy(out + len, &slen, 4);
+                len += 8;
+                continue;
+            }
+            max = room;
+            if (fi->prec[i] >= 0 && (uint32_t)fi->prec[i] < max) {
+                max = fi->prec[i];
+            } else if (fi->prec[i] == -2 && last >= 0 && (uint32_t)last < max) {
+                max = last;
+            }
+            slen = strnlen(str, max);
+            room -= slen;
+            memcpy(out + len, &slen, 4);
+            memcpy(out + len + 4, str, slen);
+            memset(out + len + 4 + slen, 0, LOG_BIN_ALIGN(4 + slen) - 4 - slen);
+            len += LOG_BIN_ALIGN(4 + slen);
+            continue;
+        default:
+            break;
+        }
+        memcpy(out + len, &v, 8);
+        len += 8;
+    }
+    return len;
+}
+
+static int log_str_append(char *out, int size, int n, const char *s, int len)
+{
+    if (n + len > size - 1) {
+        len = size - 1 - n;
+    }
+    memcpy(out + n, s, len);
+    out[n + len] = '\0';
+    return n + len;
+}
+
+/* the vsnprintf of the deferred path: print fmt with encoded args */
+static int log_bin_render(char *out, int size, const char *fmt,
+                          const char *args, uint32_t args_len)
+{
+    struct log_spec sp;
+    const char *s = fmt, *lit, *p;
+    char spec[64], *q;
+    char str[LOG_BUF_SIZE + 1];
+    int n = 0, ret, k, star[2];
+    uint32_t pos = 0, slen;
+    int64_t v;
+    double d;
+    long double ld;
+
+    out[0] = '\0';
+    for (;;) {
+        lit = s;
+        ret = log_fmt_next(&s, &sp);
+        if (ret <= 0) {
+            n = log_str_append(out, size, n, lit, strlen(lit));
+            break;
+        }
+        n = log_str_append(out, size, n, lit, sp.start - lit);
+        if (sp.type == LOG_ARG_NONE) {
+            n = log_str_append(out, size, n, "%", 1);
+            continue;
+        }
+        for (k = 0; k < sp.star_width + sp.star_prec; k++) {
+            if (pos + 8 > args_len) {
+                return n;
+            }
+            memcpy(&v, args + pos, 8);
+            star[k] = (int)v;
+            pos += 8;
+        }
+        if (sp.end - sp.start > (int)sizeof(spec) - 24) {
+            return n;
+        }
+        k = 0;
+        for (p = sp.start, q = spec; p < sp.end; p++) {
+            if (*p != '*') {
+                if (*p == '.' && p[1] == '*' && star[sp.star_width] < 0) {
+                    p++;        /* negative precision is no precision */
+                    k++;
+                    continue;
+                }
+                *q++ = *p;
+                continue;
+            }
+            q += sprintf(q, "%d", star[k++]);
+        }
+        *q = '\0';
+
+        ret = 0;
+        switch (sp.type) {
+        case LOG_ARG_DOUBLE:
+            if (pos + 8 > args_len) {
+                return n;
+            }
+            memcpy(&d, args + pos, sizeof(d));
+            pos += 8;
+            ret = snprintf(out + n, size - n, spec, d);
+            break;
+        case LOG_ARG_LDOUBLE:
+            if (pos + LOG_BIN_ALIGN(sizeof(ld)) > args_len) {
+                return n;
+            }
+            memcpy(&ld, args + pos, sizeof(ld));
+            pos += LOG_BIN_ALIGN(sizeof(ld));
+            ret = snprintf(out + n, size - n, spec, ld);
+            break;
+        case LOG_ARG_STR:
+            if (pos + 8 > args_len) {
+                return n;
+            }
+            memcpy(&slen, args + pos, 4);
+            if (slen == LOG_BIN_STR_NULL) {
+                pos += 8;
+                ret = snprintf(out + n, size - n, spec, (char *)NULL);
+                break;
+            }
+            if (slen >= sizeof(str) || pos + LOG_BIN_ALIGN(4 + slen) > args_len) {
+                return n;
+            }
+            memcpy(str, args + pos + 4, slen);
+            str[slen] = '\0';
+            pos += LOG_BIN_ALIGN(4 + slen);
+            ret = snprintf(out + n, size - n, spec, str);
+            break;
+        default:
+            if (pos + 8 > args_len) {
+                return n;
+            }
+            memcpy(&v, args + pos, 8);
+            pos += 8;
+            switch (sp.type) {
+            case LOG_ARG_INT:
+                ret = snprintf(out + n, size - n, spec, (int)v);
+                break;
+            case LOG_ARG_LONG:
+                ret = snprintf(out + n, size - n, spec, (long)v);
+                break;
+            case LOG_ARG_LLONG:
+                ret = snprintf(out + n, size - n, spec, (long long)v);
+                break;
+            case LOG_ARG_SIZE:
+                ret = snprintf(out + n, size - n, spec, (size_t)v);
+                break;
+            case LOG_ARG_PTRDIFF:
+                ret = snprintf(out + n, size - n, spec, (ptrdiff_t)v);
+                break;
+            case LOG_ARG_INTMAX:
+                ret = snprintf(out + n, size - n, spec, (intmax_t)v);
+                break;
+            case LOG_ARG_PTR:
+                ret = snprintf(out + n, size - n, spec, (void *)(uintptr_t)v);
+                break;
+            default:
+                break;
+            }
+            break;
+        }
+        if (ret > 0) {
+            n = MIN(n + ret, size - 1);
+        }
+    }
+    return n;
+}
+
+static int log_dict_init(struct log_dict *d, int with_strs)
+{
+    d->cap = LOG_DICT_INIT;
+    d->cnt = 0;
+    d->ids = (uint64_t *)calloc(d->cap, sizeof(uint64_t));
+    d->strs = with_strs ? (char **)calloc(d->cap, sizeof(char *)) : NULL;
+    if (!d->ids || (with_strs && !d->strs)) {
+        free(d->ids);
+        free(d->strs);
+        memset(d, 0, sizeof(*d));
+        return -1;
+    }
+    return 0;
+}
+
+static void log_dict_reset(struct log_dict *d)
+{
+    size_t i;
+    for (i = 0; d->strs && i < d->cap; i++) {
+        free(d->strs[i]);
+    }
+    if (d->strs) {
+        memset(d->strs, 0, d->cap * sizeof(char *));
+    }
+    if (d->ids) {
+        memset(d->ids, 0, d->cap * sizeof(uint64_t));
+    }
+    d->cnt = 0;
+}
+
+static void log_dict_free(struct log_dict *d)
+{
+    log_dict_reset(d);
+    free(d->ids);
+    free(d->strs);
+    memset(d, 0, sizeof(*d));
+}
+
+static size_t log_dict_slot(const struct log_dict *d, uint64_t id)
+{
+    size_t i = (size_t)((id * 0x9E3779B97F4A7C15ULL) >> 40) & (d->cap - 1);
+    while (d->ids[i] && d->ids[i] != id) {
+        i = (i + 1) & (d->cap - 1);
+    }
+    return i;
+}
+
+static const char *log_dict_get(const struct log_dict *d, uint64_t id)
+{
+    size_t i;
+    if (!id) {
+        return NULL;
+    }
+    i = log_dict_slot(d, id);
+    return (d->ids[i] == id && d->strs) ? d->strs[i] : "?";
+}
+
+static int log_dict_grow(struct log_dict *d)
+{
+    struct log_dict n;
+    size_t i, j;
+
+    n.cap = d->cap * 2;
+    n.cnt = d->cnt;
+    n.ids = (uint64_t *)calloc(n.cap, sizeof(uint64_t));
+    n.strs = d->strs ? (char **)calloc(n.cap, sizeof(char *)) : NULL;
+    if (!n.ids || (d->strs && !n.strs)) {
+        free(n.ids);
+        free(n.strs);
+        return -1;
+    }
+    for (i = 0; i < d->cap; i++) {
+        if (d->ids[i]) {
+            j = log_dict_slot(&n, d->ids[i]);
+            n.ids[j] = d->ids[i];
+            if (n.strs) {
+                n.strs[j] = d->strs[i];
+            }
+        }
+    }
+    free(d->ids);
+    free(d->strs);
+    *d = n;
+    return 0;
+}
+
+/*
+ * returns 1 when id is new, the table is kept under half full and is not
+ * grown in crash mode, an id which does not fit is reported as new again
+ */
+static int log_dict_add(struct log_dict *d, uint64_t id, const char *str,
+                        int grow)
+{
+    size_t i;
+
+    if ((d->cnt + 1) * 2 > d->cap && (!grow || log_dict_grow(d) < 0)) {
+        i = log_dict_slot(d, id);
+        return d->ids[i] != id;
+    }
+    i = log_dict_slot(d, id);
+    if (d->ids[i] == id) {
+        if (!d->strs) {
+            return 0;
+        }
+        free(d->strs[i]);
+    } else {
+        d->ids[i] = id;
+        d->cnt++;
+    }
+    if (d->strs) {
+        d->strs[i] = strdup(str);
+    }
+    return 1;
+}
+
+static struct log_ring *log_ring_alloc(int shared)
+{
+    size_t fmts = shared ? 0 : LOG_FMT_CACHE * sizeof(struct log_fmt_info);
+    struct log_ring *r;
+
+    r = (struct log_ring *)calloc(1, sizeof(*r) + _log_async.ring_size + fmts);
+    if (!r) {
+        return NULL;
+    }
+    r->buf = (char *)(r + 1);
+    r->size = _log_async.ring_size;
+    r->shared = shared;
+    r->tid = shared ? 0 : (int)gettid();
+    r->fmts = fmts ? (struct log_fmt_info *)(r->buf + r->size) : NULL;
+    return r;
+}
+
+static struct log_ring *log_ring_create(void)
+{
+    struct log_ring *r = NULL;
+
+    pthread_mutex_lock(&_log_async.lock);
+    if (_log_async.used + _log_async.ring_size <= _log_async.budget) {
+        r = log_ring_alloc(0);
+        if (r) {
+            r->next = _log_async.rings;
+            ATOMIC_STORE(&_log_async.rings, r);
+            _log_async.used += r->size;
+        }
+    }
+    pthread_mutex_unlock(&_log_async.lock);
+    if (!r) {
+        r = _log_async.shared;
+    }
+    pthread_setspecific(_log_async.key, r);
+    return r;
+}
+
+static void log_ring_release(void *arg)
+{
+    struct log_ring *r = (struct log_ring *)arg;
+    if (!r->shared) {
+        ATOMIC_STORE(&r->dead, 1);
+    }
+}
+
+static void log_ring_copy(struct log_ring *r, uint32_t pos,
+                          const void *src, size_t len)
+{
+    uint32_t off = pos & (r->size - 1);
+    size_t n = MIN(len, (size_t)(r->size - off));
+    memcpy(r->buf + off, src, n);
+    memcpy(r->buf, (const char *)src + n, len - n);
+}
+
+static int log_async_lock_drain(int spins)
+{
+    while (ATOMIC_XCHG(&_log_async.draining, 1)) {
+        if (spins >= 0 && spins-- == 0) {
+            return -1;
+        }
+        sched_yield();
+    }
+    return 0;
+}
+
+static void log_async_unlock_drain(void)
+{
+    ATOMIC_STORE(&_log_async.draining, 0);
+}
+
+static int log_async_fd(void)
+{
+    if (_log_use_io) {
+        return _log_fd;
+    }
+    return _log_fp ? fileno(_log_fp) : STDERR_FILENO;
+}
+
+/* crash mode write, _log_mutex may be held by the crashed thread */
+static ssize_t log_async_crash_write(const struct iovec *vec, int n)
+{
+#ifdef LOG_MMAP_OPS
+    if (_log_handle == &log_mmap_ops && _log_mmap.fd != -1) {
+        _log_mmap.crash = 1;
+        return log_mmap_append(vec, n);
+    }
+#endif
+    return writev(log_async_fd(), vec, n);
+}
+
+static void log_async_space(int crash)
+{
+    if (!crash && ATOMIC_LOAD_SEQ(&_log_async.waiters)) {
+        pthread_mutex_lock(&_log_async.lock);
+        pthread_cond_broadcast(&_log_async.space);
+        pthread_mutex_unlock(&_log_async.lock);
+    }
+}
+
+static size_t log_async_commit(struct iovec *vec, int n,
+                               struct log_ring **batch, uint32_t *pos,
+                               int nr, int crash)
+{
+    size_t len = 0;
+    int i;
+
+    if (crash) {
+        if (log_async_crash_write(vec, n) < 0) {
+            return 0;
+        }
+    } else {
+        pthread_mutex_lock(&_log_mutex);
+        _log_handle->write(vec, n);
+        pthread_mutex_unlock(&_log_mutex);
+    }
+    for (i = 0; i < n; i++) {
+        len += vec[i].iov_len;
+    }
+    for (i = 0; i < nr; i++) {
+        ATOMIC_STORE_SEQ(&batch[i]->head, pos[i]);
+    }
+    log_async_space(crash);
+    return len;
+}
+
+/*
+ * gather the committed bytes of all rings into one writev, in crash mode
+ * _log_mutex may be held by the crashed thread, so write to the fd directly
+ */
+static size_t log_async_drain_text(int crash)
+{
+    struct iovec vec[LOG_ASYNC_IOV];
+    struct log_ring *batch[LOG_ASYNC_IOV];
+    uint32_t pos[LOG_ASYNC_IOV];
+    struct log_ring *r;
+    uint32_t head, tail, off;
+    size_t total = 0;
+    int n = 0, nr = 0;
+
+    for (r = ATOMIC_LOAD(&_log_async.rings); r; r = r->next) {
+        head = r->head;
+        tail = ATOMIC_LOAD(&r->tail);
+        if (head == tail) {
+            continue;
+        }
+        if (n + 2 > LOG_ASYNC_IOV) {
+            total += log_async_commit(vec, n, batch, pos, nr, crash);
+            n = nr = 0;
+        }
+        off = head & (r->size - 1);
+        vec[n].iov_base = r->buf + off;
+        vec[n].iov_len = MIN(tail - head, r->size - off);
+        if (vec[n].iov_len < tail - head) {
+            vec[n + 1].iov_base = r->buf;
+            vec[n + 1].iov_len = tail - head - vec[n].iov_len;
+            n++;
+        }
+        n++;
+        batch[nr] = r;
+        pos[nr++] = tail;
+    }
+    if (n) {
+        total += log_async_commit(vec, n, batch, pos, nr, crash);
+    }
+    return total;
+}
+
+static void log_batch_flush(int crash)
+{
+    struct iovec vec;
+
+    if (!_log_async.batch_len) {
+        return;
+    }
+    vec.iov_base = _log_async.batch;
+    vec.iov_len = _log_async.batch_len;
+    if (crash) {
+        if (log_async_crash_write(&vec, 1) < 0) {
+            _log_async.batch_len = 0;
+        }
+    } else {
+        pthread_mutex_lock(&_log_mutex);
+        _log_handle->write(&vec, 1);
+        pthread_mutex_unlock(&_log_mutex);
+    }
+    _log_async.batch_len = 0;
+}
+
+static char *log_batch_reserve(size_t len, int crash)
+{
+    char *p;
+    if (_log_async.batch_len + len > LOG_BATCH_SIZE) {
+        log_batch_flush(crash);
+    }
+    p = _log_async.batch + _log_async.batch_len;
+    _log_async.batch_len += len;
+    return p;
+}
+
+/*
+ * a batch goes to one file: check split/rotate before filling it and start
+ * the new file with a HEAD entry, ids are defined again from there
+ */
+static void log_bin_begin(int crash)
+{
+    struct log_bin_head *h;
+
+    if (!crash) {
+        pthread_mutex_lock(&_log_mutex);
+        log_file_check();
+        pthread_mutex_unlock(&_log_mutex);
+    }
+    if (_log_async.file_gen == _log_file_gen) {
+        return;
+    }
+    _log_async.file_gen = _log_file_gen;
+    log_dict_reset(&_log_async.dict);
+    h = (struct log_bin_head *)log_batch_reserve(sizeof(*h), crash);
+    memset(h, 0, sizeof(*h));
+    h->hdr.len = sizeof(*h);
+    h->hdr.type = LOG_BIN_HEAD;
+    memcpy(h->magic, LOG_BIN_MAGIC, sizeof(LOG_BIN_MAGIC));
+    h->version = LOG_BIN_VERSION;
+    h->pid = getpid();
+    h->prefix = _log_prefix;
+    h->ptr_size = sizeof(void *);
+    h->long_size = sizeof(long);
+    h->ldbl_size = sizeof(long double);
+}
+
+static void log_bin_add_str(uint64_t id, int crash)
+{
+    struct log_bin_str *e;
+    const char *str = (const char *)(uintptr_t)id;
+    uint32_t len, slen;
+
+    if (!id || !log_dict_add(&_log_async.dict, id, NULL, !crash)) {
+        return;
+    }
+    slen = strnlen(str, LOG_BIN_STR_MAX - 1);
+    len = LOG_BIN_ALIGN(sizeof(*e) + slen + 1);
+    e = (struct log_bin_str *)log_batch_reserve(len, crash);
+    memset(e, 0, len);
+    e->hdr.len = len;
+    e->hdr.type = LOG_BIN_STR;
+    e->id = id;
+    memcpy(e + 1, str, slen);
+}
+
+static void log_bin_add_rec(const struct log_bin_rec *rec, int crash)
+{
+    if (_log_async.batch_len + LOG_BIN_ENTRY_MAX > LOG_BATCH_SIZE) {
+        log_batch_flush(crash);
+    }
+    if (_log_async.batch_len == 0) {
+        log_bin_begin(crash);
+    }
+    log_bin_add_str(rec->fmt, crash);
+    log_bin_add_str(rec->tag, crash);
+    log_bin_add_str(rec->file, crash);
+    log_bin_add_str(rec->func, crash);
+    memcpy(log_batch_reserve(rec->hdr.len, crash), rec, rec->hdr.len);
+}
+
+static void log_text_add_rec(const struct log_bin_rec *rec, int crash)
+{
+    struct log_line l;
+    struct log_meta m;
+    char msg[LOG_BUF_SIZE];
+    char *p;
+    int i;
+
+    log_bin_render(msg, sizeof(msg), (const char *)(uintptr_t)rec->fmt,
+                   (const char *)(rec + 1), rec->args_len);
+    log_meta_init(&m);
+    m.tid = rec->hdr.tid;
+    m.ts = rec->ts;
+    log_line_format(&l, rec->hdr.lvl, (const char *)(uintptr_t)rec->tag,
+                    (const char *)(uintptr_t)rec->file, rec->line,
+                    (const char *)(uintptr_t)rec->func, msg, &m);
+    p = log_batch_reserve(l.len, crash);
+    for (i = 0; i < l.cnt; i++) {
+        memcpy(p, l.vec[i].iov_base, l.vec[i].iov_len);
+        p += l.vec[i].iov_len;
+    }
+}
+
+/*
+ * turn the records of all rings into text or binary entries in the batch,
+ * in crash mode formatting is not async signal safe but beats losing them
+ */
+static size_t log_async_drain_rec(int crash)
+{
+    uint64_t tmp[LOG_BIN_REC_MAX / 8];
+    const struct log_bin_rec *rec;
+    struct log_ring *r;
+    uint32_t head, tail, off, len;
+    size_t total = 0;
+
+    for (r = ATOMIC_LOAD(&_log_async.rings); r; r = r->next) {
+        head = r->head;
+        tail = ATOMIC_LOAD(&r->tail);
+        if (head == tail) {
+            continue;
+        }
+        while (head != tail) {
+            off = head & (r->size - 1);
+            len = ((struct log_bin_hdr *)(r->buf + off))->len;
+            if (off + len > r->size) {
+                memcpy(tmp, r->buf + off, r->size - off);
+                memcpy((char *)tmp + r->size - off, r->buf, len - (r->size - off));
+                rec = (const struct log_bin_rec *)tmp;
+            } else {
+                rec = (const struct log_bin_rec *)(r->buf + off);
+            }
+            if (_log_async.active_format == LOG_FORMAT_BINARY) {
+                log_bin_add_rec(rec, crash);
+            } else {
+                log_text_add_rec(rec, crash);
+            }
+            head += len;
+            total += len;
+        }
+        ATOMIC_STORE_SEQ(&r->head, head);
+        log_async_space(crash);
+    }
+    log_batch_flush(crash);
+    return total;
+}
+
+static size_t log_async_drain(int crash)
+{
+    if (_log_async.defer) {
+        return log_async_drain_rec(crash);
+    }
+    return log_async_drain_text(crash);
+}
+
+/* free rings of exited threads once they are empty */
+static void log_async_reap(void)
+{
+    struct log_ring **pp, *r;
+
+    pthread_mutex_lock(&_log_async.lock);
+    for (pp = &_log_async.rings; (r = *pp) != NULL; ) {
+        if (ATOMIC_LOAD(&r->dead) && r->head == ATOMIC_LOAD(&r->tail)) {
+            *pp = r->next;
+            _log_async.used -= r->size;
+            free(r);
+        } else {
+            pp = &r->next;
+        }
+    }
+    pthread_mutex_unlock(&_log_async.lock);
+}
+
+static void log_async_report(void)
+{
+    struct iovec vec;
+    uint64_t buf[LOG_BIN_REC_MAX / 8];
+    struct log_bin_rec *rec = (struct log_bin_rec *)buf;
+    struct timespec ts;
+    uint64_t dropped = ATOMIC_LOAD(&_log_async.dropped);
+    uint64_t cnt = dropped - _log_async.reported;
+
+    if (!cnt) {
+        return;
+    }
+    _log_async.reported = dropped;
+    if (_log_async.defer) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        memset(rec, 0, sizeof(*rec));
+        rec->hdr.len = sizeof(*rec) + 8;
+        rec->hdr.type = LOG_BIN_REC;
+        rec->hdr.lvl = LOG_WARNING;
+        rec->hdr.tid = gettid();
+        rec->ts = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        rec->fmt = (uintptr_t)_log_fmt_dropped;
+        rec->tag = (uintptr_t)"liblog";
+        rec->file = (uintptr_t)__FILE__;
+        rec->func = (uintptr_t)__func__;
+        rec->line = __LINE__;
+        rec->args_len = 8;
+        memcpy(rec + 1, &cnt, 8);
+        if (_log_async.active_format == LOG_FORMAT_BINARY) {
+            log_bin_add_rec(rec, 0);
+        } else {
+            log_text_add_rec(rec, 0);
+        }
+        log_batch_flush(0);
+        return;
+    }
+    vec.iov_base = buf;
+    vec.iov_len = snprintf((char *)buf, sizeof(buf), _log_fmt_dropped, cnt);
+    pthread_mutex_lock(&_log_mutex);
+    _log_handle->write(&vec, 1);
+    pthread_mutex_unlock(&_log_mutex);
+}
+
+/* one flush of the FILE backend per batch, not per record */
+static void log_async_flush(void)
+{
+    log_async_lock_drain(-1);
+    if (log_async_drain(0)) {
+        pthread_mutex_lock(&_log_mutex);
+        _log_handle->flush();
+        pthread_mutex_unlock(&_log_mutex);
+    }
+    log_async_reap();
+    log_async_report();
+    log_async_unlock_drain();
+}
+
+static void *log_async_loop(void *arg)
+{
+    struct timespec ts;
+
+    while (ATOMIC_LOAD(&_log_async.running)) {
+        log_async_flush();
+
+        pthread_mutex_lock(&_log_async.lock);
+        if (_log_async.running && !_log_async.waiters) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += LOG_ASYNC_INTERVAL * 1000000L;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            ATOMIC_STORE_SEQ(&_log_async.sleeping, 1);
+            pthread_cond_timedwait(&_log_async.wake, &_log_async.lock, &ts);
+            ATOMIC_STORE_SEQ(&_log_async.sleeping, 0);
+        }
+        pthread_mutex_unlock(&_log_async.lock);
+    }
+    return NULL;
+}
+
+static int log_async_wait(struct log_ring *r, uint32_t len)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&_log_async.lock);
+    ATOMIC_STORE_SEQ(&_log_async.waiters, _log_async.waiters + 1);
+    while (r->size - (r->tail - ATOMIC_LOAD_SEQ(&r->head)) < len) {
+        if (!_log_async.running) {
+            ret = -1;
+            break;
+        }
+        pthread_cond_signal(&_log_async.wake);
+        pthread_cond_wait(&_log_async.space, &_log_async.lock);
+    }
+    ATOMIC_STORE_SEQ(&_log_async.waiters, _log_async.waiters - 1);
+    pthread_mutex_unlock(&_log_async.lock);
+    return ret;
+}
+
+#ifdef LOG_TLS
+/* ring of this thread, valid while _log_tls_gen matches _log_async.gen */
+static LOG_TLS struct log_ring *_log_tls_ring;
+static LOG_TLS unsigned int _log_tls_gen;
+#endif
+
+static struct log_ring *log_async_ring(void)
+{
+    struct log_ring *r;
+
+#ifdef LOG_TLS
+    if (LIKELY(_log_tls_gen == _log_async.gen)) {
+        return _log_tls_ring;
+    }
+#endif
+    r = (struct log_ring *)pthread_getspecific(_log_async.key);
+    if (UNLIKELY(!r)) {
+        r = log_ring_create();
+    }
+#ifdef LOG_TLS
+    _log_tls_ring = r;
+    _log_tls_gen = _log_async.gen;
+#endif
+    return r;
+}
+
+static void log_async_push(struct log_ring *r, const struct iovec *vec,
+                           int cnt, uint32_t len)
+{
+    uint32_t head, tail;
+    int i;
+
+    if (UNLIKELY(r->shared)) {
+        pthread_mutex_lock(&_log_async.shared_lock);
+    }
+    tail = r->tail;
+    head = ATOMIC_LOAD(&r->head);
+    if (UNLIKELY(r->size - (tail - head) < len) &&
+        (_log_async.policy != LOG_ASYNC_BLOCK || log_async_wait(r, len) < 0)) {
+        ATOMIC_ADD(&_log_async.dropped, 1);
+    } else {
+        for (i = 0; i < cnt; i++) {
+            log_ring_copy(r, tail, vec[i].iov_base, vec[i].iov_len);
+            tail += vec[i].iov_len;
+        }
+        ATOMIC_STORE(&r->tail, tail);
+
+        /* the writer sleeps between batches, only wake it when half full */
+        if (UNLIKELY(tail - head > (r->size >> 1)) &&
+            ATOMIC_LOAD_SEQ(&_log_async.sleeping)) {
+            pthread_mutex_lock(&_log_async.lock);
+            if (_log_async.sleeping) {
+                ATOMIC_STORE_SEQ(&_log_async.sleeping, 0);
+                pthread_cond_signal(&_log_async.wake);
+            }
+            pthread_mutex_unlock(&_log_async.lock);
+        }
+    }
+    if (UNLIKELY(r->shared)) {
+        pthread_mutex_unlock(&_log_async.shared_lock);
+    }
+}
+
+static const struct log_fmt_info *log_fmt_lookup(struct log_ring *r,
+                        const char *fmt, struct log_fmt_info *tmp)
+{
+    struct log_fmt_info *fi;
+    uintptr_t h = (uintptr_t)fmt;
+
+    if (UNLIKELY(!r->fmts)) {
+        log_fmt_parse(tmp, fmt);
+        return tmp;
+    }
+    fi = &r->fmts[(h ^ (h >> 6)) & (LOG_FMT_CACHE - 1)];
+    if (UNLIKELY(fi->fmt != fmt)) {
+        log_fmt_parse(fi, fmt);
+    }
+    return fi;
+}
+
+/*
+ * deferred formatting: the record keeps pointers and raw arguments, formats
+ * the parser can't defer are printed here and stored as a single %s
+ */
+static int log_async_print(int lvl, const char *tag, const char *file,
+                           int line, const char *func, const char *fmt,
+                           va_list ap)
+{
+    uint64_t buf[LOG_BIN_REC_MAX / 8];
+    struct log_bin_rec *rec = (struct log_bin_rec *)buf;
+    struct log_fmt_info tmp;
+    const struct log_fmt_info *fi;
+    struct log_ring *r = log_async_ring();
+    struct timespec ts;
+    struct iovec vec;
+    uint32_t slen;
+    char *args = (char *)(rec + 1);
+    int n;
+
+    fi = log_fmt_lookup(r, fmt, &tmp);
+    if (LIKELY(fi->nargs >= 0)) {
+        rec->fmt = (uintptr_t)fmt;
+        rec->args_len = log_bin_encode(args, fi, ap);
+    } else {
+        n = vsnprintf(args + 4, LOG_BUF_SIZE, fmt, ap);
+        if (UNLIKELY(n < 0)) {
+            fprintf(stderr, "vsnprintf errno:%d\n", errno);
+            return -1;
+        }
+        slen = MIN(n, LOG_BUF_SIZE - 1);
+        memcpy(args, &slen, 4);
+        memset(args + 4 + slen, 0, LOG_BIN_ALIGN(4 + slen) - 4 - slen);
+        rec->fmt = (uintptr_t)_log_fmt_str;
+        rec->args_len = LOG_BIN_ALIGN(4 + slen);
+    }
+    /* resolution of a kernel tick (1-10ms) for the price of a few loads */
+#ifdef CLOCK_REALTIME_COARSE
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+    rec->hdr.len = sizeof(*rec) + rec->args_len;
+    rec->hdr.type = LOG_BIN_REC;
+    rec->hdr.lvl = lvl;
+    rec->hdr.tid = UNLIKELY(r->shared) ? (int)gettid() : r->tid;
+    rec->ts = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    rec->tag = (uintptr_t)tag;
+    rec->file = (uintptr_t)file;
+    rec->func = (uintptr_t)func;
+    rec->line = line;
+    vec.iov_base = rec;
+    vec.iov_len = rec->hdr.len;
+    log_async_push(r, &vec, 1, rec->hdr.len);
+    return 0;
+}
+
+#if defined (OS_LINUX) || defined (OS_APPLE)
+static const int _log_crash_sig[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+#define LOG_CRASH_SIG_NUM   (int)(sizeof(_log_crash_sig)/sizeof(_log_crash_sig[0]))
+static struct sigaction _log_crash_old[LOG_CRASH_SIG_NUM];
+
+/*
+ * flush what is buffered, then restore the previous handler and raise again
+ * so the process still dies (and dumps core) the way it would without us
+ */
+static void log_async_crash(int sig)
+{
+    int i, locked;
+
+    locked = (log_async_lock_drain(1000) == 0);
+    log_async_drain(1);
+    if (locked) {
+        log_async_unlock_drain();
+    }
+    for (i = 0; i < LOG_CRASH_SIG_NUM; i++) {
+        if (_log_crash_sig[i] == sig) {
+            sigaction(sig, &_log_crash_old[i], NULL);
+        }
+    }
+    raise(sig);
+}
+
+static void log_async_signal_init(void)
+{
+    struct sigaction sa;
+    int i;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = log_async_crash;
+    sigemptyset(&sa.sa_mask);
+    for (i = 0; i < LOG_CRASH_SIG_NUM; i++) {
+        sigaction(_log_crash_sig[i], &sa, &_log_crash_old[i]);
+    }
+}
+
+static void log_async_signal_deinit(void)
+{
+    int i;
+    for (i = 0; i < LOG_CRASH_SIG_NUM; i++) {
+        sigaction(_log_crash_sig[i], &_log_crash_old[i], NULL);
+    }
+}
+#else
+static void log_async_signal_init(void)
+{
+}
+
+static void log_async_signal_deinit(void)
+{
+}
+#endif
+
+static void log_async_free(void)
+{
+    struct log_ring *r, *next;
+
+    for (r = _log_async.rings; r; r = next) {
+        next = r->next;
+        free(r);
+    }
+    _log_async.rings = NULL;
+    _log_async.shared = NULL;
+    _log_async.used = 0;
+    free(_log_async.batch);
+    _log_async.batch = NULL;
+    log_dict_free(&_log_async.dict);
+    pthread_key_delete(_log_async.key);
+    pthread_cond_destroy(&_log_async.space);
+    pthread_cond_destroy(&_log_async.wake);
+    pthread_mutex_destroy(&_log_async.shared_lock);
+    pthread_mutex_destroy(&_log_async.lock);
+}
+
+static int log_async_start(void)
+{
+    if (_log_syslog || !_log_handle) {
+        fprintf(stderr, "async log needs file or stderr output\n");
+        return -1;
+    }
+    if (_log_async.format == LOG_FORMAT_BINARY && _log_output != LOG_FILE) {
+        fprintf(stderr, "binary log needs file output\n");
+        return -1;
+    }
+    /* log_set_format only changes the next start, the writer uses this */
+    _log_async.active_format = _log_async.format;
+    if (0 != pthread_key_create(&_log_async.key, log_ring_release)) {
+        fprintf(stderr, "pthread_key_create failed\n");
+        return -1;
+    }
+    pthread_mutex_init(&_log_async.lock, NULL);
+    pthread_mutex_init(&_log_async.shared_lock, NULL);
+    pthread_cond_init(&_log_async.wake, NULL);
+    pthread_cond_init(&_log_async.space, NULL);
+    _log_async.defer = (_log_async.active_format != LOG_FORMAT_TEXT);
+    /* the rings of the last run are freed, invalidate the cached pointers,
+     * 0 stays the generation of threads that never logged */
+    if (++_log_async.gen == 0) {
+        ++_log_async.gen;
+    }
+    _log_async.dropped = 0;
+    _log_async.reported = 0;
+    _log_async.sleeping = 0;
+    _log_async.waiters = 0;
+    _log_async.draining = 0;
+    _log_async.batch_len = 0;
+    _log_async.file_gen = _log_file_gen - 1;
+    _log_async.batch = (char *)malloc(LOG_BATCH_SIZE);
+    _log_async.shared = log_ring_alloc(1);
+    _log_async.rings = _log_async.shared;
+    _log_async.used = _log_async.ring_size;
+    if (!_log_async.batch || !_log_async.shared ||
+        (_log_async.active_format == LOG_FORMAT_BINARY &&
+         log_dict_init(&_log_async.dict, 0) < 0)) {
+        fprintf(stderr, "malloc async log buffers failed\n");
+        log_async_free();
+        return -1;
+    }
+    _log_async.running = 1;
+    if (0 != pthread_create(&_log_async.thread, NULL, log_async_loop, NULL)) {
+        fprintf(stderr, "pthread_create failed\n");
+        _log_async.running = 0;
+        log_async_free();
+        return -1;
+    }
+    log_async_signal_init();
+    _log_async.enable = 1;
+    return 0;
+}
+
+static void log_async_stop(void)
+{
+    _log_async.enable = 0;
+    log_async_signal_deinit();
+    pthread_mutex_lock(&_log_async.lock);
+    ATOMIC_STORE(&_log_async.running, 0);
+    pthread_cond_signal(&_log_async.wake);
+    pthread_cond_broadcast(&_log_async.space);
+    pthread_mutex_unlock(&_log_async.lock);
+    pthread_join(_log_async.thread, NULL);
+
+    log_async_flush();
+    _log_async.defer = 0;
+    log_async_free();
+}
+
+static int _log_print(int lvl, const char *tag,
+                      const char *file, int line,
+                      const char *func, const char *msg)
+{
+    struct log_line l;
+    struct log_meta m;
+    struct log_ring *r;
+    int ret = 0;
+
+    if (_log_async.enable && !_log_syslog) {
+        log_meta_init(&m);
+        log_line_format(&l, lvl, tag, file, line, func, msg, &m);
+        r = log_async_ring();
+        log_async_push(r, l.vec, l.cnt, l.len);
+        return 0;
+    }
+    pthread_mutex_lock(&_log_mutex);
+    log_meta_init(&m);
+    log_line_format(&l, lvl, tag, file, line, func, msg, &m);
+    if (UNLIKELY(!_log_syslog)) {
+        ret = _log_handle->write(l.vec, l.cnt);
+        if (lvl <= LOG_ERR && ret >= 0) {
+            ret = _log_handle->flush();
+        }
+    }
+    pthread_mutex_unlock(&_log_mutex);
+    return ret;
+}
+
+/*
+ * read a LOG_FORMAT_BINARY file and write the text lines it stands for,
+ * a record cut short by a crash ends the decoding without an error
+ */
+int log_decode(const char *in, const char *out)
+{
+    uint64_t buf[65536 / 8];
+    struct log_bin_hdr *hdr = (struct log_bin_hdr *)buf;
+    struct log_bin_head *head = (struct log_bin_head *)buf;
+    struct log_bin_str *str = (struct log_bin_str *)buf;
+    struct log_bin_rec *rec = (struct log_bin_rec *)buf;
+    struct log_dict dict;
+    struct log_meta m;
+    struct log_line l;
+    char msg[LOG_BUF_SIZE];
+    const char *fmt;
+    FILE *fin, *fout;
+    int i, ret = -1, have_head = 0;
+
+    if (!in) {
+        printf("invalid paraments!\n");
+        return -1;
+    }
+    fin = fopen(in, "rb");
+    if (!fin) {
+        printf("fopen %s failed: %s\n", in, strerror(errno));
+        return -1;
+    }
+    fout = out ? fopen(out, "w") : stdout;
+    if (!fout) {
+        printf("fopen %s failed: %s\n", out, strerror(errno));
+        fclose(fin);
+        return -1;
+    }
+    if (log_dict_init(&dict, 1) < 0) {
+        printf("malloc failed\n");
+        goto exit;
+    }
+    memset(&m, 0, sizeof(m));
+    while (fread(hdr, sizeof(*hdr), 1, fin) == 1) {
+        if (hdr->len == 0) {
+            continue;   /* preallocated zeros of an mmap log */
+        }
+        if (hdr->len < sizeof(*hdr) || (hdr->len & 7)) {
+            printf("%s: corrupted entry\n", in);
+            goto exit;
+        }
+        if (fread(hdr + 1, hdr->len - sizeof(*hdr), 1, fin) != 1) {
+            break;
+        }
+        switch (hdr->type) {
+        case LOG_BIN_HEAD:
+            if (hdr->len < sizeof(*head) ||
+                memcmp(head->magic, LOG_BIN_MAGIC, sizeof(LOG_BIN_MAGIC)) ||
+                head->version != LOG_BIN_VERSION) {
+                printf("%s: not a liblog binary file\n", in);
+                goto exit;
+            }
+            if (head->ptr_size != sizeof(void *) ||
+                head->long_size != sizeof(long) ||
+                head->ldbl_size != sizeof(long double)) {
+                printf("%s: written by another ABI\n", in);
+                goto exit;
+            }
+            m.prefix = head->prefix;
+            m.pid = head->pid;
+            log_dict_reset(&dict);
+            have_head = 1;
+            break;
+        case LOG_BIN_STR:
+            if (!have_head || hdr->len <= sizeof(*str)) {
+                printf("%s: corrupted entry\n", in);
+                goto exit;
+            }
+            ((char *)buf)[hdr->len - 1] = '\0';
+            if (log_dict_add(&dict, str->id, (const char *)(str + 1), 1) < 0) {
+                goto exit;
+            }
+            break;
+        case LOG_BIN_REC:
+            if (!have_head || hdr->len < sizeof(*rec) ||
+                rec->args_len > hdr->len - sizeof(*rec)) {
+                printf("%s: corrupted entry\n", in);
+                goto exit;
+            }
+            fmt = log_dict_get(&dict, rec->fmt);
+            log_bin_render(msg, sizeof(msg), fmt ? fmt : "",
+                           (const char *)(rec + 1), rec->args_len);
+            m.tid = hdr->tid;
+            m.ts = rec->ts;
+            log_line_format(&l, MIN(hdr->lvl, LOG_VERB),
+                            log_dict_get(&dict, rec->tag),
+                            log_dict_get(&dict, rec->file), rec->line,
+                            log_dict_get(&dict, rec->func), msg, &m);
+            for (i = 0; i < l.cnt; i++) {
+                fwrite(l.vec[i].iov_base, 1, l.vec[i].iov_len, fout);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    ret = 0;
+exit:
+    log_dict_free(&dict);
+    fclose(fin);
+    if (fout != stdout) {
+        fclose(fout);
+    } else {
+        fflush(fout);
+    }
+    return ret;
+}
+
+#ifdef __ANDROID__
+
+#undef loge
+#define loge(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#undef logw
+#define logw(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+#undef logi
+#define logi(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#undef logd
+#define logd(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#undef logv
+#define logv(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
+
+#else
+
+/*
+ * rate limit: one GCRA token bucket per call site (file, line) or per tag
+ * pointer. tat is when the bucket is empty again, a record passes when
+ * that stays within burst intervals from now, otherwise it is counted and
+ * the count is logged from the same site once it passes again.
+ */
+#define LOG_LIMIT_SLOTS     (1024)
+#define LOG_LIMIT_PROBE     (8)
+
+struct log_limit {
+    uint64_t key;
+    uint64_t tat;
+    uint64_t suppressed;
+    int ready;              /* the site below is set */
+    int lvl;
+    int line;
+    const char *tag;
+    const char *file;
+    const char *func;
+};
+
+static struct {
+    int mode;
+    uint64_t interval;      /* ns per token */
+    uint64_t tolerance;     /* ns, burst tokens */
+    struct log_limit slot[LOG_LIMIT_SLOTS];
+} _log_limit;
+
+static const char _log_fmt_suppressed[] = "[liblog] %" PRIu64 " messages suppressed\n";
+
+static uint64_t log_limit_now(void)
+{
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* find or claim the bucket of key, NULL when its probe range is full */
+static struct log_limit *log_limit_slot(uint64_t key, int lvl, const char *tag,
+                        const char *file, int line, const char *func)
+{
+    struct log_limit *s;
+    uint64_t cur;
+    size_t i, h = (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+
+    for (i = 0; i < LOG_LIMIT_PROBE; i++) {
+        s = &_log_limit.slot[(h + i) & (LOG_LIMIT_SLOTS - 1)];
+        cur = ATOMIC_LOAD(&s->key);
+        if (cur == key) {
+            return s;
+        }
+        if (cur == 0) {
+            if (ATOMIC_CAS64(&s->key, &cur, key)) {
+                s->lvl = lvl;
+                s->tag = tag;
+                s->file = file;
+                s->line = line;
+                s->func = func;
+                ATOMIC_STORE(&s->ready, 1);
+                return s;
+            }
+            if (cur == key) {
+                return s;
+            }
+        }
+    }
+    return NULL;
+}
+
+static pthread_once_t _log_auto_once = PTHREAD_ONCE_INIT;
+
+static void log_auto_init(void)
+{
+    log_init(0, NULL);
+}
+
+static int log_vprint(int lvl, const char *tag, const char *file,
+                      int line, const char *func, const char *fmt, va_list ap)
+{
+    char buf[LOG_BUF_SIZE];
+    int n;
+
+    if (_log_async.defer) {
+        return log_async_print(lvl, tag, file, line, func, fmt, ap);
+    }
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    if (UNLIKELY(n < 0)) {
+        fprintf(stderr, "vsnprintf errno:%d\n", errno);
+        return -1;
+    }
+#ifdef USE_SYSLOG
+    if (UNLIKELY(_log_syslog)) {
+        syslog(lvl, "%s", buf);
+    }
+#endif
+    return _log_print(lvl, tag, file, line, func, buf);
+}
+
+static int log_print_raw(int lvl, const char *tag, const char *file,
+                         int line, const char *func, const char *fmt, ...)
+{
+    va_list ap;
+    int ret;
+
+    va_start(ap, fmt);
+    ret = log_vprint(lvl, tag, file, line, func, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+static int log_limit_pass(int mode, int lvl, const char *tag,
+                          const char *file, int line, const char *func)
+{
+    struct log_limit *s;
+    uint64_t key, now, tat, next, cnt, interval, tolerance;
+
+    if (mode == LOG_RATELIMIT_TAG) {
+        key = (uintptr_t)tag;
+    } else {
+        key = (uintptr_t)file * 31 + line;
+    }
+    s = log_limit_slot(key ? key : 1, lvl, tag, file, line, func);
+    if (!s) {
+        return 1;
+    }
+    interval = ATOMIC_LOAD(&_log_limit.interval);
+    tolerance = ATOMIC_LOAD(&_log_limit.tolerance);
+    now = log_limit_now();
+    tat = ATOMIC_LOAD(&s->tat);
+    do {
+        next = MAX(tat, now) + interval;
+        if (next - now > tolerance) {
+            ATOMIC_ADD(&s->suppressed, 1);
+            return 0;
+        }
+    } while (!ATOMIC_CAS64(&s->tat, &tat, next));
+
+    if (UNLIKELY(ATOMIC_LOAD(&s->suppressed))) {
+        cnt = ATOMIC_XCHG64(&s->suppressed, 0);
+        if (cnt) {
+            log_print_raw(lvl, tag, file, line, func, _log_fmt_suppressed, cnt);
+        }
+    }
+    return 1;
+}
+
+/* log what is still suppressed, from the site that suppressed it */
+static void log_limit_flush(void)
+{
+    struct log_limit *s;
+    uint64_t cnt;
+    int i;
+
+    if (!_is_log_init) {
+        return;
+    }
+    for (i = 0; i < LOG_LIMIT_SLOTS; i++) {
+        s = &_log_limit.slot[i];
+        if (!ATOMIC_LOAD(&s->ready) || !ATOMIC_LOAD(&s->suppressed)) {
+            continue;
+        }
+        cnt = ATOMIC_XCHG64(&s->suppressed, 0);
+        if (cnt) {
+            log_print_raw(s->lvl, s->tag, s->file, s->line, s->func,
+                          _log_fmt_suppressed, cnt);
+        }
+    }
+}
+
+int log_print(int lvl, const char *tag, const char *file,
+              int line, const char *func, const char *fmt, ...)
+{
+    va_list ap;
+    int ret, mode;
+
+    if (UNLIKELY(!_is_log_init)) {
+        pthread_once(&_log_auto_once, log_auto_init);
+    }
+
+    if (lvl > _log_level) {
+        return 0;
+    }
+    mode = ATOMIC_LOAD(&_log_limit.mode);
+    if (UNLIKELY(mode) && !log_limit_pass(mode, lvl, tag, file, line, func)) {
+        return 0;
+    }
+    va_start(ap, fmt);
+    ret = log_vprint(lvl, tag, file, line, func, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+#endif
+
+void log_set_level(int level)
+{
+    if (level > LOG_VERB || level < LOG_EMERG) {
         _log_level = LOG_LEVEL_DEFAULT;
     } else {
         _log_level = level;
     }
 }
 
-static void log_check_env(int *lvl, int *out)
+static void log_check_env(int *lvl, int *out, int *async)
 {
     const char *levelstr = level_str(getenv(LOG_LEVEL_ENV));
     const char *outputstr = output_str(getenv(LOG_OUTPUT_ENV));
     const char *timestr = time_str(getenv(LOG_TIMESTAMP_ENV));
+    const char *asyncstr = getenv(LOG_ASYNC_ENV);
     int level = atoi(levelstr);
     int output = atoi(outputstr);
     int timestamp = atoi(timestr);
@@ -708,6 +2989,12 @@ static void log_check_env(int *lvl, int *out)
     default:
         break;
     }
+    if (asyncstr) {
+        *async = atoi(asyncstr) > 0 ||
+                 is_str_equal(asyncstr, "y") ||
+                 is_str_equal(asyncstr, "yes") ||
+                 is_str_equal(asyncstr, "true");
+    }
     if (*lvl == LOG_DEBUG) {
         UPDATE_LOG_PREFIX(_log_prefix, LOG_FUNCLINE_BIT);
     }
@@ -730,6 +3017,129 @@ void log_set_rotate(int enable)
     _log_rotate = enable;
 }
 
+int log_set_format(int format)
+{
+    if (format < LOG_FORMAT_TEXT || format > LOG_FORMAT_BINARY) {
+        fprintf(stderr, "invalid log format %d\n", format);
+        return -1;
+    }
+    _log_async.format = format;
+    return 0;
+}
+
+void log_set_async_policy(int policy)
+{
+    _log_async.policy = (policy == LOG_ASYNC_BLOCK) ? LOG_ASYNC_BLOCK
+                                                    : LOG_ASYNC_DROP;
+}
+
+void log_set_async_buffer(size_t thread_size, size_t total_size)
+{
+    uint32_t size = LOG_ASYNC_RING_MIN;
+
+    if (thread_size == 0) {
+        thread_size = LOG_ASYNC_RING_SIZE;
+    }
+    while (size < thread_size && size < (1U << 30)) {
+        size <<= 1;
+    }
+    _log_async.ring_size = size;
+    _log_async.budget = total_size ? total_size : LOG_ASYNC_BUDGET;
+}
+
+int log_set_async(int enable)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&_log_init_mutex);
+    if (enable && !_log_async.enable) {
+        if (!_is_log_init) {
+            fprintf(stderr, "log_init must be called before log_set_async\n");
+            ret = -1;
+        } else {
+            ret = log_async_start();
+        }
+    } else if (!enable && _log_async.enable) {
+        log_async_stop();
+    }
+    pthread_mutex_unlock(&_log_init_mutex);
+    return ret;
+}
+
+void log_flush(void)
+{
+#ifndef __ANDROID__
+    if (ATOMIC_LOAD(&_log_limit.mode)) {
+        log_limit_flush();
+    }
+#endif
+    if (_log_async.enable) {
+        log_async_flush();
+    }
+    if (_is_log_init && _log_handle && !_log_syslog) {
+        pthread_mutex_lock(&_log_mutex);
+        _log_handle->flush();
+        pthread_mutex_unlock(&_log_mutex);
+    }
+}
+
+int log_set_mmap(size_t segment_size)
+{
+#ifdef LOG_MMAP_OPS
+    long page = sysconf(_SC_PAGESIZE);
+
+    if (segment_size == 0) {
+        _log_mmap_seg = 0;
+        return 0;
+    }
+    if (page <= 0) {
+        page = 4096;
+    }
+    _log_mmap_seg = (segment_size + page - 1) / page * page;
+    return 0;
+#else
+    fprintf(stderr, "mmap log is not supported\n");
+    return -1;
+#endif
+}
+
+void log_set_flush(size_t size, int ms)
+{
+    _log_flush_size = MIN(size, (size_t)LOG_FLUSH_SIZE);
+    ATOMIC_STORE(&_log_flush_ms, ms < 0 ? 0 : ms);
+    if (_log_flusher.running) {
+        /* sleep for the new age */
+        pthread_mutex_lock(&_log_flusher.lock);
+        pthread_cond_signal(&_log_flusher.cond);
+        pthread_mutex_unlock(&_log_flusher.lock);
+    }
+}
+
+void log_set_ratelimit(int mode, int rate, int burst)
+{
+#ifndef __ANDROID__
+    if (mode <= LOG_RATELIMIT_OFF || mode > LOG_RATELIMIT_TAG || rate <= 0) {
+        ATOMIC_STORE(&_log_limit.mode, LOG_RATELIMIT_OFF);
+        log_limit_flush();
+        return;
+    }
+    if (mode != ATOMIC_LOAD(&_log_limit.mode)) {
+        /* stop claiming slots before the table is cleared */
+        ATOMIC_STORE(&_log_limit.mode, LOG_RATELIMIT_OFF);
+        log_limit_flush();
+        memset(_log_limit.slot, 0, sizeof(_log_limit.slot));
+    }
+    ATOMIC_STORE(&_log_limit.interval, 1000000000ULL / rate);
+    ATOMIC_STORE(&_log_limit.tolerance, 1000000000ULL / rate * MAX(burst, 1));
+    ATOMIC_STORE(&_log_limit.mode, mode);
+#endif
+}
+
+uint64_t log_get_dropped(void)
+{
+    return ATOMIC_LOAD(&_log_async.dropped);
+}
+
 static int log_init_stderr(const char *ident)
 {
     _log_fp = stderr;
@@ -751,7 +3161,7 @@ int log_set_path(const char *path)
         fprintf(stderr, "invalid path!\n");
         return -1;
     }
-    strncpy(_log_path, path, sizeof(_log_path));
+    strncpy(_log_path, path, sizeof(_log_path) - 1);
     return 0;
 }
 
@@ -800,16 +3210,20 @@ static int log_init_file(const char *ident)
     if (ident == NULL) {
         log_get_time(_log_name, sizeof(_log_name), 1);
     } else {
-        strncpy(_log_name, ident, sizeof(_log_name));
+        strncpy(_log_name, ident, sizeof(_log_name) - 1);
     }
     _log_fp = NULL;
     _log_fd = 0;
     _log_handle->open(_log_name);
+    if (_log_handle == &log_fio_ops) {
+        log_flush_timer_start();
+    }
     return 0;
 }
 
 static void log_deinit_file(void)
 {
+    log_flush_timer_stop();
     _log_handle->close();
 }
 
@@ -854,16 +3268,15 @@ static struct log_driver log_file_driver = {
 
 static struct log_driver *_log_driver = NULL;
 
-pthread_once_t thread_once = PTHREAD_ONCE_INIT;
-
 static void log_init_once(void)
 {
     int type = _log_type;
     const char *ident = _log_ident;
+    int async = 0;
     if (_is_log_init) {
         return;
     }
-    log_check_env(&_log_level, &_log_output);
+    log_check_env(&_log_level, &_log_output, &async);
 #ifdef LOG_VERBOSE_ENABLE
     UPDATE_LOG_PREFIX(_log_prefix, LOG_VERBOSE_BIT);
 #endif
@@ -881,6 +3294,11 @@ static void log_init_once(void)
     } else {
         _log_handle = &log_fio_ops;
     }
+#ifdef LOG_MMAP_OPS
+    if (_log_mmap_seg) {
+        _log_handle = &log_mmap_ops;
+    }
+#endif
 
     if (CHECK_LOG_PREFIX(_log_prefix, LOG_VERBOSE_BIT)) {
         memset(_proc_name, 0, sizeof(_proc_name));
@@ -913,30 +3331,45 @@ static void log_init_once(void)
         return;
     }
     _log_driver->init(ident);
-    _is_log_init = 1;
     pthread_mutex_init(&_log_mutex, NULL);
+    _is_log_init = 1;
+    if (async) {
+        log_async_start();
+    }
     return;
 }
 
 int log_init(int type, const char *ident)
 {
+    pthread_mutex_lock(&_log_init_mutex);
     _log_type = type;
     _log_ident = ident;
-    if (0 != pthread_once(&thread_once, log_init_once)) {
-        fprintf(stderr, "pthread_once failed\n");
-    }
+    log_init_once();
+    pthread_mutex_unlock(&_log_init_mutex);
     return 0;
 }
 
 void log_deinit(void)
 {
+    pthread_mutex_lock(&_log_init_mutex);
     if (!_is_log_init) {
+        pthread_mutex_unlock(&_log_init_mutex);
         return;
     }
+#ifndef __ANDROID__
+    if (ATOMIC_LOAD(&_log_limit.mode)) {
+        log_limit_flush();
+        memset(_log_limit.slot, 0, sizeof(_log_limit.slot));
+    }
+#endif
+    if (_log_async.enable) {
+        log_async_stop();
+    }
     if (_log_driver) {
         _log_driver->deinit();
         _log_driver = NULL;
     }
     _is_log_init = 0;
     pthread_mutex_destroy(&_log_mutex);
+    pthread_mutex_unlock(&_log_init_mutex);
 }
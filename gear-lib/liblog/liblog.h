@@ -22,7 +22,10 @@
 #ifndef LIBLOG_H
 #define LIBLOG_H
 
-#define LIBLOG_VERSION "1.0.4"
+#define LIBLOG_VERSION "1.1.0"
+
+#include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -49,6 +52,23 @@ typedef enum {
     LOG_MAX_OUTPUT = 255
 } log_type_t;
 
+typedef enum {
+    LOG_ASYNC_DROP  = 0, /*drop the record when the thread buffer is full*/
+    LOG_ASYNC_BLOCK = 1, /*wait for the writer thread to make room*/
+} log_async_policy_t;
+
+typedef enum {
+    LOG_RATELIMIT_OFF  = 0,
+    LOG_RATELIMIT_SITE = 1, /*one budget per call site (file, line)*/
+    LOG_RATELIMIT_TAG  = 2, /*one budget per tag*/
+} log_ratelimit_t;
+
+typedef enum {
+    LOG_FORMAT_TEXT     = 0, /*format in the calling thread*/
+    LOG_FORMAT_DEFERRED = 1, /*store raw args, the writer thread formats them*/
+    LOG_FORMAT_BINARY   = 2, /*store raw args, write binary records for log_decode*/
+} log_format_t;
+
 int log_init(int type, const char *ident);
 void log_deinit();
 
@@ -56,20 +76,102 @@ void log_set_level(int level);
 void log_set_split_size(int size);
 void log_set_rotate(int enable);
 int log_set_path(const char *path);
+
+/*
+ * the FILE backend (built with -DLOG_USE_FIO) flushes once size bytes are
+ * buffered or the oldest record waited ms, records of LOG_ERR and above and
+ * log_flush flush at once, a helper thread flushes records that waited ms
+ * while nothing else was logged. size 0 flushes every record, ms 0
+ * disables the time limit. Defaults are 64KB (also the maximum) and 1000ms.
+ */
+void log_set_flush(size_t size, int ms);
+
+/*
+ * mmap backend for LOG_FILE, set before log_init: the file grows by
+ * preallocated segment_size segments (rounded up to pages) and records are
+ * copied into the mapping, a helper thread maps the next segment and
+ * unmaps the old ones. Records survive a crash of the process in the page
+ * cache, the file then ends in zeros which the next log_init skips.
+ * Split and rotate work as with the other backends. 0 turns it off,
+ * returns -1 where mmap is not supported.
+ */
+int log_set_mmap(size_t segment_size);
+
+/*
+ * rate limit records that pass the level: each site or tag may log burst
+ * records at once and rate records per second after that, the rest are
+ * counted and reported as "N messages suppressed" by the next record that
+ * passes, by log_flush and by log_deinit. In LOG_RATELIMIT_TAG mode the
+ * tag pointer is the key, so tags must be string literals. Changing the
+ * mode must not race with other threads logging, rate 0 turns it off.
+ */
+void log_set_ratelimit(int mode, int rate, int burst);
+
+/*
+ * async mode: log_print copies the formatted record into a lock-free buffer
+ * owned by the calling thread, a background thread batches all buffers into
+ * large writes. Buffers are flushed on log_deinit, log_flush and when the
+ * process gets SIGSEGV/SIGBUS/SIGFPE/SIGILL/SIGABRT.
+ *
+ * thread_size is the buffer size of each thread, total_size bounds the sum
+ * of all buffers, threads started past the budget share one locked buffer.
+ * Buffer size, policy and format take effect on the next log_set_async(1),
+ * which must be called after log_init. log_set_async(0) and log_deinit must
+ * not race with other threads still logging.
+ *
+ * LOG_FORMAT_DEFERRED and LOG_FORMAT_BINARY skip vsnprintf in the caller:
+ * the record keeps a timestamp, the fmt/tag/file/func pointers and the raw
+ * arguments (%s arguments are copied), so fmt and tag must be string
+ * literals or outlive log_deinit. Formats using %n, %ls or positional
+ * arguments are formatted by the caller. LOG_FORMAT_BINARY needs LOG_FILE
+ * output, log_decode turns such a file back into text.
+ */
+int log_set_async(int enable);
+void log_set_async_policy(int policy);
+void log_set_async_buffer(size_t thread_size, size_t total_size);
+void log_flush(void);
+uint64_t log_get_dropped(void);
+int log_set_format(int format);
+int log_decode(const char *in, const char *out);
 int log_print(int lvl, const char *tag, const char *file, int line,
         const char *func, const char *fmt, ...);
 
 #define LOG_LEVEL_ENV     "LIBLOG_LEVEL"
 #define LOG_OUTPUT_ENV    "LIBLOG_OUTPUT"
 #define LOG_TIMESTAMP_ENV "LIBLOG_TIMESTAMP"
+#define LOG_ASYNC_ENV     "LIBLOG_ASYNC"
 
+/*
+ * tag passed by the log macros, define it before including liblog.h to
+ * give a file its own tag, LOG_RATELIMIT_TAG keeps one budget per tag
+ */
+#ifndef LOG_TAG
 #define LOG_TAG "tag"
+#endif
+
+/*
+ * least severe level compiled in: the macros of levels above it compile to
+ * nothing and their arguments are not evaluated. Defaults to LOG_INFO
+ * with NDEBUG and LOG_VERB otherwise, MODE=release passes LOG_INFO. Define
+ * it before including liblog.h to override. It is checked where the macro
+ * is used, so redefining it also works per file.
+ */
+#ifndef LOG_LEVEL_MIN
+#ifdef NDEBUG
+#define LOG_LEVEL_MIN LOG_INFO
+#else
+#define LOG_LEVEL_MIN LOG_VERB
+#endif
+#endif
+
+#define LOG_PRINT(lvl, ...) ((void)((lvl) <= LOG_LEVEL_MIN ? \
+        log_print(lvl, LOG_TAG, __FILE__, __LINE__, __func__, __VA_ARGS__) : 0))
 
-#define loge(...) log_print(LOG_ERR, LOG_TAG, __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define logw(...) log_print(LOG_WARNING, LOG_TAG, __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define logi(...) log_print(LOG_INFO, LOG_TAG, __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define logd(...) log_print(LOG_DEBUG, LOG_TAG, __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define logv(...) log_print(LOG_VERB, LOG_TAG, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#define loge(...) LOG_PRINT(LOG_ERR, __VA_ARGS__)
+#define logw(...) LOG_PRINT(LOG_WARNING, __VA_ARGS__)
+#define logi(...) LOG_PRINT(LOG_INFO, __VA_ARGS__)
+#define logd(...) LOG_PRINT(LOG_DEBUG, __VA_ARGS__)
+#define logv(...) LOG_PRINT(LOG_VERB, __VA_ARGS__)
 
 #ifdef __cplusplus
 }
@@ -20,10 +20,21 @@
  * SOFTWARE.
  ******************************************************************************/
 #include <libposix.h>
+#define LOG_TAG "test"
 #include "liblog.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <dirent.h>
 
 static void test_no_init(void)
 {
@@ -36,6 +47,9 @@ static void test_no_init(void)
         logi("debug msg %d, %s\n", i, tmp);
         logv("debug msg %d, %s\n", i, tmp);
     }
+    /* make MODE=release fails if these strings are in test_liblog.o */
+    logd("level_min release check %d\n", i);
+    logv("level_min release check %d\n", i);
     log_deinit();
 }
 
@@ -86,6 +100,226 @@ static void test_file_noname(void)
     log_deinit();
 }
 
+#define SPLIT_DIR       "tmp/split/"
+#define SPLIT_FILE      SPLIT_DIR "split.log"
+#define SPLIT_SIZE      8192
+
+/* removes the split files and returns how many there were */
+static int split_files(int max_size)
+{
+    char path[512];
+    struct dirent *e;
+    struct stat st;
+    DIR *dir = opendir(SPLIT_DIR);
+    int n = 0;
+
+    while (dir && (e = readdir(dir))) {
+        if (e->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s%s", SPLIT_DIR, e->d_name);
+        if (stat(path, &st) == 0 && st.st_size > max_size) {
+            printf("%s is %d bytes, limit %d\n", path, (int)st.st_size,
+                   max_size);
+            abort();
+        }
+        unlink(path);
+        n++;
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    return n;
+}
+
+/* split and rotate on the byte count kept in memory, not stat */
+static void test_split(void)
+{
+    char buf[SPLIT_SIZE + 1024];
+    FILE *fp;
+    int i, n;
+
+    split_files(1 << 30);
+    log_init(LOG_FILE, SPLIT_FILE);
+    log_set_split_size(SPLIT_SIZE);
+    log_set_rotate(1);
+    for (i = 0; i < 1000; i++) {
+        logi("rotate i=%d\n", i);
+    }
+    log_deinit();
+    n = split_files(SPLIT_SIZE + 256);
+    if (n != 1) {
+        printf("rotate left %d files\n", n);
+        abort();
+    }
+
+    /* an existing file past the limit is split before the first record */
+    fp = fopen(SPLIT_FILE, "w");
+    memset(buf, 'x', sizeof(buf));
+    fwrite(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    log_init(LOG_FILE, SPLIT_FILE);
+    log_set_split_size(SPLIT_SIZE);
+    log_set_rotate(0);
+    logi("after split\n");
+    log_deinit();
+    fp = fopen(SPLIT_FILE, "r");
+    if (!fp || !fgets(buf, sizeof(buf), fp) || !strstr(buf, "after split")) {
+        printf("existing file was not split\n");
+        abort();
+    }
+    fclose(fp);
+    n = split_files(sizeof(buf));
+    if (n != 2) {
+        printf("split left %d files\n", n);
+        abort();
+    }
+    log_set_split_size(0x7fffffff);
+    printf("split: ok\n");
+}
+
+#define AGE_FILE        "tmp/age.log"
+
+/* a lone record reaches the file within the flush age, no later write needed */
+static void test_flush_age(void)
+{
+    char buf[256] = {0};
+    FILE *fp;
+
+    unlink(AGE_FILE);
+    log_init(LOG_FILE, AGE_FILE);
+    log_set_flush(64*1024, 100);
+    logi("aged record\n");
+    usleep(500*1000);
+    fp = fopen(AGE_FILE, "r");
+    if (!fp || !fread(buf, 1, sizeof(buf) - 1, fp) || !strstr(buf, "aged record")) {
+        printf("record still buffered after the flush age\n");
+        abort();
+    }
+    fclose(fp);
+    log_deinit();
+    log_set_flush(64*1024, 1000);
+    unlink(AGE_FILE);
+    printf("flush age: ok\n");
+}
+
+#define MMAP_FILE       "tmp/mmap.log"
+#define MMAP_TEXT       "tmp/mmap.txt"
+#define MMAP_SEGMENT    16384
+
+/*
+ * check the file has no zero bytes left from preallocation and holds
+ * "mmap i=0" up to i=n-1 in order, returns the size of the file
+ */
+static long mmap_check(int n)
+{
+    static char data[1 << 20];
+    char *p, *q;
+    FILE *fp = fopen(MMAP_FILE, "r");
+    long len;
+    int i = 0;
+
+    if (!fp) {
+        printf("open %s failed\n", MMAP_FILE);
+        abort();
+    }
+    len = fread(data, 1, sizeof(data) - 1, fp);
+    fclose(fp);
+    data[len] = '\0';
+    if ((long)strlen(data) != len) {
+        printf("%s has a zero byte at %d of %ld\n", MMAP_FILE,
+               (int)strlen(data), len);
+        abort();
+    }
+    for (p = data; (q = strstr(p, "mmap i=")); p = q + 7) {
+        if (atoi(q + 7) != i) {
+            printf("mmap: expect i=%d, got i=%d\n", i, atoi(q + 7));
+            abort();
+        }
+        i++;
+    }
+    if (i != n) {
+        printf("mmap: %d of %d lines\n", i, n);
+        abort();
+    }
+    return len;
+}
+
+static void test_mmap(void)
+{
+    struct stat st;
+    pid_t pid;
+    int i, status;
+
+    unlink(MMAP_FILE);
+    log_set_mmap(MMAP_SEGMENT);
+    log_init(LOG_FILE, MMAP_FILE);
+    log_set_level(LOG_INFO);
+    for (i = 0; i < 2000; i++) {
+        logi("mmap i=%d\n", i);
+    }
+    log_deinit();
+    mmap_check(2000);
+
+    /* append after a clean close */
+    log_init(LOG_FILE, MMAP_FILE);
+    for (; i < 2010; i++) {
+        logi("mmap i=%d\n", i);
+    }
+    log_deinit();
+    mmap_check(2010);
+
+    /* a crash leaves the records and a zero tail the next open skips */
+    pid = fork();
+    if (pid == 0) {
+        log_init(LOG_FILE, MMAP_FILE);
+        for (; i < 2020; i++) {
+            logi("mmap i=%d\n", i);
+        }
+        abort();
+    }
+    waitpid(pid, &status, 0);
+    i += 10;
+    stat(MMAP_FILE, &st);
+    log_init(LOG_FILE, MMAP_FILE);
+    logi("mmap i=%d\n", i++);
+    log_deinit();
+    if (mmap_check(i) >= st.st_size) {
+        printf("mmap: crash left no preallocated tail\n");
+        abort();
+    }
+
+    /* binary records may end in zeros, they must survive the reopen */
+    unlink(MMAP_FILE);
+    pid = fork();
+    if (pid == 0) {
+        log_init(LOG_FILE, MMAP_FILE);
+        log_set_format(LOG_FORMAT_BINARY);
+        log_set_async(1);
+        for (i = 0; i < 10; i++) {
+            logi("mmap i=%d %s %d\n", i, "", 0);
+        }
+        abort();
+    }
+    waitpid(pid, &status, 0);
+    log_init(LOG_FILE, MMAP_FILE);
+    log_set_format(LOG_FORMAT_BINARY);
+    log_set_async(1);
+    logi("mmap i=%d %s %d\n", 10, "", 0);
+    log_deinit();
+    log_set_format(LOG_FORMAT_TEXT);
+    if (log_decode(MMAP_FILE, MMAP_TEXT)) {
+        printf("mmap: log_decode failed\n");
+        abort();
+    }
+    rename(MMAP_TEXT, MMAP_FILE);
+    mmap_check(11);
+
+    log_set_mmap(0);
+    unlink(MMAP_FILE);
+    printf("mmap: ok\n");
+}
+
 static void *test(void *arg)
 {
     int i;
@@ -103,19 +337,622 @@ static void *test(void *arg)
 
 static void test_thread_log(void)
 {
-    pthread_t pid;
-    pthread_create(&pid, NULL, test, "test1");
-    pthread_create(&pid, NULL, test, "test2");
-    pthread_create(&pid, NULL, test, "test3");
-    pthread_join(pid, NULL);
+    pthread_t pid[3];
+    pthread_create(&pid[0], NULL, test, "test1");
+    pthread_create(&pid[1], NULL, test, "test2");
+    pthread_create(&pid[2], NULL, test, "test3");
+    pthread_join(pid[0], NULL);
+    pthread_join(pid[1], NULL);
+    pthread_join(pid[2], NULL);
+    log_deinit();
+}
+
+#define ASYNC_THREADS   4
+#define ASYNC_LINES     2000
+#define ASYNC_FILE      "tmp/async.log"
+#define ASYNC_TEXT      "tmp/async.txt"
+
+/* binary logs are read through log_decode */
+static FILE *async_open(int format)
+{
+    const char *name = ASYNC_FILE;
+    FILE *fp;
+
+    if (format == LOG_FORMAT_BINARY) {
+        if (log_decode(ASYNC_FILE, ASYNC_TEXT)) {
+            printf("log_decode %s failed\n", ASYNC_FILE);
+            abort();
+        }
+        name = ASYNC_TEXT;
+    }
+    fp = fopen(name, "r");
+    if (!fp) {
+        printf("open %s failed\n", name);
+        abort();
+    }
+    return fp;
+}
+
+static void *async_worker(void *arg)
+{
+    int i, id = (int)(intptr_t)arg;
+    for (i = 0; i < ASYNC_LINES; i++) {
+        logi("async t=%d i=%d\n", id, i);
+    }
+    return NULL;
+}
+
+/*
+ * run the workers and check every line is in the file once, in order for
+ * each thread, returns the number of lines found
+ */
+static int async_run(int format)
+{
+    pthread_t tid[ASYNC_THREADS];
+    int next[ASYNC_THREADS] = {0};
+    char line[1024];
+    FILE *fp;
+    char *p;
+    int i, t, n = 0, reported = 0, lost;
+
+    for (i = 0; i < ASYNC_THREADS; i++) {
+        pthread_create(&tid[i], NULL, async_worker, (void *)(intptr_t)i);
+    }
+    for (i = 0; i < ASYNC_THREADS; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    log_deinit();
+
+    fp = async_open(format);
+    while (fgets(line, sizeof(line), fp)) {
+        if ((p = strstr(line, "[liblog] "))) {
+            reported += atoi(p + 9);
+            continue;
+        }
+        p = strstr(line, "async t=");
+        if (!p || sscanf(p, "async t=%d i=%d", &t, &i) != 2 ||
+            t < 0 || t >= ASYNC_THREADS || i < next[t]) {
+            printf("bad line: %s", line);
+            abort();
+        }
+        next[t] = i + 1;
+        n++;
+    }
+    fclose(fp);
+    lost = ASYNC_THREADS * ASYNC_LINES - n;
+    if ((uint64_t)lost != log_get_dropped() || lost != reported) {
+        printf("lost %d lines, dropped %d, reported %d\n",
+               lost, (int)log_get_dropped(), reported);
+        abort();
+    }
+    return n;
+}
+
+static void test_async(int format)
+{
+    int n;
+
+    unlink(ASYNC_FILE);
+    log_init(LOG_FILE, ASYNC_FILE);
+    log_set_level(LOG_INFO);
+    log_set_format(format);
+    log_set_async_policy(LOG_ASYNC_BLOCK);
+    log_set_async_buffer(4096, 0);
+    if (log_set_async(1)) {
+        printf("log_set_async failed\n");
+        abort();
+    }
+    n = async_run(format);
+    if (n != ASYNC_THREADS * ASYNC_LINES) {
+        printf("block: got %d lines\n", n);
+        abort();
+    }
+
+    unlink(ASYNC_FILE);
+    log_init(LOG_FILE, ASYNC_FILE);
+    log_set_async_policy(LOG_ASYNC_DROP);
+    log_set_async(1);
+    n = async_run(format);
+    printf("async format %d: block %d lines, drop %d lines %d dropped\n",
+           format, ASYNC_THREADS * ASYNC_LINES, n,
+           ASYNC_THREADS * ASYNC_LINES - n);
+
+    /* one thread fits in the budget, the others share the overflow ring */
+    unlink(ASYNC_FILE);
+    log_init(LOG_FILE, ASYNC_FILE);
+    log_set_async_policy(LOG_ASYNC_BLOCK);
+    log_set_async_buffer(4096, 8192);
+    log_set_async(1);
+    n = async_run(format);
+    if (n != ASYNC_THREADS * ASYNC_LINES) {
+        printf("budget: got %d lines\n", n);
+        abort();
+    }
+    log_set_async_buffer(0, 0);
+    log_set_format(LOG_FORMAT_TEXT);
+    unlink(ASYNC_FILE);
+    unlink(ASYNC_TEXT);
+}
+
+/* log_set_format while async runs only changes the next log_set_async(1) */
+static void test_async_switch(void)
+{
+    char line[1024];
+    FILE *fp;
+    int round, n;
+
+    for (round = 0; round < 2; round++) {
+        unlink(ASYNC_FILE);
+        log_init(LOG_FILE, ASYNC_FILE);
+        log_set_level(LOG_INFO);
+        log_set_format(round ? LOG_FORMAT_BINARY : LOG_FORMAT_DEFERRED);
+        if (log_set_async(1)) {
+            printf("log_set_async failed\n");
+            abort();
+        }
+        logi("switch a\n");
+        log_set_format(round ? LOG_FORMAT_TEXT : LOG_FORMAT_BINARY);
+        logi("switch b\n");
+        log_flush();
+        log_deinit();
+
+        fp = async_open(round ? LOG_FORMAT_BINARY : LOG_FORMAT_TEXT);
+        for (n = 0; fgets(line, sizeof(line), fp); ) {
+            n += strstr(line, "switch ") != NULL;
+        }
+        fclose(fp);
+        if (n != 2) {
+            printf("format switch %d: got %d lines\n", round, n);
+            abort();
+        }
+    }
+    log_set_format(LOG_FORMAT_TEXT);
+    unlink(ASYNC_FILE);
+    unlink(ASYNC_TEXT);
+}
+
+static void test_async_crash(int format)
+{
+    char line[1024];
+    FILE *fp;
+    pid_t pid;
+    int i, status, n = 0;
+
+    unlink(ASYNC_FILE);
+    pid = fork();
+    if (pid == 0) {
+        log_init(LOG_FILE, ASYNC_FILE);
+        log_set_format(format);
+        log_set_async(1);
+        for (i = 0; i < 10; i++) {
+            logi("crash i=%d\n", i);
+        }
+        abort();
+    }
+    waitpid(pid, &status, 0);
+    if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGABRT) {
+        printf("child did not die of SIGABRT\n");
+        abort();
+    }
+    fp = async_open(format);
+    while (fgets(line, sizeof(line), fp)) {
+        if (strstr(line, "crash i=")) {
+            n++;
+        }
+    }
+    fclose(fp);
+    if (n != 10) {
+        printf("crash: %d of 10 lines flushed\n", n);
+        abort();
+    }
+    unlink(ASYNC_FILE);
+    unlink(ASYNC_TEXT);
+    printf("async crash format %d: %d lines flushed\n", format, n);
+}
+
+/* the same call sites in every format, so only the timestamps differ */
+static void format_lines(void)
+{
+    char big[2048];
+    const char *null = NULL;
+    long double ld = 3.25L;
+
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    logi("plain line\n");
+    logi("int %d %i %u %x %X %o %c|\n", -42, 7, 3000000000U, 255, 255, 8, 'z');
+    logi("len %hd %hhu %ld %lld %zu %td %jd\n", (short)-3, (unsigned char)250,
+         -123456789L, -1234567890123LL, (size_t)99, (ptrdiff_t)-5, (intmax_t)77);
+    logi("float %f %.2f %e %g %10.3f %Lf\n", 1.5, 3.14159, 12345.678, 0.0001,
+         -2.5, ld);
+    logi("str [%s] [%10s] [%-6s] [%.3s] [%s]\n", "abc", "right", "left",
+         "truncate", null);
+    logi("star [%*d] [%-*d] [%.*s] [%*.*f] [%.*s]\n", 6, 42, 5, 7, 2, "abcdef",
+         8, 2, 3.14159, -1, "neg");
+    logi("percent 100%% %d%%\n", 50);
+    logi("ptr %p %p\n", (void *)0x1234, NULL);
+    logi("wide %lc fallback %d\n", (wint_t)'w', 1);
+    logi("positional %2$s %1$s\n", "world", "hello");
+    logi("long %s\n", big);
+    logi("two long %s %s\n", big, big);
+    logw("warn %s=%d\n", "key", 1);
+    loge("err %s\n", "failed");
+}
+
+/*
+ * drop every "[YYYY-MM-DD HH:MM:SS.mmm]", lines cut at LOG_BUF_SIZE run
+ * into the next one, the rest must match byte for byte
+ */
+static int format_read(const char *name, char *buf, int size)
+{
+    char line[8192];
+    FILE *fp = fopen(name, "r");
+    char *p;
+    int n = 0;
+
+    if (!fp) {
+        printf("open %s failed\n", name);
+        abort();
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        for (p = line; *p && n < size - 1; p++) {
+            if (p[0] == '[' && strlen(p) > 25 && p[5] == '-' &&
+                p[11] == ' ' && p[24] == ']') {
+                p += 24;
+                continue;
+            }
+            buf[n++] = *p;
+        }
+    }
+    buf[n] = '\0';
+    fclose(fp);
+    return n;
+}
+
+static void test_format(void)
+{
+    static char text[65536], out[65536];
+    int format, n, m;
+
+    for (format = LOG_FORMAT_TEXT; format <= LOG_FORMAT_BINARY; format++) {
+        unlink(ASYNC_FILE);
+        log_init(LOG_FILE, ASYNC_FILE);
+        log_set_level(LOG_INFO);
+        log_set_format(format);
+        if (format != LOG_FORMAT_TEXT && log_set_async(1)) {
+            printf("log_set_async format %d failed\n", format);
+            abort();
+        }
+        format_lines();
+        log_deinit();
+        if (format == LOG_FORMAT_BINARY) {
+            if (log_decode(ASYNC_FILE, ASYNC_TEXT)) {
+                printf("log_decode failed\n");
+                abort();
+            }
+            m = format_read(ASYNC_TEXT, out, sizeof(out));
+        } else if (format == LOG_FORMAT_DEFERRED) {
+            m = format_read(ASYNC_FILE, out, sizeof(out));
+        } else {
+            n = format_read(ASYNC_FILE, text, sizeof(text));
+            continue;
+        }
+        if (m != n || memcmp(text, out, n)) {
+            printf("format %d differs from text:\n%s\n----\n%s\n", format,
+                   text, out);
+            abort();
+        }
+    }
+    log_set_format(LOG_FORMAT_TEXT);
+    unlink(ASYNC_FILE);
+    unlink(ASYNC_TEXT);
+    printf("format: deferred and binary match text, %d bytes\n", n);
+}
+
+#define LIMIT_FILE      "tmp/limit.log"
+
+#define limit_print(tag, line, ...) \
+    log_print(LOG_ERR, tag, "limit.c", line, __func__, __VA_ARGS__)
+
+/* count records whose prefix holds site, and the suppressed counts */
+static int limit_grep(const char *site, unsigned long long *suppressed)
+{
+    char buf[1024];
+    FILE *fp = fopen(LIMIT_FILE, "r");
+    char *p;
+    int n = 0;
+
+    if (!fp) {
+        printf("open %s failed\n", LIMIT_FILE);
+        abort();
+    }
+    while (fgets(buf, sizeof(buf), fp)) {
+        if (!strstr(buf, site)) {
+            continue;
+        }
+        p = strstr(buf, "[liblog] ");
+        if (p) {
+            *suppressed += strtoull(p + 9, NULL, 10);
+        } else {
+            n++;
+        }
+    }
+    fclose(fp);
+    return n;
+}
+
+static int limit_count(int line, unsigned long long *suppressed)
+{
+    char site[32];
+
+    snprintf(site, sizeof(site), "[limit.c:%d: ", line);
+    return limit_grep(site, suppressed);
+}
+
+/* the macros pass LOG_TAG, files that define their own get their own budget */
+#undef LOG_TAG
+#define LOG_TAG "macro_a"
+
+static void limit_tag_a(void)
+{
+    loge("macro tag a\n");
+}
+
+#undef LOG_TAG
+#define LOG_TAG "macro_b"
+
+static void limit_tag_b(void)
+{
+    loge("macro tag b\n");
+}
+
+#undef LOG_TAG
+#define LOG_TAG "test"
+
+static void *limit_worker(void *arg)
+{
+    int i;
+    for (i = 0; i < 1000; i++) {
+        limit_print("limited", 104, "thread i=%d\n", i);
+    }
+    return NULL;
+}
+
+static void test_ratelimit(void)
+{
+    unsigned long long sa = 0, sb = 0;
+    pthread_t tid[4];
+    int i, a, b, site;
+
+    unlink(LIMIT_FILE);
+    log_init(LOG_FILE, LIMIT_FILE);
+    log_set_ratelimit(LOG_RATELIMIT_SITE, 10, 5);
+    for (i = 0; i < 1000; i++) {
+        limit_print("limited", 101, "flood i=%d\n", i);
+        if (i % 250 == 0) {
+            limit_print("limited", 102, "other site i=%d\n", i);
+        }
+    }
+    log_deinit();
+    a = limit_count(101, &sa);
+    b = limit_count(102, &sb);
+    if (a < 5 || a > 50 || a + sa != 1000 || b != 4 || sb != 0) {
+        printf("site limit: %d passed, %llu suppressed, other %d/%llu\n",
+               a, sa, b, sb);
+        abort();
+    }
+    site = a;
+
+    /* all threads take from the same bucket, nothing is lost */
+    unlink(LIMIT_FILE);
+    log_init(LOG_FILE, LIMIT_FILE);
+    log_set_ratelimit(LOG_RATELIMIT_SITE, 10, 5);
+    for (i = 0; i < 4; i++) {
+        pthread_create(&tid[i], NULL, limit_worker, NULL);
+    }
+    for (i = 0; i < 4; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    log_deinit();
+    sa = 0;
+    a = limit_count(104, &sa);
+    if (a < 5 || a > 50 || a + sa != 4000) {
+        printf("thread limit: %d passed, %llu suppressed\n", a, sa);
+        abort();
+    }
+
+    /* two sites under one tag share the budget, another tag does not */
+    unlink(LIMIT_FILE);
+    log_init(LOG_FILE, LIMIT_FILE);
+    log_set_ratelimit(LOG_RATELIMIT_TAG, 1, 2);
+    for (i = 0; i < 100; i++) {
+        limit_print("limited", 101, "tag one\n");
+        limit_print("limited", 102, "tag two\n");
+        limit_print("free", 103, "tag free\n");
+    }
+    log_set_ratelimit(LOG_RATELIMIT_OFF, 0, 0);
+    log_deinit();
+    sa = sb = 0;
+    a = limit_count(101, &sa) + limit_count(102, &sa);
+    b = limit_count(103, &sb);
+    if (a < 2 || a > 4 || a + sa != 200 || b < 2 || b > 4 || b + sb != 100) {
+        printf("tag limit: %d passed, %llu suppressed, free %d/%llu\n",
+               a, sa, b, sb);
+        abort();
+    }
+
+    /* the same through loge, one bucket per LOG_TAG */
+    unlink(LIMIT_FILE);
+    log_init(LOG_FILE, LIMIT_FILE);
+    log_set_ratelimit(LOG_RATELIMIT_TAG, 1, 2);
+    for (i = 0; i < 100; i++) {
+        limit_tag_a();
+        limit_tag_b();
+    }
+    log_deinit();
+    sa = sb = 0;
+    a = limit_grep(" limit_tag_a]", &sa);
+    b = limit_grep(" limit_tag_b]", &sb);
+    if (a < 2 || a > 4 || a + sa != 100 || b < 2 || b > 4 || b + sb != 100) {
+        printf("macro tag limit: a %d/%llu, b %d/%llu\n", a, sa, b, sb);
+        abort();
+    }
+    log_set_ratelimit(LOG_RATELIMIT_OFF, 0, 0);
+    unlink(LIMIT_FILE);
+    printf("ratelimit: site %d passed of 1000, tag %d passed of 100\n",
+           site, a);
+}
+
+static int limit_side;
+
+static int limit_eval(void)
+{
+    return ++limit_side;
+}
+
+/* compiled as if liblog.h was included with -DLOG_LEVEL_MIN=LOG_INFO */
+#undef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN LOG_INFO
+
+static void test_level_min(void)
+{
+    log_init(LOG_STDERR, NULL);
+    log_set_level(LOG_VERB);
+    logd("not compiled %d\n", limit_eval());
+    logv("not compiled %d\n", limit_eval());
+    if (limit_side != 0) {
+        printf("logd/logv below LOG_LEVEL_MIN were evaluated\n");
+        abort();
+    }
+    logi("compiled %d\n", limit_eval());
+    log_deinit();
+    if (limit_side != 1) {
+        printf("logi above LOG_LEVEL_MIN was not evaluated\n");
+        abort();
+    }
+    printf("level_min: logd/logv compiled out\n");
+}
+
+#undef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN LOG_VERB
+
+static int bench_lines;
+
+static double bench_cpu[64];
+
+static double bench_thread_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *bench_worker(void *arg)
+{
+    double *cpu = (double *)arg;
+    double t0 = bench_thread_ns();
+    int i;
+    for (i = 0; i < bench_lines; i++) {
+        logi("rtp send len=%d seq=%d ts=%u\n", 1400, i, i * 3600);
+    }
+    *cpu = bench_thread_ns() - t0;
+    return NULL;
+}
+
+/*
+ * lines/s/thread counts until everything is written, ns/call only the cpu
+ * time the callers spent in logi, so a writer sharing their cpu is not
+ * billed to them. The rings are big enough that callers never wait
+ */
+static void bench_run(const char *name, int format, int async, int mmap,
+                      int threads)
+{
+    pthread_t tid[64];
+    struct timeval t0, t2;
+    double sec, call = 0;
+    int i;
+
+    unlink("tmp/bench.log");
+    log_set_mmap(mmap ? 4*1024*1024 : 0);
+    log_init(LOG_FILE, "tmp/bench.log");
+    log_set_level(LOG_INFO);
+    log_set_split_size(10*1024*1024);
+    log_set_rotate(1);
+    log_set_format(format);
+    log_set_async_policy(LOG_ASYNC_BLOCK);
+    log_set_async_buffer(16*1024*1024, 256*1024*1024);
+    if (async) {
+        log_set_async(1);
+    }
+    gettimeofday(&t0, NULL);
+    for (i = 0; i < threads; i++) {
+        pthread_create(&tid[i], NULL, bench_worker, &bench_cpu[i]);
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_join(tid[i], NULL);
+        call += bench_cpu[i];
+    }
+    log_deinit();
+    gettimeofday(&t2, NULL);
+    sec = (t2.tv_sec - t0.tv_sec) + (t2.tv_usec - t0.tv_usec) / 1e6;
+    printf("%10s %8d %14.0f %10.0f\n", name, threads,
+           bench_lines / sec, call / bench_lines / threads);
+    log_set_async_buffer(0, 0);
+    log_set_format(LOG_FORMAT_TEXT);
+    log_set_mmap(0);
+    unlink("tmp/bench.log");
+}
+
+static void bench(int threads)
+{
+    int t;
+    printf("%10s %8s %14s %10s\n", "mode", "threads", "lines/s/thread", "ns/call");
+    for (t = 1; t <= threads; t *= 2) {
+        bench_run("sync", LOG_FORMAT_TEXT, 0, 0, t);
+        bench_run("mmap", LOG_FORMAT_TEXT, 0, 1, t);
+        bench_run("async", LOG_FORMAT_TEXT, 1, 0, t);
+        bench_run("async+mmap", LOG_FORMAT_TEXT, 1, 1, t);
+        bench_run("deferred", LOG_FORMAT_DEFERRED, 1, 0, t);
+        bench_run("binary", LOG_FORMAT_BINARY, 1, 0, t);
+        log_set_ratelimit(LOG_RATELIMIT_SITE, 1000, 100);
+        bench_run("ratelimit", LOG_FORMAT_TEXT, 0, 0, t);
+        log_set_ratelimit(LOG_RATELIMIT_OFF, 0, 0);
+    }
 }
 
 int main(int argc, char **argv)
 {
+    int format;
+
+    if (argc > 1 && !strcmp(argv[1], "bench")) {
+        bench_lines = argc > 3 ? atoi(argv[3]) : 100000;
+        bench(argc > 2 ? atoi(argv[2]) : 4);
+        return 0;
+    }
     test_no_init();
     test_file_name();
     test_rsyslog();
     test_file_noname();
     test_thread_log();
+    test_split();
+    test_flush_age();
+    test_mmap();
+    test_format();
+    test_ratelimit();
+    test_level_min();
+    for (format = LOG_FORMAT_TEXT; format <= LOG_FORMAT_BINARY; format++) {
+        test_async(format);
+        test_async_crash(format);
+    }
+    test_async_switch();
+
+    /* the same again through the mmap backend */
+    log_set_mmap(MMAP_SEGMENT);
+    test_split();
+    for (format = LOG_FORMAT_TEXT; format <= LOG_FORMAT_BINARY; format++) {
+        test_async(format);
+        test_async_crash(format);
+    }
+    log_set_mmap(0);
     return 0;
 }
@@ -0,0 +1,715 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libmempool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <pthread.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+/*
+ * slab is SLAB_SIZE aligned, so owner of any object is found by masking
+ * its address, no header per object:
+ *
+ *   |slab hdr|obj|obj|obj|...|      small objects of one size class
+ *   |slab hdr|large object......|   one object bigger than MEMPOOL_MAX_SMALL
+ *
+ * thread heap has a local free list and a remote free list per class.
+ * owner pops/pushes local list without lock, other threads push freed
+ * objects to remote list by CAS, owner takes the whole remote list when
+ * local list is empty. heap of exited thread is adopted by next new thread.
+ */
+#define SLAB_SHIFT      16
+#define SLAB_SIZE       (1 << SLAB_SHIFT)
+#define SLAB_HDR        64
+#define CLASS_LARGE     0xFFFF
+#define ARENA_ALIGN     16
+#define ARENA_CHUNK_DEF (64 * 1024)
+
+#define ALIGN_UP(x, a)  (((x) + (a) - 1) & ~((size_t)(a) - 1))
+
+static const uint32_t class_size[] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512,
+    768, 1024, 1536, 2048, 3072, 4096, 6144, 8192,
+};
+#define NCLASS  ARRAY_SIZE(class_size)
+
+struct mp_slab {
+    struct mp_heap *heap;   /* NULL for large object */
+    struct mempool *pool;
+    struct mp_slab *next;
+    uint32_t cls;
+    size_t large_size;
+};
+
+struct mp_class {
+    void *local;
+    void *remote;
+};
+
+struct mp_heap {
+    struct mempool *pool;
+    struct mp_heap *next;
+    struct mp_heap *orphan_next;
+    struct mp_slab *slabs;
+    struct mp_class cls[NCLASS];
+};
+
+struct mempool {
+    char name[32];
+    int flags;
+    uint64_t id;
+    pthread_key_t key;
+    pthread_mutex_t lock;
+    struct mp_heap *heaps;
+    struct mp_heap *orphans;
+    size_t nheaps;
+    int64_t nslabs;
+    int64_t bytes;
+    int64_t objects;
+    int64_t class_objects[NCLASS + 1];  /* last is large */
+    struct mempool *next;
+};
+
+static pthread_mutex_t g_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mempool *g_pool_list = NULL;
+static pthread_once_t g_class_once = PTHREAD_ONCE_INIT;
+static uint8_t g_class_index[MEMPOOL_MAX_SMALL / 16 + 1];
+
+/* heap of last used pool, saves pthread_getspecific on hot path */
+#if defined (_MSC_VER)
+#define MP_TLS  __declspec(thread)
+#elif defined (__GNUC__) && !defined (OS_RTOS)
+#define MP_TLS  __thread
+#endif
+#ifdef MP_TLS
+static MP_TLS struct mp_heap *tls_heap;
+static MP_TLS uint64_t tls_pool_id;
+#endif
+static uint64_t g_pool_id = 0;
+
+#if defined (_MSC_VER)
+static inline void *atomic_xchg_ptr(void **p, void *v)
+{
+    return InterlockedExchangePointer((PVOID volatile *)p, v);
+}
+
+static inline int atomic_cas_ptr(void **p, void *old, void *v)
+{
+    return InterlockedCompareExchangePointer((PVOID volatile *)p, v, old) == old;
+}
+
+static inline void atomic_add64(int64_t *p, int64_t v)
+{
+    InterlockedExchangeAdd64((LONG64 volatile *)p, v);
+}
+
+static inline int64_t atomic_load64(int64_t *p)
+{
+    return InterlockedCompareExchange64((LONG64 volatile *)p, 0, 0);
+}
+
+static void *slab_alloc_aligned(size_t size)
+{
+    return _aligned_malloc(size, SLAB_SIZE);
+}
+
+static void slab_free_aligned(void *p)
+{
+    _aligned_free(p);
+}
+#else
+static inline void *atomic_xchg_ptr(void **p, void *v)
+{
+    return __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL);
+}
+
+static inline int atomic_cas_ptr(void **p, void *old, void *v)
+{
+    return __atomic_compare_exchange_n(p, &old, v, 0, __ATOMIC_RELEASE,
+                                       __ATOMIC_RELAXED);
+}
+
+static inline void atomic_add64(int64_t *p, int64_t v)
+{
+    __atomic_fetch_add(p, v, __ATOMIC_RELAXED);
+}
+
+static inline int64_t atomic_load64(int64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static void *slab_alloc_aligned(size_t size)
+{
+    void *p = NULL;
+    if (posix_memalign(&p, SLAB_SIZE, size) != 0) {
+        return NULL;
+    }
+    return p;
+}
+
+static void slab_free_aligned(void *p)
+{
+    free(p);
+}
+#endif
+
+static void class_index_init(void)
+{
+    uint32_t i, c = 0;
+    for (i = 0; i < ARRAY_SIZE(g_class_index); i++) {
+        while (i * 16 > class_size[c]) {
+            c++;
+        }
+        g_class_index[i] = c;
+    }
+}
+
+static inline uint32_t size_to_class(size_t size)
+{
+    return g_class_index[(size + 15) >> 4];
+}
+
+static inline struct mp_slab *ptr_to_slab(void *ptr)
+{
+    return (struct mp_slab *)((uintptr_t)ptr & ~((uintptr_t)SLAB_SIZE - 1));
+}
+
+static inline void account(struct mempool *pool, uint32_t cls, int64_t bytes, int64_t n)
+{
+    if (pool->flags & MEMPOOL_ACCOUNTING) {
+        atomic_add64(&pool->bytes, bytes);
+        atomic_add64(&pool->objects, n);
+        atomic_add64(&pool->class_objects[cls], n);
+    }
+}
+
+/* runs on the exiting thread, the heap goes to the next new thread */
+static void heap_release(void *arg)
+{
+    struct mp_heap *heap = (struct mp_heap *)arg;
+    struct mempool *pool = heap->pool;
+
+#ifdef MP_TLS
+    /* later destructors of this thread must not allocate from it */
+    if (tls_heap == heap) {
+        tls_heap = NULL;
+        tls_pool_id = 0;
+    }
+#endif
+    pthread_mutex_lock(&pool->lock);
+    heap->orphan_next = pool->orphans;
+    pool->orphans = heap;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static inline struct mp_heap *heap_self(struct mempool *pool)
+{
+#ifdef MP_TLS
+    if (LIKELY(tls_pool_id == pool->id)) {
+        return tls_heap;
+    }
+    tls_heap = (struct mp_heap *)pthread_getspecific(pool->key);
+    tls_pool_id = tls_heap ? pool->id : 0;
+    return tls_heap;
+#else
+    return (struct mp_heap *)pthread_getspecific(pool->key);
+#endif
+}
+
+static struct mp_heap *heap_get(struct mempool *pool)
+{
+    struct mp_heap *heap = heap_self(pool);
+    if (LIKELY(heap != NULL)) {
+        return heap;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->orphans) {
+        heap = pool->orphans;
+        pool->orphans = heap->orphan_next;
+        heap->orphan_next = NULL;
+    } else {
+        heap = (struct mp_heap *)calloc(1, sizeof(struct mp_heap));
+        if (heap) {
+            heap->pool = pool;
+            heap->next = pool->heaps;
+            pool->heaps = heap;
+            pool->nheaps++;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (!heap) {
+        printf("%s: malloc heap failed\n", __func__);
+        return NULL;
+    }
+    pthread_setspecific(pool->key, heap);
+#ifdef MP_TLS
+    tls_heap = heap;
+    tls_pool_id = pool->id;
+#endif
+    return heap;
+}
+
+static int slab_new(struct mp_heap *heap, uint32_t cls)
+{
+    struct mp_slab *slab;
+    uint8_t *p, *end;
+    void *head = NULL;
+    size_t size = class_size[cls];
+
+    slab = (struct mp_slab *)slab_alloc_aligned(SLAB_SIZE);
+    if (!slab) {
+        printf("%s: alloc slab failed %s\n", __func__, strerror(errno));
+        return -1;
+    }
+    slab->heap = heap;
+    slab->pool = heap->pool;
+    slab->cls = cls;
+    slab->large_size = 0;
+    slab->next = heap->slabs;
+    heap->slabs = slab;
+
+    /* link objects from back to front, so they are handed out in order */
+    end = (uint8_t *)slab + SLAB_HDR + ((SLAB_SIZE - SLAB_HDR) / size) * size;
+    for (p = end - size; p >= (uint8_t *)slab + SLAB_HDR; p -= size) {
+        *(void **)p = head;
+        head = p;
+    }
+    heap->cls[cls].local = head;
+    atomic_add64(&heap->pool->nslabs, 1);
+    return 0;
+}
+
+static void *large_alloc(struct mempool *pool, size_t size)
+{
+    struct mp_slab *slab;
+    if (size > ((size_t)-1) - SLAB_HDR) {
+        return NULL;
+    }
+    slab = (struct mp_slab *)slab_alloc_aligned(SLAB_HDR + size);
+    if (!slab) {
+        printf("%s: alloc %zu failed %s\n", __func__, size, strerror(errno));
+        return NULL;
+    }
+    slab->heap = NULL;
+    slab->pool = pool;
+    slab->next = NULL;
+    slab->cls = CLASS_LARGE;
+    slab->large_size = size;
+    account(pool, NCLASS, size, 1);
+    return (uint8_t *)slab + SLAB_HDR;
+}
+
+void *mempool_alloc(struct mempool *pool, size_t size)
+{
+    struct mp_heap *heap;
+    struct mp_class *c;
+    uint32_t cls;
+    void *obj;
+
+    if (UNLIKELY(!pool)) {
+        return NULL;
+    }
+    if (size > MEMPOOL_MAX_SMALL) {
+        return large_alloc(pool, size);
+    }
+    heap = heap_get(pool);
+    if (UNLIKELY(!heap)) {
+        return NULL;
+    }
+    cls = size_to_class(size);
+    c = &heap->cls[cls];
+    obj = c->local;
+    if (!obj) {
+        obj = atomic_xchg_ptr(&c->remote, NULL);
+        if (!obj) {
+            if (slab_new(heap, cls) < 0) {
+                return NULL;
+            }
+            obj = c->local;
+        }
+    }
+    c->local = *(void **)obj;
+    account(pool, cls, class_size[cls], 1);
+    return obj;
+}
+
+void *mempool_calloc(struct mempool *pool, size_t size)
+{
+    void *p = mempool_alloc(pool, size);
+    if (p) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+void mempool_free(void *ptr)
+{
+    struct mp_slab *slab;
+    struct mp_class *c;
+    void *old;
+
+    if (!ptr) {
+        return;
+    }
+    slab = ptr_to_slab(ptr);
+    if (slab->cls == CLASS_LARGE) {
+        account(slab->pool, NCLASS, -(int64_t)slab->large_size, -1);
+        slab_free_aligned(slab);
+        return;
+    }
+    account(slab->pool, slab->cls, -(int64_t)class_size[slab->cls], -1);
+    c = &slab->heap->cls[slab->cls];
+    if (heap_self(slab->pool) == slab->heap) {
+        *(void **)ptr = c->local;
+        c->local = ptr;
+        return;
+    }
+    do {
+        old = c->remote;
+        *(void **)ptr = old;
+    } while (!atomic_cas_ptr(&c->remote, old, ptr));
+}
+
+struct mempool *mempool_create(const char *name, int flags)
+{
+    struct mempool *pool = (struct mempool *)calloc(1, sizeof(struct mempool));
+    if (!pool) {
+        printf("%s: malloc failed %s\n", __func__, strerror(errno));
+        return NULL;
+    }
+    pthread_once(&g_class_once, class_index_init);
+    snprintf(pool->name, sizeof(pool->name), "%s", name ? name : "mempool");
+    pool->flags = flags;
+#ifdef MEMPOOL_ACCOUNTING_ALL
+    pool->flags |= MEMPOOL_ACCOUNTING;
+#endif
+    if (pthread_key_create(&pool->key, heap_release) != 0) {
+        printf("%s: pthread_key_create failed\n", __func__);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+
+    pthread_mutex_lock(&g_pool_lock);
+    pool->id = ++g_pool_id;
+    pool->next = g_pool_list;
+    g_pool_list = pool;
+    pthread_mutex_unlock(&g_pool_lock);
+    return pool;
+}
+
+void mempool_destroy(struct mempool *pool)
+{
+    struct mempool **pp;
+    struct mp_heap *heap, *next_heap;
+    struct mp_slab *slab, *next_slab;
+
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&g_pool_lock);
+    for (pp = &g_pool_list; *pp; pp = &(*pp)->next) {
+        if (*pp == pool) {
+            *pp = pool->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_pool_lock);
+
+    pthread_key_delete(pool->key);
+#ifdef MP_TLS
+    if (tls_pool_id == pool->id) {
+        tls_heap = NULL;
+        tls_pool_id = 0;
+    }
+#endif
+    for (heap = pool->heaps; heap; heap = next_heap) {
+        next_heap = heap->next;
+        for (slab = heap->slabs; slab; slab = next_slab) {
+            next_slab = slab->next;
+            slab_free_aligned(slab);
+        }
+        free(heap);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+int mempool_get_stat(struct mempool *pool, struct mempool_stat *st)
+{
+    if (!pool || !st) {
+        return -1;
+    }
+    st->bytes = (size_t)atomic_load64(&pool->bytes);
+    st->objects = (size_t)atomic_load64(&pool->objects);
+    st->slabs = (size_t)atomic_load64(&pool->nslabs);
+    pthread_mutex_lock(&pool->lock);
+    st->heaps = pool->nheaps;
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+static void pool_dump(struct mempool *pool, FILE *fp)
+{
+    struct mempool_stat st;
+    int64_t n;
+    uint32_t i;
+
+    mempool_get_stat(pool, &st);
+    fprintf(fp, "mempool %s: %zu bytes %zu objects in flight, %zu slabs, %zu heaps%s\n",
+            pool->name, st.bytes, st.objects, st.slabs, st.heaps,
+            (pool->flags & MEMPOOL_ACCOUNTING) ? "" : " (no accounting)");
+    if (!(pool->flags & MEMPOOL_ACCOUNTING)) {
+        return;
+    }
+    for (i = 0; i <= NCLASS; i++) {
+        n = atomic_load64(&pool->class_objects[i]);
+        if (n == 0) {
+            continue;
+        }
+        if (i < NCLASS) {
+            fprintf(fp, "    %6u: %" PRId64 "\n", class_size[i], n);
+        } else {
+            fprintf(fp, "     large: %" PRId64 "\n", n);
+        }
+    }
+}
+
+void mempool_dump(struct mempool *pool, FILE *fp)
+{
+    struct mempool *p;
+    if (!fp) {
+        fp = stdout;
+    }
+    if (pool) {
+        pool_dump(pool, fp);
+        return;
+    }
+    pthread_mutex_lock(&g_pool_lock);
+    for (p = g_pool_list; p; p = p->next) {
+        pool_dump(p, fp);
+    }
+    pthread_mutex_unlock(&g_pool_lock);
+}
+
+/******************************************************************************
+ * arena
+ ******************************************************************************/
+struct arena_chunk {
+    struct arena_chunk *prev;
+    size_t size;
+    size_t used;
+    size_t reserved;
+    uint8_t data[1];
+};
+
+#define ARENA_CHUNK_HDR     ALIGN_UP(offsetof(struct arena_chunk, data), ARENA_ALIGN)
+
+struct mempool_arena {
+    struct arena_chunk *cur;
+    struct arena_chunk *spare;
+    size_t chunk_size;
+    size_t used;
+    size_t size;
+};
+
+static inline uint8_t *chunk_data(struct arena_chunk *c)
+{
+    return (uint8_t *)c + ARENA_CHUNK_HDR;
+}
+
+struct mempool_arena *mempool_arena_create(size_t chunk_size)
+{
+    struct mempool_arena *a;
+    a = (struct mempool_arena *)calloc(1, sizeof(struct mempool_arena));
+    if (!a) {
+        printf("%s: malloc failed %s\n", __func__, strerror(errno));
+        return NULL;
+    }
+    a->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_DEF;
+    return a;
+}
+
+/* keep the biggest released chunk for next use, free others */
+static void arena_chunk_release(struct mempool_arena *a, struct arena_chunk *c)
+{
+    struct arena_chunk *f = c;
+    if (!a->spare || a->spare->size < c->size) {
+        f = a->spare;
+        a->spare = c;
+        c->used = 0;
+    }
+    if (f) {
+        a->size -= f->size;
+        free(f);
+    }
+}
+
+static struct arena_chunk *arena_chunk_new(struct mempool_arena *a, size_t size)
+{
+    struct arena_chunk *c;
+    size_t need = size > a->chunk_size ? size : a->chunk_size;
+
+    if (a->spare && a->spare->size >= need) {
+        c = a->spare;
+        a->spare = NULL;
+    } else {
+        c = (struct arena_chunk *)malloc(ARENA_CHUNK_HDR + need);
+        if (!c) {
+            printf("%s: malloc %zu failed %s\n", __func__, need, strerror(errno));
+            return NULL;
+        }
+        c->size = need;
+        a->size += need;
+    }
+    c->used = 0;
+    c->prev = a->cur;
+    a->cur = c;
+    return c;
+}
+
+void *mempool_arena_alloc(struct mempool_arena *a, size_t size)
+{
+    struct arena_chunk *c;
+    void *p;
+
+    if (UNLIKELY(!a)) {
+        return NULL;
+    }
+    size = ALIGN_UP(size ? size : 1, ARENA_ALIGN);
+    c = a->cur;
+    if (UNLIKELY(!c || c->size - c->used < size)) {
+        c = arena_chunk_new(a, size);
+        if (!c) {
+            return NULL;
+        }
+    }
+    p = chunk_data(c) + c->used;
+    c->used += size;
+    a->used += size;
+    return p;
+}
+
+void *mempool_arena_calloc(struct mempool_arena *a, size_t size)
+{
+    void *p = mempool_arena_alloc(a, size);
+    if (p) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+void mempool_scope_begin(struct mempool_scope *sc, struct mempool_arena *a)
+{
+    sc->arena = a;
+    sc->chunk = a ? a->cur : NULL;
+    sc->used = (a && a->cur) ? a->cur->used : 0;
+    sc->total = a ? a->used : 0;
+}
+
+void mempool_scope_end(struct mempool_scope *sc)
+{
+    struct mempool_arena *a = sc->arena;
+    struct arena_chunk *c;
+
+    if (!a) {
+        return;
+    }
+    while (a->cur && a->cur != (struct arena_chunk *)sc->chunk) {
+        c = a->cur;
+        a->cur = c->prev;
+        arena_chunk_release(a, c);
+    }
+    if (a->cur) {
+        a->cur->used = sc->used;
+    }
+    a->used = sc->total;
+}
+
+void mempool_arena_reset(struct mempool_arena *a)
+{
+    struct mempool_scope sc;
+    if (!a) {
+        return;
+    }
+    sc.arena = a;
+    sc.chunk = NULL;
+    sc.used = 0;
+    sc.total = 0;
+    mempool_scope_end(&sc);
+}
+
+void mempool_arena_destroy(struct mempool_arena *a)
+{
+    struct arena_chunk *c, *prev;
+    if (!a) {
+        return;
+    }
+    for (c = a->cur; c; c = prev) {
+        prev = c->prev;
+        free(c);
+    }
+    free(a->spare);
+    free(a);
+}
+
+size_t mempool_arena_used(struct mempool_arena *a)
+{
+    return a ? a->used : 0;
+}
+
+size_t mempool_arena_size(struct mempool_arena *a)
+{
+    return a ? a->size : 0;
+}
+
+static pthread_key_t g_arena_key;
+static pthread_once_t g_arena_once = PTHREAD_ONCE_INIT;
+
+static void arena_thread_release(void *arg)
+{
+    mempool_arena_destroy((struct mempool_arena *)arg);
+}
+
+static void arena_key_init(void)
+{
+    pthread_key_create(&g_arena_key, arena_thread_release);
+}
+
+struct mempool_arena *mempool_arena_thread(void)
+{
+    struct mempool_arena *a;
+    pthread_once(&g_arena_once, arena_key_init);
+    a = (struct mempool_arena *)pthread_getspecific(g_arena_key);
+    if (!a) {
+        a = mempool_arena_create(ARENA_CHUNK_DEF);
+        if (a) {
+            pthread_setspecific(g_arena_key, a);
+        }
+    }
+    return a;
+}
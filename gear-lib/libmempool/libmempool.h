@@ -0,0 +1,108 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef LIBMEMPOOL_H
+#define LIBMEMPOOL_H
+
+#include <libposix.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#define LIBMEMPOOL_VERSION "0.1.0"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * mempool is size class slab allocator for small objects on hot path.
+ * each thread allocates from its own heap without lock, an object can be
+ * freed by any thread, it goes back to the free list of the owner heap.
+ * objects larger than MEMPOOL_MAX_SMALL are allocated from system.
+ * slabs are kept until mempool_destroy, all objects must be freed before.
+ * a heap is handed to a new thread when its thread exits, and all heaps
+ * are freed by mempool_destroy: no other thread may still allocate from
+ * the pool at that point.
+ */
+#define MEMPOOL_MAX_SMALL       (8192)
+
+/* count bytes and objects in flight, see mempool_get_stat/mempool_dump */
+#define MEMPOOL_ACCOUNTING      (1 << 0)
+
+struct mempool;
+
+struct mempool_stat {
+    size_t bytes;       /* bytes in flight, rounded to size class */
+    size_t objects;     /* objects in flight */
+    size_t slabs;       /* slabs allocated */
+    size_t heaps;       /* thread heaps */
+};
+
+GEAR_API struct mempool *mempool_create(const char *name, int flags);
+GEAR_API void mempool_destroy(struct mempool *pool);
+GEAR_API void *mempool_alloc(struct mempool *pool, size_t size);
+GEAR_API void *mempool_calloc(struct mempool *pool, size_t size);
+/* ptr must come from mempool_alloc/mempool_calloc of any pool */
+GEAR_API void mempool_free(void *ptr);
+GEAR_API int mempool_get_stat(struct mempool *pool, struct mempool_stat *st);
+/* dump one pool, or all pools if pool is NULL */
+GEAR_API void mempool_dump(struct mempool *pool, FILE *fp);
+
+/*
+ * arena is a bump allocator, alloc is a pointer increment, memory is
+ * released all at once by reset, or by scope end.
+ * arena is not thread safe, use mempool_arena_thread() for a per-thread one.
+ */
+struct mempool_arena;
+
+struct mempool_scope {
+    struct mempool_arena *arena;
+    void *chunk;
+    size_t used;
+    size_t total;
+};
+
+GEAR_API struct mempool_arena *mempool_arena_create(size_t chunk_size);
+GEAR_API void mempool_arena_destroy(struct mempool_arena *a);
+GEAR_API void *mempool_arena_alloc(struct mempool_arena *a, size_t size);
+GEAR_API void *mempool_arena_calloc(struct mempool_arena *a, size_t size);
+GEAR_API void mempool_arena_reset(struct mempool_arena *a);
+/* bytes allocated from arena, and bytes held from system */
+GEAR_API size_t mempool_arena_used(struct mempool_arena *a);
+GEAR_API size_t mempool_arena_size(struct mempool_arena *a);
+/* arena of calling thread, created on first use, freed on thread exit */
+GEAR_API struct mempool_arena *mempool_arena_thread(void);
+
+/*
+ * scope for reset-per-request:
+ *     struct mempool_scope sc;
+ *     mempool_scope_begin(&sc, mempool_arena_thread());
+ *     ... mempool_arena_alloc() ...
+ *     mempool_scope_end(&sc);   //everything allocated in scope is released
+ * scopes can be nested, and must end in reverse order.
+ */
+GEAR_API void mempool_scope_begin(struct mempool_scope *sc, struct mempool_arena *a);
+GEAR_API void mempool_scope_end(struct mempool_scope *sc);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,273 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libmempool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#define PALIGN      "%15s: %6.4f sec\n"
+#define NOBJS       (1000000)
+#define NTHREADS    (4)
+#define BATCH_SIZE  (1000)
+
+static double epoch_double(void)
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + (t.tv_usec * 1.0) / 1000000.0;
+}
+
+static int test_basic(void)
+{
+    struct mempool *pool = mempool_create("basic", MEMPOOL_ACCOUNTING);
+    struct mempool_stat st;
+    void *p[100];
+    int i, err = 0;
+
+    for (i = 0; i < 100; i++) {
+        p[i] = mempool_calloc(pool, i * 100 + 1);
+        memset(p[i], i, i * 100 + 1);
+    }
+    mempool_get_stat(pool, &st);
+    if (st.objects != 100) {
+        err++;
+    }
+    mempool_dump(pool, stdout);
+    for (i = 0; i < 100; i++) {
+        if (((uint8_t *)p[i])[i * 100] != (uint8_t)i) {
+            err++;
+        }
+        mempool_free(p[i]);
+    }
+    mempool_get_stat(pool, &st);
+    if (st.objects != 0 || st.bytes != 0) {
+        err++;
+    }
+    mempool_destroy(pool);
+    printf("%15s: %s\n", "basic", err ? "failed" : "ok");
+    return err;
+}
+
+static int test_scope(void)
+{
+    struct mempool_arena *a = mempool_arena_thread();
+    struct mempool_scope outer, inner;
+    size_t used;
+    char *s;
+    int i, err = 0;
+
+    mempool_scope_begin(&outer, a);
+    s = mempool_arena_alloc(a, 16);
+    strcpy(s, "request");
+    used = mempool_arena_used(a);
+    for (i = 0; i < 1000; i++) {
+        mempool_scope_begin(&inner, a);
+        mempool_arena_alloc(a, 1000);
+        mempool_arena_alloc(a, 100000);
+        mempool_scope_end(&inner);
+    }
+    if (mempool_arena_used(a) != used || strcmp(s, "request")) {
+        err++;
+    }
+    mempool_scope_end(&outer);
+    if (mempool_arena_used(a) != 0) {
+        err++;
+    }
+    printf("%15s: %s, %zu bytes held\n", "scope", err ? "failed" : "ok",
+           mempool_arena_size(a));
+    return err;
+}
+
+/*
+ * producer allocates, consumer frees, like task_create/task_destroy of
+ * workq, objects are freed on other thread. handed over in batches so
+ * the result is not dominated by thread switching
+ */
+struct batch {
+    void *obj[BATCH_SIZE];
+    struct batch *next;
+};
+
+struct handoff {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct batch *head;
+    int done;
+    int use_pool;
+};
+
+static void *consumer(void *arg)
+{
+    struct handoff *h = (struct handoff *)arg;
+    struct batch *b;
+    int i;
+
+    for (;;) {
+        pthread_mutex_lock(&h->lock);
+        while (!h->head && !h->done) {
+            pthread_cond_wait(&h->cond, &h->lock);
+        }
+        b = h->head;
+        h->head = NULL;
+        pthread_mutex_unlock(&h->lock);
+        if (!b) {
+            break;
+        }
+        while (b) {
+            struct batch *next = b->next;
+            for (i = 0; i < BATCH_SIZE; i++) {
+                if (h->use_pool) {
+                    mempool_free(b->obj[i]);
+                } else {
+                    free(b->obj[i]);
+                }
+            }
+            free(b);
+            b = next;
+        }
+    }
+    return NULL;
+}
+
+static void bench_cross_thread(int use_pool)
+{
+    struct handoff h;
+    struct mempool *pool = mempool_create("cross", 0);
+    struct batch *b;
+    pthread_t tid;
+    double t1, t2;
+    int i, j;
+
+    memset(&h, 0, sizeof(h));
+    pthread_mutex_init(&h.lock, NULL);
+    pthread_cond_init(&h.cond, NULL);
+    h.use_pool = use_pool;
+    pthread_create(&tid, NULL, consumer, &h);
+    t1 = epoch_double();
+    for (i = 0; i < NOBJS / BATCH_SIZE; i++) {
+        b = (struct batch *)malloc(sizeof(struct batch));
+        for (j = 0; j < BATCH_SIZE; j++) {
+            b->obj[j] = use_pool ? mempool_alloc(pool, 64) : malloc(64);
+        }
+        pthread_mutex_lock(&h.lock);
+        b->next = h.head;
+        h.head = b;
+        pthread_cond_signal(&h.cond);
+        pthread_mutex_unlock(&h.lock);
+    }
+    pthread_mutex_lock(&h.lock);
+    h.done = 1;
+    pthread_cond_signal(&h.cond);
+    pthread_mutex_unlock(&h.lock);
+    pthread_join(tid, NULL);
+    t2 = epoch_double();
+    printf(PALIGN, use_pool ? "cross mempool" : "cross malloc", t2 - t1);
+    mempool_destroy(pool);
+}
+
+static struct mempool *g_pool;
+
+static void *local_worker(void *arg)
+{
+    void *p[64];
+    int i, j;
+    int use_pool = *(int *)arg;
+    for (i = 0; i < NOBJS / 64; i++) {
+        for (j = 0; j < 64; j++) {
+            p[j] = use_pool ? mempool_alloc(g_pool, 32 + j * 16) : malloc(32 + j * 16);
+        }
+        for (j = 0; j < 64; j++) {
+            if (use_pool) {
+                mempool_free(p[j]);
+            } else {
+                free(p[j]);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void bench_local(int use_pool)
+{
+    pthread_t tid[NTHREADS];
+    double t1, t2;
+    int i;
+
+    g_pool = mempool_create("local", 0);
+    t1 = epoch_double();
+    for (i = 0; i < NTHREADS; i++) {
+        pthread_create(&tid[i], NULL, local_worker, &use_pool);
+    }
+    for (i = 0; i < NTHREADS; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    t2 = epoch_double();
+    printf(PALIGN, use_pool ? "local mempool" : "local malloc", t2 - t1);
+    mempool_destroy(g_pool);
+}
+
+static void bench_arena(void)
+{
+    struct mempool_arena *a = mempool_arena_thread();
+    struct mempool_scope sc;
+    double t1, t2;
+    int i, j;
+    void *p[16];
+
+    t1 = epoch_double();
+    for (i = 0; i < NOBJS / 16; i++) {
+        mempool_scope_begin(&sc, a);
+        for (j = 0; j < 16; j++) {
+            p[j] = mempool_arena_alloc(a, 48);
+        }
+        mempool_scope_end(&sc);
+    }
+    t2 = epoch_double();
+    printf(PALIGN, "arena scope", t2 - t1);
+    t1 = epoch_double();
+    for (i = 0; i < NOBJS / 16; i++) {
+        for (j = 0; j < 16; j++) {
+            p[j] = malloc(48);
+        }
+        for (j = 0; j < 16; j++) {
+            free(p[j]);
+        }
+    }
+    t2 = epoch_double();
+    printf(PALIGN, "malloc/free", t2 - t1);
+}
+
+int main(int argc, char **argv)
+{
+    int err = 0;
+    err |= test_basic();
+    err |= test_scope();
+    printf("%15s: %d objects\n", "bench", NOBJS);
+    bench_local(0);
+    bench_local(1);
+    bench_cross_thread(0);
+    bench_cross_thread(1);
+    bench_arena();
+    return err ? -1 : 0;
+}
@@ -30,16 +30,34 @@
 #if defined (OS_LINUX) || defined (OS_APPLE)
 #include <sys/eventfd.h>
 #endif
+#ifdef ENABLE_MEMPOOL
+#include <libmempool.h>
+#endif
 
 #define QUEUE_MAX_DEPTH 200
 
+#ifdef ENABLE_MEMPOOL
+static struct mempool *g_item_pool = NULL;
+static pthread_once_t g_item_pool_once = PTHREAD_ONCE_INIT;
+
+static void item_pool_init(void)
+{
+    g_item_pool = mempool_create("queue_item", 0);
+}
+#endif
+
 struct queue_item *queue_item_alloc(struct queue *q, void *data, size_t len, void *arg)
 {
     struct queue_item *item;
     if (!q || !data || len == 0) {
         return NULL;
     }
+#ifdef ENABLE_MEMPOOL
+    pthread_once(&g_item_pool_once, item_pool_init);
+    item = mempool_calloc(g_item_pool, sizeof(struct queue_item));
+#else
     item = CALLOC(1, struct queue_item);
+#endif
     if (!item) {
         printf("malloc failed!\n");
         return NULL;
@@ -48,7 +66,14 @@ struct queue_item *queue_item_alloc(struct queue *q, void *data, size_t len, voi
         item->opaque.iov_base = (q->alloc_hook)(data, len, arg);
         item->opaque.iov_len = len;
     } else {
+#ifdef ENABLE_MEMPOOL
+        item->data.iov_base = mempool_alloc(g_item_pool, len);
+        if (item->data.iov_base) {
+            memcpy(item->data.iov_base, data, len);
+        }
+#else
         item->data.iov_base = memdup(data, len);
+#endif
         item->data.iov_len = len;
     }
     item->arg = arg;
@@ -65,9 +90,17 @@ void queue_item_free(struct queue *q, struct queue_item *item)
         (q->free_hook)(item->opaque.iov_base);
         item->opaque.iov_len = 0;
     } else {
+#ifdef ENABLE_MEMPOOL
+        mempool_free(item->data.iov_base);
+#else
         free(item->data.iov_base);
+#endif
     }
+#ifdef ENABLE_MEMPOOL
+    mempool_free(item);
+#else
     free(item);
+#endif
 }
 
 struct iovec *queue_item_get_data(struct queue *q, struct queue_item *it)
@@ -40,19 +40,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
-#include "librbtree.h"
-
-#define RB_RED      0
-#define RB_BLACK    1
-
-#define __rb_parent(pc)    ((struct rb_node *)(pc & ~3))
-
-#define __rb_color(pc)     ((pc) & 1)
-#define __rb_is_black(pc)  __rb_color(pc)
-#define __rb_is_red(pc)    (!__rb_color(pc))
-#define rb_color(rb)       __rb_color((rb)->__rb_parent_color)
-#define rb_is_red(rb)      __rb_is_red((rb)->__rb_parent_color)
-#define rb_is_black(rb)    __rb_is_black((rb)->__rb_parent_color)
+#include "librbtree_augmented.h"
 
 static inline void rb_set_black(struct rb_node *rb)
 {
@@ -64,30 +52,6 @@ static inline struct rb_node *rb_red_parent(struct rb_node *red)
     return (struct rb_node *)red->__rb_parent_color;
 }
 
-static inline void rb_set_parent(struct rb_node *rb, struct rb_node *p)
-{
-    rb->__rb_parent_color = rb_color(rb) | (unsigned long)p;
-}
-
-static inline void rb_set_parent_color(struct rb_node *rb,
-                struct rb_node *p, int color)
-{
-    rb->__rb_parent_color = (unsigned long)p | color;
-}
-
-static inline void
-__rb_change_child(struct rb_node *old, struct rb_node *_new,
-                struct rb_node *parent, struct rb_root *root)
-{
-    if (parent) {
-        if (parent->rb_left == old)
-            parent->rb_left = _new;
-        else
-            parent->rb_right = _new;
-    } else
-        root->rb_node = _new;
-}
-
 /*
  * Helper function for rotations:
  * - old's parent and color get assigned to new
@@ -413,12 +377,6 @@ static inline void dummy_propagate(struct rb_node *node, struct rb_node *stop) {
 static inline void dummy_copy(struct rb_node *old, struct rb_node *_new) {}
 static inline void dummy_rotate(struct rb_node *old, struct rb_node *_new) {}
 
-struct rb_augment_callbacks {
-    void (*propagate)(struct rb_node *node, struct rb_node *stop);
-    void (*copy)(struct rb_node *old, struct rb_node *_new);
-    void (*rotate)(struct rb_node *old, struct rb_node *_new);
-};
-
 static const struct rb_augment_callbacks dummy_callbacks = {
     dummy_propagate, dummy_copy, dummy_rotate
 };
@@ -428,112 +386,46 @@ void rb_insert_color(struct rb_node *node, struct rb_root *root)
     __rb_insert(node, root, dummy_rotate);
 }
 
-#ifdef __ANDROID__
-static struct rb_node *
-#else
-static __always_inline struct rb_node *
-#endif
-__rb_erase_augmented(struct rb_node *node, struct rb_root *root,
-                const struct rb_augment_callbacks *augment)
+void rb_erase(struct rb_node *node, struct rb_root *root)
 {
-    struct rb_node *child = node->rb_right, *tmp = node->rb_left;
-    struct rb_node *parent, *rebalance;
-    unsigned long pc;
+    struct rb_node *rebalance;
+    rebalance = __rb_erase_augmented(node, root, &dummy_callbacks);
+    if (rebalance)
+        ____rb_erase_color(rebalance, root, dummy_rotate);
+}
 
-    if (!tmp) {
-        /*
-         * Case 1: node to erase has no more than 1 child (easy!)
-         *
-         * Note that if there is one child it must be red due to 5)
-         * and node must be black due to 4). We adjust colors locally
-         * so as to bypass __rb_erase_color() later on.
-         */
-        pc = node->__rb_parent_color;
-        parent = __rb_parent(pc);
-        __rb_change_child(node, child, parent, root);
-        if (child) {
-            child->__rb_parent_color = pc;
-            rebalance = NULL;
-        } else
-            rebalance = __rb_is_black(pc) ? parent : NULL;
-        tmp = parent;
-    } else if (!child) {
-        /* Still case 1, but this time the child is node->rb_left */
-        tmp->__rb_parent_color = pc = node->__rb_parent_color;
-        parent = __rb_parent(pc);
-        __rb_change_child(node, tmp, parent, root);
-        rebalance = NULL;
-        tmp = parent;
-    } else {
-        struct rb_node *successor = child, *child2;
-        tmp = child->rb_left;
-        if (!tmp) {
-            /*
-             * Case 2: node's successor is its right child
-             *
-             *    (n)          (s)
-             *    / \          / \
-             *  (x) (s)  ->  (x) (c)
-             *        \
-             *        (c)
-             */
-             parent = successor;
-             child2 = successor->rb_right;
-             augment->copy(node, successor);
-        } else {
-            /*
-             * Case 3: node's successor is leftmost under
-             * node's right child subtree
-             *
-             *    (n)          (s)
-             *    / \          / \
-             *  (x) (y)  ->  (x) (y)
-             *      /            /
-             *    (p)          (p)
-             *    /            /
-             *  (s)          (c)
-             *    \
-             *    (c)
-             */
-            do {
-                parent = successor;
-                successor = tmp;
-                tmp = tmp->rb_left;
-            } while (tmp);
-            parent->rb_left = child2 = successor->rb_right;
-            successor->rb_right = child;
-            rb_set_parent(child, successor);
-            augment->copy(node, successor);
-            augment->propagate(parent, successor);
-        }
+void rb_insert_color_cached(struct rb_node *node,
+                struct rb_root_cached *root, bool leftmost)
+{
+    if (leftmost)
+        root->rb_leftmost = node;
+    rb_insert_color(node, &root->rb_root);
+}
 
-        successor->rb_left = tmp = node->rb_left;
-        rb_set_parent(tmp, successor);
+void rb_erase_cached(struct rb_node *node, struct rb_root_cached *root)
+{
+    if (root->rb_leftmost == node)
+        root->rb_leftmost = rb_next(node);
+    rb_erase(node, &root->rb_root);
+}
 
-        pc = node->__rb_parent_color;
-        tmp = __rb_parent(pc);
-        __rb_change_child(node, successor, tmp, root);
-        if (child2) {
-            successor->__rb_parent_color = pc;
-            rb_set_parent_color(child2, parent, RB_BLACK);
-            rebalance = NULL;
-        } else {
-            unsigned long pc2 = successor->__rb_parent_color;
-            successor->__rb_parent_color = pc;
-            rebalance = __rb_is_black(pc2) ? parent : NULL;
-        }
-        tmp = successor;
-    }
+/*
+ * Augmented rbtree manipulation functions.
+ *
+ * This instantiates the same __always_inline functions as in the non-augmented
+ * case, but this time with user-defined callbacks.
+ */
 
-    augment->propagate(tmp, NULL);
-    return rebalance;
+void __rb_insert_augmented(struct rb_node *node, struct rb_root *root,
+    void (*augment_rotate)(struct rb_node *rb_old, struct rb_node *rb_new))
+{
+    __rb_insert(node, root, augment_rotate);
 }
-void rb_erase(struct rb_node *node, struct rb_root *root)
+
+void __rb_erase_color(struct rb_node *parent, struct rb_root *root,
+    void (*augment_rotate)(struct rb_node *rb_old, struct rb_node *rb_new))
 {
-    struct rb_node *rebalance;
-    rebalance = __rb_erase_augmented(node, root, &dummy_callbacks);
-    if (rebalance)
-        ____rb_erase_color(rebalance, root, dummy_rotate);
+    ____rb_erase_color(parent, root, augment_rotate);
 }
 
 /*
@@ -638,6 +530,14 @@ void rb_replace_node(struct rb_node *victim, struct rb_node *_new,
     *_new = *victim;
 }
 
+void rb_replace_node_cached(struct rb_node *victim, struct rb_node *_new,
+                struct rb_root_cached *root)
+{
+    if (root->rb_leftmost == victim)
+        root->rb_leftmost = _new;
+    rb_replace_node(victim, _new, &root->rb_root);
+}
+
 static struct rb_node *rb_left_deepest_node(const struct rb_node *node)
 {
     for (;;) {
@@ -675,3 +575,221 @@ struct rb_node *rb_first_postorder(const struct rb_root *root)
 
     return rb_left_deepest_node(root->rb_node);
 }
+
+/*
+ * Order-statistic tree
+ */
+static inline unsigned long rb_os_subtree_count(const struct rb_node *rb)
+{
+    return rb ? rb_entry(rb, struct rb_os_node, rb)->__subtree_count : 0;
+}
+
+static inline bool rb_os_compute(struct rb_os_node *node, bool exit)
+{
+    unsigned long count = 1 + rb_os_subtree_count(node->rb.rb_left) +
+                          rb_os_subtree_count(node->rb.rb_right);
+    if (exit && node->__subtree_count == count)
+        return true;
+    node->__subtree_count = count;
+    return false;
+}
+
+RB_DECLARE_CALLBACKS(static, rb_os_augment, struct rb_os_node, rb,
+                __subtree_count, rb_os_compute)
+
+void rb_os_insert_color(struct rb_os_node *node, struct rb_root *root)
+{
+    struct rb_node *rb;
+
+    /* the new node is a leaf, every ancestor gains one */
+    node->__subtree_count = 1;
+    for (rb = rb_parent(&node->rb); rb; rb = rb_parent(rb))
+        rb_entry(rb, struct rb_os_node, rb)->__subtree_count++;
+    rb_insert_augmented(&node->rb, root, &rb_os_augment);
+}
+
+void rb_os_erase(struct rb_os_node *node, struct rb_root *root)
+{
+    rb_erase_augmented(&node->rb, root, &rb_os_augment);
+}
+
+unsigned long rb_os_count(const struct rb_root *root)
+{
+    return rb_os_subtree_count(root->rb_node);
+}
+
+struct rb_os_node *rb_os_select(const struct rb_root *root, unsigned long k)
+{
+    struct rb_node *rb = root->rb_node;
+
+    while (rb) {
+        unsigned long left = rb_os_subtree_count(rb->rb_left);
+        if (k < left) {
+            rb = rb->rb_left;
+        } else if (k == left) {
+            return rb_entry(rb, struct rb_os_node, rb);
+        } else {
+            k -= left + 1;
+            rb = rb->rb_right;
+        }
+    }
+    return NULL;
+}
+
+unsigned long rb_os_rank(const struct rb_os_node *node)
+{
+    const struct rb_node *rb = &node->rb, *parent;
+    unsigned long rank = rb_os_subtree_count(rb->rb_left);
+
+    while ((parent = rb_parent(rb))) {
+        if (rb == parent->rb_right)
+            rank += rb_os_subtree_count(parent->rb_left) + 1;
+        rb = parent;
+    }
+    return rank;
+}
+
+/*
+ * Interval tree, the generic kernel interval tree instantiated for uint64_t
+ *
+ * Cond1: node->start <= last
+ * Cond2: start <= node->last
+ */
+#define ITLAST(n) ((n)->last)
+
+RB_DECLARE_CALLBACKS_MAX(static, interval_tree_augment,
+                struct interval_tree_node, rb, uint64_t, __subtree_last, ITLAST)
+
+void interval_tree_insert(struct interval_tree_node *node,
+                struct rb_root_cached *root)
+{
+    struct rb_node **link = &root->rb_root.rb_node, *rb_parent = NULL;
+    uint64_t start = node->start, last = node->last;
+    struct interval_tree_node *parent;
+    bool leftmost = true;
+
+    while (*link) {
+        rb_parent = *link;
+        parent = rb_entry(rb_parent, struct interval_tree_node, rb);
+        if (parent->__subtree_last < last)
+            parent->__subtree_last = last;
+        if (start < parent->start)
+            link = &parent->rb.rb_left;
+        else {
+            link = &parent->rb.rb_right;
+            leftmost = false;
+        }
+    }
+
+    node->__subtree_last = last;
+    rb_link_node(&node->rb, rb_parent, link);
+    rb_insert_augmented_cached(&node->rb, root, leftmost,
+                    &interval_tree_augment);
+}
+
+void interval_tree_remove(struct interval_tree_node *node,
+                struct rb_root_cached *root)
+{
+    rb_erase_augmented_cached(&node->rb, root, &interval_tree_augment);
+}
+
+static struct interval_tree_node *
+interval_tree_subtree_search(struct interval_tree_node *node,
+                uint64_t start, uint64_t last)
+{
+    while (true) {
+        /*
+         * Loop invariant: start <= node->__subtree_last
+         * (Cond2 is satisfied by one of the subtree nodes)
+         */
+        if (node->rb.rb_left) {
+            struct interval_tree_node *left = rb_entry(node->rb.rb_left,
+                            struct interval_tree_node, rb);
+            if (start <= left->__subtree_last) {
+                /*
+                 * Some nodes in left subtree satisfy Cond2.
+                 * Iterate to find the leftmost such node N.
+                 * If it also satisfies Cond1, that's the
+                 * match we are looking for. Otherwise, there
+                 * is no matching interval as nodes to the
+                 * right of N can't satisfy Cond1 either.
+                 */
+                node = left;
+                continue;
+            }
+        }
+        if (node->start <= last) {        /* Cond1 */
+            if (start <= node->last)      /* Cond2 */
+                return node;              /* node is leftmost match */
+            if (node->rb.rb_right) {
+                node = rb_entry(node->rb.rb_right,
+                                struct interval_tree_node, rb);
+                if (start <= node->__subtree_last)
+                    continue;
+            }
+        }
+        return NULL;    /* No match */
+    }
+}
+
+struct interval_tree_node *interval_tree_iter_first(
+                struct rb_root_cached *root, uint64_t start, uint64_t last)
+{
+    struct interval_tree_node *node, *leftmost;
+
+    if (!root->rb_root.rb_node)
+        return NULL;
+
+    /*
+     * Overlap of [start, last] with the whole tree is decided in O(1):
+     * the root holds the largest last, the cached leftmost the smallest
+     * start. Ranges outside both skip the walk entirely.
+     */
+    node = rb_entry(root->rb_root.rb_node, struct interval_tree_node, rb);
+    if (node->__subtree_last < start)
+        return NULL;
+
+    leftmost = rb_entry(root->rb_leftmost, struct interval_tree_node, rb);
+    if (leftmost->start > last)
+        return NULL;
+
+    return interval_tree_subtree_search(node, start, last);
+}
+
+struct interval_tree_node *interval_tree_iter_next(
+                struct interval_tree_node *node, uint64_t start, uint64_t last)
+{
+    struct rb_node *rb = node->rb.rb_right, *prev;
+
+    while (true) {
+        /*
+         * Loop invariants:
+         *   Cond1: node->start <= last
+         *   rb == node->rb.rb_right
+         *
+         * First, search right subtree if suitable
+         */
+        if (rb) {
+            struct interval_tree_node *right = rb_entry(rb,
+                            struct interval_tree_node, rb);
+            if (start <= right->__subtree_last)
+                return interval_tree_subtree_search(right, start, last);
+        }
+
+        /* Move up the tree until we come from a node's left child */
+        do {
+            rb = rb_parent(&node->rb);
+            if (!rb)
+                return NULL;
+            prev = &node->rb;
+            node = rb_entry(rb, struct interval_tree_node, rb);
+            rb = node->rb.rb_right;
+        } while (prev == rb);
+
+        /* Check if the node intersects [start, last] */
+        if (last < node->start)          /* !Cond1 */
+            return NULL;
+        else if (start <= node->last)    /* Cond2 */
+            return node;
+    }
+}
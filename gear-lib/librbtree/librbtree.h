@@ -22,7 +22,7 @@
 #ifndef LIBRBTREE_H
 #define LIBRBTREE_H
 
-#define LIBRBTREE_VERSION "0.1.0"
+#define LIBRBTREE_VERSION "0.2.0"
 
 #include <libposix.h>
 
@@ -40,10 +40,26 @@ struct rb_root {
     struct rb_node *rb_node;
 };
 
+/*
+ * Leftmost-cached rbtrees.
+ *
+ * We do not cache the rightmost node based on footprint
+ * size vs number of potential users that could benefit
+ * from O(1) rb_last(). Just not worth it, users that want
+ * this feature can always implement the logic explicitly.
+ * Furthermore, users that want to cache both pointers may
+ * find it a bit asymmetric, but that's ok.
+ */
+struct rb_root_cached {
+    struct rb_root rb_root;
+    struct rb_node *rb_leftmost;
+};
+
 
 #define rb_parent(r)   ((struct rb_node *)((r)->__rb_parent_color & ~3))
 
 #define RB_ROOT (struct rb_root) { NULL, }
+#define RB_ROOT_CACHED (struct rb_root_cached) { {NULL, }, NULL }
 #define rb_entry(ptr, type, member) container_of(ptr, type, member)
 
 #define RB_EMPTY_ROOT(root)  ((root)->rb_node == NULL)
@@ -63,6 +79,16 @@ struct rb_node *rb_prev(const struct rb_node *);
 struct rb_node *rb_first(const struct rb_root *);
 struct rb_node *rb_last(const struct rb_root *);
 
+/* Same as above, O(1) rb_first() on a leftmost-cached tree */
+#define rb_first_cached(root) (root)->rb_leftmost
+
+/* leftmost: node was linked as the left child of every node on its path */
+void rb_insert_color_cached(struct rb_node *node,
+                struct rb_root_cached *root, bool leftmost);
+void rb_erase_cached(struct rb_node *node, struct rb_root_cached *root);
+void rb_replace_node_cached(struct rb_node *victim, struct rb_node *_new,
+                struct rb_root_cached *root);
+
 /* Postorder iteration - always visit the parent after its children */
 struct rb_node *rb_first_postorder(const struct rb_root *);
 struct rb_node *rb_next_postorder(const struct rb_node *);
@@ -99,6 +125,48 @@ static inline void rb_link_node(struct rb_node * node, struct rb_node * parent,
              typeof(*pos), field); 1; }); \
          pos = n)
 
+/*
+ * Order-statistic tree: every node counts the nodes of its subtree, so the
+ * k-th node and the rank of a node are found in O(log n).
+ *
+ * Embed struct rb_os_node, find the position with the usual compare walk,
+ * then rb_link_node() and rb_os_insert_color() instead of rb_insert_color().
+ */
+struct rb_os_node {
+    struct rb_node rb;
+    unsigned long __subtree_count;
+};
+
+void rb_os_insert_color(struct rb_os_node *node, struct rb_root *root);
+void rb_os_erase(struct rb_os_node *node, struct rb_root *root);
+unsigned long rb_os_count(const struct rb_root *root);
+/* k-th node in sort order, starting from 0, NULL if k >= count */
+struct rb_os_node *rb_os_select(const struct rb_root *root, unsigned long k);
+/* number of nodes before node in sort order */
+unsigned long rb_os_rank(const struct rb_os_node *node);
+
+/*
+ * Interval tree of closed intervals [start, last], sorted by start, every
+ * node keeps the max last of its subtree. iter_first/iter_next return all
+ * nodes overlapping [start, last] in start order, e.g. the record segments
+ * covering a requested time range.
+ */
+struct interval_tree_node {
+    struct rb_node rb;
+    uint64_t start;    /* Start of interval */
+    uint64_t last;     /* Last location _in_ interval */
+    uint64_t __subtree_last;
+};
+
+void interval_tree_insert(struct interval_tree_node *node,
+                struct rb_root_cached *root);
+void interval_tree_remove(struct interval_tree_node *node,
+                struct rb_root_cached *root);
+struct interval_tree_node *interval_tree_iter_first(
+                struct rb_root_cached *root, uint64_t start, uint64_t last);
+struct interval_tree_node *interval_tree_iter_next(
+                struct interval_tree_node *node, uint64_t start, uint64_t last);
+
 #ifdef __cplusplus
 }
 #endif
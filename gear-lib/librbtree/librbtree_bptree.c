@@ -0,0 +1,630 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+#include "librbtree_bptree.h"
+
+#define LEAF_KEYS   ((uint32_t)BPTREE_LEAF_KEYS)
+#define INNER_KEYS  ((uint32_t)BPTREE_INNER_KEYS)
+
+/* non-root nodes hold at least half, the append split may leave the
+ * rightmost leaf below that until it fills up */
+#define LEAF_MIN    (LEAF_KEYS / 2)
+#define INNER_MIN   (INNER_KEYS / 2)
+
+#define BPTREE_MAX_HEIGHT   48
+
+static void *bptree_node_alloc(struct bptree *t)
+{
+    void *p = NULL;
+#if defined(_WIN32)
+    p = _aligned_malloc(BPTREE_NODE_SIZE, BPTREE_CACHE_LINE);
+#else
+    if (posix_memalign(&p, BPTREE_CACHE_LINE, BPTREE_NODE_SIZE))
+        p = NULL;
+#endif
+    if (!p) {
+        printf("bptree node alloc failed!\n");
+        return NULL;
+    }
+    ((struct bptree_leaf *)p)->count = 0;
+    t->nodes++;
+    return p;
+}
+
+static void bptree_node_free(struct bptree *t, void *p)
+{
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+    t->nodes--;
+}
+
+/* number of keys <= key */
+static inline uint32_t upper_pos(const uint64_t *keys, uint32_t n, uint64_t key)
+{
+    const uint64_t *base = keys;
+
+    if (!n)
+        return 0;
+    while (n > 1) {
+        uint32_t half = n >> 1;
+        base = (base[half] <= key) ? base + half : base;
+        n -= half;
+    }
+    return (uint32_t)(base - keys) + (*base <= key);
+}
+
+/* number of keys < key */
+static inline uint32_t lower_pos(const uint64_t *keys, uint32_t n, uint64_t key)
+{
+    const uint64_t *base = keys;
+
+    if (!n)
+        return 0;
+    while (n > 1) {
+        uint32_t half = n >> 1;
+        base = (base[half] < key) ? base + half : base;
+        n -= half;
+    }
+    return (uint32_t)(base - keys) + (*base < key);
+}
+
+struct bptree *bptree_create(void)
+{
+    struct bptree *t = (struct bptree *)calloc(1, sizeof(struct bptree));
+    if (!t) {
+        printf("malloc bptree failed!\n");
+        return NULL;
+    }
+    return t;
+}
+
+static void bptree_free_node(struct bptree *t, void *node, uint32_t height)
+{
+    if (height) {
+        struct bptree_inner *in = (struct bptree_inner *)node;
+        uint32_t i;
+        for (i = 0; i <= in->count; i++)
+            bptree_free_node(t, in->children[i], height - 1);
+    }
+    bptree_node_free(t, node);
+}
+
+void bptree_clear(struct bptree *t)
+{
+    if (t->root)
+        bptree_free_node(t, t->root, t->height);
+    t->root = NULL;
+    t->height = 0;
+    t->count = 0;
+    t->first = NULL;
+    t->last = NULL;
+}
+
+void bptree_destroy(struct bptree *t)
+{
+    if (!t)
+        return;
+    bptree_clear(t);
+    free(t);
+}
+
+size_t bptree_count(const struct bptree *t)
+{
+    return t->count;
+}
+
+static struct bptree_leaf *bptree_find_leaf(const struct bptree *t, uint64_t key)
+{
+    void *node = t->root;
+    uint32_t h;
+
+    for (h = t->height; h; h--) {
+        struct bptree_inner *in = (struct bptree_inner *)node;
+        node = in->children[upper_pos(in->keys, in->count, key)];
+    }
+    return (struct bptree_leaf *)node;
+}
+
+int bptree_lookup(const struct bptree *t, uint64_t key, void **val)
+{
+    struct bptree_leaf *leaf;
+    uint32_t pos;
+
+    if (!t->root)
+        return -1;
+    leaf = bptree_find_leaf(t, key);
+    pos = lower_pos(leaf->keys, leaf->count, key);
+    if (pos == leaf->count || leaf->keys[pos] != key)
+        return -1;
+    if (val)
+        *val = leaf->vals[pos];
+    return 0;
+}
+
+static void leaf_insert_at(struct bptree_leaf *leaf, uint32_t pos,
+                uint64_t key, void *val)
+{
+    uint32_t n = leaf->count - pos;
+
+    memmove(&leaf->keys[pos + 1], &leaf->keys[pos], n * sizeof(uint64_t));
+    memmove(&leaf->vals[pos + 1], &leaf->vals[pos], n * sizeof(void *));
+    leaf->keys[pos] = key;
+    leaf->vals[pos] = val;
+    leaf->count++;
+}
+
+static void leaf_remove_at(struct bptree_leaf *leaf, uint32_t pos)
+{
+    uint32_t n = leaf->count - pos - 1;
+
+    memmove(&leaf->keys[pos], &leaf->keys[pos + 1], n * sizeof(uint64_t));
+    memmove(&leaf->vals[pos], &leaf->vals[pos + 1], n * sizeof(void *));
+    leaf->count--;
+}
+
+/* remove keys[pos] and children[pos + 1] */
+static void inner_remove_at(struct bptree_inner *in, uint32_t pos)
+{
+    uint32_t n = in->count - pos - 1;
+
+    memmove(&in->keys[pos], &in->keys[pos + 1], n * sizeof(uint64_t));
+    memmove(&in->children[pos + 1], &in->children[pos + 2], n * sizeof(void *));
+    in->count--;
+}
+
+static void leaf_link_after(struct bptree *t, struct bptree_leaf *pos,
+                struct bptree_leaf *leaf)
+{
+    leaf->prev = pos;
+    leaf->next = pos->next;
+    if (pos->next)
+        pos->next->prev = leaf;
+    else
+        t->last = leaf;
+    pos->next = leaf;
+}
+
+static void leaf_unlink(struct bptree *t, struct bptree_leaf *leaf)
+{
+    if (leaf->prev)
+        leaf->prev->next = leaf->next;
+    else
+        t->first = leaf->next;
+    if (leaf->next)
+        leaf->next->prev = leaf->prev;
+    else
+        t->last = leaf->prev;
+}
+
+int bptree_insert(struct bptree *t, uint64_t key, void *val)
+{
+    struct bptree_inner *path[BPTREE_MAX_HEIGHT];
+    uint32_t idx[BPTREE_MAX_HEIGHT];
+    void *spare[BPTREE_MAX_HEIGHT + 1];
+    struct bptree_leaf *leaf, *right;
+    void *node, *child;
+    uint64_t sep;
+    uint32_t h, pos, split, need, used;
+
+    if (!t->root) {
+        leaf = (struct bptree_leaf *)bptree_node_alloc(t);
+        if (!leaf)
+            return -1;
+        leaf->prev = leaf->next = NULL;
+        leaf->keys[0] = key;
+        leaf->vals[0] = val;
+        leaf->count = 1;
+        t->root = t->first = t->last = leaf;
+        t->height = 0;
+        t->count = 1;
+        return 0;
+    }
+
+    node = t->root;
+    for (h = 0; h < t->height; h++) {
+        struct bptree_inner *in = (struct bptree_inner *)node;
+        path[h] = in;
+        idx[h] = upper_pos(in->keys, in->count, key);
+        node = in->children[idx[h]];
+    }
+    leaf = (struct bptree_leaf *)node;
+    pos = lower_pos(leaf->keys, leaf->count, key);
+    if (pos < leaf->count && leaf->keys[pos] == key) {
+        leaf->vals[pos] = val;
+        return 0;
+    }
+    if (leaf->count < LEAF_KEYS) {
+        leaf_insert_at(leaf, pos, key, val);
+        t->count++;
+        return 0;
+    }
+
+    /* allocate every node the split can take before touching the tree:
+     * the leaf, each full parent and a new root when they are all full */
+    for (need = 1; need <= h && path[h - need]->count == INNER_KEYS; need++)
+        ;
+    if (need > h) {
+        if (t->height + 1 >= BPTREE_MAX_HEIGHT) {
+            printf("bptree too high!\n");
+            return -1;
+        }
+        need++;
+    }
+    for (used = 0; used < need; used++) {
+        spare[used] = bptree_node_alloc(t);
+        if (!spare[used]) {
+            while (used--)
+                bptree_node_free(t, spare[used]);
+            return -1;
+        }
+    }
+    used = 0;
+
+    /* split a full leaf, appends past the end keep the old leaf full */
+    right = (struct bptree_leaf *)spare[used++];
+    split = (pos == LEAF_KEYS && !leaf->next) ? LEAF_KEYS : (LEAF_KEYS + 1) / 2;
+    if (pos < split) {
+        right->count = LEAF_KEYS - split + 1;
+        memcpy(right->keys, &leaf->keys[split - 1], right->count * sizeof(uint64_t));
+        memcpy(right->vals, &leaf->vals[split - 1], right->count * sizeof(void *));
+        leaf->count = split - 1;
+        leaf_insert_at(leaf, pos, key, val);
+    } else {
+        right->count = LEAF_KEYS - split;
+        memcpy(right->keys, &leaf->keys[split], right->count * sizeof(uint64_t));
+        memcpy(right->vals, &leaf->vals[split], right->count * sizeof(void *));
+        leaf->count = split;
+        leaf_insert_at(right, pos - split, key, val);
+    }
+    leaf_link_after(t, leaf, right);
+    t->count++;
+    sep = right->keys[0];
+    child = right;
+
+    /* insert (sep, child) into the parents, splitting full ones */
+    while (h--) {
+        struct bptree_inner *in = path[h], *rin;
+        uint64_t tkeys[BPTREE_INNER_KEYS + 1];
+        void *tchildren[BPTREE_INNER_KEYS + 2];
+        uint32_t i = idx[h], n, left;
+
+        if (in->count < INNER_KEYS) {
+            n = in->count - i;
+            memmove(&in->keys[i + 1], &in->keys[i], n * sizeof(uint64_t));
+            memmove(&in->children[i + 2], &in->children[i + 1], n * sizeof(void *));
+            in->keys[i] = sep;
+            in->children[i + 1] = child;
+            in->count++;
+            return 0;
+        }
+
+        rin = (struct bptree_inner *)spare[used++];
+        memcpy(tkeys, in->keys, i * sizeof(uint64_t));
+        tkeys[i] = sep;
+        memcpy(&tkeys[i + 1], &in->keys[i], (INNER_KEYS - i) * sizeof(uint64_t));
+        memcpy(tchildren, in->children, (i + 1) * sizeof(void *));
+        tchildren[i + 1] = child;
+        memcpy(&tchildren[i + 2], &in->children[i + 1], (INNER_KEYS - i) * sizeof(void *));
+
+        left = (INNER_KEYS + 1) / 2;
+        in->count = left;
+        memcpy(in->keys, tkeys, left * sizeof(uint64_t));
+        memcpy(in->children, tchildren, (left + 1) * sizeof(void *));
+        rin->count = INNER_KEYS - left;
+        memcpy(rin->keys, &tkeys[left + 1], rin->count * sizeof(uint64_t));
+        memcpy(rin->children, &tchildren[left + 1], (rin->count + 1) * sizeof(void *));
+        sep = tkeys[left];
+        child = rin;
+    }
+
+    /* the root was split */
+    {
+        struct bptree_inner *root = (struct bptree_inner *)spare[used++];
+        root->count = 1;
+        root->keys[0] = sep;
+        root->children[0] = t->root;
+        root->children[1] = child;
+        t->root = root;
+        t->height++;
+    }
+    return 0;
+}
+
+/* refill or merge an inner node that fell below INNER_MIN */
+static void bptree_fix_inner(struct bptree *t, struct bptree_inner **path,
+                uint32_t *idx, uint32_t h)
+{
+    for (;;) {
+        struct bptree_inner *in = path[h], *p, *left, *right;
+        uint32_t ci;
+
+        if (h == 0) {
+            if (!in->count) {
+                t->root = in->children[0];
+                t->height--;
+                bptree_node_free(t, in);
+            }
+            return;
+        }
+        if (in->count >= INNER_MIN)
+            return;
+
+        p = path[h - 1];
+        ci = idx[h - 1];
+        left = ci ? (struct bptree_inner *)p->children[ci - 1] : NULL;
+        right = ci < p->count ? (struct bptree_inner *)p->children[ci + 1] : NULL;
+
+        if (left && left->count > INNER_MIN) {
+            /* rotate right through the parent */
+            memmove(&in->keys[1], &in->keys[0], in->count * sizeof(uint64_t));
+            memmove(&in->children[1], &in->children[0], (in->count + 1) * sizeof(void *));
+            in->keys[0] = p->keys[ci - 1];
+            in->children[0] = left->children[left->count];
+            in->count++;
+            p->keys[ci - 1] = left->keys[left->count - 1];
+            left->count--;
+            return;
+        }
+        if (right && right->count > INNER_MIN) {
+            /* rotate left through the parent */
+            in->keys[in->count] = p->keys[ci];
+            in->children[in->count + 1] = right->children[0];
+            in->count++;
+            p->keys[ci] = right->keys[0];
+            memmove(&right->keys[0], &right->keys[1], (right->count - 1) * sizeof(uint64_t));
+            memmove(&right->children[0], &right->children[1], right->count * sizeof(void *));
+            right->count--;
+            return;
+        }
+        if (left) {
+            left->keys[left->count] = p->keys[ci - 1];
+            memcpy(&left->keys[left->count + 1], in->keys, in->count * sizeof(uint64_t));
+            memcpy(&left->children[left->count + 1], in->children, (in->count + 1) * sizeof(void *));
+            left->count += in->count + 1;
+            bptree_node_free(t, in);
+            inner_remove_at(p, ci - 1);
+        } else {
+            in->keys[in->count] = p->keys[ci];
+            memcpy(&in->keys[in->count + 1], right->keys, right->count * sizeof(uint64_t));
+            memcpy(&in->children[in->count + 1], right->children, (right->count + 1) * sizeof(void *));
+            in->count += right->count + 1;
+            bptree_node_free(t, right);
+            inner_remove_at(p, ci);
+        }
+        h--;
+    }
+}
+
+int bptree_remove(struct bptree *t, uint64_t key, void **val)
+{
+    struct bptree_inner *path[BPTREE_MAX_HEIGHT], *p;
+    uint32_t idx[BPTREE_MAX_HEIGHT];
+    struct bptree_leaf *leaf, *left, *right;
+    void *node = t->root;
+    uint32_t h, pos, ci;
+
+    if (!node)
+        return -1;
+    for (h = 0; h < t->height; h++) {
+        struct bptree_inner *in = (struct bptree_inner *)node;
+        path[h] = in;
+        idx[h] = upper_pos(in->keys, in->count, key);
+        node = in->children[idx[h]];
+    }
+    leaf = (struct bptree_leaf *)node;
+    pos = lower_pos(leaf->keys, leaf->count, key);
+    if (pos == leaf->count || leaf->keys[pos] != key)
+        return -1;
+    if (val)
+        *val = leaf->vals[pos];
+    leaf_remove_at(leaf, pos);
+    t->count--;
+
+    if (!t->height) {
+        if (!leaf->count) {
+            bptree_node_free(t, leaf);
+            t->root = t->first = t->last = NULL;
+        }
+        return 0;
+    }
+    if (leaf->count >= LEAF_MIN)
+        return 0;
+
+    p = path[t->height - 1];
+    ci = idx[t->height - 1];
+    left = ci ? (struct bptree_leaf *)p->children[ci - 1] : NULL;
+    right = ci < p->count ? (struct bptree_leaf *)p->children[ci + 1] : NULL;
+
+    if (left && left->count > LEAF_MIN) {
+        leaf_insert_at(leaf, 0, left->keys[left->count - 1], left->vals[left->count - 1]);
+        left->count--;
+        p->keys[ci - 1] = leaf->keys[0];
+        return 0;
+    }
+    if (right && right->count > LEAF_MIN) {
+        leaf->keys[leaf->count] = right->keys[0];
+        leaf->vals[leaf->count] = right->vals[0];
+        leaf->count++;
+        leaf_remove_at(right, 0);
+        p->keys[ci] = right->keys[0];
+        return 0;
+    }
+    if (left) {
+        memcpy(&left->keys[left->count], leaf->keys, leaf->count * sizeof(uint64_t));
+        memcpy(&left->vals[left->count], leaf->vals, leaf->count * sizeof(void *));
+        left->count += leaf->count;
+        leaf_unlink(t, leaf);
+        bptree_node_free(t, leaf);
+        inner_remove_at(p, ci - 1);
+    } else {
+        memcpy(&leaf->keys[leaf->count], right->keys, right->count * sizeof(uint64_t));
+        memcpy(&leaf->vals[leaf->count], right->vals, right->count * sizeof(void *));
+        leaf->count += right->count;
+        leaf_unlink(t, right);
+        bptree_node_free(t, right);
+        inner_remove_at(p, ci);
+    }
+    bptree_fix_inner(t, path, idx, t->height - 1);
+    return 0;
+}
+
+int bptree_bulk_load(struct bptree *t, const uint64_t *keys,
+                void * const *vals, size_t num)
+{
+    void **level;
+    uint64_t *mins;
+    size_t i, n, nodes, pos;
+
+    if (t->root) {
+        printf("bptree_bulk_load needs an empty tree!\n");
+        return -1;
+    }
+    if (!num)
+        return 0;
+    for (i = 1; i < num; i++) {
+        if (keys[i] <= keys[i - 1]) {
+            printf("bptree_bulk_load keys not strictly increasing at %zu!\n", i);
+            return -1;
+        }
+    }
+
+    nodes = (num + LEAF_KEYS - 1) / LEAF_KEYS;
+    level = (void **)malloc(nodes * sizeof(void *));
+    mins = (uint64_t *)malloc(nodes * sizeof(uint64_t));
+    if (!level || !mins) {
+        printf("malloc bptree_bulk_load failed!\n");
+        free(level);
+        free(mins);
+        return -1;
+    }
+
+    /* spread keys evenly, every leaf ends up at least half full */
+    for (i = 0, pos = 0; i < nodes; i++) {
+        struct bptree_leaf *leaf = (struct bptree_leaf *)bptree_node_alloc(t);
+        size_t cnt = num / nodes + (i < num % nodes);
+        if (!leaf)
+            goto fail;
+        leaf->count = (uint32_t)cnt;
+        memcpy(leaf->keys, &keys[pos], cnt * sizeof(uint64_t));
+        if (vals)
+            memcpy(leaf->vals, &vals[pos], cnt * sizeof(void *));
+        else
+            memset(leaf->vals, 0, cnt * sizeof(void *));
+        leaf->prev = i ? (struct bptree_leaf *)level[i - 1] : NULL;
+        leaf->next = NULL;
+        if (i)
+            ((struct bptree_leaf *)level[i - 1])->next = leaf;
+        level[i] = leaf;
+        mins[i] = keys[pos];
+        pos += cnt;
+    }
+    t->first = (struct bptree_leaf *)level[0];
+    t->last = (struct bptree_leaf *)level[nodes - 1];
+    t->count = num;
+    t->height = 0;
+
+    /* build inner levels until one node is left */
+    while (nodes > 1) {
+        size_t parents = (nodes + INNER_KEYS) / (INNER_KEYS + 1);
+        for (i = 0, pos = 0; i < parents; i++) {
+            struct bptree_inner *in = (struct bptree_inner *)bptree_node_alloc(t);
+            size_t cnt = nodes / parents + (i < nodes % parents);
+            if (!in) {
+                /* children from pos on are still only in level[] */
+                t->root = NULL;
+                for (n = pos; n < nodes; n++)
+                    bptree_free_node(t, level[n], t->height);
+                for (n = 0; n < i; n++)
+                    bptree_free_node(t, level[n], t->height + 1);
+                goto fail_built;
+            }
+            in->count = (uint32_t)(cnt - 1);
+            memcpy(in->children, &level[pos], cnt * sizeof(void *));
+            memcpy(in->keys, &mins[pos + 1], (cnt - 1) * sizeof(uint64_t));
+            level[i] = in;
+            mins[i] = mins[pos];
+            pos += cnt;
+        }
+        nodes = parents;
+        t->height++;
+    }
+    t->root = level[0];
+    free(level);
+    free(mins);
+    return 0;
+
+fail:
+    for (n = 0; n < i; n++)
+        bptree_node_free(t, level[n]);
+fail_built:
+    free(level);
+    free(mins);
+    t->root = NULL;
+    t->first = t->last = NULL;
+    t->count = 0;
+    t->height = 0;
+    return -1;
+}
+
+bool bptree_lower_bound(const struct bptree *t, uint64_t key,
+                struct bptree_iter *it)
+{
+    struct bptree_leaf *leaf;
+    uint32_t pos;
+
+    it->leaf = NULL;
+    it->pos = 0;
+    if (!t->root)
+        return false;
+    leaf = bptree_find_leaf(t, key);
+    pos = lower_pos(leaf->keys, leaf->count, key);
+    if (pos == leaf->count) {
+        /* all keys here are smaller, the next leaf starts above key */
+        leaf = leaf->next;
+        pos = 0;
+    }
+    it->leaf = leaf;
+    it->pos = pos;
+    return leaf != NULL;
+}
+
+bool bptree_first(const struct bptree *t, struct bptree_iter *it)
+{
+    it->leaf = t->first;
+    it->pos = 0;
+    return it->leaf != NULL;
+}
+
+bool bptree_last(const struct bptree *t, struct bptree_iter *it)
+{
+    it->leaf = t->last;
+    it->pos = it->leaf ? it->leaf->count - 1 : 0;
+    return it->leaf != NULL;
+}
@@ -0,0 +1,157 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef LIBRBTREE_BPTREE_H
+#define LIBRBTREE_BPTREE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * bptree: B+tree ordered map of uint64_t keys to void * values
+ *
+ * Nodes are BPTREE_NODE_SIZE bytes, cache line aligned, so one lookup
+ * touches a few wide nodes instead of one rb_node per key. Keys live in
+ * the leaves, which are linked for range scans; inner nodes only route.
+ *
+ * A key is in child i of an inner node when keys[i - 1] <= key < keys[i].
+ * Appending past the largest key leaves the old rightmost leaf full, so
+ * time ordered inserts pack leaves completely.
+ */
+
+#ifndef BPTREE_NODE_SIZE
+#define BPTREE_NODE_SIZE    512
+#endif
+
+#define BPTREE_CACHE_LINE   64
+
+#define BPTREE_LEAF_KEYS    ((BPTREE_NODE_SIZE - 8 - 2 * sizeof(void *)) / \
+                             (sizeof(uint64_t) + sizeof(void *)))
+#define BPTREE_INNER_KEYS   ((BPTREE_NODE_SIZE - 8 - sizeof(void *)) / \
+                             (sizeof(uint64_t) + sizeof(void *)))
+
+struct bptree_leaf {
+    uint32_t count;
+    uint32_t reserved;
+    struct bptree_leaf *prev;
+    struct bptree_leaf *next;
+    uint64_t keys[BPTREE_LEAF_KEYS];
+    void *vals[BPTREE_LEAF_KEYS];
+};
+
+struct bptree_inner {
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t keys[BPTREE_INNER_KEYS];
+    void *children[BPTREE_INNER_KEYS + 1];
+};
+
+struct bptree {
+    void *root;
+    uint32_t height;            /* inner levels above the leaves */
+    size_t count;
+    size_t nodes;
+    struct bptree_leaf *first;
+    struct bptree_leaf *last;
+};
+
+struct bptree_iter {
+    struct bptree_leaf *leaf;
+    uint32_t pos;
+};
+
+struct bptree *bptree_create(void);
+void bptree_destroy(struct bptree *t);
+void bptree_clear(struct bptree *t);
+size_t bptree_count(const struct bptree *t);
+
+/* insert or replace, returns 0 */
+int bptree_insert(struct bptree *t, uint64_t key, void *val);
+/* returns 0 and the value when found, -1 otherwise */
+int bptree_lookup(const struct bptree *t, uint64_t key, void **val);
+int bptree_remove(struct bptree *t, uint64_t key, void **val);
+
+/*
+ * build an empty tree from strictly increasing keys with packed leaves,
+ * vals may be NULL to store NULL values
+ */
+int bptree_bulk_load(struct bptree *t, const uint64_t *keys,
+                void * const *vals, size_t num);
+
+/* position at the first key >= key, returns false when there is none */
+bool bptree_lower_bound(const struct bptree *t, uint64_t key,
+                struct bptree_iter *it);
+bool bptree_first(const struct bptree *t, struct bptree_iter *it);
+bool bptree_last(const struct bptree *t, struct bptree_iter *it);
+
+static inline bool bptree_iter_valid(const struct bptree_iter *it)
+{
+    return it->leaf != NULL;
+}
+
+static inline uint64_t bptree_iter_key(const struct bptree_iter *it)
+{
+    return it->leaf->keys[it->pos];
+}
+
+static inline void *bptree_iter_val(const struct bptree_iter *it)
+{
+    return it->leaf->vals[it->pos];
+}
+
+static inline void bptree_iter_next(struct bptree_iter *it)
+{
+    if (++it->pos >= it->leaf->count) {
+        it->leaf = it->leaf->next;
+        it->pos = 0;
+    }
+}
+
+static inline void bptree_iter_prev(struct bptree_iter *it)
+{
+    if (it->pos) {
+        it->pos--;
+    } else {
+        it->leaf = it->leaf->prev;
+        it->pos = it->leaf ? it->leaf->count - 1 : 0;
+    }
+}
+
+/*
+ * bptree_for_each_range - iterate keys in [lo, hi]
+ *
+ * @it:     struct bptree_iter to use as a loop cursor
+ * @t:      struct bptree *
+ */
+#define bptree_for_each_range(it, t, lo, hi)                              \
+    for (bptree_lower_bound(t, lo, it);                                   \
+         bptree_iter_valid(it) && bptree_iter_key(it) <= (hi);            \
+         bptree_iter_next(it))
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -22,7 +22,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
-#include "librbtree.h"
+#include <string.h>
+#include <time.h>
+#include "librbtree_augmented.h"
+#include "librbtree_bptree.h"
 
 #define container_of(ptr, type, member) ({			\
 	const typeof( ((type *)0)->member ) *__mptr = (ptr);	\
@@ -143,8 +146,651 @@ static void test(struct rb_root *mytree, int *input, size_t len)
     }
 }
 
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint64_t rnd(void)
+{
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return rnd_state;
+}
+
+struct os_entry {
+    struct rb_os_node os;
+    struct rb_node cached;
+    int key;
+};
+
+static void os_insert(struct rb_root *root, struct rb_root_cached *croot,
+                struct os_entry *e)
+{
+    struct rb_node **link = &root->rb_node, *parent = NULL;
+    bool leftmost = true;
+
+    while (*link) {
+        parent = *link;
+        if (e->key < rb_entry(parent, struct os_entry, os.rb)->key)
+            link = &parent->rb_left;
+        else
+            link = &parent->rb_right;
+    }
+    rb_link_node(&e->os.rb, parent, link);
+    rb_os_insert_color(&e->os, root);
+
+    link = &croot->rb_root.rb_node;
+    parent = NULL;
+    while (*link) {
+        parent = *link;
+        if (e->key < rb_entry(parent, struct os_entry, cached)->key) {
+            link = &parent->rb_left;
+        } else {
+            link = &parent->rb_right;
+            leftmost = false;
+        }
+    }
+    rb_link_node(&e->cached, parent, link);
+    rb_insert_color_cached(&e->cached, croot, leftmost);
+}
+
+static unsigned long os_verify(struct rb_node *rb)
+{
+    unsigned long count;
+    if (!rb)
+        return 0;
+    count = 1 + os_verify(rb->rb_left) + os_verify(rb->rb_right);
+    if (rb_entry(rb, struct rb_os_node, rb)->__subtree_count != count) {
+        printf("subtree count %lu != %lu\n",
+               rb_entry(rb, struct rb_os_node, rb)->__subtree_count, count);
+        exit(1);
+    }
+    return count;
+}
+
+static int test_cached_os(void)
+{
+    const int num = 5000;
+    struct rb_root root = RB_ROOT;
+    struct rb_root_cached croot = RB_ROOT_CACHED;
+    struct os_entry *e = (struct os_entry *)calloc(num, sizeof(*e));
+    struct rb_node *node;
+    unsigned long k;
+    int i, prev;
+
+    printf("RB_CACHED/RB_OS==================\n");
+    for (i = 0; i < num; i++) {
+        e[i].key = rnd() % 1000;
+        os_insert(&root, &croot, &e[i]);
+        if (rb_first_cached(&croot) != rb_first(&croot.rb_root)) {
+            printf("leftmost wrong after insert %d\n", i);
+            return -1;
+        }
+    }
+    os_verify(root.rb_node);
+    prev = -1;
+    for (k = 0, node = rb_first(&root); node; node = rb_next(node), k++) {
+        struct os_entry *x = rb_entry(node, struct os_entry, os.rb);
+        if (x->key < prev || &rb_os_select(&root, k)->rb != node ||
+            rb_os_rank(&x->os) != k) {
+            printf("select/rank mismatch at %lu\n", k);
+            return -1;
+        }
+        prev = x->key;
+    }
+    if (k != rb_os_count(&root) || rb_os_select(&root, k)) {
+        printf("count mismatch %lu\n", k);
+        return -1;
+    }
+    for (i = 0; i < num; i += 2) {
+        rb_os_erase(&e[i].os, &root);
+        rb_erase_cached(&e[i].cached, &croot);
+        if (rb_first_cached(&croot) != rb_first(&croot.rb_root)) {
+            printf("leftmost wrong after erase %d\n", i);
+            return -1;
+        }
+    }
+    if (os_verify(root.rb_node) != (unsigned long)num / 2) {
+        printf("count after erase mismatch\n");
+        return -1;
+    }
+    for (k = 0, node = rb_first(&root); node; node = rb_next(node), k++) {
+        if (&rb_os_select(&root, k)->rb != node ||
+            rb_os_rank(rb_entry(node, struct rb_os_node, rb)) != k) {
+            printf("select/rank mismatch after erase at %lu\n", k);
+            return -1;
+        }
+    }
+    for (i = 1; i < num; i += 2) {
+        rb_os_erase(&e[i].os, &root);
+        rb_erase_cached(&e[i].cached, &croot);
+    }
+    if (!RB_EMPTY_ROOT(&root) || rb_first_cached(&croot)) {
+        printf("tree not empty\n");
+        return -1;
+    }
+    free(e);
+    printf("cached leftmost and order statistics ok\n");
+    return 0;
+}
+
+static int test_interval(void)
+{
+    const int num = 3000;
+    struct rb_root_cached root = RB_ROOT_CACHED;
+    struct interval_tree_node *it = (struct interval_tree_node *)calloc(num, sizeof(*it));
+    struct interval_tree_node *n;
+    char *hit = (char *)calloc(num, 1);
+    int i, q, expect, got;
+
+    printf("INTERVAL_TREE====================\n");
+    for (i = 0; i < num; i++) {
+        it[i].start = rnd() % 100000;
+        it[i].last = it[i].start + rnd() % 1000;
+        interval_tree_insert(&it[i], &root);
+    }
+    for (q = 0; q < 2000; q++) {
+        uint64_t start = rnd() % 101000, last = start + rnd() % 2000;
+        if (q == 1000) {
+            /* drop a third and keep querying */
+            for (i = 0; i < num; i += 3)
+                interval_tree_remove(&it[i], &root);
+        }
+        memset(hit, 0, num);
+        got = 0;
+        for (n = interval_tree_iter_first(&root, start, last); n;
+             n = interval_tree_iter_next(n, start, last)) {
+            if (n->start > last || n->last < start) {
+                printf("query %d: [%llu, %llu] not overlapping\n", q,
+                       (unsigned long long)n->start, (unsigned long long)n->last);
+                return -1;
+            }
+            hit[n - it] = 1;
+            got++;
+        }
+        for (i = 0, expect = 0; i < num; i++) {
+            if (q >= 1000 && (i % 3) == 0)
+                continue;
+            if (it[i].start <= last && start <= it[i].last) {
+                expect++;
+                if (!hit[i]) {
+                    printf("query %d: missed interval %d\n", q, i);
+                    return -1;
+                }
+            }
+        }
+        if (got != expect) {
+            printf("query %d: got %d expect %d\n", q, got, expect);
+            return -1;
+        }
+    }
+    free(hit);
+    free(it);
+    printf("interval tree ok\n");
+    return 0;
+}
+
+static void timer_insert(struct rb_root_cached *root, struct os_entry *e, bool cached)
+{
+    struct rb_node **link = &root->rb_root.rb_node, *parent = NULL;
+    bool leftmost = true;
+
+    while (*link) {
+        parent = *link;
+        if (e->key < rb_entry(parent, struct os_entry, cached)->key) {
+            link = &parent->rb_left;
+        } else {
+            link = &parent->rb_right;
+            leftmost = false;
+        }
+    }
+    rb_link_node(&e->cached, parent, link);
+    if (cached)
+        rb_insert_color_cached(&e->cached, root, leftmost);
+    else
+        rb_insert_color(&e->cached, &root->rb_root);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench(int num)
+{
+    struct rb_root root = RB_ROOT;
+    struct rb_root_cached croot = RB_ROOT_CACHED;
+    struct rb_root_cached itroot = RB_ROOT_CACHED;
+    struct os_entry *e = (struct os_entry *)calloc(num, sizeof(*e));
+    struct interval_tree_node *it = (struct interval_tree_node *)calloc(num, sizeof(*it));
+    struct rb_node *node;
+    unsigned long sum = 0;
+    double t0;
+    int i, j, ops = 1000000;
+
+    for (i = 0; i < num; i++) {
+        e[i].key = rnd() % (num * 4);
+        os_insert(&root, &croot, &e[i]);
+    }
+    printf("%d nodes:\n", num);
+
+    /* timer queue: expire the minimum, rearm it later */
+    t0 = now_ns();
+    for (i = 0; i < ops; i++) {
+        struct os_entry *x;
+        node = rb_first_cached(&croot);
+        x = rb_entry(node, struct os_entry, cached);
+        rb_erase_cached(node, &croot);
+        x->key += num;
+        timer_insert(&croot, x, true);
+    }
+    printf("  timer rb_first_cached     %8.2f ns/op\n", (now_ns() - t0) / ops);
+    t0 = now_ns();
+    for (i = 0; i < ops; i++) {
+        struct os_entry *x;
+        node = rb_first(&croot.rb_root);
+        x = rb_entry(node, struct os_entry, cached);
+        rb_erase(node, &croot.rb_root);
+        x->key += num;
+        timer_insert(&croot, x, false);
+    }
+    printf("  timer rb_first            %8.2f ns/op\n", (now_ns() - t0) / ops);
+
+    /* k-th element: walk vs select */
+    t0 = now_ns();
+    for (i = 0; i < 1000; i++) {
+        unsigned long k = rnd() % num;
+        for (node = rb_first(&root); k--; node = rb_next(node));
+        sum += rb_entry(node, struct os_entry, os.rb)->key;
+    }
+    printf("  k-th by rb_next walk      %8.2f ns/op\n", (now_ns() - t0) / 1000);
+    t0 = now_ns();
+    for (i = 0; i < ops; i++) {
+        sum += rb_entry(rb_os_select(&root, rnd() % num), struct os_entry, os)->key;
+    }
+    printf("  rb_os_select              %8.2f ns/op\n", (now_ns() - t0) / ops);
+    t0 = now_ns();
+    for (i = 0; i < ops; i++) {
+        sum += rb_os_rank(&e[rnd() % num].os);
+    }
+    printf("  rb_os_rank                %8.2f ns/op\n", (now_ns() - t0) / ops);
+
+    /* record segments of 10s every 10s, query random 30s ranges */
+    for (i = 0; i < num; i++) {
+        it[i].start = (uint64_t)i * 10000;
+        it[i].last = it[i].start + 9999;
+        interval_tree_insert(&it[i], &itroot);
+    }
+    t0 = now_ns();
+    for (i = 0; i < 1000; i++) {
+        uint64_t start = rnd() % ((uint64_t)num * 10000), last = start + 30000;
+        for (j = 0; j < num; j++) {
+            if (it[j].start <= last && start <= it[j].last)
+                sum++;
+        }
+    }
+    printf("  overlap by linear scan    %8.2f ns/op\n", (now_ns() - t0) / 1000);
+    t0 = now_ns();
+    for (i = 0; i < ops; i++) {
+        uint64_t start = rnd() % ((uint64_t)num * 10000), last = start + 30000;
+        struct interval_tree_node *n;
+        for (n = interval_tree_iter_first(&itroot, start, last); n;
+             n = interval_tree_iter_next(n, start, last))
+            sum++;
+    }
+    printf("  interval_tree_iter        %8.2f ns/op\n", (now_ns() - t0) / ops);
+    printf("(checksum %lu)\n", sum);
+    free(it);
+    free(e);
+}
+
+static struct bptree_leaf *bp_prev_leaf;
+
+/* keys of node are in [lo, hi], returns the number of keys below node */
+static long bp_verify(struct bptree *t, void *node, uint32_t h,
+                uint64_t lo, uint64_t hi)
+{
+    uint32_t i;
+    long cnt = 0, sub;
+
+    if (!h) {
+        struct bptree_leaf *leaf = (struct bptree_leaf *)node;
+        if (leaf->prev != bp_prev_leaf ||
+            (bp_prev_leaf ? bp_prev_leaf->next : t->first) != leaf) {
+            printf("leaf chain broken\n");
+            return -1;
+        }
+        if (!leaf->count || leaf->count > BPTREE_LEAF_KEYS ||
+            (node != t->root && leaf != t->last &&
+             leaf->count < BPTREE_LEAF_KEYS / 2)) {
+            printf("leaf count %u\n", leaf->count);
+            return -1;
+        }
+        for (i = 0; i < leaf->count; i++) {
+            if (leaf->keys[i] < lo || leaf->keys[i] > hi ||
+                (i && leaf->keys[i] <= leaf->keys[i - 1])) {
+                printf("leaf key order\n");
+                return -1;
+            }
+        }
+        bp_prev_leaf = leaf;
+        return leaf->count;
+    }
+
+    struct bptree_inner *in = (struct bptree_inner *)node;
+    if (in->count > BPTREE_INNER_KEYS || (!in->count) ||
+        (node != t->root && in->count < BPTREE_INNER_KEYS / 2)) {
+        printf("inner count %u\n", in->count);
+        return -1;
+    }
+    for (i = 0; i <= in->count; i++) {
+        uint64_t clo = i ? in->keys[i - 1] : lo;
+        uint64_t chi = i < in->count ? in->keys[i] - 1 : hi;
+        if (i < in->count && (in->keys[i] < lo || in->keys[i] > hi ||
+            (i && in->keys[i] <= in->keys[i - 1]))) {
+            printf("inner key order\n");
+            return -1;
+        }
+        sub = bp_verify(t, in->children[i], h - 1, clo, chi);
+        if (sub < 0)
+            return -1;
+        cnt += sub;
+    }
+    return cnt;
+}
+
+static int bp_check(struct bptree *t)
+{
+    long cnt = 0;
+
+    bp_prev_leaf = NULL;
+    if (t->root)
+        cnt = bp_verify(t, t->root, t->height, 0, UINT64_MAX);
+    if (cnt < 0 || (size_t)cnt != bptree_count(t) || bp_prev_leaf != t->last) {
+        printf("bptree check failed, %ld keys, count %zu\n", cnt, bptree_count(t));
+        return -1;
+    }
+    return 0;
+}
+
+static int test_bptree(void)
+{
+    const uint32_t space = 60000;
+    struct bptree *t = bptree_create();
+    struct bptree_iter it;
+    uint64_t *keys;
+    char *present = (char *)calloc(space, 1);
+    size_t n = 0, i, cnt;
+    void *val;
+    int step;
+
+    printf("BPTREE===========================\n");
+    for (step = 0; step < 400000; step++) {
+        uint64_t key = rnd() % space;
+        int op = rnd() % 8;
+        if (step > 300000)
+            op = op < 6 ? 6 : op;   /* drain */
+        if (op < 4) {
+            if (bptree_insert(t, key, (void *)(uintptr_t)(key * 3 + 1)))
+                return -1;
+            n += !present[key];
+            present[key] = 1;
+        } else if (op < 7) {
+            int ret = bptree_remove(t, key, &val);
+            if ((ret == 0) != present[key] ||
+                (!ret && val != (void *)(uintptr_t)(key * 3 + 1))) {
+                printf("step %d: remove %llu ret %d\n", step, (unsigned long long)key, ret);
+                return -1;
+            }
+            n -= present[key];
+            present[key] = 0;
+        } else {
+            int ret = bptree_lookup(t, key, &val);
+            if ((ret == 0) != present[key]) {
+                printf("step %d: lookup %llu ret %d\n", step, (unsigned long long)key, ret);
+                return -1;
+            }
+        }
+        if (bptree_count(t) != n) {
+            printf("step %d: count %zu != %zu\n", step, bptree_count(t), n);
+            return -1;
+        }
+        if ((step % 9973) == 0 && bp_check(t))
+            return -1;
+        if ((step % 50000) == 0) {
+            /* ordered scan and lower_bound against the reference */
+            uint64_t lo = rnd() % space, hi = lo + 500, k = lo;
+            bptree_for_each_range(&it, t, lo, hi) {
+                while (k < space && !present[k])
+                    k++;
+                if (bptree_iter_key(&it) != k) {
+                    printf("step %d: range scan %llu != %llu\n", step,
+                           (unsigned long long)bptree_iter_key(&it), (unsigned long long)k);
+                    return -1;
+                }
+                k++;
+            }
+            while (k <= hi && k < space && !present[k])
+                k++;
+            if (k <= hi && k < space) {
+                printf("step %d: range scan stopped early\n", step);
+                return -1;
+            }
+        }
+    }
+    if (bp_check(t))
+        return -1;
+
+    /* bulk load, then mixed updates keep it valid */
+    bptree_clear(t);
+    keys = (uint64_t *)malloc(space * sizeof(uint64_t));
+    for (i = 0; i < space; i++)
+        keys[i] = i * 7;
+    if (bptree_bulk_load(t, keys, NULL, space) || bp_check(t))
+        return -1;
+    if (!bptree_bulk_load(t, keys, NULL, space)) {
+        printf("bulk load into a full tree\n");
+        return -1;
+    }
+    for (i = 0, cnt = 0, bptree_first(t, &it); bptree_iter_valid(&it); bptree_iter_next(&it), i++) {
+        if (bptree_iter_key(&it) != keys[i])
+            return -1;
+        cnt++;
+    }
+    for (bptree_last(t, &it); bptree_iter_valid(&it); bptree_iter_prev(&it))
+        cnt--;
+    if (i != space || cnt) {
+        printf("bulk load scan %zu\n", i);
+        return -1;
+    }
+    if (!bptree_lower_bound(t, 15, &it) || bptree_iter_key(&it) != 21 ||
+        bptree_lower_bound(t, keys[space - 1] + 1, &it)) {
+        printf("lower_bound mismatch\n");
+        return -1;
+    }
+    for (i = 0; i < space; i += 2) {
+        if (bptree_remove(t, keys[i], NULL) || bptree_insert(t, keys[i] + 1, NULL))
+            return -1;
+    }
+    if (bp_check(t) || bptree_count(t) != space)
+        return -1;
+    for (i = 0; i < space; i++) {
+        if (bptree_remove(t, (i & 1) ? keys[i] : keys[i] + 1, NULL))
+            return -1;
+    }
+    if (bptree_count(t) || t->root || t->nodes) {
+        printf("bptree not empty, %zu nodes\n", t->nodes);
+        return -1;
+    }
+
+    /* time ordered appends pack leaves full */
+    for (i = 0; i < space; i++)
+        bptree_insert(t, 1000000 + i, NULL);
+    if (bp_check(t))
+        return -1;
+    printf("bptree ok, %zu keys in %zu nodes of %d bytes\n", bptree_count(t),
+           t->nodes, BPTREE_NODE_SIZE);
+    bptree_destroy(t);
+    free(keys);
+    free(present);
+    return 0;
+}
+
+struct bench_entry {
+    struct rb_node rb;
+    uint64_t key;
+    void *val;
+};
+
+static int rb_bench_insert(struct rb_root *root, struct bench_entry *e)
+{
+    struct rb_node **link = &root->rb_node, *parent = NULL;
+
+    while (*link) {
+        struct bench_entry *x = rb_entry(*link, struct bench_entry, rb);
+        parent = *link;
+        if (e->key < x->key)
+            link = &parent->rb_left;
+        else if (e->key > x->key)
+            link = &parent->rb_right;
+        else
+            return -1;
+    }
+    rb_link_node(&e->rb, parent, link);
+    rb_insert_color(&e->rb, root);
+    return 0;
+}
+
+static struct bench_entry *rb_bench_find(struct rb_root *root, uint64_t key)
+{
+    struct rb_node *node = root->rb_node;
+
+    while (node) {
+        struct bench_entry *x = rb_entry(node, struct bench_entry, rb);
+        if (key < x->key)
+            node = node->rb_left;
+        else if (key > x->key)
+            node = node->rb_right;
+        else
+            return x;
+    }
+    return NULL;
+}
+
+static double now_ns(void);
+
+static void bench_bptree(size_t num, int with_rb)
+{
+    struct rb_root root = RB_ROOT;
+    struct bench_entry *e = NULL;
+    struct bptree *t = bptree_create();
+    struct bptree_iter it;
+    struct rb_node *node;
+    uint64_t *keys = (uint64_t *)malloc(num * sizeof(uint64_t));
+    uint64_t sum = 0, state;
+    size_t i, lookups = num < 2000000 ? num : 2000000;
+    double t0;
+    void *val;
+
+    /* random keys, splitmix64 of the index */
+    for (i = 0; i < num; i++) {
+        uint64_t z = (i + 1) * 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        keys[i] = (z ^ (z >> 31)) >> 8;
+    }
+    printf("%zu keys:\n", num);
+
+    if (with_rb) {
+        e = (struct bench_entry *)calloc(num, sizeof(*e));
+        t0 = now_ns();
+        for (i = 0; i < num; i++) {
+            e[i].key = keys[i];
+            rb_bench_insert(&root, &e[i]);
+        }
+        printf("  rbtree insert random     %8.1f ns/op\n", (now_ns() - t0) / num);
+    }
+    t0 = now_ns();
+    for (i = 0; i < num; i++)
+        bptree_insert(t, keys[i], &keys[i]);
+    printf("  bptree insert random     %8.1f ns/op, %zu nodes %.1f MB\n",
+           (now_ns() - t0) / num, t->nodes, t->nodes * (double)BPTREE_NODE_SIZE / 1e6);
+
+    if (with_rb) {
+        state = 1;
+        t0 = now_ns();
+        for (i = 0; i < lookups; i++) {
+            state = state * 6364136223846793005ULL + 1;
+            sum += rb_bench_find(&root, keys[(state >> 20) % num])->key;
+        }
+        printf("  rbtree lookup random     %8.1f ns/op\n", (now_ns() - t0) / lookups);
+    }
+    state = 1;
+    t0 = now_ns();
+    for (i = 0; i < lookups; i++) {
+        state = state * 6364136223846793005ULL + 1;
+        bptree_lookup(t, keys[(state >> 20) % num], &val);
+        sum += *(uint64_t *)val;
+    }
+    printf("  bptree lookup random     %8.1f ns/op\n", (now_ns() - t0) / lookups);
+
+    if (with_rb) {
+        t0 = now_ns();
+        for (node = rb_first(&root); node; node = rb_next(node))
+            sum += rb_entry(node, struct bench_entry, rb)->key;
+        printf("  rbtree scan              %8.2f ns/key\n", (now_ns() - t0) / num);
+    }
+    t0 = now_ns();
+    for (bptree_first(t, &it); bptree_iter_valid(&it); bptree_iter_next(&it))
+        sum += bptree_iter_key(&it);
+    printf("  bptree scan              %8.2f ns/key\n", (now_ns() - t0) / num);
+
+    /* sorted input: appends and bulk load */
+    for (i = 0; i < num; i++)
+        keys[i] = i * 16;
+    if (with_rb) {
+        root = RB_ROOT;
+        t0 = now_ns();
+        for (i = 0; i < num; i++) {
+            e[i].key = keys[i];
+            rb_bench_insert(&root, &e[i]);
+        }
+        printf("  rbtree insert sorted     %8.1f ns/op\n", (now_ns() - t0) / num);
+        free(e);
+    }
+    bptree_clear(t);
+    t0 = now_ns();
+    for (i = 0; i < num; i++)
+        bptree_insert(t, keys[i], NULL);
+    printf("  bptree insert sorted     %8.1f ns/op, %zu nodes\n", (now_ns() - t0) / num, t->nodes);
+    bptree_clear(t);
+    t0 = now_ns();
+    bptree_bulk_load(t, keys, NULL, num);
+    printf("  bptree bulk load         %8.1f ns/op, %zu nodes\n", (now_ns() - t0) / num, t->nodes);
+    t0 = now_ns();
+    for (i = 0; i < 100000; i++) {
+        uint64_t lo = (rnd() % num) * 16;
+        bptree_for_each_range(&it, t, lo, lo + 16 * 100)
+            sum += bptree_iter_key(&it);
+    }
+    printf("  bptree range of 100      %8.1f ns/op\n", (now_ns() - t0) / 100000);
+    printf("(checksum %llu)\n", (unsigned long long)sum);
+    bptree_destroy(t);
+    free(keys);
+}
+
 int main(int argc, char **argv)
 {
+    if (argc > 2 && !strcmp(argv[1], "bptree")) {
+        bench_bptree(strtoull(argv[2], NULL, 0), argc < 4 || strcmp(argv[3], "norb"));
+        return 0;
+    }
+    if (argc > 2 && !strcmp(argv[1], "bench")) {
+        bench(atoi(argv[2]));
+        return 0;
+    }
+
     printf("input 1=====================\n");
     test(&mytree_uk, input1, (sizeof(input1)/sizeof(input1[0])));
 
@@ -156,5 +802,8 @@ int main(int argc, char **argv)
 
     printf("input 4=====================\n");
     test(&mytree_uk, input4, (sizeof(input4)/sizeof(input4[0])));
+
+    if (test_cached_os() || test_interval() || test_bptree())
+        return -1;
     return 0;
 }
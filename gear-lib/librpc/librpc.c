@@ -30,6 +30,9 @@
 #include <errno.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#ifdef ENABLE_MEMPOOL
+#include <libmempool.h>
+#endif
 
 #define ENABLE_DEBUG 0
 
@@ -65,6 +68,17 @@ struct wq_arg {
 
 static struct hash *_msg_map_registered = NULL;
 
+#ifdef ENABLE_MEMPOOL
+/* wq_arg is allocated on event thread and freed on workq thread */
+static struct mempool *_wq_arg_pool = NULL;
+static pthread_once_t _wq_arg_pool_once = PTHREAD_ONCE_INIT;
+
+static void wq_arg_pool_init(void)
+{
+    _wq_arg_pool = mempool_create("rpc_wq_arg", 0);
+}
+#endif
+
 static void dump_buffer(void *buf, int len)
 {
     int i;
@@ -195,6 +209,9 @@ int rpc_send(struct rpc_base *base, struct rpc_packet *pkt)
     int ret, head_size;
     void *buf = NULL;
     int len;
+#ifdef ENABLE_MEMPOOL
+    struct mempool_scope scope;
+#endif
 
     head_size = sizeof(rpc_header_t);
 
@@ -205,9 +222,17 @@ int rpc_send(struct rpc_base *base, struct rpc_packet *pkt)
     print_packet(pkt);
 #endif
     len = head_size + pkt->header.payload_len;
+#ifdef ENABLE_MEMPOOL
+    mempool_scope_begin(&scope, mempool_arena_thread());
+    buf = mempool_arena_alloc(scope.arena, len);
+#else
     buf = calloc(1, len);
+#endif
     if (!buf) {
         printf("%s:%d alloc buf failed!\n", __func__, __LINE__);
+#ifdef ENABLE_MEMPOOL
+        mempool_scope_end(&scope);
+#endif
         return -1;
     }
     memcpy(buf, (void *)&pkt->header, head_size);
@@ -221,7 +246,11 @@ int rpc_send(struct rpc_base *base, struct rpc_packet *pkt)
         printf("%s:%d send len %d not matched %d failed!\n", __func__, __LINE__, ret, len);
         ret = -1;
     }
+#ifdef ENABLE_MEMPOOL
+    mempool_scope_end(&scope);
+#else
     free(buf);
+#endif
     return ret;
 }
 
@@ -356,6 +385,7 @@ int rpc_call(struct rpc *rpc, uint32_t msg_id,
         rpc->state = rpc_send_syn;
         if (thread_wait(ss->base.dispatch_thread, 2000) == -1) {
             printf("%s wait response failed %d:%s\n", __func__, errno, strerror(errno));
+            thread_unlock(ss->base.dispatch_thread);
             return -1;
         }
         thread_unlock(ss->base.dispatch_thread);
@@ -543,6 +573,13 @@ static void process_wq(void *arg)
             rpc_send(&session->base, &pkt);
         }
     }
+#ifdef ENABLE_MEMPOOL
+    mempool_free(wq->ibuf);
+    mempool_free(wq);
+#else
+    free(wq->ibuf);
+    free(wq);
+#endif
 }
 
 struct rpcs *rpc_server_get_handle(struct rpc_session *ss)
@@ -559,15 +596,33 @@ static int process_msg(struct rpcs *s, struct rpc_session *session, struct rpc_p
 
     msg_handler = find_msg_handler(h->msg_id);
     if (msg_handler) {
-        struct wq_arg *arg = calloc(1, sizeof(struct wq_arg));
-        struct rpc_session *ss = &arg->session;
+        struct wq_arg *arg;
+        struct rpc_session *ss;
+#ifdef ENABLE_MEMPOOL
+        pthread_once(&_wq_arg_pool_once, wq_arg_pool_init);
+        arg = mempool_calloc(_wq_arg_pool, sizeof(struct wq_arg));
+#else
+        arg = calloc(1, sizeof(struct wq_arg));
+#endif
+        if (!arg) {
+            printf("%s: alloc wq_arg failed\n", __func__);
+            return -1;
+        }
+        ss = &arg->session;
         arg->rpcs = s;
         memcpy(&arg->handler, msg_handler, sizeof(msg_handler_t));
         memcpy(&arg->session, session, sizeof(struct rpc_session));
         ss->uuid_dst = pkt->header.uuid_dst;
         ss->timestamp = pkt->header.timestamp;
         ss->msg_id = pkt->header.msg_id;
+#ifdef ENABLE_MEMPOOL
+        arg->ibuf = mempool_alloc(_wq_arg_pool, h->payload_len);
+        if (arg->ibuf) {
+            memcpy(arg->ibuf, pkt->payload, h->payload_len);
+        }
+#else
         arg->ibuf = memdup(pkt->payload, h->payload_len);
+#endif
         arg->ilen = h->payload_len;
 
         workq_pool_task_push(s->wq_pool, process_wq, arg);
@@ -5,7 +5,7 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := librtsp
 
 ifeq ($(MODE), release)
-LOCAL_CFLAGS += -O0
+LOCAL_CFLAGS += -O0 -DLOG_LEVEL_MIN=LOG_INFO
 endif
 
 LIBRARIES_DIR	:= $(LOCAL_PATH)/../
@@ -22,12 +22,17 @@
 #include "rtp.h"
 #include <liblog.h>
 #include <libsock.h>
+#include <libbitmap_ida.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#ifdef ENABLE_MEMPOOL
+#include <libmempool.h>
+#endif
 
 #define RTP_V(v)    ((v >> 30) & 0x03)   /* protocol version */
 #define RTP_P(v)    ((v >> 29) & 0x01)   /* padding flag */
@@ -50,6 +55,22 @@
 #define nbo_w32 rtp_write_uint32
 
 static uint16_t g_base_port = 20000;//must even data
+#define RTP_PORT_RANGE  30000
+#define RTP_SSRC_MAX    (1 << 16)
+
+/*
+ * rtp/rtcp port pairs and ssrc are taken from id allocators instead of
+ * rand(), so two sessions never share a port pair or an ssrc
+ */
+static struct ida *g_port_ida = NULL;
+static struct ida *g_ssrc_ida = NULL;
+static pthread_once_t g_ida_once = PTHREAD_ONCE_INIT;
+
+static void rtp_ida_init(void)
+{
+    g_port_ida = ida_create(g_base_port, RTP_PORT_RANGE, 0);
+    g_ssrc_ida = ida_create(0, RTP_SSRC_MAX, IDA_RANDOM | IDA_SCRAMBLE);
+}
 
 static inline uint16_t rtp_read_uint16(const uint8_t* ptr)
 {
@@ -256,6 +277,9 @@ int rtp_packet_pack(struct rtp_socket *sock, struct rtp_packet *pkt, const void*
     int n, ret;
     uint8_t *rtp;
     const uint8_t *ptr;
+#ifdef ENABLE_MEMPOOL
+    struct mempool_scope scope;
+#endif
     if (!pkt || pkt->header.timestamp == timestamp || pkt->payload == NULL) {
         return -1;
     }
@@ -269,18 +293,36 @@ int rtp_packet_pack(struct rtp_socket *sock, struct rtp_packet *pkt, const void*
         bytes -= pkt->payloadlen;
 
         n = RTP_FIXED_HEADER + pkt->payloadlen;
+#ifdef ENABLE_MEMPOOL
+        /* packet buffer only lives until sendto, reuse arena of this thread */
+        mempool_scope_begin(&scope, mempool_arena_thread());
+        rtp = (uint8_t*)mempool_arena_alloc(scope.arena, n);
+        if (!rtp) {
+            mempool_scope_end(&scope);
+            return ENOMEM;
+        }
+#else
         rtp = (uint8_t*)calloc(1, n);
         if (!rtp) return ENOMEM;
+#endif
 
         n = rtp_packet_serialize(pkt, rtp, n);
         if (n != RTP_FIXED_HEADER + pkt->payloadlen) {
+#ifdef ENABLE_MEMPOOL
+            mempool_scope_end(&scope);
+#else
             free(rtp);
+#endif
             return -1;
         }
 
-        loge("send len=%d\n", n);
+        logd("send len=%d\n", n);
         ret = rtp_sendto(sock, NULL, 0, rtp, n);//XXX
+#ifdef ENABLE_MEMPOOL
+        mempool_scope_end(&scope);
+#else
         free(rtp);
+#endif
         if (ret < 0) {
             loge("rtp_sendto ret=%d\n", ret);
         }
@@ -289,19 +331,22 @@ int rtp_packet_pack(struct rtp_socket *sock, struct rtp_packet *pkt, const void*
     return 0;
 }
 
-int rtp_ssrc(void)
+int rtp_ssrc_alloc(uint32_t *ssrc)
 {
-    static unsigned int seed = 0;
-    if (0 == seed) {
-        seed = (unsigned int)time(NULL);
-        srand(seed);
-    }
-    return rand();
+    pthread_once(&g_ida_once, rtp_ida_init);
+    return ida_alloc(g_ssrc_ida, ssrc);
+}
+
+void rtp_ssrc_free(uint32_t ssrc)
+{
+    pthread_once(&g_ida_once, rtp_ida_init);
+    ida_free(g_ssrc_ida, ssrc);
 }
 
 struct rtp_socket *rtp_socket_create(enum rtp_mode mode, int tcp_fd, const char* src_ip, const char *dst_ip)
 {
-    unsigned short i;
+    uint32_t port;
+    int n;
     struct rtp_socket *s = calloc(1, sizeof(struct rtp_socket));
     if (!s) {
         return NULL;
@@ -313,21 +358,24 @@ struct rtp_socket *rtp_socket_create(enum rtp_mode mode, int tcp_fd, const char*
         s->rtp_fd = tcp_fd;
         break;
     case RTP_UDP:
-        srand((unsigned int)time(NULL));
-        do {
-            i = rand() % 30000;
-            i = i/2*2 + g_base_port;
-
-            if (-1 == (s->rtp_fd = sock_udp_bind(src_ip, i))) {
+        pthread_once(&g_ida_once, rtp_ida_init);
+        for (n = 0; n < RTP_PORT_RANGE / 2; n++) {
+            if (-1 == ida_alloc_pair(g_port_ida, &port)) {
+                break;
+            }
+            /* port used by other process, next pair is after it */
+            if (-1 == (s->rtp_fd = sock_udp_bind(src_ip, port))) {
+                ida_free_pair(g_port_ida, port);
                 continue;
             }
 
-            if (-1 == (s->rtcp_fd = sock_udp_bind(src_ip, i+1))) {
+            if (-1 == (s->rtcp_fd = sock_udp_bind(src_ip, port+1))) {
                 sock_close(s->rtp_fd);
+                ida_free_pair(g_port_ida, port);
                 continue;
             }
-            s->rtp_src_port = i;
-            s->rtcp_src_port = i+1;
+            s->rtp_src_port = port;
+            s->rtcp_src_port = port+1;
             if (src_ip) {
                 strcpy(s->ip, src_ip);
             }
@@ -336,10 +384,16 @@ struct rtp_socket *rtp_socket_create(enum rtp_mode mode, int tcp_fd, const char*
             }
             logi("bind %s rtp port %d %d\n", src_ip, s->rtp_src_port, s->rtcp_src_port);
             break;
-        } while(1);
+        }
+        if (s->rtp_src_port == 0) {
+            loge("no free rtp port pair in %d~%d\n", g_base_port, g_base_port + RTP_PORT_RANGE);
+            free(s);
+            return NULL;
+        }
         break;
     case RAW_UDP:
     default:
+        free(s);
         return NULL;
         break;
     }
@@ -349,9 +403,15 @@ struct rtp_socket *rtp_socket_create(enum rtp_mode mode, int tcp_fd, const char*
 
 void rtp_socket_destroy(struct rtp_socket *s)
 {
-    if (s) {
-        free(s);
+    if (!s) {
+        return;
+    }
+    if (s->mode == RTP_UDP) {
+        sock_close(s->rtp_fd);
+        sock_close(s->rtcp_fd);
+        ida_free_pair(g_port_ida, s->rtp_src_port);
     }
+    free(s);
 }
 
 ssize_t rtp_sendto(struct rtp_socket *s, const char *ip, uint16_t port, const void *buf, size_t len)
@@ -410,7 +470,11 @@ struct rtp_context *rtp_create(int frequence, int boundwidth)
     struct rtp_context *ctx	= calloc(1, sizeof(struct rtp_context));
     if (!ctx) return NULL;
 
-    ctx->ssrc = rtp_ssrc();
+    if (-1 == rtp_ssrc_alloc(&ctx->ssrc)) {
+        loge("rtp_ssrc_alloc failed!\n");
+        free(ctx);
+        return NULL;
+    }
     ctx->rtcp_bw = (size_t)(boundwidth * RTCP_BANDWIDTH_FRACTION);
     ctx->avg_rtcp_size = 0;
     ctx->frequence = frequence;
@@ -421,6 +485,10 @@ struct rtp_context *rtp_create(int frequence, int boundwidth)
 
 void rtp_destroy(struct rtp_context *rtp)
 {
+    if (!rtp) {
+        return;
+    }
+    rtp_ssrc_free(rtp->ssrc);
     free(rtp);
 }
 
@@ -166,7 +166,8 @@ struct rtp_socket {
     int rtcp_fd;
 };
 
-int rtp_ssrc(void);
+int rtp_ssrc_alloc(uint32_t *ssrc);
+void rtp_ssrc_free(uint32_t ssrc);
 
 struct rtp_packet *rtp_packet_create(uint8_t pt, int size, uint16_t seq, uint32_t ssrc);
 void rtp_packet_destroy(struct rtp_packet *pkt);
@@ -272,6 +273,7 @@ struct rtp_context
     struct rtp_payload_t *payload;
 };
 struct rtp_context *rtp_create(int frequence, int boundwidth);
+void rtp_destroy(struct rtp_context *rtp);
 
 int rtp_payload_h264_encode(struct rtp_socket *sock, struct rtp_packet *pkt, const void* h264, int bytes, uint32_t timestamp);
 
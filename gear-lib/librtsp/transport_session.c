@@ -25,6 +25,7 @@
 #include <libdict.h>
 #include <libgevent.h>
 #include <libmedia-io.h>
+#include <libbitmap_ida.h>
 #include "transport_session.h"
 #include "media_source.h"
 #include "rtp.h"
@@ -41,50 +42,80 @@ void *transport_session_pool_create()
     return (void *)dict_new();
 }
 
-void transport_session_pool_destroy(void *pool)
-{
-    int rank = 0;
-    char *key, *val;
-    while (1) {
-        rank = dict_enumerate((dict *)pool, rank, &key, &val);
-        if (rank < 0) {
-            break;
-        }
-        free(val);
-    }
-    dict_free((dict *)pool);
-}
+#define SESSION_ID_MAX  (1 << 16)
+
+/* session ids look random over uint32 but never collide */
+static struct ida *g_session_ida = NULL;
+static pthread_once_t g_session_ida_once = PTHREAD_ONCE_INIT;
 
-static uint32_t get_random_number()
+static void session_ida_init(void)
 {
-    struct timeval now = {0};
-    gettimeofday(&now, NULL);
-    srand(now.tv_usec);
-    return (rand() % ((uint32_t)-1));
+    g_session_ida = ida_create(0, SESSION_ID_MAX, IDA_RANDOM | IDA_SCRAMBLE);
 }
 
 struct transport_session *transport_session_create(void *pool, struct transport_header *t)
 {
     char key[9];
     struct transport_session *s = calloc(1, sizeof(struct transport_session));
-    s->session_id = get_random_number();
+    if (!s) {
+        return NULL;
+    }
+    pthread_once(&g_session_ida_once, session_ida_init);
+    if (-1 == ida_alloc(g_session_ida, &s->session_id)) {
+        loge("no free session id\n");
+        free(s);
+        return NULL;
+    }
     snprintf(key, sizeof(key), "%08X", s->session_id);
     s->rtp = rtp_create(90000, 0);
+    if (!s->rtp) {
+        ida_free(g_session_ida, s->session_id);
+        free(s);
+        return NULL;
+    }
     s->rtp->sock = rtp_socket_create(t->mode, t->fd, t->source, t->destination);
+    if (!s->rtp->sock) {
+        rtp_destroy(s->rtp);
+        ida_free(g_session_ida, s->session_id);
+        free(s);
+        return NULL;
+    }
     s->rtp->sock->rtp_dst_port = t->rtp.u.client_port1;
     s->rtp->sock->rtcp_dst_port = t->rtp.u.client_port2;
     dict_add((dict *)pool, key, (char *)s);
     return s;
 }
 
+static void transport_session_release(struct transport_session *s)
+{
+    rtp_socket_destroy(s->rtp->sock);
+    rtp_destroy(s->rtp);
+    ida_free(g_session_ida, s->session_id);
+    free(s);
+}
+
 void transport_session_destroy(void *pool, char *key)
 {
     struct transport_session *s = transport_session_lookup(pool, key);
     if (!s) {
         return;
     }
-    rtp_socket_destroy(s->rtp->sock);
     dict_del((dict *)pool, key);
+    transport_session_release(s);
+}
+
+void transport_session_pool_destroy(void *pool)
+{
+    int rank = 0;
+    char *key, *val;
+    while (1) {
+        rank = dict_enumerate((dict *)pool, rank, &key, &val);
+        if (rank < 0) {
+            break;
+        }
+        transport_session_release((struct transport_session *)val);
+    }
+    dict_free((dict *)pool);
 }
 
 struct transport_session *transport_session_lookup(void *pool, char *key)
@@ -116,7 +147,7 @@ static void *send_thread(struct thread *t, void *ptr)
         return NULL;
     }
     ms->is_active = true;
-    ssrc = (unsigned int)rtp_ssrc();
+    ssrc = ts->rtp->ssrc;
     pts = time_now_msec();
     seq = ssrc;
     logd("rtp send thread %s created\n", t->name);
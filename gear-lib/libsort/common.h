@@ -43,7 +43,7 @@ static inline void byte_swap(byte *p, byte *q, size_t size)
     }
 }
 
-static int default_cmp(const void *a, const void *b, size_t size)
+static inline int default_cmp(const void *a, const void *b, size_t size)
 {
     const byte *p = (const byte *)a;
     const byte *q = (const byte *)b;
@@ -53,6 +53,15 @@ static int default_cmp(const void *a, const void *b, size_t size)
     return 0;
 }
 
+/*
+ * radix sort with a caller provided scratch of num elements, NULL to
+ * allocate it, for parallel_sort which already owns one
+ */
+int radix_sort32_tmp(uint32_t *base, size_t num, uint32_t flip, uint32_t *tmp);
+int radix_sort64_tmp(uint64_t *base, size_t num, uint64_t flip, uint64_t *tmp);
+int radix_sort_rec_tmp(byte *base, size_t num, size_t size,
+                       size_t key_off, size_t key_size, byte *tmp);
+
 #ifdef __cplusplus
 }
 #endif
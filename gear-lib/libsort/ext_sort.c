@@ -0,0 +1,623 @@
+/*****************************************************************************
+ * Copyright (C) 2014-2020
+ * file:    ext_sort.c
+ * author:  gozfree <gozfree@163.com>
+ * description: external merge sort of files larger than memory
+ *****************************************************************************/
+#include "common.h"
+#include <libfile.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * run generation reads as much input as the memory budget holds, sorts it
+ * (on the workq pool if one is given) and writes it out as a run file.
+ * runs are merged k at a time through a loser tree, every run and the
+ * output get an equal share of the budget as read/write buffer, so the
+ * disk sees few large sequential requests. more runs than one pass can
+ * take are merged into bigger runs first.
+ * input that fits in the budget is sorted and written without run files.
+ */
+
+#define EXT_SORT_MEM_DEFAULT    (64 * 1024 * 1024)
+#define EXT_SORT_MEM_MIN        (256 * 1024)
+/* smallest per run read buffer worth a seek, bounds the merge fan-in */
+#define EXT_SORT_IO_RUN         (1024 * 1024)
+#define EXT_SORT_IO_MIN         (64 * 1024)
+#define EXT_SORT_IO_MAX         (8 * 1024 * 1024)
+#define EXT_SORT_TMP_DIR        "/tmp"
+
+struct ext_sort {
+    size_t size;            /* record size, 0 for delimited records */
+    fp_cmp cmp;
+    int delim;
+    fp_cmp_var vcmp;
+    size_t mem;
+    const char *tmp_dir;
+    struct workq_pool *pool;
+    char **runs;            /* run files, merged from head on */
+    int head;
+    int nrun;
+    int cap_run;
+    int seq;
+};
+
+/* index of a delimited record in the run generation buffer */
+struct vrec {
+    const byte *p;
+    size_t len;             /* without the delimiter */
+    const struct ext_sort *es;
+};
+
+static int vrec_cmp(const void *a, const void *b, size_t size)
+{
+    const struct vrec *x = (const struct vrec *)a;
+    const struct vrec *y = (const struct vrec *)b;
+    return x->es->vcmp(x->p, x->len, y->p, y->len);
+}
+
+#define PDQSORT_NAME        vrec
+#define PDQSORT_TYPE        struct vrec
+#define PDQSORT_LESS(a, b)  (vrec_cmp(&(a), &(b), 0) < 0)
+#include "libsort_pdq.h"
+
+static int default_cmp_var(const void *a, size_t alen, const void *b, size_t blen)
+{
+    int ret = memcmp(a, b, alen < blen ? alen : blen);
+    if (ret) {
+        return ret;
+    }
+    return (alen > blen) - (alen < blen);
+}
+
+struct ext_writer {
+    struct file *f;
+    byte *buf;
+    size_t cap;
+    size_t len;
+};
+
+static int writer_flush(struct ext_writer *w)
+{
+    if (w->len && file_write(w->f, w->buf, w->len) != (ssize_t)w->len) {
+        printf("file_write %zu bytes failed!\n", w->len);
+        return -1;
+    }
+    w->len = 0;
+    return 0;
+}
+
+static int writer_put(struct ext_writer *w, const void *p, size_t n)
+{
+    if (w->len + n > w->cap) {
+        if (writer_flush(w)) {
+            return -1;
+        }
+        if (n >= w->cap) {
+            if (file_write(w->f, p, n) != (ssize_t)n) {
+                printf("file_write %zu bytes failed!\n", n);
+                return -1;
+            }
+            return 0;
+        }
+    }
+    memcpy(w->buf + w->len, p, n);
+    w->len += n;
+    return 0;
+}
+
+struct ext_reader {
+    struct file *f;
+    byte *buf;
+    size_t cap;
+    size_t len;
+    size_t pos;
+    int eof;
+    const byte *rec;        /* current record, NULL when exhausted */
+    size_t rec_len;         /* without the delimiter */
+};
+
+static int reader_fill(struct ext_reader *r)
+{
+    ssize_t n;
+
+    if (r->pos) {
+        memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+    }
+    n = file_read(r->f, r->buf + r->len, r->cap - r->len);
+    if (n < 0) {
+        printf("file_read failed!\n");
+        return -1;
+    }
+    if ((size_t)n < r->cap - r->len) {
+        r->eof = 1;
+    }
+    r->len += n;
+    return 0;
+}
+
+/* moves to the next record, 0 with r->rec NULL at the end, -1 on error */
+static int reader_next(const struct ext_sort *es, struct ext_reader *r)
+{
+    const byte *q;
+    byte *nbuf;
+
+    r->rec = NULL;
+    if (es->size) {
+        if (r->len - r->pos < es->size && !r->eof && reader_fill(r)) {
+            return -1;
+        }
+        if (r->len - r->pos < es->size) {
+            if (r->len != r->pos) {
+                printf("run ends in a partial record!\n");
+                return -1;
+            }
+            return 0;
+        }
+        r->rec = r->buf + r->pos;
+        r->rec_len = es->size;
+        r->pos += es->size;
+        return 0;
+    }
+    for (;;) {
+        q = (const byte *)memchr(r->buf + r->pos, es->delim, r->len - r->pos);
+        if (q) {
+            r->rec = r->buf + r->pos;
+            r->rec_len = q - r->rec;
+            r->pos += r->rec_len + 1;
+            return 0;
+        }
+        if (r->eof) {
+            if (r->pos < r->len) {
+                r->rec = r->buf + r->pos;
+                r->rec_len = r->len - r->pos;
+                r->pos = r->len;
+            }
+            return 0;
+        }
+        if (r->pos == 0 && r->len == r->cap) {
+            /* a record longer than the buffer */
+            nbuf = (byte *)realloc(r->buf, r->cap * 2);
+            if (!nbuf) {
+                printf("realloc %zu failed!\n", r->cap * 2);
+                return -1;
+            }
+            r->buf = nbuf;
+            r->cap *= 2;
+        }
+        if (reader_fill(r)) {
+            return -1;
+        }
+    }
+}
+
+static char *run_create_path(struct ext_sort *es)
+{
+    char path[PATH_MAX];
+    char **runs;
+    int cap;
+
+    if (es->nrun == es->cap_run) {
+        cap = es->cap_run ? es->cap_run * 2 : 16;
+        runs = (char **)realloc(es->runs, cap * sizeof(char *));
+        if (!runs) {
+            printf("realloc runs failed!\n");
+            return NULL;
+        }
+        es->runs = runs;
+        es->cap_run = cap;
+    }
+    snprintf(path, sizeof(path), "%s/extsort.%d.%p.%d.run",
+             es->tmp_dir, (int)getpid(), (void *)es, es->seq++);
+    es->runs[es->nrun] = strdup(path);
+    if (!es->runs[es->nrun]) {
+        return NULL;
+    }
+    return es->runs[es->nrun++];
+}
+
+static void run_remove(struct ext_sort *es, int i)
+{
+    if (es->runs[i]) {
+        file_delete(es->runs[i]);
+        free(es->runs[i]);
+        es->runs[i] = NULL;
+    }
+}
+
+static int sort_records(struct ext_sort *es, void *base, size_t num, size_t size, fp_cmp cmp)
+{
+    if (es->pool) {
+        return parallel_sort(es->pool, base, num, size, cmp);
+    }
+    if (cmp == vrec_cmp) {
+        pdqsort_vrec((struct vrec *)base, num);
+        return 0;
+    }
+    return pdq_sort(base, num, size, cmp);
+}
+
+/*
+ * sorted chunk to a new run, or straight to out when it is all the input.
+ * fixed records are one write, delimited ones go through wbuf.
+ */
+static int chunk_write(struct ext_sort *es, const char *out, const byte *buf,
+                       size_t len, const struct vrec *idx, size_t nidx,
+                       byte *wbuf, size_t wcap)
+{
+    struct ext_writer w;
+    const char *path = out;
+    byte delim = (byte)es->delim;
+    size_t i;
+    int ret = -1;
+
+    if (!path && !(path = run_create_path(es))) {
+        return -1;
+    }
+    memset(&w, 0, sizeof(w));
+    w.f = file_open(path, F_WRCLEAR);
+    if (!w.f) {
+        return -1;
+    }
+    if (es->size) {
+        if (len && file_write(w.f, buf, len) != (ssize_t)len) {
+            printf("file_write %s failed!\n", path);
+            goto out;
+        }
+    } else {
+        w.buf = wbuf;
+        w.cap = wcap;
+        for (i = 0; i < nidx; i++) {
+            if (writer_put(&w, idx[i].p, idx[i].len) ||
+                writer_put(&w, &delim, 1)) {
+                goto out;
+            }
+        }
+        if (writer_flush(&w)) {
+            goto out;
+        }
+    }
+    ret = 0;
+out:
+    file_close(w.f);
+    return ret;
+}
+
+static int gen_runs_fixed(struct ext_sort *es, struct file *in, const char *out, int *done)
+{
+    size_t cap = es->mem / es->size * es->size;
+    ssize_t n;
+    byte *buf;
+    int first = 1, ret = -1;
+
+    if (cap == 0) {
+        cap = es->size;
+    }
+    buf = (byte *)malloc(cap);
+    if (!buf) {
+        printf("malloc %zu failed!\n", cap);
+        return -1;
+    }
+    for (;;) {
+        n = file_read(in, buf, cap);
+        if (n < 0) {
+            printf("file_read failed!\n");
+            goto out;
+        }
+        if (n == 0) {
+            break;
+        }
+        if (n % es->size) {
+            printf("input is not a multiple of %zu bytes records!\n", es->size);
+            goto out;
+        }
+        if (sort_records(es, buf, n / es->size, es->size, es->cmp)) {
+            goto out;
+        }
+        if ((size_t)n < cap && first) {
+            *done = 1;
+            ret = chunk_write(es, out, buf, n, NULL, 0, NULL, 0);
+            goto out;
+        }
+        if (chunk_write(es, NULL, buf, n, NULL, 0, NULL, 0)) {
+            goto out;
+        }
+        first = 0;
+        if ((size_t)n < cap) {
+            break;
+        }
+    }
+    if (first) {
+        /* empty input */
+        *done = 1;
+        ret = chunk_write(es, out, buf, 0, NULL, 0, NULL, 0);
+        goto out;
+    }
+    ret = 0;
+out:
+    free(buf);
+    return ret;
+}
+
+static int gen_runs_var(struct ext_sort *es, struct file *in, const char *out, int *done)
+{
+    size_t wcap, cap, icap, len = 0, pos, nidx;
+    struct vrec *idx;
+    const byte *q;
+    byte *buf, *wbuf;
+    ssize_t n;
+    int eof = 0, first = 1, ret = -1;
+
+    wcap = es->mem / 16;
+    wcap = wcap < EXT_SORT_IO_MIN ? EXT_SORT_IO_MIN : wcap;
+    wcap = wcap > EXT_SORT_IO_MAX ? EXT_SORT_IO_MAX : wcap;
+    cap = (es->mem - wcap) / 3 * 2;
+    icap = (es->mem - wcap - cap) / sizeof(struct vrec);
+    buf = (byte *)malloc(cap);
+    wbuf = (byte *)malloc(wcap);
+    idx = (struct vrec *)malloc(icap * sizeof(struct vrec));
+    if (!buf || !wbuf || !idx) {
+        printf("malloc run buffers failed!\n");
+        goto out;
+    }
+    while (!eof || len) {
+        if (!eof) {
+            n = file_read(in, buf + len, cap - len);
+            if (n < 0) {
+                printf("file_read failed!\n");
+                goto out;
+            }
+            if ((size_t)n < cap - len) {
+                eof = 1;
+            }
+            len += n;
+        }
+        for (pos = 0, nidx = 0; nidx < icap && pos < len; nidx++) {
+            q = (const byte *)memchr(buf + pos, es->delim, len - pos);
+            if (!q && !eof) {
+                break;
+            }
+            idx[nidx].p = buf + pos;
+            idx[nidx].len = q ? (size_t)(q - (buf + pos)) : len - pos;
+            idx[nidx].es = es;
+            pos += idx[nidx].len + (q ? 1 : 0);
+        }
+        if (nidx == 0 && len) {
+            printf("record longer than the %zu bytes run buffer!\n", cap);
+            goto out;
+        }
+        if (sort_records(es, idx, nidx, sizeof(struct vrec), vrec_cmp)) {
+            goto out;
+        }
+        if (first && eof && pos == len) {
+            *done = 1;
+            ret = chunk_write(es, out, NULL, 0, idx, nidx, wbuf, wcap);
+            goto out;
+        }
+        if (chunk_write(es, NULL, NULL, 0, idx, nidx, wbuf, wcap)) {
+            goto out;
+        }
+        first = 0;
+        memmove(buf, buf + pos, len - pos);
+        len -= pos;
+    }
+    ret = 0;
+out:
+    free(idx);
+    free(wbuf);
+    free(buf);
+    return ret;
+}
+
+/* a beats b: smaller record, the earlier run on ties, k is the sentinel */
+static inline int lt_beats(const struct ext_sort *es, const struct ext_reader *r,
+                           int k, int a, int b)
+{
+    int c;
+
+    if (a == k) {
+        return 1;
+    }
+    if (b == k) {
+        return 0;
+    }
+    if (!r[a].rec) {
+        return 0;
+    }
+    if (!r[b].rec) {
+        return 1;
+    }
+    if (es->size) {
+        c = es->cmp(r[a].rec, r[b].rec, es->size);
+    } else {
+        c = es->vcmp(r[a].rec, r[a].rec_len, r[b].rec, r[b].rec_len);
+    }
+    return c < 0 || (c == 0 && a < b);
+}
+
+/* replay the path of leaf s, losers stay in the nodes, winner to t[0] */
+static inline void lt_adjust(const struct ext_sort *es, const struct ext_reader *r,
+                             int *t, int k, int s)
+{
+    int p, tmp;
+
+    for (p = (s + k) / 2; p > 0; p /= 2) {
+        if (lt_beats(es, r, k, t[p], s)) {
+            tmp = t[p];
+            t[p] = s;
+            s = tmp;
+        }
+    }
+    t[0] = s;
+}
+
+/* merge runs [from, from + k) into path, removes them when done */
+static int merge_runs(struct ext_sort *es, int from, int k, const char *path)
+{
+    struct ext_reader *r;
+    struct ext_writer w;
+    size_t io;
+    byte delim = (byte)es->delim;
+    int *t, i, ret = -1;
+
+    io = es->mem / (k + 1);
+    io = io < EXT_SORT_IO_MIN ? EXT_SORT_IO_MIN : io;
+    io = io > EXT_SORT_IO_MAX ? EXT_SORT_IO_MAX : io;
+    if (es->size && io < es->size) {
+        io = es->size;
+    }
+    memset(&w, 0, sizeof(w));
+    r = (struct ext_reader *)calloc(k, sizeof(struct ext_reader));
+    t = (int *)calloc(k, sizeof(int));
+    w.buf = (byte *)malloc(io);
+    w.cap = io;
+    if (!r || !t || !w.buf) {
+        printf("malloc merge buffers failed!\n");
+        goto out;
+    }
+    for (i = 0; i < k; i++) {
+        r[i].f = file_open(es->runs[from + i], F_RDONLY);
+        r[i].buf = (byte *)malloc(io);
+        r[i].cap = io;
+        if (!r[i].f || !r[i].buf) {
+            printf("open run %s failed!\n", es->runs[from + i]);
+            goto out;
+        }
+        if (reader_next(es, &r[i])) {
+            goto out;
+        }
+    }
+    w.f = file_open(path, F_WRCLEAR);
+    if (!w.f) {
+        goto out;
+    }
+
+    for (i = 0; i < k; i++) {
+        t[i] = k;
+    }
+    for (i = k - 1; i >= 0; i--) {
+        lt_adjust(es, r, t, k, i);
+    }
+    while (r[i = t[0]].rec) {
+        if (writer_put(&w, r[i].rec, r[i].rec_len)) {
+            goto out;
+        }
+        if (!es->size && writer_put(&w, &delim, 1)) {
+            goto out;
+        }
+        if (reader_next(es, &r[i])) {
+            goto out;
+        }
+        lt_adjust(es, r, t, k, i);
+    }
+    if (writer_flush(&w)) {
+        goto out;
+    }
+    ret = 0;
+out:
+    if (w.f) {
+        file_close(w.f);
+    }
+    free(w.buf);
+    for (i = 0; r && i < k; i++) {
+        if (r[i].f) {
+            file_close(r[i].f);
+        }
+        free(r[i].buf);
+    }
+    free(r);
+    free(t);
+    if (ret == 0) {
+        for (i = 0; i < k; i++) {
+            run_remove(es, from + i);
+        }
+    }
+    return ret;
+}
+
+static int ext_sort_file(struct ext_sort *es, const char *in, const char *out,
+                         const struct ext_sort_conf *conf)
+{
+    struct file *f;
+    char *path;
+    int fanin, k, i, done = 0, ret = -1;
+
+    es->mem = conf && conf->mem_budget ? conf->mem_budget : EXT_SORT_MEM_DEFAULT;
+    if (es->mem < EXT_SORT_MEM_MIN) {
+        es->mem = EXT_SORT_MEM_MIN;
+    }
+    es->tmp_dir = conf && conf->tmp_dir ? conf->tmp_dir : EXT_SORT_TMP_DIR;
+    es->pool = conf ? conf->pool : NULL;
+
+    f = file_open(in, F_RDONLY);
+    if (!f) {
+        return -1;
+    }
+    if (es->size) {
+        ret = gen_runs_fixed(es, f, out, &done);
+    } else {
+        ret = gen_runs_var(es, f, out, &done);
+    }
+    file_close(f);
+    if (ret || done) {
+        goto out;
+    }
+
+    ret = -1;
+    fanin = (int)(es->mem / EXT_SORT_IO_RUN) - 1;
+    fanin = fanin < 2 ? 2 : fanin;
+    while (es->nrun - es->head > fanin) {
+        if (!(path = run_create_path(es))) {
+            goto out;
+        }
+        if (merge_runs(es, es->head, fanin, path)) {
+            goto out;
+        }
+        es->head += fanin;
+    }
+    k = es->nrun - es->head;
+    if (merge_runs(es, es->head, k, out)) {
+        goto out;
+    }
+    es->head += k;
+    ret = 0;
+out:
+    for (i = 0; i < es->nrun; i++) {
+        run_remove(es, i);
+    }
+    free(es->runs);
+    return ret;
+}
+
+int ext_sort(const char *in, const char *out, size_t size, fp_cmp cmp,
+             const struct ext_sort_conf *conf)
+{
+    struct ext_sort es;
+
+    if (!in || !out || !size) {
+        printf("invalid parameter!\n");
+        return -1;
+    }
+    memset(&es, 0, sizeof(es));
+    es.size = size;
+    es.cmp = cmp ? cmp : default_cmp;
+    return ext_sort_file(&es, in, out, conf);
+}
+
+int ext_sort_var(const char *in, const char *out, int delim, fp_cmp_var cmp,
+                 const struct ext_sort_conf *conf)
+{
+    struct ext_sort es;
+
+    if (!in || !out) {
+        printf("invalid parameter!\n");
+        return -1;
+    }
+    memset(&es, 0, sizeof(es));
+    es.delim = delim;
+    es.vcmp = cmp ? cmp : default_cmp_var;
+    return ext_sort_file(&es, in, out, conf);
+}
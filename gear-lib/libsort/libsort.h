@@ -18,9 +18,81 @@ extern "C" {
 #endif
 
 typedef int (*fp_cmp)(const void *a, const void *b, size_t size);
+typedef int (*fp_cmp_var)(const void *a, size_t alen, const void *b, size_t blen);
+
+struct workq_pool;
 
 void heap_sort(void *base, size_t num, size_t size, fp_cmp cmp);
 int bubble_sort(void *array, size_t num, size_t size, fp_cmp cmp);
+int select_sort(void *array, size_t num, size_t size, fp_cmp cmp);
+
+/*
+ * pattern-defeating quicksort: O(n log n) worst case, O(n) on sorted,
+ * reversed and all equal input, not stable. cmp NULL compares bytes.
+ * quick_sort is the same sort under its old name.
+ */
+int pdq_sort(void *base, size_t num, size_t size, fp_cmp cmp);
+int quick_sort(void *array, size_t num, size_t size, fp_cmp cmp);
+
+/*
+ * typed instances without the comparator call, see libsort_pdq.h to
+ * generate one for another element type. floats are compared with <,
+ * NaN has no order.
+ */
+void pdq_sort_u32(uint32_t *base, size_t num);
+void pdq_sort_i32(int32_t *base, size_t num);
+void pdq_sort_u64(uint64_t *base, size_t num);
+void pdq_sort_i64(int64_t *base, size_t num);
+void pdq_sort_float(float *base, size_t num);
+void pdq_sort_double(double *base, size_t num);
+
+/*
+ * LSD radix sort, 8 bit digits, O(n) with a temporary copy of the input,
+ * returns -1 if that allocation fails.
+ * radix_sort sorts num records of size bytes by the unsigned host endian
+ * integer key of key_size (1, 2, 4 or 8) bytes at key_off, it is stable.
+ */
+int radix_sort_u32(uint32_t *base, size_t num);
+int radix_sort_i32(int32_t *base, size_t num);
+int radix_sort_u64(uint64_t *base, size_t num);
+int radix_sort_i64(int64_t *base, size_t num);
+int radix_sort(void *base, size_t num, size_t size, size_t key_off, size_t key_size);
+
+/*
+ * sort runs on the threads of pool and merge them in parallel, needs a
+ * scratch copy of the input, returns -1 if it cannot be allocated.
+ * below 16K elements per thread, or with pool NULL, it sorts in the
+ * calling thread. blocks until done, so it must not be called from a
+ * task of the same pool.
+ * parallel_sort is not stable, the typed variants sort with radix runs,
+ * parallel_sort_key sorts records like radix_sort and is stable.
+ */
+int parallel_sort(struct workq_pool *pool, void *base, size_t num, size_t size, fp_cmp cmp);
+int parallel_sort_u32(struct workq_pool *pool, uint32_t *base, size_t num);
+int parallel_sort_u64(struct workq_pool *pool, uint64_t *base, size_t num);
+int parallel_sort_key(struct workq_pool *pool, void *base, size_t num,
+                      size_t size, size_t key_off, size_t key_size);
+
+/*
+ * external merge sort of file in into file out, for inputs larger than
+ * memory. sorted runs of mem_budget bytes are spilled to tmp_dir and
+ * merged through a loser tree with large sequential reads, in several
+ * passes if there are too many runs for the budget. with pool the runs
+ * are sorted by parallel_sort. all zero conf, or NULL, is 64MB in /tmp.
+ * ext_sort sorts records of size bytes, ext_sort_var records ending with
+ * delim, compared without it (cmp NULL is memcmp order). a last record
+ * without delim gets one in out. in and out may be the same file.
+ */
+struct ext_sort_conf {
+    size_t mem_budget;
+    const char *tmp_dir;
+    struct workq_pool *pool;
+};
+
+int ext_sort(const char *in, const char *out, size_t size, fp_cmp cmp,
+             const struct ext_sort_conf *conf);
+int ext_sort_var(const char *in, const char *out, int delim, fp_cmp_var cmp,
+                 const struct ext_sort_conf *conf);
 
 #ifdef __cplusplus
 }
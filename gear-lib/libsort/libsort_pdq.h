@@ -0,0 +1,506 @@
+/*****************************************************************************
+ * Copyright (C) 2014-2020
+ * file:    libsort_pdq.h
+ * author:  gozfree <gozfree@163.com>
+ * description: pdqsort template, type specialized or generic
+ *****************************************************************************/
+/*
+ * pattern-defeating quicksort template, after Orson Peters' pdqsort
+ *
+ * include this file with the element described by macros, it generates
+ * static functions for that element, the comparator and the element size
+ * are compile time constants so everything inlines:
+ *
+ *   #define PDQSORT_NAME        u32
+ *   #define PDQSORT_TYPE        uint32_t
+ *   #define PDQSORT_LESS(a, b)  ((a) < (b))
+ *   #include <libsort_pdq.h>
+ *
+ *   static void pdqsort_u32(uint32_t *base, size_t num);
+ *
+ * PDQSORT_LESS gets two lvalues of PDQSORT_TYPE without side effects, it
+ * may use them more than once. the macros are undefined
+ * at the end, so the file can be included again for another type.
+ *
+ * - insertion sort below 24 elements
+ * - median of 3, ninther above 128 elements
+ * - branchless block partition (BlockQuicksort), no mispredicted branch
+ *   per element for cheap comparators
+ * - runs of equal elements go to partition_left and are never sorted again
+ * - already sorted partitions are finished by a bounded insertion sort
+ * - unbalanced partitions shuffle a few elements to break patterns, after
+ *   log2(n) of them heapsort takes over, so O(n log n) worst case
+ * - recursion on the smaller side only, O(log n) stack
+ * - not stable
+ *
+ * libsort itself includes it once more in generic form (PDQSORT_GENERIC)
+ * for pdq_sort() with fp_cmp and a runtime element size.
+ */
+#ifndef LIBSORT_PDQ_H
+#define LIBSORT_PDQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PDQ_INSERTION_SORT_THRESHOLD    24
+#define PDQ_NINTHER_THRESHOLD           128
+#define PDQ_PARTIAL_INSERTION_LIMIT     8
+#define PDQ_BLOCK_SIZE                  64
+
+#define PDQ_CAT2(a, b)  a##_##b
+#define PDQ_CAT(a, b)   PDQ_CAT2(a, b)
+
+static inline int pdq_log2(size_t n)
+{
+    int log = 0;
+    while (n >>= 1) {
+        log++;
+    }
+    return log;
+}
+
+#endif
+
+#ifndef PDQSORT_NAME
+#error "PDQSORT_NAME must be defined before including libsort_pdq.h"
+#endif
+
+#define PDQ_FN(x)   PDQ_CAT(PDQ_CAT(pdqsort, PDQSORT_NAME), x)
+
+#ifdef PDQSORT_GENERIC
+/*
+ * elements are size bytes at unsigned char pointers, ctx carries size,
+ * cmp, swap and a scratch element
+ */
+struct PDQ_FN(ctx) {
+    size_t size;
+    int (*cmp)(const void *a, const void *b, size_t size);
+    void (*swap)(void *a, void *b, size_t size);
+    unsigned char *tmp;
+};
+typedef unsigned char *PDQ_FN(iter);
+typedef const struct PDQ_FN(ctx) *PDQ_FN(ctx_t);
+#define PDQ_ADD(p, k)       ((p) + (size_t)(k) * ctx->size)
+#define PDQ_SUB(p, k)       ((p) - (size_t)(k) * ctx->size)
+#define PDQ_INC(p)          ((p) += ctx->size)
+#define PDQ_DEC(p)          ((p) -= ctx->size)
+#define PDQ_DIFF(a, b)      ((size_t)((a) - (b)) / ctx->size)
+#define PDQ_LESS(a, b)      (ctx->cmp((a), (b), ctx->size) < 0)
+#define PDQ_SWAP(a, b)      ctx->swap((a), (b), ctx->size)
+#define PDQ_MOVE(dst, src)  memcpy((dst), (src), ctx->size)
+#define PDQ_TMP(t)          unsigned char *t = ctx->tmp
+#define PDQ_REF(t)          (t)
+#else
+typedef PDQSORT_TYPE *PDQ_FN(iter);
+typedef const void *PDQ_FN(ctx_t);
+#define PDQ_ADD(p, k)       ((p) + (k))
+#define PDQ_SUB(p, k)       ((p) - (k))
+#define PDQ_INC(p)          (++(p))
+#define PDQ_DEC(p)          (--(p))
+#define PDQ_DIFF(a, b)      ((size_t)((a) - (b)))
+#define PDQ_LESS(a, b)      PDQSORT_LESS(*(a), *(b))
+#define PDQ_SWAP(a, b)      do { PDQSORT_TYPE _t = *(a); *(a) = *(b); *(b) = _t; } while (0)
+#define PDQ_MOVE(dst, src)  (*(dst) = *(src))
+#define PDQ_TMP(t)          PDQSORT_TYPE t
+#define PDQ_TMP2(t)         PDQSORT_TYPE t
+#define PDQ_REF(t)          (&(t))
+#define PDQ_BRANCHLESS
+#endif
+
+#define PDQ_ITER    PDQ_FN(iter)
+#define PDQ_CTX     PDQ_FN(ctx_t)
+
+static inline void PDQ_FN(insertion_sort)(PDQ_ITER begin, PDQ_ITER end, PDQ_CTX ctx)
+{
+    PDQ_ITER cur, sift, sift_1;
+    PDQ_TMP(tmp);
+
+    if (begin == end) {
+        return;
+    }
+    for (cur = PDQ_ADD(begin, 1); cur != end; PDQ_INC(cur)) {
+        sift = cur;
+        sift_1 = PDQ_SUB(cur, 1);
+        if (PDQ_LESS(sift, sift_1)) {
+            PDQ_MOVE(PDQ_REF(tmp), sift);
+            do {
+                PDQ_MOVE(sift, sift_1);
+                PDQ_DEC(sift);
+            } while (sift != begin && (PDQ_DEC(sift_1), PDQ_LESS(PDQ_REF(tmp), sift_1)));
+            PDQ_MOVE(sift, PDQ_REF(tmp));
+        }
+    }
+}
+
+/* the element before begin is not greater than any in [begin, end) */
+static inline void PDQ_FN(unguarded_insertion_sort)(PDQ_ITER begin, PDQ_ITER end, PDQ_CTX ctx)
+{
+    PDQ_ITER cur, sift, sift_1;
+    PDQ_TMP(tmp);
+
+    if (begin == end) {
+        return;
+    }
+    for (cur = PDQ_ADD(begin, 1); cur != end; PDQ_INC(cur)) {
+        sift = cur;
+        sift_1 = PDQ_SUB(cur, 1);
+        if (PDQ_LESS(sift, sift_1)) {
+            PDQ_MOVE(PDQ_REF(tmp), sift);
+            do {
+                PDQ_MOVE(sift, sift_1);
+                PDQ_DEC(sift);
+            } while ((PDQ_DEC(sift_1), PDQ_LESS(PDQ_REF(tmp), sift_1)));
+            PDQ_MOVE(sift, PDQ_REF(tmp));
+        }
+    }
+}
+
+/* gives up after moving PDQ_PARTIAL_INSERTION_LIMIT elements */
+static inline int PDQ_FN(partial_insertion_sort)(PDQ_ITER begin, PDQ_ITER end, PDQ_CTX ctx)
+{
+    PDQ_ITER cur, sift, sift_1;
+    size_t limit = 0;
+    PDQ_TMP(tmp);
+
+    if (begin == end) {
+        return 1;
+    }
+    for (cur = PDQ_ADD(begin, 1); cur != end; PDQ_INC(cur)) {
+        sift = cur;
+        sift_1 = PDQ_SUB(cur, 1);
+        if (PDQ_LESS(sift, sift_1)) {
+            PDQ_MOVE(PDQ_REF(tmp), sift);
+            do {
+                PDQ_MOVE(sift, sift_1);
+                PDQ_DEC(sift);
+            } while (sift != begin && (PDQ_DEC(sift_1), PDQ_LESS(PDQ_REF(tmp), sift_1)));
+            PDQ_MOVE(sift, PDQ_REF(tmp));
+            limit += PDQ_DIFF(cur, sift);
+        }
+        if (limit > PDQ_PARTIAL_INSERTION_LIMIT) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static inline void PDQ_FN(sort2)(PDQ_ITER a, PDQ_ITER b, PDQ_CTX ctx)
+{
+    if (PDQ_LESS(b, a)) {
+        PDQ_SWAP(a, b);
+    }
+}
+
+static inline void PDQ_FN(sort3)(PDQ_ITER a, PDQ_ITER b, PDQ_ITER c, PDQ_CTX ctx)
+{
+    PDQ_FN(sort2)(a, b, ctx);
+    PDQ_FN(sort2)(b, c, ctx);
+    PDQ_FN(sort2)(a, b, ctx);
+}
+
+static void PDQ_FN(sift_down)(PDQ_ITER base, size_t root, size_t num, PDQ_CTX ctx)
+{
+    size_t child;
+
+    for (; (child = 2 * root + 1) < num; root = child) {
+        if (child + 1 < num && PDQ_LESS(PDQ_ADD(base, child), PDQ_ADD(base, child + 1))) {
+            child++;
+        }
+        if (!PDQ_LESS(PDQ_ADD(base, root), PDQ_ADD(base, child))) {
+            break;
+        }
+        PDQ_SWAP(PDQ_ADD(base, root), PDQ_ADD(base, child));
+    }
+}
+
+static void PDQ_FN(heap_sort)(PDQ_ITER begin, PDQ_ITER end, PDQ_CTX ctx)
+{
+    size_t num = PDQ_DIFF(end, begin);
+    size_t i;
+
+    for (i = num / 2; i-- > 0;) {
+        PDQ_FN(sift_down)(begin, i, num, ctx);
+    }
+    for (i = num; i-- > 1;) {
+        PDQ_SWAP(begin, PDQ_ADD(begin, i));
+        PDQ_FN(sift_down)(begin, 0, i, ctx);
+    }
+}
+
+#ifdef PDQ_BRANCHLESS
+static inline void PDQ_FN(swap_offsets)(PDQ_ITER first, PDQ_ITER last,
+                                        const unsigned char *offsets_l,
+                                        const unsigned char *offsets_r,
+                                        size_t num, int use_swaps, PDQ_CTX ctx)
+{
+    PDQ_ITER l, r;
+    size_t i;
+    PDQ_TMP2(tmp);
+
+    if (use_swaps) {
+        /* descending input needs real swaps to stay O(n) */
+        for (i = 0; i < num; i++) {
+            PDQ_SWAP(PDQ_ADD(first, offsets_l[i]), PDQ_SUB(last, offsets_r[i]));
+        }
+    } else if (num > 0) {
+        l = PDQ_ADD(first, offsets_l[0]);
+        r = PDQ_SUB(last, offsets_r[0]);
+        PDQ_MOVE(PDQ_REF(tmp), l);
+        PDQ_MOVE(l, r);
+        for (i = 1; i < num; i++) {
+            l = PDQ_ADD(first, offsets_l[i]);
+            PDQ_MOVE(r, l);
+            r = PDQ_SUB(last, offsets_r[i]);
+            PDQ_MOVE(l, r);
+        }
+        PDQ_MOVE(r, PDQ_REF(tmp));
+    }
+}
+#endif
+
+/*
+ * partition [begin, end) around *begin, elements equal to the pivot go
+ * right. returns the pivot position, *partitioned is set when no element
+ * had to move.
+ */
+static PDQ_ITER PDQ_FN(partition_right)(PDQ_ITER begin, PDQ_ITER end, int *partitioned, PDQ_CTX ctx)
+{
+    PDQ_ITER first = begin, last = end, pivot_pos;
+    PDQ_TMP(pivot);
+#ifdef PDQ_BRANCHLESS
+    unsigned char offsets_l[PDQ_BLOCK_SIZE], offsets_r[PDQ_BLOCK_SIZE];
+    PDQ_ITER offsets_l_base, offsets_r_base;
+    size_t num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+    size_t num_unknown, left_split, right_split, num, i;
+#endif
+
+    PDQ_MOVE(PDQ_REF(pivot), begin);
+    while ((PDQ_INC(first), PDQ_LESS(first, PDQ_REF(pivot))));
+    if (PDQ_SUB(first, 1) == begin) {
+        while (first < last && (PDQ_DEC(last), !PDQ_LESS(last, PDQ_REF(pivot))));
+    } else {
+        while ((PDQ_DEC(last), !PDQ_LESS(last, PDQ_REF(pivot))));
+    }
+    *partitioned = first >= last;
+
+#ifdef PDQ_BRANCHLESS
+    if (!*partitioned) {
+        PDQ_SWAP(first, last);
+        PDQ_INC(first);
+        /*
+         * BlockQuicksort: collect offsets of misplaced elements of a block
+         * from each side without branching on the comparison, then swap
+         */
+        offsets_l_base = first;
+        offsets_r_base = last;
+        while (first < last) {
+            num_unknown = PDQ_DIFF(last, first);
+            left_split = num_l == 0 ? (num_r == 0 ? num_unknown / 2 : num_unknown) : 0;
+            right_split = num_r == 0 ? (num_unknown - left_split) : 0;
+
+            if (left_split >= PDQ_BLOCK_SIZE) {
+                left_split = PDQ_BLOCK_SIZE;
+            }
+            for (i = 0; i < left_split;) {
+                offsets_l[num_l] = (unsigned char)i++;
+                num_l += !PDQ_LESS(first, PDQ_REF(pivot));
+                PDQ_INC(first);
+            }
+            if (right_split >= PDQ_BLOCK_SIZE) {
+                right_split = PDQ_BLOCK_SIZE;
+            }
+            for (i = 0; i < right_split;) {
+                offsets_r[num_r] = (unsigned char)++i;
+                PDQ_DEC(last);
+                num_r += PDQ_LESS(last, PDQ_REF(pivot));
+            }
+
+            num = num_l < num_r ? num_l : num_r;
+            PDQ_FN(swap_offsets)(offsets_l_base, offsets_r_base,
+                                 offsets_l + start_l, offsets_r + start_r,
+                                 num, num_l == num_r, ctx);
+            num_l -= num;
+            num_r -= num;
+            start_l += num;
+            start_r += num;
+            if (num_l == 0) {
+                start_l = 0;
+                offsets_l_base = first;
+            }
+            if (num_r == 0) {
+                start_r = 0;
+                offsets_r_base = last;
+            }
+        }
+        /* [first, last) is known now, move the leftovers of one side */
+        if (num_l) {
+            while (num_l--) {
+                PDQ_DEC(last);
+                PDQ_SWAP(PDQ_ADD(offsets_l_base, offsets_l[start_l + num_l]), last);
+            }
+            first = last;
+        }
+        if (num_r) {
+            while (num_r--) {
+                PDQ_SWAP(PDQ_SUB(offsets_r_base, offsets_r[start_r + num_r]), first);
+                PDQ_INC(first);
+            }
+        }
+    }
+#else
+    while (first < last) {
+        PDQ_SWAP(first, last);
+        while ((PDQ_INC(first), PDQ_LESS(first, PDQ_REF(pivot))));
+        while ((PDQ_DEC(last), !PDQ_LESS(last, PDQ_REF(pivot))));
+    }
+#endif
+
+    pivot_pos = PDQ_SUB(first, 1);
+    PDQ_MOVE(begin, pivot_pos);
+    PDQ_MOVE(pivot_pos, PDQ_REF(pivot));
+    return pivot_pos;
+}
+
+/*
+ * partition [begin, end) around *begin, elements equal to the pivot go
+ * left. used when the pivot equals the element before the range, so the
+ * left part is all equal and done.
+ */
+static PDQ_ITER PDQ_FN(partition_left)(PDQ_ITER begin, PDQ_ITER end, PDQ_CTX ctx)
+{
+    PDQ_ITER first = begin, last = end, pivot_pos;
+    PDQ_TMP(pivot);
+
+    PDQ_MOVE(PDQ_REF(pivot), begin);
+    while ((PDQ_DEC(last), PDQ_LESS(PDQ_REF(pivot), last)));
+    if (PDQ_ADD(last, 1) == end) {
+        while (first < last && (PDQ_INC(first), !PDQ_LESS(PDQ_REF(pivot), first)));
+    } else {
+        while ((PDQ_INC(first), !PDQ_LESS(PDQ_REF(pivot), first)));
+    }
+    while (first < last) {
+        PDQ_SWAP(first, last);
+        while ((PDQ_DEC(last), PDQ_LESS(PDQ_REF(pivot), last)));
+        while ((PDQ_INC(first), !PDQ_LESS(PDQ_REF(pivot), first)));
+    }
+    pivot_pos = last;
+    PDQ_MOVE(begin, pivot_pos);
+    PDQ_MOVE(pivot_pos, PDQ_REF(pivot));
+    return pivot_pos;
+}
+
+/* swap a few elements at quarter positions to break a pattern */
+static inline void PDQ_FN(shuffle)(PDQ_ITER lo, PDQ_ITER hi, size_t n, PDQ_CTX ctx)
+{
+    size_t q = n / 4;
+
+    PDQ_SWAP(lo, PDQ_ADD(lo, q));
+    PDQ_SWAP(PDQ_SUB(hi, 1), PDQ_SUB(hi, q));
+    if (n > PDQ_NINTHER_THRESHOLD) {
+        PDQ_SWAP(PDQ_ADD(lo, 1), PDQ_ADD(lo, q + 1));
+        PDQ_SWAP(PDQ_ADD(lo, 2), PDQ_ADD(lo, q + 2));
+        PDQ_SWAP(PDQ_SUB(hi, 2), PDQ_SUB(hi, q + 1));
+        PDQ_SWAP(PDQ_SUB(hi, 3), PDQ_SUB(hi, q + 2));
+    }
+}
+
+static void PDQ_FN(loop)(PDQ_ITER begin, PDQ_ITER end, int bad_allowed, int leftmost, PDQ_CTX ctx)
+{
+    PDQ_ITER pivot_pos;
+    size_t size, s2, l_size, r_size;
+    int partitioned;
+
+    for (;;) {
+        size = PDQ_DIFF(end, begin);
+        if (size < PDQ_INSERTION_SORT_THRESHOLD) {
+            if (leftmost) {
+                PDQ_FN(insertion_sort)(begin, end, ctx);
+            } else {
+                PDQ_FN(unguarded_insertion_sort)(begin, end, ctx);
+            }
+            return;
+        }
+
+        s2 = size / 2;
+        if (size > PDQ_NINTHER_THRESHOLD) {
+            PDQ_FN(sort3)(begin, PDQ_ADD(begin, s2), PDQ_SUB(end, 1), ctx);
+            PDQ_FN(sort3)(PDQ_ADD(begin, 1), PDQ_ADD(begin, s2 - 1), PDQ_SUB(end, 2), ctx);
+            PDQ_FN(sort3)(PDQ_ADD(begin, 2), PDQ_ADD(begin, s2 + 1), PDQ_SUB(end, 3), ctx);
+            PDQ_FN(sort3)(PDQ_ADD(begin, s2 - 1), PDQ_ADD(begin, s2), PDQ_ADD(begin, s2 + 1), ctx);
+            PDQ_SWAP(begin, PDQ_ADD(begin, s2));
+        } else {
+            PDQ_FN(sort3)(PDQ_ADD(begin, s2), begin, PDQ_SUB(end, 1), ctx);
+        }
+
+        /*
+         * pivot equal to the element before the range, which is not less
+         * than anything here: everything equal to it goes left and is done
+         */
+        if (!leftmost && !PDQ_LESS(PDQ_SUB(begin, 1), begin)) {
+            begin = PDQ_ADD(PDQ_FN(partition_left)(begin, end, ctx), 1);
+            continue;
+        }
+
+        pivot_pos = PDQ_FN(partition_right)(begin, end, &partitioned, ctx);
+        l_size = PDQ_DIFF(pivot_pos, begin);
+        r_size = PDQ_DIFF(end, pivot_pos) - 1;
+
+        if (l_size < size / 8 || r_size < size / 8) {
+            if (--bad_allowed == 0) {
+                PDQ_FN(heap_sort)(begin, end, ctx);
+                return;
+            }
+            if (l_size >= PDQ_INSERTION_SORT_THRESHOLD) {
+                PDQ_FN(shuffle)(begin, pivot_pos, l_size, ctx);
+            }
+            if (r_size >= PDQ_INSERTION_SORT_THRESHOLD) {
+                PDQ_FN(shuffle)(PDQ_ADD(pivot_pos, 1), end, r_size, ctx);
+            }
+        } else if (partitioned &&
+                   PDQ_FN(partial_insertion_sort)(begin, pivot_pos, ctx) &&
+                   PDQ_FN(partial_insertion_sort)(PDQ_ADD(pivot_pos, 1), end, ctx)) {
+            return;
+        }
+
+        /* recurse into the smaller side, loop on the larger */
+        if (l_size < r_size) {
+            PDQ_FN(loop)(begin, pivot_pos, bad_allowed, leftmost, ctx);
+            begin = PDQ_ADD(pivot_pos, 1);
+            leftmost = 0;
+        } else {
+            PDQ_FN(loop)(PDQ_ADD(pivot_pos, 1), end, bad_allowed, 0, ctx);
+            end = pivot_pos;
+        }
+    }
+}
+
+#ifndef PDQSORT_GENERIC
+static inline void PDQ_CAT(pdqsort, PDQSORT_NAME)(PDQSORT_TYPE *base, size_t num)
+{
+    if (num < 2) {
+        return;
+    }
+    PDQ_FN(loop)(base, base + num, pdq_log2(num), 1, NULL);
+}
+#endif
+
+#undef PDQ_FN
+#undef PDQ_ADD
+#undef PDQ_SUB
+#undef PDQ_INC
+#undef PDQ_DEC
+#undef PDQ_DIFF
+#undef PDQ_LESS
+#undef PDQ_SWAP
+#undef PDQ_MOVE
+#undef PDQ_TMP
+#undef PDQ_TMP2
+#undef PDQ_REF
+#undef PDQ_ITER
+#undef PDQ_CTX
+#undef PDQ_BRANCHLESS
+#undef PDQSORT_NAME
+#undef PDQSORT_TYPE
+#undef PDQSORT_LESS
+#undef PDQSORT_GENERIC
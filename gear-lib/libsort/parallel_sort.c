@@ -0,0 +1,389 @@
+/*****************************************************************************
+ * Copyright (C) 2014-2020
+ * file:    parallel_sort.c
+ * author:  gozfree <gozfree@163.com>
+ * description: sort runs on a workq_pool and merge them in parallel
+ *****************************************************************************/
+#include "common.h"
+#include <libworkq.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/*
+ * input is cut into one run per workq, each run is sorted by a task, then
+ * pairs of runs are merged round by round between base and a scratch copy.
+ * every merge is cut again along the merge path (the co-rank of an output
+ * position tells how many elements come from each input), so all workq
+ * stay busy until the last round, which is one merge cut in one piece per
+ * workq.
+ */
+
+/* below this many elements per run the tasks cost more than they save */
+#define PSORT_MIN_RUN   16384
+
+enum psort_kind {
+    PSORT_GENERIC,
+    PSORT_U32,
+    PSORT_U64,
+    PSORT_KEY,
+};
+
+struct psort {
+    enum psort_kind kind;
+    size_t size;
+    fp_cmp cmp;
+    size_t key_off;
+    size_t key_size;
+    byte *tmp;
+    int err;
+    int pending;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+struct psort_task {
+    struct psort *ps;
+    byte *a;        /* sort: the run, merge: first input */
+    size_t na;
+    byte *b;        /* merge: second input */
+    size_t nb;
+    byte *out;      /* merge: output of the whole pair */
+    byte *tmp;      /* sort: scratch as large as the run */
+    size_t d0;      /* merge: output range [d0, d1) of this piece */
+    size_t d1;
+};
+
+static inline uint64_t psort_key(const struct psort *ps, const byte *rec)
+{
+    uint8_t k8;
+    uint16_t k16;
+    uint32_t k32;
+    uint64_t k64;
+
+    rec += ps->key_off;
+    switch (ps->key_size) {
+    case 1:
+        k8 = *rec;
+        return k8;
+    case 2:
+        memcpy(&k16, rec, 2);
+        return k16;
+    case 4:
+        memcpy(&k32, rec, 4);
+        return k32;
+    default:
+        memcpy(&k64, rec, 8);
+        return k64;
+    }
+}
+
+#define LESS_GENERIC(ps, x, y)  ((ps)->cmp((x), (y), (ps)->size) < 0)
+#define LESS_U32(ps, x, y)      (*(const uint32_t *)(x) < *(const uint32_t *)(y))
+#define LESS_U64(ps, x, y)      (*(const uint64_t *)(x) < *(const uint64_t *)(y))
+#define LESS_KEY(ps, x, y)      (psort_key((ps), (x)) < psort_key((ps), (y)))
+
+/*
+ * co-rank: number of elements of a among the first d of merge(a, b), ties
+ * go to a first. merge takes from b only when b is strictly less, which
+ * keeps runs of equal keys in input order.
+ */
+#define PSORT_MERGE_FUNCS(name, SIZE, LESS)                                   \
+static size_t name##_corank(const struct psort *ps, size_t d,                 \
+                            const byte *a, size_t na,                         \
+                            const byte *b, size_t nb)                         \
+{                                                                             \
+    size_t lo = d > nb ? d - nb : 0;                                          \
+    size_t hi = d < na ? d : na;                                              \
+    size_t i;                                                                 \
+    while (lo < hi) {                                                         \
+        i = lo + (hi - lo) / 2;                                               \
+        if (!LESS(ps, b + (d - i - 1) * (SIZE), a + i * (SIZE))) {            \
+            lo = i + 1;                                                       \
+        } else {                                                              \
+            hi = i;                                                           \
+        }                                                                     \
+    }                                                                         \
+    return lo;                                                                \
+}                                                                             \
+                                                                              \
+static void name##_merge(const struct psort *ps,                              \
+                         const byte *a, size_t na,                            \
+                         const byte *b, size_t nb, byte *out)                 \
+{                                                                             \
+    const byte *ae = a + na * (SIZE), *be = b + nb * (SIZE);                  \
+    int take_b;                                                               \
+    while (a < ae && b < be) {                                                \
+        take_b = LESS(ps, b, a);                                              \
+        memcpy(out, take_b ? b : a, (SIZE));                                  \
+        b += take_b ? (SIZE) : 0;                                             \
+        a += take_b ? 0 : (SIZE);                                             \
+        out += (SIZE);                                                        \
+    }                                                                         \
+    memcpy(out, a, ae - a);                                                   \
+    memcpy(out + (ae - a), b, be - b);                                        \
+}
+
+PSORT_MERGE_FUNCS(psort_generic, ps->size, LESS_GENERIC)
+PSORT_MERGE_FUNCS(psort_u32, 4, LESS_U32)
+PSORT_MERGE_FUNCS(psort_u64, 8, LESS_U64)
+PSORT_MERGE_FUNCS(psort_key, ps->size, LESS_KEY)
+
+static void psort_done(struct psort *ps, int err)
+{
+    pthread_mutex_lock(&ps->lock);
+    if (err) {
+        ps->err = err;
+    }
+    if (--ps->pending == 0) {
+        pthread_cond_signal(&ps->cond);
+    }
+    pthread_mutex_unlock(&ps->lock);
+}
+
+static int psort_run_sort(struct psort *ps, byte *base, size_t num, byte *tmp)
+{
+    switch (ps->kind) {
+    case PSORT_U32:
+        if (!tmp) {
+            return radix_sort_u32((uint32_t *)base, num);
+        }
+        return radix_sort32_tmp((uint32_t *)base, num, 0, (uint32_t *)tmp);
+    case PSORT_U64:
+        if (!tmp) {
+            return radix_sort_u64((uint64_t *)base, num);
+        }
+        return radix_sort64_tmp((uint64_t *)base, num, 0, (uint64_t *)tmp);
+    case PSORT_KEY:
+        if (num < 2) {
+            return 0;
+        }
+        return radix_sort_rec_tmp(base, num, ps->size, ps->key_off,
+                                  ps->key_size, tmp);
+    default:
+        return pdq_sort(base, num, ps->size, ps->cmp);
+    }
+}
+
+static void psort_sort_task(void *arg)
+{
+    struct psort_task *t = (struct psort_task *)arg;
+    psort_done(t->ps, psort_run_sort(t->ps, t->a, t->na, t->tmp));
+}
+
+static void psort_merge_task(void *arg)
+{
+    struct psort_task *t = (struct psort_task *)arg;
+    struct psort *ps = t->ps;
+    size_t size = ps->size;
+    size_t i0, i1;
+
+#define PSORT_MERGE_PIECE(name)                                               \
+    do {                                                                      \
+        i0 = name##_corank(ps, t->d0, t->a, t->na, t->b, t->nb);              \
+        i1 = name##_corank(ps, t->d1, t->a, t->na, t->b, t->nb);              \
+        name##_merge(ps, t->a + i0 * size, i1 - i0,                           \
+                     t->b + (t->d0 - i0) * size, (t->d1 - i1) - (t->d0 - i0), \
+                     t->out + t->d0 * size);                                  \
+    } while (0)
+
+    switch (ps->kind) {
+    case PSORT_U32:
+        PSORT_MERGE_PIECE(psort_u32);
+        break;
+    case PSORT_U64:
+        PSORT_MERGE_PIECE(psort_u64);
+        break;
+    case PSORT_KEY:
+        PSORT_MERGE_PIECE(psort_key);
+        break;
+    default:
+        PSORT_MERGE_PIECE(psort_generic);
+        break;
+    }
+#undef PSORT_MERGE_PIECE
+    psort_done(ps, 0);
+}
+
+/* push n tasks and wait for all, a task the pool refuses runs here */
+static int psort_exec(struct workq_pool *pool, struct psort *ps,
+                      task_func_t func, struct psort_task *tasks, int n)
+{
+    int i;
+
+    pthread_mutex_lock(&ps->lock);
+    ps->pending = n;
+    pthread_mutex_unlock(&ps->lock);
+    for (i = 0; i < n; i++) {
+        if (workq_pool_task_push(pool, func, &tasks[i]) < 0) {
+            func(&tasks[i]);
+        }
+    }
+    pthread_mutex_lock(&ps->lock);
+    while (ps->pending > 0) {
+        pthread_cond_wait(&ps->cond, &ps->lock);
+    }
+    pthread_mutex_unlock(&ps->lock);
+    return ps->err;
+}
+
+static int psort(struct workq_pool *pool, struct psort *ps, byte *base, size_t num)
+{
+    struct psort_task *tasks;
+    size_t *run_off, *run_len, per, pieces, p, len;
+    byte *src = base, *dst;
+    int nrun, nt, i, r, threads, ret = -1;
+
+    threads = pool ? pool->wq_array.num : 1;
+    nrun = threads;
+    if (num / PSORT_MIN_RUN < (size_t)nrun) {
+        nrun = (int)(num / PSORT_MIN_RUN);
+    }
+    if (nrun <= 1) {
+        return psort_run_sort(ps, base, num, NULL);
+    }
+
+    ps->tmp = (byte *)malloc(num * ps->size);
+    tasks = (struct psort_task *)calloc(2 * threads, sizeof(struct psort_task));
+    run_off = (size_t *)calloc(2 * nrun, sizeof(size_t));
+    if (!ps->tmp || !tasks || !run_off) {
+        printf("malloc parallel_sort buffers failed!\n");
+        goto out;
+    }
+    run_len = run_off + nrun;
+    pthread_mutex_init(&ps->lock, NULL);
+    pthread_cond_init(&ps->cond, NULL);
+
+    for (i = 0; i < nrun; i++) {
+        run_off[i] = num * i / nrun;
+        run_len[i] = num * (i + 1) / nrun - run_off[i];
+        tasks[i].ps = ps;
+        tasks[i].a = base + run_off[i] * ps->size;
+        tasks[i].na = run_len[i];
+        tasks[i].tmp = ps->tmp + run_off[i] * ps->size;
+    }
+    if (psort_exec(pool, ps, psort_sort_task, tasks, nrun)) {
+        goto fini;
+    }
+
+    dst = ps->tmp;
+    while (nrun > 1) {
+        /* each pair gets its share of the threads, a lone run is copied */
+        pieces = threads / (nrun / 2);
+        if (pieces < 1) {
+            pieces = 1;
+        }
+        nt = 0;
+        for (r = 0; r < nrun; r += 2) {
+            len = run_len[r] + (r + 1 < nrun ? run_len[r + 1] : 0);
+            per = r + 1 < nrun ? pieces : 1;
+            for (p = 0; p < per; p++) {
+                struct psort_task *t = &tasks[nt++];
+                t->ps = ps;
+                t->a = src + run_off[r] * ps->size;
+                t->na = run_len[r];
+                t->b = t->a + run_len[r] * ps->size;
+                t->nb = len - run_len[r];
+                t->out = dst + run_off[r] * ps->size;
+                t->d0 = len * p / per;
+                t->d1 = len * (p + 1) / per;
+            }
+            run_off[r / 2] = run_off[r];
+            run_len[r / 2] = len;
+        }
+        psort_exec(pool, ps, psort_merge_task, tasks, nt);
+        nrun = (nrun + 1) / 2;
+        dst = src;
+        src = (src == base) ? ps->tmp : base;
+    }
+    if (src != base) {
+        memcpy(base, src, num * ps->size);
+    }
+    ret = 0;
+
+fini:
+    pthread_cond_destroy(&ps->cond);
+    pthread_mutex_destroy(&ps->lock);
+out:
+    free(run_off);
+    free(tasks);
+    free(ps->tmp);
+    return ret;
+}
+
+int parallel_sort(struct workq_pool *pool, void *base, size_t num, size_t size, fp_cmp cmp)
+{
+    struct psort ps;
+
+    if (!base || !size) {
+        printf("invalid parameter!\n");
+        return -1;
+    }
+    if (num < 2) {
+        return 0;
+    }
+    memset(&ps, 0, sizeof(ps));
+    ps.kind = PSORT_GENERIC;
+    ps.size = size;
+    ps.cmp = cmp ? cmp : default_cmp;
+    return psort(pool, &ps, (byte *)base, num);
+}
+
+int parallel_sort_u32(struct workq_pool *pool, uint32_t *base, size_t num)
+{
+    struct psort ps;
+
+    if (!base) {
+        printf("invalid parameter!\n");
+        return -1;
+    }
+    if (num < 2) {
+        return 0;
+    }
+    memset(&ps, 0, sizeof(ps));
+    ps.kind = PSORT_U32;
+    ps.size = sizeof(uint32_t);
+    return psort(pool, &ps, (byte *)base, num);
+}
+
+int parallel_sort_u64(struct workq_pool *pool, uint64_t *base, size_t num)
+{
+    struct psort ps;
+
+    if (!base) {
+        printf("invalid parameter!\n");
+        return -1;
+    }
+    if (num < 2) {
+        return 0;
+    }
+    memset(&ps, 0, sizeof(ps));
+    ps.kind = PSORT_U64;
+    ps.size = sizeof(uint64_t);
+    return psort(pool, &ps, (byte *)base, num);
+}
+
+int parallel_sort_key(struct workq_pool *pool, void *base, size_t num,
+                      size_t size, size_t key_off, size_t key_size)
+{
+    struct psort ps;
+
+    if (!base || !size) {
+        printf("invalid parameter!\n");
+        return -1;
+    }
+    if ((key_size != 1 && key_size != 2 && key_size != 4 && key_size != 8) ||
+        key_off + key_size > size) {
+        printf("invalid key %zu@%zu in %zu bytes record!\n", key_size, key_off, size);
+        return -1;
+    }
+    if (num < 2) {
+        return 0;
+    }
+    memset(&ps, 0, sizeof(ps));
+    ps.kind = PSORT_KEY;
+    ps.size = size;
+    ps.key_off = key_off;
+    ps.key_size = key_size;
+    return psort(pool, &ps, (byte *)base, num);
+}
@@ -0,0 +1,144 @@
+/*****************************************************************************
+ * Copyright (C) 2014-2020
+ * file:    pdq_sort.c
+ * author:  gozfree <gozfree@163.com>
+ * description: pattern-defeating quicksort, generic and typed instances
+ *****************************************************************************/
+#include "common.h"
+#include <stdlib.h>
+
+#define PDQSORT_NAME        generic
+#define PDQSORT_GENERIC
+#include "libsort_pdq.h"
+
+#define PDQSORT_NAME        u32
+#define PDQSORT_TYPE        uint32_t
+#define PDQSORT_LESS(a, b)  ((a) < (b))
+#include "libsort_pdq.h"
+
+#define PDQSORT_NAME        i32
+#define PDQSORT_TYPE        int32_t
+#define PDQSORT_LESS(a, b)  ((a) < (b))
+#include "libsort_pdq.h"
+
+#define PDQSORT_NAME        u64
+#define PDQSORT_TYPE        uint64_t
+#define PDQSORT_LESS(a, b)  ((a) < (b))
+#include "libsort_pdq.h"
+
+#define PDQSORT_NAME        i64
+#define PDQSORT_TYPE        int64_t
+#define PDQSORT_LESS(a, b)  ((a) < (b))
+#include "libsort_pdq.h"
+
+#define PDQSORT_NAME        float
+#define PDQSORT_TYPE        float
+#define PDQSORT_LESS(a, b)  ((a) < (b))
+#include "libsort_pdq.h"
+
+#define PDQSORT_NAME        double
+#define PDQSORT_TYPE        double
+#define PDQSORT_LESS(a, b)  ((a) < (b))
+#include "libsort_pdq.h"
+
+/* elements above this size use a heap scratch element */
+#define PDQ_STACK_ELEM_MAX  256
+
+static void u32_swap(void *a, void *b, size_t size)
+{
+    uint32_t t = *(uint32_t *)a;
+    *(uint32_t *)a = *(uint32_t *)b;
+    *(uint32_t *)b = t;
+}
+
+static void u64_swap(void *a, void *b, size_t size)
+{
+    uint64_t t = *(uint64_t *)a;
+    *(uint64_t *)a = *(uint64_t *)b;
+    *(uint64_t *)b = t;
+}
+
+static void words_swap(void *a, void *b, size_t size)
+{
+    uint64_t *p = (uint64_t *)a, *q = (uint64_t *)b, t;
+    for (size /= 8; size--; p++, q++) {
+        t = *p;
+        *p = *q;
+        *q = t;
+    }
+}
+
+static void generic_swap(void *a, void *b, size_t size)
+{
+    byte_swap((byte *)a, (byte *)b, size);
+}
+
+int pdq_sort(void *base, size_t num, size_t size, fp_cmp cmp)
+{
+    struct pdqsort_generic_ctx ctx;
+    uint64_t stack_tmp[PDQ_STACK_ELEM_MAX / sizeof(uint64_t)];
+    byte *b = (byte *)base;
+
+    if (!base || !size) {
+        printf("invalid parameter!\n");
+        return -1;
+    }
+    if (num < 2) {
+        return 0;
+    }
+    ctx.size = size;
+    ctx.cmp = cmp ? cmp : default_cmp;
+    if (size == 4 && ((uintptr_t)base % 4) == 0) {
+        ctx.swap = u32_swap;
+    } else if (size == 8 && ((uintptr_t)base % 8) == 0) {
+        ctx.swap = u64_swap;
+    } else if (((uintptr_t)base | size) % 8 == 0) {
+        ctx.swap = words_swap;
+    } else {
+        ctx.swap = generic_swap;
+    }
+    if (size <= PDQ_STACK_ELEM_MAX) {
+        ctx.tmp = (unsigned char *)stack_tmp;
+    } else {
+        ctx.tmp = (unsigned char *)malloc(size);
+        if (!ctx.tmp) {
+            printf("malloc %zu failed!\n", size);
+            return -1;
+        }
+    }
+    pdqsort_generic_loop(b, b + num * size, pdq_log2(num), 1, &ctx);
+    if (ctx.tmp != (unsigned char *)stack_tmp) {
+        free(ctx.tmp);
+    }
+    return 0;
+}
+
+void pdq_sort_u32(uint32_t *base, size_t num)
+{
+    pdqsort_u32(base, num);
+}
+
+void pdq_sort_i32(int32_t *base, size_t num)
+{
+    pdqsort_i32(base, num);
+}
+
+void pdq_sort_u64(uint64_t *base, size_t num)
+{
+    pdqsort_u64(base, num);
+}
+
+void pdq_sort_i64(int64_t *base, size_t num)
+{
+    pdqsort_i64(base, num);
+}
+
+void pdq_sort_float(float *base, size_t num)
+{
+    pdqsort_float(base, num);
+}
+
+void pdq_sort_double(double *base, size_t num)
+{
+    pdqsort_double(base, num);
+}
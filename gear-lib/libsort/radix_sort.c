@@ -0,0 +1,285 @@
+/*****************************************************************************
+ * Copyright (C) 2014-2020
+ * file:    radix_sort.c
+ * author:  gozfree <gozfree@163.com>
+ * description: LSD radix sort on 8 bit digits
+ *****************************************************************************/
+#include "common.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * below this radix loses to pdqsort: one pass to count all digits, then
+ * one scatter per digit that is not the same for every key
+ */
+#define RADIX_SORT_THRESHOLD    256
+
+#define PDQSORT_NAME        radix_u32
+#define PDQSORT_TYPE        uint32_t
+#define PDQSORT_LESS(a, b)  ((a) < (b))
+#include "libsort_pdq.h"
+
+#define PDQSORT_NAME        radix_u64
+#define PDQSORT_TYPE        uint64_t
+#define PDQSORT_LESS(a, b)  ((a) < (b))
+#include "libsort_pdq.h"
+
+/* counts of all digits in one pass, returns the prefix sums in place */
+static void radix_prefix(size_t cnt[256])
+{
+    size_t i, sum = 0, c;
+
+    for (i = 0; i < 256; i++) {
+        c = cnt[i];
+        cnt[i] = sum;
+        sum += c;
+    }
+}
+
+/*
+ * flip is xor'ed into the key before taking digits, the sign bit for
+ * signed keys so negative values order first
+ */
+int radix_sort32_tmp(uint32_t *base, size_t num, uint32_t flip, uint32_t *tmp)
+{
+    size_t cnt[4][256];
+    uint32_t *src = base, *dst, *buf = tmp, v;
+    size_t i;
+    int d, sh;
+
+    memset(cnt, 0, sizeof(cnt));
+    for (i = 0; i < num; i++) {
+        v = base[i] ^ flip;
+        cnt[0][v & 0xff]++;
+        cnt[1][(v >> 8) & 0xff]++;
+        cnt[2][(v >> 16) & 0xff]++;
+        cnt[3][v >> 24]++;
+    }
+    if (!buf) {
+        buf = (uint32_t *)malloc(num * sizeof(uint32_t));
+        if (!buf) {
+            printf("malloc %zu failed!\n", num * sizeof(uint32_t));
+            return -1;
+        }
+    }
+    dst = buf;
+    for (d = 0; d < 4; d++) {
+        sh = d * 8;
+        if (cnt[d][((src[0] ^ flip) >> sh) & 0xff] == num) {
+            continue;
+        }
+        radix_prefix(cnt[d]);
+        for (i = 0; i < num; i++) {
+            v = src[i];
+            dst[cnt[d][((v ^ flip) >> sh) & 0xff]++] = v;
+        }
+        src = dst;
+        dst = (src == base) ? buf : base;
+    }
+    if (src != base) {
+        memcpy(base, src, num * sizeof(uint32_t));
+    }
+    if (buf != tmp) {
+        free(buf);
+    }
+    return 0;
+}
+
+int radix_sort64_tmp(uint64_t *base, size_t num, uint64_t flip, uint64_t *tmp)
+{
+    size_t cnt[8][256];
+    uint64_t *src = base, *dst, *buf = tmp, v;
+    size_t i;
+    int d, sh;
+
+    memset(cnt, 0, sizeof(cnt));
+    for (i = 0; i < num; i++) {
+        v = base[i] ^ flip;
+        for (d = 0; d < 8; d++) {
+            cnt[d][(v >> (d * 8)) & 0xff]++;
+        }
+    }
+    if (!buf) {
+        buf = (uint64_t *)malloc(num * sizeof(uint64_t));
+        if (!buf) {
+            printf("malloc %zu failed!\n", num * sizeof(uint64_t));
+            return -1;
+        }
+    }
+    dst = buf;
+    for (d = 0; d < 8; d++) {
+        sh = d * 8;
+        if (cnt[d][((src[0] ^ flip) >> sh) & 0xff] == num) {
+            continue;
+        }
+        radix_prefix(cnt[d]);
+        for (i = 0; i < num; i++) {
+            v = src[i];
+            dst[cnt[d][((v ^ flip) >> sh) & 0xff]++] = v;
+        }
+        src = dst;
+        dst = (src == base) ? buf : base;
+    }
+    if (src != base) {
+        memcpy(base, src, num * sizeof(uint64_t));
+    }
+    if (buf != tmp) {
+        free(buf);
+    }
+    return 0;
+}
+
+int radix_sort_u32(uint32_t *base, size_t num)
+{
+    if (!base) {
+        printf("invalid parameter!\n");
+        return -1;
+    }
+    if (num < RADIX_SORT_THRESHOLD) {
+        pdqsort_radix_u32(base, num);
+        return 0;
+    }
+    return radix_sort32_tmp(base, num, 0, NULL);
+}
+
+int radix_sort_i32(int32_t *base, size_t num)
+{
+    if (!base) {
+        printf("invalid parameter!\n");
+        return -1;
+    }
+    if (num < RADIX_SORT_THRESHOLD) {
+        uint32_t *u = (uint32_t *)base;
+        size_t i;
+        /* bias to unsigned order, sort, bias back */
+        for (i = 0; i < num; i++) {
+            u[i] ^= 0x80000000U;
+        }
+        pdqsort_radix_u32(u, num);
+        for (i = 0; i < num; i++) {
+            u[i] ^= 0x80000000U;
+        }
+        return 0;
+    }
+    return radix_sort32_tmp((uint32_t *)base, num, 0x80000000U, NULL);
+}
+
+int radix_sort_u64(uint64_t *base, size_t num)
+{
+    if (!base) {
+        printf("invalid parameter!\n");
+        return -1;
+    }
+    if (num < RADIX_SORT_THRESHOLD) {
+        pdqsort_radix_u64(base, num);
+        return 0;
+    }
+    return radix_sort64_tmp(base, num, 0, NULL);
+}
+
+int radix_sort_i64(int64_t *base, size_t num)
+{
+    if (!base) {
+        printf("invalid parameter!\n");
+        return -1;
+    }
+    if (num < RADIX_SORT_THRESHOLD) {
+        uint64_t *u = (uint64_t *)base;
+        size_t i;
+        for (i = 0; i < num; i++) {
+            u[i] ^= 0x8000000000000000ULL;
+        }
+        pdqsort_radix_u64(u, num);
+        for (i = 0; i < num; i++) {
+            u[i] ^= 0x8000000000000000ULL;
+        }
+        return 0;
+    }
+    return radix_sort64_tmp((uint64_t *)base, num, 0x8000000000000000ULL, NULL);
+}
+
+static inline uint64_t radix_key(const byte *rec, size_t key_size)
+{
+    uint8_t k8;
+    uint16_t k16;
+    uint32_t k32;
+    uint64_t k64;
+
+    switch (key_size) {
+    case 1:
+        k8 = *rec;
+        return k8;
+    case 2:
+        memcpy(&k16, rec, 2);
+        return k16;
+    case 4:
+        memcpy(&k32, rec, 4);
+        return k32;
+    default:
+        memcpy(&k64, rec, 8);
+        return k64;
+    }
+}
+
+int radix_sort_rec_tmp(byte *base, size_t num, size_t size,
+                       size_t key_off, size_t key_size, byte *tmp)
+{
+    size_t cnt[8][256];
+    byte *src = base, *dst, *buf = tmp, *rec;
+    uint64_t k;
+    size_t i;
+    int d, sh, digits = (int)key_size;
+
+    memset(cnt, 0, sizeof(cnt));
+    for (i = 0, rec = src + key_off; i < num; i++, rec += size) {
+        k = radix_key(rec, key_size);
+        for (d = 0; d < digits; d++) {
+            cnt[d][(k >> (d * 8)) & 0xff]++;
+        }
+    }
+    if (!buf) {
+        buf = (byte *)malloc(num * size);
+        if (!buf) {
+            printf("malloc %zu failed!\n", num * size);
+            return -1;
+        }
+    }
+    dst = buf;
+    for (d = 0; d < digits; d++) {
+        sh = d * 8;
+        if (cnt[d][(radix_key(src + key_off, key_size) >> sh) & 0xff] == num) {
+            continue;
+        }
+        radix_prefix(cnt[d]);
+        for (i = 0, rec = src; i < num; i++, rec += size) {
+            k = radix_key(rec + key_off, key_size);
+            memcpy(dst + cnt[d][(k >> sh) & 0xff]++ * size, rec, size);
+        }
+        src = dst;
+        dst = (src == base) ? buf : base;
+    }
+    if (src != base) {
+        memcpy(base, src, num * size);
+    }
+    if (buf != tmp) {
+        free(buf);
+    }
+    return 0;
+}
+
+int radix_sort(void *base, size_t num, size_t size, size_t key_off, size_t key_size)
+{
+    if (!base || !size) {
+        printf("invalid parameter!\n");
+        return -1;
+    }
+    if ((key_size != 1 && key_size != 2 && key_size != 4 && key_size != 8) ||
+        key_off + key_size > size) {
+        printf("invalid key %zu@%zu in %zu bytes record!\n", key_size, key_off, size);
+        return -1;
+    }
+    if (num < 2) {
+        return 0;
+    }
+    return radix_sort_rec_tmp((byte *)base, num, size, key_off, key_size, NULL);
+}
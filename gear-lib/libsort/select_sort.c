@@ -19,8 +19,8 @@ int select_sort(void *array, size_t num, size_t size, fp_cmp cmp)
 
     for (; s < e; s += size) {
         byte *first = s;
-        byte *p = first + 1;
-        for (; p <= e; p++) {
+        byte *p = first + size;
+        for (; p <= e; p += size) {
             if (cmp(p, first, size) < 0) {
                 first = p;
             }
@@ -8,8 +8,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libworkq.h>
+#include <libfile.h>
 #include "libsort.h"
 
+#define PDQSORT_NAME        rec
+#define PDQSORT_TYPE        struct rec
+#define PDQSORT_LESS(a, b)  ((a).key < (b).key)
+
+struct rec {
+    uint32_t key;
+    uint32_t seq;
+    char pad[8];
+};
+#include "libsort_pdq.h"
+
 #define print_array(type, format, array) \
     do {\
         size_t len = sizeof(array)/sizeof(array[0]);\
@@ -71,9 +87,585 @@ void test_bsort()
     print_array(float, "%f\t", f);
 
 }
+enum dist {
+    DIST_RANDOM,
+    DIST_SORTED,
+    DIST_REVERSED,
+    DIST_FEW_UNIQUE,
+    DIST_ORGAN_PIPE,
+    DIST_SAWTOOTH,
+    DIST_MAX,
+};
+
+static const char *dist_name[DIST_MAX] = {
+    "random", "sorted", "reversed", "few unique", "organ pipe", "sawtooth",
+};
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint64_t rnd(void)
+{
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return rnd_state;
+}
+
+static uint32_t gen(enum dist d, size_t i, size_t n)
+{
+    switch (d) {
+    case DIST_SORTED:     return (uint32_t)i;
+    case DIST_REVERSED:   return (uint32_t)(n - i);
+    case DIST_FEW_UNIQUE: return (uint32_t)(rnd() % 8);
+    case DIST_ORGAN_PIPE: return (uint32_t)(i < n / 2 ? i : n - i);
+    case DIST_SAWTOOTH:   return (uint32_t)(i % 1000);
+    default:              return (uint32_t)rnd();
+    }
+}
+
+static int u32_cmp(const void *a, const void *b, size_t size)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int u32_qcmp(const void *a, const void *b)
+{
+    return u32_cmp(a, b, 4);
+}
+
+static int i64_qcmp(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* 13 byte elements, compared by all bytes with the default comparator */
+static int bytes13_qcmp(const void *a, const void *b)
+{
+    return memcmp(a, b, 13);
+}
+
+static int check(const char *what, const void *a, const void *b, size_t len,
+                 enum dist d, size_t n)
+{
+    if (memcmp(a, b, len)) {
+        printf("%s: %s n=%zu mismatch!\n", what, dist_name[d], n);
+        return -1;
+    }
+    return 0;
+}
+
+static int test_pdq_radix(void)
+{
+    static const size_t sizes[] = {0, 1, 2, 3, 23, 24, 25, 100, 129, 255,
+                                   256, 1000, 4096, 100000};
+    size_t si, n, i, maxn = 100000;
+    uint32_t *ref = calloc(maxn, sizeof(uint32_t));
+    uint32_t *a = calloc(maxn, sizeof(uint32_t));
+    uint32_t *orig = calloc(maxn, sizeof(uint32_t));
+    int64_t *ref64 = calloc(maxn, sizeof(int64_t));
+    int64_t *a64 = calloc(maxn, sizeof(int64_t));
+    unsigned char *rb = calloc(maxn, 13);
+    unsigned char *rb2 = calloc(maxn, 13);
+    struct rec *rec = calloc(maxn, sizeof(struct rec));
+    int d, ret = -1;
+
+    for (d = 0; d < DIST_MAX; d++) {
+        for (si = 0; si < sizeof(sizes)/sizeof(sizes[0]); si++) {
+            n = sizes[si];
+            for (i = 0; i < n; i++) {
+                ref[i] = gen(d, i, n);
+                ref64[i] = (int64_t)((uint64_t)ref[i] << 32 | (uint32_t)rnd());
+                if (d == DIST_FEW_UNIQUE) {
+                    ref64[i] = (int64_t)ref[i] - 4;
+                }
+            }
+            memcpy(orig, ref, n * 4);
+            qsort(ref, n, 4, u32_qcmp);
+
+            memcpy(a, orig, n * 4);
+            pdq_sort(a, n, 4, u32_cmp);
+            if (check("pdq_sort", a, ref, n * 4, d, n)) goto out;
+            memcpy(a, orig, n * 4);
+            pdq_sort_u32(a, n);
+            if (check("pdq_sort_u32", a, ref, n * 4, d, n)) goto out;
+            memcpy(a, orig, n * 4);
+            radix_sort_u32(a, n);
+            if (check("radix_sort_u32", a, ref, n * 4, d, n)) goto out;
+
+            memcpy(a64, ref64, n * 8);
+            qsort(ref64, n, 8, i64_qcmp);
+            pdq_sort_i64(a64, n);
+            if (check("pdq_sort_i64", a64, ref64, n * 8, d, n)) goto out;
+            for (i = 0; i < n; i++) a64[i] = ref64[n - 1 - i];
+            radix_sort_i64(a64, n);
+            if (check("radix_sort_i64", a64, ref64, n * 8, d, n)) goto out;
+
+            /* odd element size through the generic path */
+            for (i = 0; i < n * 13; i++) rb[i] = (unsigned char)(d == DIST_FEW_UNIQUE ? rnd() % 2 : rnd());
+            memcpy(rb2, rb, n * 13);
+            qsort(rb2, n, 13, bytes13_qcmp);
+            quick_sort(rb, n, 13, NULL);
+            if (n && check("quick_sort 13", rb, rb2, n * 13, d, n)) goto out;
+
+            /* stability of the record radix sort, key at an odd offset */
+            for (i = 0; i < n; i++) {
+                uint32_t k = gen(d, i, n) % 1000;
+                memset(rb + i * 13, 0, 13);
+                memcpy(rb + i * 13 + 3, &k, 4);
+                memcpy(rb + i * 13 + 7, &i, 4);
+            }
+            radix_sort(rb, n, 13, 3, 4);
+            for (i = 1; i < n; i++) {
+                uint32_t k0, k1, s0, s1;
+                memcpy(&k0, rb + (i - 1) * 13 + 3, 4);
+                memcpy(&k1, rb + i * 13 + 3, 4);
+                memcpy(&s0, rb + (i - 1) * 13 + 7, 4);
+                memcpy(&s1, rb + i * 13 + 7, 4);
+                if (k0 > k1 || (k0 == k1 && s0 > s1)) {
+                    printf("radix_sort record: %s n=%zu not sorted/stable at %zu!\n",
+                           dist_name[d], n, i);
+                    goto out;
+                }
+            }
+
+            /* typed template instance on a struct */
+            for (i = 0; i < n; i++) {
+                rec[i].key = gen(d, i, n) % 1000;
+                rec[i].seq = (uint32_t)i;
+            }
+            pdqsort_rec(rec, n);
+            for (i = 1; i < n; i++) {
+                if (rec[i - 1].key > rec[i].key) {
+                    printf("pdqsort_rec: %s n=%zu not sorted at %zu!\n",
+                           dist_name[d], n, i);
+                    goto out;
+                }
+            }
+        }
+    }
+
+    /* O(n^2) sorts with elements larger than one byte */
+    for (n = 2; n < 300; n += 37) {
+        for (i = 0; i < n; i++) a64[i] = ref64[i] = (int64_t)rnd() % 100;
+        qsort(ref64, n, 8, i64_qcmp);
+        select_sort(a64, n, 8, NULL);
+        for (i = 1; i < n; i++) {
+            if (memcmp(&a64[i - 1], &a64[i], 8) > 0) {
+                printf("select_sort: n=%zu not sorted at %zu!\n", n, i);
+                goto out;
+            }
+        }
+    }
+    printf("pdq_sort/radix_sort test passed\n");
+    ret = 0;
+out:
+    free(ref);
+    free(a);
+    free(orig);
+    free(ref64);
+    free(a64);
+    free(rb);
+    free(rb2);
+    free(rec);
+    return ret;
+}
+
+static int test_parallel(void)
+{
+    static const size_t sizes[] = {0, 1, 1000, 16384 * 2 + 1, 100000, 1000003};
+    struct workq_pool *pool = workq_pool_create_n(5);
+    size_t si, n, i, maxn = 1000003;
+    uint32_t *ref = calloc(maxn, sizeof(uint32_t));
+    uint32_t *a = calloc(maxn, sizeof(uint32_t));
+    uint64_t *a64 = calloc(maxn, sizeof(uint64_t));
+    struct rec *rec = calloc(maxn, sizeof(struct rec));
+    int d, ret = -1;
+
+    if (!pool) {
+        goto out;
+    }
+    for (d = 0; d < DIST_MAX; d++) {
+        for (si = 0; si < sizeof(sizes)/sizeof(sizes[0]); si++) {
+            n = sizes[si];
+            for (i = 0; i < n; i++) ref[i] = gen(d, i, n);
+            memcpy(a, ref, n * 4);
+            for (i = 0; i < n; i++) a64[i] = (uint64_t)ref[i] << 20 | (i & 0xfffff);
+            for (i = 0; i < n; i++) {
+                rec[i].key = ref[i] % 1000;
+                rec[i].seq = (uint32_t)i;
+            }
+            qsort(ref, n, 4, u32_qcmp);
+
+            if (parallel_sort(pool, a, n, 4, u32_cmp) ||
+                check("parallel_sort", a, ref, n * 4, d, n)) goto out;
+            for (i = 0; i < n; i++) a[i] = ref[n - 1 - i];
+            if (parallel_sort_u32(d & 1 ? NULL : pool, a, n) ||
+                check("parallel_sort_u32", a, ref, n * 4, d, n)) goto out;
+            if (parallel_sort_u64(pool, a64, n)) goto out;
+            for (i = 0; i < n; i++) {
+                if ((uint32_t)(a64[i] >> 20) != ref[i] || (i && a64[i - 1] > a64[i])) {
+                    printf("parallel_sort_u64: %s n=%zu mismatch at %zu!\n",
+                           dist_name[d], n, i);
+                    goto out;
+                }
+            }
+            if (parallel_sort_key(pool, rec, n, sizeof(struct rec), 0, 4)) goto out;
+            for (i = 1; i < n; i++) {
+                if (rec[i - 1].key > rec[i].key ||
+                    (rec[i - 1].key == rec[i].key && rec[i - 1].seq > rec[i].seq)) {
+                    printf("parallel_sort_key: %s n=%zu not sorted/stable at %zu!\n",
+                           dist_name[d], n, i);
+                    goto out;
+                }
+            }
+        }
+    }
+    printf("parallel_sort test passed\n");
+    ret = 0;
+out:
+    workq_pool_destroy(pool);
+    free(ref);
+    free(a);
+    free(a64);
+    free(rec);
+    return ret;
+}
+
+#define EXT_IN   "/tmp/test_libsort.in"
+#define EXT_OUT  "/tmp/test_libsort.out"
+
+struct ext_line {
+    const char *p;
+    size_t len;
+};
+
+static int ext_line_qcmp(const void *a, const void *b)
+{
+    const struct ext_line *x = a, *y = b;
+    int ret = memcmp(x->p, y->p, x->len < y->len ? x->len : y->len);
+    return ret ? ret : (x->len > y->len) - (x->len < y->len);
+}
+
+static int rec_key_cmp(const void *a, const void *b, size_t size)
+{
+    uint64_t x, y;
+    memcpy(&x, a, 8);
+    memcpy(&y, b, 8);
+    return (x > y) - (x < y);
+}
+
+static int rec_key_qcmp(const void *a, const void *b)
+{
+    return rec_key_cmp(a, b, 12);
+}
+
+/* fixed 12 byte records keyed by their first 8 bytes */
+static int test_ext_fixed(size_t n, struct ext_sort_conf *conf)
+{
+    size_t len = n * 12, i;
+    unsigned char *ref = malloc(len + 1);
+    unsigned char *res = malloc(len + 1);
+    uint64_t k;
+    ssize_t got;
+    int ret = -1;
+
+    for (i = 0; i < n; i++) {
+        k = rnd() % (n / 2 + 1);
+        memcpy(ref + i * 12, &k, 8);
+        memcpy(ref + i * 12 + 8, &i, 4);
+    }
+    unlink(EXT_OUT);
+    if (len) {
+        file_write_path(EXT_IN, ref, len);
+    } else {
+        fclose(fopen(EXT_IN, "w"));
+    }
+    if (ext_sort(EXT_IN, EXT_OUT, 12, rec_key_cmp, conf)) {
+        printf("ext_sort n=%zu failed!\n", n);
+        goto out;
+    }
+    got = file_get_size(EXT_OUT);
+    if (got != (ssize_t)len || (len && file_read_path(EXT_OUT, res, len) != (ssize_t)len)) {
+        printf("ext_sort n=%zu output %zd bytes!\n", n, got);
+        goto out;
+    }
+    qsort(ref, n, 12, rec_key_qcmp);
+    for (i = 0; i < n; i++) {
+        if (memcmp(ref + i * 12, res + i * 12, 8)) {
+            printf("ext_sort n=%zu mismatch at %zu!\n", n, i);
+            goto out;
+        }
+    }
+    ret = 0;
+out:
+    free(ref);
+    free(res);
+    return ret;
+}
+
+/* random lines of 0..maxlen bytes, the last one without newline */
+static int test_ext_var(size_t n, size_t maxlen, struct ext_sort_conf *conf)
+{
+    struct ext_line *lines = calloc(n + 1, sizeof(struct ext_line));
+    char *text = malloc(n * (maxlen + 1) + 1);
+    char *res = NULL;
+    char *p = text, *q;
+    size_t i, j, len;
+    ssize_t got;
+    int ret = -1;
+
+    for (i = 0; i < n; i++) {
+        len = rnd() % (maxlen + 1);
+        lines[i].p = p;
+        lines[i].len = len;
+        for (j = 0; j < len; j++) {
+            *p++ = 'a' + rnd() % 4;
+        }
+        if (i + 1 < n) {
+            *p++ = '\n';
+        }
+    }
+    len = p - text;
+    unlink(EXT_OUT);
+    if (len) {
+        file_write_path(EXT_IN, text, len);
+    } else {
+        fclose(fopen(EXT_IN, "w"));
+    }
+    if (ext_sort_var(EXT_IN, EXT_OUT, '\n', NULL, conf)) {
+        printf("ext_sort_var n=%zu failed!\n", n);
+        goto out;
+    }
+    /* an empty last line is no record */
+    if (n && lines[n - 1].len == 0) {
+        n--;
+    }
+    qsort(lines, n, sizeof(struct ext_line), ext_line_qcmp);
+    got = file_get_size(EXT_OUT);
+    res = malloc(got + 1);
+    if (got > 0 && file_read_path(EXT_OUT, res, got) != got) {
+        goto out;
+    }
+    for (i = 0, p = res; i < n; i++) {
+        q = memchr(p, '\n', res + got - p);
+        if (!q || (size_t)(q - p) != lines[i].len || memcmp(p, lines[i].p, lines[i].len)) {
+            printf("ext_sort_var n=%zu mismatch at line %zu!\n", n, i);
+            goto out;
+        }
+        p = q + 1;
+    }
+    if (p != res + got) {
+        printf("ext_sort_var n=%zu trailing output!\n", n);
+        goto out;
+    }
+    ret = 0;
+out:
+    free(lines);
+    free(text);
+    free(res);
+    return ret;
+}
+
+static int test_ext_sort(void)
+{
+    struct workq_pool *pool = workq_pool_create_n(3);
+    struct ext_sort_conf small = {0, NULL, NULL};
+    struct ext_sort_conf big = {0, NULL, NULL};
+    struct ext_sort_conf par = {0, NULL, NULL};
+    int ret = -1;
+
+    /* 256K budget: 2-way merges in several passes */
+    small.mem_budget = 256 * 1024;
+    par.mem_budget = 4 * 1024 * 1024;
+    par.pool = pool;
+    if (test_ext_fixed(0, &small) ||
+        test_ext_fixed(1, NULL) ||
+        test_ext_fixed(1000, &big) ||
+        test_ext_fixed(256 * 1024 / 12 * 2, &small) ||
+        test_ext_fixed(300000, &small) ||
+        test_ext_fixed(1000000, &par) ||
+        test_ext_var(0, 10, &small) ||
+        test_ext_var(1, 10, NULL) ||
+        test_ext_var(5000, 40, &big) ||
+        test_ext_var(100000, 30, &small) ||
+        test_ext_var(20000, 3000, &small) ||
+        test_ext_var(300000, 60, &par)) {
+        goto out;
+    }
+    printf("ext_sort test passed\n");
+    ret = 0;
+out:
+    unlink(EXT_IN);
+    unlink(EXT_OUT);
+    workq_pool_destroy(pool);
+    return ret;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+enum algo {
+    ALGO_QSORT,
+    ALGO_HEAP,
+    ALGO_PDQ,
+    ALGO_PDQ_U32,
+    ALGO_RADIX_U32,
+    ALGO_BUBBLE,
+    ALGO_SELECT,
+    ALGO_MAX,
+};
+
+static const char *algo_name[ALGO_MAX] = {
+    "qsort", "heap_sort", "pdq_sort", "pdq_sort_u32", "radix_sort_u32",
+    "bubble_sort", "select_sort",
+};
+
+static double bench_one(enum algo al, uint32_t *a, const uint32_t *src, size_t n)
+{
+    double t;
+
+    memcpy(a, src, n * 4);
+    t = now_ms();
+    switch (al) {
+    case ALGO_QSORT:     qsort(a, n, 4, u32_qcmp); break;
+    case ALGO_HEAP:      heap_sort(a, n, 4, u32_cmp); break;
+    case ALGO_PDQ:       pdq_sort(a, n, 4, u32_cmp); break;
+    case ALGO_PDQ_U32:   pdq_sort_u32(a, n); break;
+    case ALGO_RADIX_U32: radix_sort_u32(a, n); break;
+    case ALGO_BUBBLE:    bubble_sort(a, n, 4, u32_cmp); break;
+    case ALGO_SELECT:    select_sort(a, n, 4, u32_cmp); break;
+    default: break;
+    }
+    return now_ms() - t;
+}
+
+/*
+ * ms per sort of n uint32_t, the O(n^2) sorts only run on n/100 elements
+ * (at most 10000), printed after the @
+ */
+static void bench_sort(size_t n)
+{
+    uint32_t *src = malloc(n * 4);
+    uint32_t *a = malloc(n * 4);
+    size_t small = n / 100 > 10000 ? 10000 : n / 100, i;
+    int d, al;
+
+    printf("%zu uint32_t, ms per sort\n", n);
+    printf("%-12s", "dist");
+    for (al = 0; al < ALGO_MAX; al++) {
+        printf(" %14s", algo_name[al]);
+    }
+    printf("\n");
+    for (d = 0; d < DIST_MAX; d++) {
+        for (i = 0; i < n; i++) src[i] = gen(d, i, n);
+        printf("%-12s", dist_name[d]);
+        for (al = 0; al < ALGO_MAX; al++) {
+            if (al == ALGO_BUBBLE || al == ALGO_SELECT) {
+                for (i = 0; i < small; i++) src[i] = gen(d, i, small);
+                printf(" %11.2f@%zu", bench_one(al, a, src, small), small);
+            } else {
+                printf(" %14.2f", bench_one(al, a, src, n));
+            }
+        }
+        printf("\n");
+    }
+    free(src);
+    free(a);
+}
+
+/* ms per sort of n random uint32_t on 1..threads workq threads */
+static void bench_parallel(size_t n, int threads)
+{
+    uint32_t *src = malloc(n * 4);
+    uint32_t *a = malloc(n * 4);
+    struct workq_pool *pool;
+    double t, t1 = 0, tu = 0;
+    size_t i;
+    int th;
+
+    for (i = 0; i < n; i++) src[i] = gen(DIST_RANDOM, i, n);
+    memcpy(a, src, n * 4);
+    t = now_ms();
+    pdq_sort(a, n, 4, u32_cmp);
+    printf("%zu uint32_t, pdq_sort %.2f ms\n", n, now_ms() - t);
+    printf("%8s %16s %8s %18s %8s\n", "threads", "parallel_sort", "speedup",
+           "parallel_sort_u32", "speedup");
+    for (th = 1; th <= threads; th *= 2) {
+        pool = workq_pool_create_n(th);
+        memcpy(a, src, n * 4);
+        t = now_ms();
+        parallel_sort(pool, a, n, 4, u32_cmp);
+        t = now_ms() - t;
+        if (th == 1) t1 = t;
+        printf("%8d %13.2f ms %7.2fx", th, t, t1 / t);
+        memcpy(a, src, n * 4);
+        t = now_ms();
+        parallel_sort_u32(pool, a, n);
+        t = now_ms() - t;
+        if (th == 1) tu = t;
+        printf(" %15.2f ms %7.2fx\n", t, tu / t);
+        workq_pool_destroy(pool);
+    }
+    free(src);
+    free(a);
+}
+
+/* sort a file of mb MB of 16 byte records with a budget of mem_mb MB */
+static void bench_ext(size_t mb, size_t mem_mb)
+{
+    struct ext_sort_conf conf = {mem_mb << 20, NULL, NULL};
+    size_t n = (mb << 20) / 16, i, step = 1 << 16;
+    uint64_t rec[2 * 65536];
+    struct file *f = file_open(EXT_IN, F_WRCLEAR);
+    double t;
+
+    for (i = 0; i < n; i += step) {
+        size_t j, m = n - i < step ? n - i : step;
+        for (j = 0; j < m; j++) {
+            rec[2 * j] = rnd();
+            rec[2 * j + 1] = i + j;
+        }
+        file_write(f, rec, m * 16);
+    }
+    file_close(f);
+    t = now_ms();
+    if (ext_sort(EXT_IN, EXT_OUT, 16, rec_key_cmp, &conf)) {
+        printf("ext_sort failed!\n");
+    }
+    t = now_ms() - t;
+    printf("ext_sort %zu MB, budget %zu MB: %.0f ms, %.1f MB/s\n",
+           mb, mem_mb, t, mb * 1000.0 / t);
+    unlink(EXT_IN);
+    unlink(EXT_OUT);
+}
+
 int main(int argc, char **argv)
 {
+    if (argc > 3 && !strcmp(argv[1], "ext")) {
+        bench_ext(strtoul(argv[2], NULL, 0), strtoul(argv[3], NULL, 0));
+        return 0;
+    }
+    if (argc > 2) {
+        bench_parallel(strtoul(argv[1], NULL, 0), atoi(argv[2]));
+        return 0;
+    }
+    if (argc > 1) {
+        bench_sort(strtoul(argv[1], NULL, 0));
+        return 0;
+    }
     test_bsort();
     test_heapsort();
-    return 0;
+    if (test_pdq_radix()) {
+        return -1;
+    }
+    if (test_parallel()) {
+        return -1;
+    }
+    return test_ext_sort();
 }
@@ -22,23 +22,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include "libstrex.h"
+#include "strex_simd.h"
 
 char *strtrim(char *s)
 {
-    char *p = s;
-    char *q = s;
-
-    while (*p != '\0') {
-        if (!isspace(*p)) {
-            *q = *p;
-            q++;
-        }
-        p++;
-    }
-    *(q++) = '\0';
+    size_t len = strlen(s);
 
+    s[strex_simd()->trim(s, len)] = '\0';
     return s;
 }
 
@@ -87,26 +78,63 @@ size_t strlcpy(char *dst, const char *src, size_t len)
 
 char *strtolower(char *dst, char *src, size_t n)
 {
-    char *p = dst;
-    while (n) {
-        *dst = tolower(*src);
-        dst++;
-        src++;
-        n--;
-    }
-    return p;
+    strex_simd()->lower(dst, src, n);
+    return dst;
 }
 
 char *strtoupper(char *dst, char *src, size_t n)
 {
-    char *p = dst;
-    while (n) {
-        *dst = toupper(*src);
-        dst++;
-        src++;
-        n--;
+    strex_simd()->upper(dst, src, n);
+    return dst;
+}
+
+char *strfind(const char *s, size_t len, const char *sub, size_t sublen)
+{
+    if (!sublen)
+        return (char *)s;
+    if (sublen > len)
+        return NULL;
+    if (sublen == 1)
+        return (char *)memchr(s, sub[0], len);
+    return (char *)strex_simd()->find(s, len, sub, sublen);
+}
+
+char *strfindi(const char *s, size_t len, const char *sub, size_t sublen)
+{
+    if (!sublen)
+        return (char *)s;
+    if (sublen > len)
+        return NULL;
+    if (sublen == 1) {
+        const char *lo = (const char *)memchr(s, strex_fold((uint8_t)sub[0]), len);
+        const char *up = (const char *)memchr(s, strex_unfold((uint8_t)sub[0]),
+                                              lo ? (size_t)(lo - s) : len);
+        return (char *)(up ? up : lo);
     }
-    return p;
+    return (char *)strex_simd()->findi(s, len, sub, sublen);
+}
+
+char *strstri(const char *s, const char *sub)
+{
+    return strfindi(s, strlen(s), sub, strlen(sub));
+}
+
+int memcasecmp(const void *s1, const void *s2, size_t n)
+{
+    return strex_simd()->casecmp((const uint8_t *)s1, (const uint8_t *)s2, n);
+}
+
+int strcmpi_n(const char *s1, const char *s2, size_t n)
+{
+    size_t l1 = strnlen(s1, n);
+    size_t l2 = strnlen(s2, n);
+    size_t m = l1 < l2 ? l1 : l2;
+    int d = memcasecmp(s1, s2, m);
+
+    if (d || m == n)
+        return d;
+    /* one of them ends at m */
+    return strex_fold((uint8_t)s1[m]) - strex_fold((uint8_t)s2[m]);
 }
 
 /**
@@ -120,7 +148,7 @@ int strhex2bin(char ch)
 {
 	if ((ch >= '0') && (ch <= '9'))
 		return ch - '0';
-	ch = tolower(ch);
+	ch |= 0x20;
 	if ((ch >= 'a') && (ch <= 'f'))
 		return ch - 'a' + 10;
 	return -1;
@@ -222,17 +250,6 @@ size_t base64_decode(void* target, const char *src, size_t bytes)
 }
 
 static const char* s_base16_enc = "0123456789ABCDEF";
-static const uint8_t s_base16_dec[128] = {
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 0, 0, 0, 0, 0, /* 0 - 9 */
-    0,10,11,12,13,14,15, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* A - F */
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0,10,11,12,13,14,15, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* a - f */
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-};
-
 size_t base16_encode(char* target, const void *source, size_t bytes)
 {
     size_t i;
@@ -248,15 +265,9 @@ size_t base16_encode(char* target, const void *source, size_t bytes)
 
 size_t base16_decode(void* target, const char *source, size_t bytes)
 {
-    size_t i;
-    uint8_t* p;
-    p = (uint8_t*)target;
     if (0 != bytes % 2) {
         return -1;
     }
-    for (i = 0; i < bytes / 2; i++) {
-        p[i] = s_base16_dec[source[i * 2] & 0x7F] << 4;
-        p[i] |= s_base16_dec[source[i * 2 + 1] & 0x7F];
-    }
-    return i;
+    strex_simd()->hexdec((uint8_t*)target, source, bytes / 2);
+    return bytes / 2;
 }
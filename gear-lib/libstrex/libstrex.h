@@ -25,6 +25,8 @@
 #include <libposix.h>
 #include <stdlib.h>
 
+#define LIBSTREX_VERSION "0.1.0"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -56,12 +58,53 @@ size_t strlncpy(char *dst, size_t len, const char *src, size_t n);
 
 /**
  * @externtion of string convert uppercase or lowercase
+ *  only ASCII letters are converted, as in the "C" locale, dst may be src
  */
 char *strtoupper(char *dst, char *src, size_t n);
 char *strtolower(char *dst, char *src, size_t n);
 
+/**
+ * @strfind find the first sub[0, sublen) in s[0, len), like memmem
+ * @strfindi ASCII case-insensitive strfind
+ * @strstri ASCII case-insensitive strstr
+ *
+ * @return pointer to the match in s, s for empty sub, or NULL
+ */
+char *strfind(const char *s, size_t len, const char *sub, size_t sublen);
+char *strfindi(const char *s, size_t len, const char *sub, size_t sublen);
+char *strstri(const char *s, const char *sub);
+
+/**
+ * @memcasecmp ASCII case-insensitive memcmp of n bytes
+ * @strcmpi_n ASCII case-insensitive strncmp
+ *
+ * @return difference of the first mismatched bytes in lowercase, or 0
+ */
+int memcasecmp(const void *s1, const void *s2, size_t n);
+int strcmpi_n(const char *s1, const char *s2, size_t n);
+
+/**
+ * @strhex2bin value of a hex digit, or -1
+ */
 int strhex2bin(char ch);
 
+/*
+ * strfind/strfindi/strstri, memcasecmp/strcmpi_n, strtoupper/strtolower,
+ * strtrim and base16_decode run on the best SIMD level of the cpu,
+ * detected at first use, generic code is fallback.
+ * strex_simd_set() forces a level, it is for test and benchmark.
+ */
+enum strex_simd_level {
+    STREX_SIMD_GENERIC = 0,
+    STREX_SIMD_SSE42,
+    STREX_SIMD_AVX2,
+};
+
+int strex_simd_get(void);
+int strex_simd_set(int level);
+int strex_simd_supported(int level);
+const char *strex_simd_name(int level);
+
 GEAR_API size_t base64_encode(char* target, const void *source, size_t bytes);
 GEAR_API size_t base64_encode_url(char* target, const void *source, size_t bytes);
 GEAR_API size_t base64_decode(void* target, const char *source, size_t bytes);
@@ -0,0 +1,636 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include <string.h>
+#include "libstrex.h"
+#include "strex_simd.h"
+
+/*
+ * each level is compiled with target attribute, so the library itself
+ * is built for baseline cpu, the best level is chosen by cpuid at first
+ * use, or forced by strex_simd_set().
+ *
+ * find/findi test the first and the last byte of needle at every position
+ * of a vector, and only compare the whole needle at positions where both
+ * match, see Mula, "SIMD-friendly algorithms for substring searching".
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STREX_SIMD_X86
+#include <immintrin.h>
+#endif
+
+const struct strex_simd_ops *_strex_simd_ops = NULL;
+
+/******************************************************************************
+ * generic, one byte at a time
+ ******************************************************************************/
+static inline int is_space(uint8_t c)
+{
+    return c == ' ' || (unsigned)(c - '\t') < 5;
+}
+
+static const uint8_t s_hex_dec[128] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 0, 0, 0, 0, 0, /* 0 - 9 */
+    0,10,11,12,13,14,15, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* A - F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0,10,11,12,13,14,15, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* a - f */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const char *generic_find(const char *hay, size_t hlen,
+                const char *needle, size_t nlen)
+{
+    const char *p = hay;
+    const char *end;
+
+    if (hlen < nlen)
+        return NULL;
+    end = hay + hlen - nlen + 1;
+    while (p < end) {
+        p = (const char *)memchr(p, needle[0], end - p);
+        if (!p)
+            return NULL;
+        if (!memcmp(p + 1, needle + 1, nlen - 1))
+            return p;
+        p++;
+    }
+    return NULL;
+}
+
+static int generic_casecmp(const uint8_t *s1, const uint8_t *s2, size_t n)
+{
+    size_t i;
+    int d;
+
+    for (i = 0; i < n; i++) {
+        d = strex_fold(s1[i]) - strex_fold(s2[i]);
+        if (d)
+            return d;
+    }
+    return 0;
+}
+
+static const char *generic_findi(const char *hay, size_t hlen,
+                const char *needle, size_t nlen)
+{
+    const uint8_t *h = (const uint8_t *)hay;
+    const uint8_t *n = (const uint8_t *)needle;
+    const uint8_t first = strex_fold(n[0]);
+    size_t i;
+
+    for (i = 0; i + nlen <= hlen; i++) {
+        if (strex_fold(h[i]) == first &&
+            !generic_casecmp(h + i + 1, n + 1, nlen - 1))
+            return hay + i;
+    }
+    return NULL;
+}
+
+static void generic_lower(char *dst, const char *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = (char)strex_fold((uint8_t)src[i]);
+}
+
+static void generic_upper(char *dst, const char *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = (char)strex_unfold((uint8_t)src[i]);
+}
+
+static size_t generic_trim(char *s, size_t len)
+{
+    size_t i, j = 0;
+
+    for (i = 0; i < len; i++) {
+        if (!is_space((uint8_t)s[i]))
+            s[j++] = s[i];
+    }
+    return j;
+}
+
+static void generic_hexdec(uint8_t *dst, const char *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = (s_hex_dec[src[i * 2] & 0x7F] << 4) |
+                 s_hex_dec[src[i * 2 + 1] & 0x7F];
+    }
+}
+
+static const struct strex_simd_ops generic_ops = {
+    STREX_SIMD_GENERIC,
+    "generic",
+    generic_find,
+    generic_findi,
+    generic_casecmp,
+    generic_lower,
+    generic_upper,
+    generic_trim,
+    generic_hexdec,
+};
+
+#ifdef STREX_SIMD_X86
+/******************************************************************************
+ * sse4.2, 128 bits a time
+ ******************************************************************************/
+/* 0xff in bytes of v which are in [lo, lo + n] */
+__attribute__((target("sse4.2")))
+static inline __m128i sse42_range(__m128i v, char lo, char n)
+{
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(n)), t);
+}
+
+__attribute__((target("sse4.2")))
+static inline __m128i sse42_fold(__m128i v)
+{
+    return _mm_or_si128(v, _mm_and_si128(sse42_range(v, 'A', 25),
+                    _mm_set1_epi8(0x20)));
+}
+
+__attribute__((target("sse4.2")))
+static inline __m128i sse42_space(__m128i v)
+{
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                    sse42_range(v, '\t', 4));
+}
+
+/* value of hex digits, 0 for the others, high bit ignored as generic */
+__attribute__((target("sse4.2")))
+static inline __m128i sse42_hexval(__m128i v)
+{
+    __m128i d, a;
+
+    v = _mm_and_si128(v, _mm_set1_epi8(0x7F));
+    d = _mm_and_si128(sse42_range(v, '0', 9),
+                    _mm_sub_epi8(v, _mm_set1_epi8('0')));
+    v = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    a = _mm_and_si128(sse42_range(v, 'a', 5),
+                    _mm_sub_epi8(v, _mm_set1_epi8('a' - 10)));
+    return _mm_or_si128(d, a);
+}
+
+__attribute__((target("sse4.2")))
+static const char *sse42_find(const char *hay, size_t hlen,
+                const char *needle, size_t nlen)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[nlen - 1]);
+    size_t i;
+    unsigned mask;
+
+    for (i = 0; i + nlen - 1 + 16 <= hlen; i += 16) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(hay + i + nlen - 1));
+        mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, b0),
+                                               _mm_cmpeq_epi8(last, b1)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (!memcmp(hay + i + bit + 1, needle + 1, nlen - 2))
+                return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return generic_find(hay + i, hlen - i, needle, nlen);
+}
+
+__attribute__((target("sse4.2")))
+static int sse42_casecmp(const uint8_t *s1, const uint8_t *s2, size_t n)
+{
+    size_t i;
+    unsigned mask;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i a = sse42_fold(_mm_loadu_si128((const __m128i *)(s1 + i)));
+        __m128i b = sse42_fold(_mm_loadu_si128((const __m128i *)(s2 + i)));
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) ^ 0xFFFF;
+        if (mask) {
+            i += __builtin_ctz(mask);
+            return strex_fold(s1[i]) - strex_fold(s2[i]);
+        }
+    }
+    return generic_casecmp(s1 + i, s2 + i, n - i);
+}
+
+__attribute__((target("sse4.2")))
+static const char *sse42_findi(const char *hay, size_t hlen,
+                const char *needle, size_t nlen)
+{
+    const uint8_t *n = (const uint8_t *)needle;
+    const __m128i first = _mm_set1_epi8(strex_fold(n[0]));
+    const __m128i last = _mm_set1_epi8(strex_fold(n[nlen - 1]));
+    size_t i;
+    unsigned mask;
+
+    for (i = 0; i + nlen - 1 + 16 <= hlen; i += 16) {
+        __m128i b0 = sse42_fold(_mm_loadu_si128((const __m128i *)(hay + i)));
+        __m128i b1 = sse42_fold(_mm_loadu_si128(
+                                (const __m128i *)(hay + i + nlen - 1)));
+        mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, b0),
+                                               _mm_cmpeq_epi8(last, b1)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (!sse42_casecmp((const uint8_t *)hay + i + bit + 1, n + 1,
+                               nlen - 2))
+                return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return generic_findi(hay + i, hlen - i, needle, nlen);
+}
+
+__attribute__((target("sse4.2")))
+static void sse42_lower(char *dst, const char *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), sse42_fold(v));
+    }
+    generic_lower(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse4.2")))
+static void sse42_upper(char *dst, const char *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        v = _mm_sub_epi8(v, _mm_and_si128(sse42_range(v, 'a', 25),
+                                          _mm_set1_epi8(0x20)));
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+    generic_upper(dst + i, src + i, n - i);
+}
+
+/*
+ * blocks without white-space are moved as a whole, the output position
+ * is never ahead of the input, so a block store only overwrites bytes
+ * which are already loaded.
+ */
+__attribute__((target("sse4.2")))
+static size_t sse42_trim(char *s, size_t len)
+{
+    size_t i, j = 0;
+    unsigned keep;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        keep = _mm_movemask_epi8(sse42_space(v)) ^ 0xFFFF;
+        if (keep == 0xFFFF) {
+            _mm_storeu_si128((__m128i *)(s + j), v);
+            j += 16;
+            continue;
+        }
+        while (keep) {
+            s[j++] = s[i + __builtin_ctz(keep)];
+            keep &= keep - 1;
+        }
+    }
+    for (; i < len; i++) {
+        if (!is_space((uint8_t)s[i]))
+            s[j++] = s[i];
+    }
+    return j;
+}
+
+/* 32 hex chars to 16 bytes, pairs are merged by hi * 16 + lo in maddubs */
+__attribute__((target("sse4.2")))
+static void sse42_hexdec(uint8_t *dst, const char *src, size_t n)
+{
+    const __m128i weight = _mm_set1_epi16(0x0110);
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i a = sse42_hexval(_mm_loadu_si128((const __m128i *)(src + i * 2)));
+        __m128i b = sse42_hexval(_mm_loadu_si128((const __m128i *)(src + i * 2 + 16)));
+        a = _mm_maddubs_epi16(a, weight);
+        b = _mm_maddubs_epi16(b, weight);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(a, b));
+    }
+    generic_hexdec(dst + i, src + i * 2, n - i);
+}
+
+static const struct strex_simd_ops sse42_ops = {
+    STREX_SIMD_SSE42,
+    "sse4.2",
+    sse42_find,
+    sse42_findi,
+    sse42_casecmp,
+    sse42_lower,
+    sse42_upper,
+    sse42_trim,
+    sse42_hexdec,
+};
+
+/******************************************************************************
+ * avx2, 256 bits a time, tails go to the sse4.2 kernels, which are legacy
+ * sse encoded, so clear the upper halves before, or every call pays the
+ * avx to sse transition penalty
+ ******************************************************************************/
+__attribute__((target("avx2")))
+static inline __m256i avx2_range(__m256i v, char lo, char n)
+{
+    __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(n)), t);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_fold(__m256i v)
+{
+    return _mm256_or_si256(v, _mm256_and_si256(avx2_range(v, 'A', 25),
+                    _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_space(__m256i v)
+{
+    return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                    avx2_range(v, '\t', 4));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_hexval(__m256i v)
+{
+    __m256i d, a;
+
+    v = _mm256_and_si256(v, _mm256_set1_epi8(0x7F));
+    d = _mm256_and_si256(avx2_range(v, '0', 9),
+                    _mm256_sub_epi8(v, _mm256_set1_epi8('0')));
+    v = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    a = _mm256_and_si256(avx2_range(v, 'a', 5),
+                    _mm256_sub_epi8(v, _mm256_set1_epi8('a' - 10)));
+    return _mm256_or_si256(d, a);
+}
+
+__attribute__((target("avx2")))
+static const char *avx2_find(const char *hay, size_t hlen,
+                const char *needle, size_t nlen)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[nlen - 1]);
+    size_t i;
+    uint32_t mask;
+
+    for (i = 0; i + nlen - 1 + 32 <= hlen; i += 32) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(hay + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(hay + i + nlen - 1));
+        mask = _mm256_movemask_epi8(_mm256_and_si256(
+                                    _mm256_cmpeq_epi8(first, b0),
+                                    _mm256_cmpeq_epi8(last, b1)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (!memcmp(hay + i + bit + 1, needle + 1, nlen - 2))
+                return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    _mm256_zeroupper();
+    return sse42_find(hay + i, hlen - i, needle, nlen);
+}
+
+__attribute__((target("avx2")))
+static int avx2_casecmp(const uint8_t *s1, const uint8_t *s2, size_t n)
+{
+    size_t i;
+    uint32_t mask;
+
+    /* two vectors a time, the mismatch is located by the second loop */
+    for (i = 0; i + 64 <= n; i += 64) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(s1 + i));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(s2 + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(s1 + i + 32));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(s2 + i + 32));
+        __m256i eq = _mm256_and_si256(
+                        _mm256_cmpeq_epi8(avx2_fold(a0), avx2_fold(b0)),
+                        _mm256_cmpeq_epi8(avx2_fold(a1), avx2_fold(b1)));
+        if (~(uint32_t)_mm256_movemask_epi8(eq))
+            break;
+    }
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = avx2_fold(_mm256_loadu_si256((const __m256i *)(s1 + i)));
+        __m256i b = avx2_fold(_mm256_loadu_si256((const __m256i *)(s2 + i)));
+        mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+        if (mask) {
+            i += __builtin_ctz(mask);
+            return strex_fold(s1[i]) - strex_fold(s2[i]);
+        }
+    }
+    _mm256_zeroupper();
+    return sse42_casecmp(s1 + i, s2 + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static const char *avx2_findi(const char *hay, size_t hlen,
+                const char *needle, size_t nlen)
+{
+    const uint8_t *n = (const uint8_t *)needle;
+    const __m256i first = _mm256_set1_epi8(strex_fold(n[0]));
+    const __m256i last = _mm256_set1_epi8(strex_fold(n[nlen - 1]));
+    size_t i;
+    uint32_t mask;
+
+    for (i = 0; i + nlen - 1 + 32 <= hlen; i += 32) {
+        __m256i b0 = avx2_fold(_mm256_loadu_si256((const __m256i *)(hay + i)));
+        __m256i b1 = avx2_fold(_mm256_loadu_si256(
+                                (const __m256i *)(hay + i + nlen - 1)));
+        mask = _mm256_movemask_epi8(_mm256_and_si256(
+                                    _mm256_cmpeq_epi8(first, b0),
+                                    _mm256_cmpeq_epi8(last, b1)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (!avx2_casecmp((const uint8_t *)hay + i + bit + 1, n + 1,
+                              nlen - 2))
+                return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    _mm256_zeroupper();
+    return sse42_findi(hay + i, hlen - i, needle, nlen);
+}
+
+__attribute__((target("avx2")))
+static void avx2_lower(char *dst, const char *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), avx2_fold(v));
+    }
+    _mm256_zeroupper();
+    sse42_lower(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void avx2_upper(char *dst, const char *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        v = _mm256_sub_epi8(v, _mm256_and_si256(avx2_range(v, 'a', 25),
+                                                _mm256_set1_epi8(0x20)));
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+    }
+    _mm256_zeroupper();
+    sse42_upper(dst + i, src + i, n - i);
+}
+
+/*
+ * as sse42_trim, mixed blocks are packed 8 bytes a time by pext with
+ * the byte mask of kept bytes, an 8 byte store never passes the group.
+ */
+__attribute__((target("avx2,bmi2,popcnt")))
+static size_t avx2_trim(char *s, size_t len)
+{
+    size_t i, j = 0, k;
+    uint32_t keep;
+    uint64_t w, m;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        keep = ~(uint32_t)_mm256_movemask_epi8(avx2_space(v));
+        if (keep == 0xFFFFFFFF) {
+            _mm256_storeu_si256((__m256i *)(s + j), v);
+            j += 32;
+            continue;
+        }
+        for (k = 0; k < 32; k += 8) {
+            m = _pdep_u64((keep >> k) & 0xFF, 0x0101010101010101ULL) * 0xFF;
+            memcpy(&w, s + i + k, 8);
+            w = _pext_u64(w, m);
+            memcpy(s + j, &w, 8);
+            j += __builtin_popcount((keep >> k) & 0xFF);
+        }
+    }
+    for (; i < len; i++) {
+        if (!is_space((uint8_t)s[i]))
+            s[j++] = s[i];
+    }
+    return j;
+}
+
+__attribute__((target("avx2")))
+static void avx2_hexdec(uint8_t *dst, const char *src, size_t n)
+{
+    const __m256i weight = _mm256_set1_epi16(0x0110);
+    size_t i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i a = avx2_hexval(_mm256_loadu_si256((const __m256i *)(src + i * 2)));
+        __m256i b = avx2_hexval(_mm256_loadu_si256((const __m256i *)(src + i * 2 + 32)));
+        a = _mm256_maddubs_epi16(a, weight);
+        b = _mm256_maddubs_epi16(b, weight);
+        /* packus works in 128 bit lanes, put the quadwords back in order */
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(
+                                _mm256_packus_epi16(a, b), 0xD8));
+    }
+    _mm256_zeroupper();
+    sse42_hexdec(dst + i, src + i * 2, n - i);
+}
+
+static const struct strex_simd_ops avx2_ops = {
+    STREX_SIMD_AVX2,
+    "avx2",
+    avx2_find,
+    avx2_findi,
+    avx2_casecmp,
+    avx2_lower,
+    avx2_upper,
+    avx2_trim,
+    avx2_hexdec,
+};
+#endif
+
+static const struct strex_simd_ops *simd_ops_of(int level)
+{
+#ifdef STREX_SIMD_X86
+    __builtin_cpu_init();
+    switch (level) {
+    case STREX_SIMD_GENERIC:
+        return &generic_ops;
+    case STREX_SIMD_SSE42:
+        if (__builtin_cpu_supports("sse4.2"))
+            return &sse42_ops;
+        break;
+    case STREX_SIMD_AVX2:
+        if (__builtin_cpu_supports("avx2") &&
+            __builtin_cpu_supports("bmi2") &&
+            __builtin_cpu_supports("popcnt"))
+            return &avx2_ops;
+        break;
+    default:
+        break;
+    }
+    return NULL;
+#else
+    return level == STREX_SIMD_GENERIC ? &generic_ops : NULL;
+#endif
+}
+
+const struct strex_simd_ops *strex_simd_detect(void)
+{
+    const struct strex_simd_ops *ops = NULL;
+    int level;
+
+    for (level = STREX_SIMD_AVX2; level >= 0 && !ops; level--)
+        ops = simd_ops_of(level);
+    /* every thread detects the same, no lock is needed */
+    _strex_simd_ops = ops;
+    return ops;
+}
+
+int strex_simd_get(void)
+{
+    return strex_simd()->level;
+}
+
+int strex_simd_supported(int level)
+{
+    return simd_ops_of(level) != NULL;
+}
+
+int strex_simd_set(int level)
+{
+    const struct strex_simd_ops *ops = simd_ops_of(level);
+    if (!ops)
+        return -1;
+    _strex_simd_ops = ops;
+    return 0;
+}
+
+const char *strex_simd_name(int level)
+{
+    const struct strex_simd_ops *ops = simd_ops_of(level);
+    return ops ? ops->name : "unsupported";
+}
@@ -0,0 +1,72 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef STREX_SIMD_H
+#define STREX_SIMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * internal, byte kernels of string operations. all lengths are explicit,
+ * kernels never read outside [p, p + len), NUL is an ordinary byte.
+ * case folding is ASCII only, as tolower()/toupper() in the "C" locale.
+ */
+static inline uint8_t strex_fold(uint8_t c)
+{
+    return c + (((unsigned)(c - 'A') < 26) << 5);
+}
+
+static inline uint8_t strex_unfold(uint8_t c)
+{
+    return c - (((unsigned)(c - 'a') < 26) << 5);
+}
+
+struct strex_simd_ops {
+    int level;
+    const char *name;
+    /* first match of needle in hay, 2 <= nlen <= hlen, or NULL */
+    const char *(*find)(const char *hay, size_t hlen,
+                    const char *needle, size_t nlen);
+    const char *(*findi)(const char *hay, size_t hlen,
+                    const char *needle, size_t nlen);
+    /* folded (lowercase) difference of the first mismatch, 0 if equal */
+    int (*casecmp)(const uint8_t *s1, const uint8_t *s2, size_t n);
+    void (*lower)(char *dst, const char *src, size_t n);
+    void (*upper)(char *dst, const char *src, size_t n);
+    /* remove white-space of s[0, len) in place, return the new length */
+    size_t (*trim)(char *s, size_t len);
+    /* decode 2 * n hex chars to n bytes, bad char decodes as 0 */
+    void (*hexdec)(uint8_t *dst, const char *src, size_t n);
+};
+
+extern const struct strex_simd_ops *_strex_simd_ops;
+const struct strex_simd_ops *strex_simd_detect(void);
+
+static inline const struct strex_simd_ops *strex_simd(void)
+{
+    const struct strex_simd_ops *ops = _strex_simd_ops;
+    if (UNLIKELY(!ops))
+        ops = strex_simd_detect();
+    return ops;
+}
+
+#endif
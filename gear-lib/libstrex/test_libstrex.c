@@ -19,10 +19,12 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  ******************************************************************************/
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/time.h>
 #include "libstrex.h"
 
 void base64_test()
@@ -46,7 +48,7 @@ void base64_test()
 void strex_test()
 {
     char *mix = "Hello World";
-    char tmp[10] = "\n\t a\nb\t cd";
+    char tmp[16] = "\n\t a\nb\t cd";
     char upper[20] = {0};
     char lower[20] = {0};
     printf("tmp=%s\n", tmp);
@@ -55,9 +57,316 @@ void strex_test()
     printf("strtoupper()=%s\n", strtoupper(upper, mix, strlen(mix)));
 }
 
+static double epoch_double(void)
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + (t.tv_usec * 1.0) / 1000000.0;
+}
+
+static const char s_alphabet[] = "aAbB \t\r\n0F9f:-";
+
+static void random_str(char *s, size_t len, int nchar)
+{
+    size_t i;
+    for (i = 0; i < len; i++) {
+        s[i] = (rand() % 50 == 0) ? (char)(rand() % 256) : s_alphabet[rand() % nchar];
+    }
+}
+
+static char *ref_find(const char *s, size_t len, const char *sub, size_t sublen, int icase)
+{
+    size_t i, j;
+    for (i = 0; i + sublen <= len; i++) {
+        for (j = 0; j < sublen; j++) {
+            int a = (unsigned char)s[i + j], b = (unsigned char)sub[j];
+            if (icase && a < 128 && b < 128) {
+                a = tolower(a);
+                b = tolower(b);
+            }
+            if (a != b) {
+                break;
+            }
+        }
+        if (j == sublen) {
+            return (char *)s + i;
+        }
+    }
+    return NULL;
+}
+
+static int ref_casecmp(const char *s1, const char *s2, size_t n)
+{
+    size_t i;
+    for (i = 0; i < n; i++) {
+        int a = (unsigned char)s1[i], b = (unsigned char)s2[i];
+        a = a < 128 ? tolower(a) : a;
+        b = b < 128 ? tolower(b) : b;
+        if (a != b) {
+            return a - b;
+        }
+    }
+    return 0;
+}
+
+static int sign(int v)
+{
+    return (v > 0) - (v < 0);
+}
+
+/* every level must give the same result as the byte by byte reference */
+static int test_simd(void)
+{
+    static const size_t sizes[] = {0, 1, 2, 15, 16, 17, 31, 32, 33, 63, 64, 100, 257, 1000};
+    char s[1100], t[1100], d0[1100], d1[1100], sub[40];
+    size_t i, j, k, len, sublen, n;
+    int best = strex_simd_get();
+    int level, err = 0, r;
+
+    for (level = STREX_SIMD_GENERIC; level <= STREX_SIMD_AVX2; level++) {
+        if (!strex_simd_supported(level)) {
+            printf("%15s: not supported\n", strex_simd_name(level));
+            continue;
+        }
+        strex_simd_set(level);
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            len = sizes[i];
+            for (j = 0; j < 200; j++) {
+                random_str(s, len, 2 + j % 13);
+                s[len] = '\0';
+
+                /* needles cut from s hit matches, random ones mostly miss */
+                sublen = rand() % 36;
+                if (j % 2 && sublen <= len) {
+                    memcpy(sub, s + rand() % (len - sublen + 1), sublen);
+                    for (k = 0; k < sublen; k++) {
+                        if (rand() % 3 == 0 && isalpha((unsigned char)sub[k])) {
+                            sub[k] ^= 0x20;
+                        }
+                    }
+                } else {
+                    random_str(sub, sublen, 2 + j % 13);
+                }
+                err += strfind(s, len, sub, sublen) != ref_find(s, len, sub, sublen, 0);
+                err += strfindi(s, len, sub, sublen) != ref_find(s, len, sub, sublen, 1);
+
+                memcpy(t, s, len);
+                for (k = 0; k < len; k++) {
+                    if (rand() % 2 && isalpha((unsigned char)t[k])) {
+                        t[k] ^= 0x20;
+                    }
+                }
+                if (len && j % 3 == 0) {
+                    t[rand() % len] = s_alphabet[rand() % 14];
+                }
+                r = memcasecmp(s, t, len);
+                err += sign(r) != sign(ref_casecmp(s, t, len));
+
+                for (k = 0; k < len; k++) {
+                    unsigned char c = s[k];
+                    d0[k] = c < 128 ? tolower(c) : c;
+                }
+                strtolower(d1, s, len);
+                err += memcmp(d0, d1, len) != 0;
+                for (k = 0; k < len; k++) {
+                    unsigned char c = s[k];
+                    d0[k] = c < 128 ? toupper(c) : c;
+                }
+                memcpy(d1, s, len);
+                strtoupper(d1, d1, len);
+                err += memcmp(d0, d1, len) != 0;
+
+                /* trim stops at the first NUL */
+                for (k = n = 0; s[k]; k++) {
+                    if (!isspace((unsigned char)s[k])) {
+                        d0[n++] = s[k];
+                    }
+                }
+                d0[n] = '\0';
+                memcpy(d1, s, len + 1);
+                err += strcmp(strtrim(d1), d0) != 0;
+
+                for (k = 0; k < len / 2; k++) {
+                    int hi = strhex2bin(s[k * 2] & 0x7F);
+                    int lo = strhex2bin(s[k * 2 + 1] & 0x7F);
+                    d0[k] = ((hi < 0 ? 0 : hi) << 4) | (lo < 0 ? 0 : lo);
+                }
+                err += base16_decode(d1, s, len / 2 * 2) != len / 2;
+                err += memcmp(d0, d1, len / 2) != 0;
+            }
+        }
+        err += strstri("Content-Length: 10", "content-length") == NULL;
+        err += strstri("CSeq: 2", "cseq:") == NULL;
+        err += strcmpi_n("Session: 1", "SESSION: 2", 8) != 0;
+        err += strcmpi_n("abc", "ABCD", 8) >= 0;
+        err += strcmpi_n("abcd", "ABC", 8) <= 0;
+        err += strfindi("xxA", 3, "a", 1) == NULL;
+        err += strfindi("x\xe9", 2, "\xc9", 1) != NULL;
+        printf("%15s: %s\n", strex_simd_name(level), err ? "failed" : "ok");
+    }
+    strex_simd_set(best);
+    return err;
+}
+
+#define BENCH_BYTES     (1UL << 28)
+
+static char *old_tolower(char *dst, char *src, size_t n)
+{
+    char *p = dst;
+    while (n) {
+        *dst = tolower(*src);
+        dst++;
+        src++;
+        n--;
+    }
+    return p;
+}
+
+static char *old_strstri(const char *str, const char *find)
+{
+    size_t len = strlen(find);
+    do {
+        if (strncasecmp(str, find, len) == 0) {
+            return (char *)str;
+        }
+    } while (*str++);
+    return NULL;
+}
+
+/*
+ * GB/s of each op on each level, every cell processes BENCH_BYTES,
+ * "libc" is the byte by byte code or libc call it replaces
+ */
+static void bench(size_t max_len)
+{
+    static const char needle[] = "Content-Length:";
+    static const char s_header[] = "CSeq: 3\r\nContent-Type: application/sdp\r\n"
+                                   "Cache-Control: no-cache\r\nSession: 12345678\r\n";
+    char *s, *t, *d;
+    size_t len, loops, n;
+    unsigned long sum = 0;
+    int level;
+    double t1, t2;
+
+    s = (char *)malloc(max_len + 1);
+    t = (char *)malloc(max_len + 1);
+    d = (char *)malloc(max_len + 1);
+
+    printf("\n%8s %8s %8s %8s %8s %8s %8s %8s %8s\n", "len", "level",
+           "find", "findi", "casecmp", "lower", "trim", "hexdec", "strstri");
+    for (len = 64; len <= max_len; len *= 8) {
+        loops = BENCH_BYTES / len;
+        /* rtsp header lines, the needle at the end */
+        for (n = 0; n < len; n++) {
+            s[n] = s_header[n % (sizeof(s_header) - 1)];
+        }
+        memcpy(s + len - sizeof(needle) + 1, needle, sizeof(needle) - 1);
+        s[len] = '\0';
+        for (n = 0; n <= len; n++) {
+            t[n] = toupper((unsigned char)s[n]);
+        }
+        for (level = -1; level <= STREX_SIMD_AVX2; level++) {
+            if (level >= 0 && strex_simd_set(level) < 0) {
+                continue;
+            }
+            printf("%8zu %8s", len, level < 0 ? "libc" : strex_simd_name(level));
+
+            t1 = epoch_double();
+            for (n = 0; n < loops; n++) {
+                sum += level < 0 ? (size_t)memmem(s, len, needle, sizeof(needle) - 1)
+                                 : (size_t)strfind(s, len, needle, sizeof(needle) - 1);
+            }
+            t2 = epoch_double();
+            printf(" %8.2f", BENCH_BYTES / (t2 - t1) / 1e9);
+
+            t1 = epoch_double();
+            for (n = 0; n < loops; n++) {
+                sum += level < 0 ? (size_t)strcasestr(s, needle)
+                                 : (size_t)strfindi(s, len, needle, sizeof(needle) - 1);
+            }
+            t2 = epoch_double();
+            printf(" %8.2f", BENCH_BYTES / (t2 - t1) / 1e9);
+
+            t1 = epoch_double();
+            for (n = 0; n < loops; n++) {
+                sum += level < 0 ? strncasecmp(s, t, len) : strcmpi_n(s, t, len);
+            }
+            t2 = epoch_double();
+            printf(" %8.2f", BENCH_BYTES / (t2 - t1) / 1e9);
+
+            t1 = epoch_double();
+            for (n = 0; n < loops; n++) {
+                if (level < 0) {
+                    old_tolower(d, t, len);
+                } else {
+                    strtolower(d, t, len);
+                }
+                sum += d[n % len];
+            }
+            t2 = epoch_double();
+            printf(" %8.2f", BENCH_BYTES / (t2 - t1) / 1e9);
+
+            /* trim works in place, refill the buffer each time */
+            t1 = epoch_double();
+            for (n = 0; n < loops; n++) {
+                memcpy(d, s, len + 1);
+                if (level < 0) {
+                    char *p = d, *q = d;
+                    for (; *p; p++) {
+                        if (!isspace(*p)) {
+                            *q++ = *p;
+                        }
+                    }
+                    *q = '\0';
+                } else {
+                    strtrim(d);
+                }
+                sum += d[0];
+            }
+            t2 = epoch_double();
+            printf(" %8.2f", BENCH_BYTES / (t2 - t1) / 1e9);
+
+            t1 = epoch_double();
+            for (n = 0; n < loops; n++) {
+                if (level < 0) {
+                    size_t k;
+                    for (k = 0; k < len / 2; k++) {
+                        int hi = strhex2bin(s[k * 2]), lo = strhex2bin(s[k * 2 + 1]);
+                        d[k] = ((hi < 0 ? 0 : hi) << 4) | (lo < 0 ? 0 : lo);
+                    }
+                } else {
+                    base16_decode(d, s, len);
+                }
+                sum += d[n % (len / 2)];
+            }
+            t2 = epoch_double();
+            printf(" %8.2f", BENCH_BYTES / (t2 - t1) / 1e9);
+
+            t1 = epoch_double();
+            for (n = 0; n < loops; n++) {
+                sum += level < 0 ? (size_t)old_strstri(s, needle) : (size_t)strstri(s, needle);
+            }
+            t2 = epoch_double();
+            printf(" %8.2f\n", BENCH_BYTES / (t2 - t1) / 1e9);
+        }
+    }
+    printf("(GB/s, checksum %lu)\n", sum);
+    free(s);
+    free(t);
+    free(d);
+}
+
 int main(int argc, char **argv)
 {
+    int err = 0;
     base64_test();
     strex_test();
-    return 0;
+    printf("%15s: %s\n", "simd level", strex_simd_name(strex_simd_get()));
+    err += test_simd();
+    if (argc > 2 && !strcmp(argv[1], "bench")) {
+        bench(atoi(argv[2]));
+    } else if (argc > 1 && !strcmp(argv[1], "bench")) {
+        bench(1 << 18);
+    }
+    return err;
 }
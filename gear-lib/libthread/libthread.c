@@ -82,6 +82,10 @@ struct thread *thread_create(void *(*func)(struct thread *, void *), void *arg)
         }
         break;
     case THREAD_LOCK_COND:
+        if (0 != mutex_lock_init(&t->lock.mutex)) {
+            printf("mutex_lock_init failed\n");
+            goto err;
+        }
         if (0 != mutex_cond_init(&t->cond)) {
             printf("mutex_cond_init failed\n");
             goto err;
@@ -217,6 +221,7 @@ int thread_lock(struct thread *t)
     }
     switch (t->type) {
     case THREAD_LOCK_MUTEX:
+    case THREAD_LOCK_COND:
         return mutex_lock(&t->lock.mutex);
         break;
     case THREAD_LOCK_SPIN:
@@ -235,6 +240,7 @@ int thread_unlock(struct thread *t)
     }
     switch (t->type) {
     case THREAD_LOCK_MUTEX:
+    case THREAD_LOCK_COND:
         return mutex_unlock(&t->lock.mutex);
         break;
     case THREAD_LOCK_SPIN:
@@ -8,11 +8,68 @@ extern "C"
 {
 #endif
 
+#define LIBUTF2GBK_VERSION "0.1.0"
+
+/* written for a code point without gbk mapping */
+#ifndef UTF2GBK_REPLACEMENT
+#define UTF2GBK_REPLACEMENT '?'
+#endif
+
+enum utf2gbk_result {
+	UTF2GBK_INVALID = -1,	/* invalid utf-8 at in + consumed */
+	UTF2GBK_OK = 0,		/* all input is done */
+	UTF2GBK_PARTIAL = 1,	/* input ends inside a sequence, pass it again with more */
+	UTF2GBK_FULL = 2,	/* no room in out for the next char */
+};
+
+/*
+ * utf8_to_gbk - convert a chunk of utf-8 to gbk, ascii is copied as is
+ * @consumed: bytes of in which are converted
+ * @produced: bytes written to out
+ *
+ * for chunked input keep in[consumed, in_len) and pass it in front of the
+ * next chunk when UTF2GBK_PARTIAL; for chunked output flush out[0, produced)
+ * and call again from in + consumed when UTF2GBK_FULL.
+ */
+int utf8_to_gbk(char *out, size_t out_len, const char *in, size_t in_len,
+		size_t *consumed, size_t *produced);
+
+/*
+ * utf8_validate - check RFC 3629 utf-8
+ * @valid: length of the valid prefix, may be NULL
+ * return UTF2GBK_OK, UTF2GBK_PARTIAL if the tail is a truncated sequence,
+ * or UTF2GBK_INVALID
+ */
+int utf8_validate(const char *in, size_t len, size_t *valid);
+
+/* gbk code of unicode, 0 if there is none */
+unsigned short unicode_to_gbk(unsigned int unicode);
+
+/*
+ * return 1 if pInput[0, pLen) is converted, 0 on invalid utf-8 or on a
+ * sequence cut at pLen, no NUL is added
+ */
 int  UTF_8ToGB2312(char*pOut, char *pInput, int pLen);
 int UTF_8ToUnicode(char* pOutput, char *pInput);
 void UnicodeToGB2312(char*pOut, char *pInput);
 
+/*
+ * utf8_to_gbk and utf8_validate run on the best SIMD level of the cpu,
+ * detected at first use, generic code is fallback.
+ * utf2gbk_simd_set() forces a level, it is for test and benchmark.
+ */
+enum utf2gbk_simd_level {
+	UTF2GBK_SIMD_GENERIC = 0,
+	UTF2GBK_SIMD_SSE42,
+	UTF2GBK_SIMD_AVX2,
+};
+
+int utf2gbk_simd_get(void);
+int utf2gbk_simd_set(int level);
+int utf2gbk_simd_supported(int level);
+const char *utf2gbk_simd_name(int level);
+
 #ifdef __cplusplus
 }
 #endif
-#endif /* __UTF2GBK_H__ */
\ No newline at end of file
+#endif /* __UTF2GBK_H__ */
@@ -1,14 +1,341 @@
 #include <stdio.h> 
 #include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
 #include "libutf2gbk.h"
 
-int main()
+static double epoch_double(void)
+{
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + (t.tv_usec * 1.0) / 1000000.0;
+}
+
+/* append one code point as utf-8 */
+static size_t put_utf8(uint8_t *p, uint32_t cp)
+{
+	if (cp < 0x80) {
+		p[0] = cp;
+		return 1;
+	} else if (cp < 0x800) {
+		p[0] = 0xC0 | (cp >> 6);
+		p[1] = 0x80 | (cp & 0x3F);
+		return 2;
+	} else if (cp < 0x10000) {
+		p[0] = 0xE0 | (cp >> 12);
+		p[1] = 0x80 | ((cp >> 6) & 0x3F);
+		p[2] = 0x80 | (cp & 0x3F);
+		return 3;
+	}
+	p[0] = 0xF0 | (cp >> 18);
+	p[1] = 0x80 | ((cp >> 12) & 0x3F);
+	p[2] = 0x80 | ((cp >> 6) & 0x3F);
+	p[3] = 0x80 | (cp & 0x3F);
+	return 4;
+}
+
+static uint32_t random_cp(int kind)
+{
+	uint32_t cp;
+	switch (kind % 4) {
+	case 0:
+		return rand() % 0x80;
+	case 1:
+		return 0x80 + rand() % (0x800 - 0x80);
+	case 2:
+		/* mostly cjk */
+		if (rand() % 4)
+			return 0x4E00 + rand() % (0x9FA5 - 0x4E00);
+		do {
+			cp = 0x800 + rand() % (0x10000 - 0x800);
+		} while (cp >= 0xD800 && cp < 0xE000);
+		return cp;
+	default:
+		return 0x10000 + rand() % (0x110000 - 0x10000);
+	}
+}
+
+/*
+ * reference by the table of RFC 3629: well-formed byte sequences,
+ * returns UTF2GBK_* as utf8_validate
+ */
+static int ref_validate(const uint8_t *s, size_t len, size_t *valid)
+{
+	size_t i = 0, k, n;
+	uint8_t c, lo, hi;
+
+	while (i < len) {
+		c = s[i];
+		lo = 0x80;
+		hi = 0xBF;
+		if (c <= 0x7F) {
+			i++;
+			continue;
+		} else if (c >= 0xC2 && c <= 0xDF) {
+			n = 2;
+		} else if (c >= 0xE0 && c <= 0xEF) {
+			n = 3;
+			lo = c == 0xE0 ? 0xA0 : 0x80;
+			hi = c == 0xED ? 0x9F : 0xBF;
+		} else if (c >= 0xF0 && c <= 0xF4) {
+			n = 4;
+			lo = c == 0xF0 ? 0x90 : 0x80;
+			hi = c == 0xF4 ? 0x8F : 0xBF;
+		} else {
+			*valid = i;
+			return UTF2GBK_INVALID;
+		}
+		for (k = 1; k < n; k++) {
+			if (i + k >= len) {
+				*valid = i;
+				return UTF2GBK_PARTIAL;
+			}
+			if (s[i + k] < (k == 1 ? lo : 0x80) || s[i + k] > (k == 1 ? hi : 0xBF)) {
+				*valid = i;
+				return UTF2GBK_INVALID;
+			}
+		}
+		i += n;
+	}
+	*valid = i;
+	return UTF2GBK_OK;
+}
+
+static size_t random_text(uint8_t *buf, size_t len, int mix)
+{
+	size_t n = 0;
+	while (n + 4 <= len) {
+		n += put_utf8(buf + n, random_cp(mix < 4 ? mix : rand() % 4));
+	}
+	return n;
+}
+
+static int test_known(void)
 {
 	char buf[] = "nininihhahahhh你好呀你好呀哈哈哈";
-	char buf2[(strlen(buf) + 1) * 6];
-	
-	UTF_8ToGB2312(buf2,buf,strlen(buf));
-	printf("buf : %s \nbuf 2 : %s \n",buf,buf2);
-	printf("utf8-len : %lu,gb2312-len : %lu\n",strlen(buf),strlen(buf2));
+	const char gbk[] = "nininihhahahhh\xC4\xE3\xBA\xC3\xD1\xBD\xC4\xE3\xBA\xC3\xD1\xBD"
+			   "\xB9\xFE\xB9\xFE\xB9\xFE";
+	char buf2[sizeof(buf)];
+	int err = 0;
+
+	memset(buf2, 0, sizeof(buf2));
+	err += UTF_8ToGB2312(buf2, buf, strlen(buf)) != 1;
+	err += strcmp(buf2, gbk) != 0;
+	printf("buf : %s \nbuf 2 : %s \n", buf, buf2);
+	printf("utf8-len : %lu,gb2312-len : %lu\n", strlen(buf), strlen(buf2));
+	/* the first and the last entries of the table */
+	err += unicode_to_gbk(0x00A4) != 0xA1E8;
+	err += unicode_to_gbk(0xFFE5) != 0xA3A4;
+	err += unicode_to_gbk(0x00A5) != 0;
+	err += unicode_to_gbk(0x1F600) != 0;
+	err += UTF_8ToGB2312(buf2, "\xC0\x80", 2) != 0;
+	err += UTF_8ToGB2312(buf2, "\xED\xA0\x80", 3) != 0;
+	err += UTF_8ToGB2312(buf2, "\xE4\xB8", 2) != 0;
+	return err;
+}
+
+/* every level must give the same result as the reference */
+static int test_validate(void)
+{
+	static const uint8_t bad[][4] = {
+		{0xC0, 0x80}, {0xC1, 0xBF}, {0xE0, 0x80, 0x80}, {0xE0, 0x9F, 0xBF},
+		{0xED, 0xA0, 0x80}, {0xED, 0xBF, 0xBF}, {0xF0, 0x8F, 0xBF, 0xBF},
+		{0xF4, 0x90, 0x80, 0x80}, {0xF5, 0x80, 0x80, 0x80}, {0xFF}, {0x80},
+		{0xE4, 0xBD}, {0xF0, 0x9F, 0x98},
+	};
+	uint8_t buf[600];
+	size_t len, v0, v1, pos, k;
+	int best = utf2gbk_simd_get();
+	int level, i, r0, r1, err = 0;
+
+	for (level = UTF2GBK_SIMD_GENERIC; level <= UTF2GBK_SIMD_AVX2; level++) {
+		if (!utf2gbk_simd_supported(level)) {
+			printf("%15s: not supported\n", utf2gbk_simd_name(level));
+			continue;
+		}
+		utf2gbk_simd_set(level);
+		for (i = 0; i < 20000; i++) {
+			len = random_text(buf, 4 + rand() % (sizeof(buf) - 4), i % 5);
+			switch (i % 4) {
+			case 0:
+				break;
+			case 1:
+				/* a random byte */
+				if (len)
+					buf[rand() % len] = rand() % 256;
+				break;
+			case 2:
+				/* a known bad sequence */
+				k = rand() % (sizeof(bad) / sizeof(bad[0]));
+				if (len >= 4) {
+					pos = rand() % (len - 3);
+					memcpy(buf + pos, bad[k], 4);
+				}
+				break;
+			default:
+				/* cut anywhere */
+				len = rand() % (len + 1);
+				break;
+			}
+			r0 = ref_validate(buf, len, &v0);
+			r1 = utf8_validate((const char *)buf, len, &v1);
+			if (r0 != r1 || v0 != v1) {
+				err++;
+			}
+		}
+		printf("%15s: %s\n", utf2gbk_simd_name(level), err ? "failed" : "ok");
+	}
+	utf2gbk_simd_set(best);
+	return err;
+}
+
+/* one call and random chunks of in and out give the same bytes */
+static int test_stream(void)
+{
+	static uint8_t text[8192];
+	static char one[8192], many[8192];
+	size_t len, n0, n1, consumed, produced, in_pos, out_pos, in_end, out_end;
+	int i, r, err = 0;
+
+	for (i = 0; i < 300; i++) {
+		len = random_text(text, sizeof(text), i % 5);
+		r = utf8_to_gbk(one, sizeof(one), (const char *)text, len, &n0, &n1);
+		err += r != UTF2GBK_OK || n0 != len;
+
+		in_pos = out_pos = 0;
+		in_end = 0;
+		while (in_pos < len) {
+			/* the caller grows the input window, and drains a small out */
+			if (in_end < len) {
+				in_end += 1 + rand() % 40;
+				in_end = in_end > len ? len : in_end;
+			}
+			out_end = out_pos + 1 + rand() % 40;
+			r = utf8_to_gbk(many + out_pos, out_end - out_pos, (const char *)text + in_pos,
+					in_end - in_pos, &consumed, &produced);
+			if (r == UTF2GBK_INVALID || (r == UTF2GBK_PARTIAL && in_end == len)) {
+				err++;
+				break;
+			}
+			in_pos += consumed;
+			out_pos += produced;
+		}
+		err += out_pos != n1 || memcmp(one, many, n1) != 0;
+	}
+	r = utf8_to_gbk(one, sizeof(one), "ab\xE4\xBD", 4, &n0, &n1);
+	err += r != UTF2GBK_PARTIAL || n0 != 2 || n1 != 2;
+	r = utf8_to_gbk(one, 3, "ab\xE4\xBD\xA0", 5, &n0, &n1);
+	err += r != UTF2GBK_FULL || n0 != 2 || n1 != 2;
+	r = utf8_to_gbk(one, 3, "ab\xF0\x9F\x98\x80", 6, &n0, &n1);
+	err += r != UTF2GBK_OK || n0 != 6 || n1 != 3 || one[2] != UTF2GBK_REPLACEMENT;
+	printf("stream test %s\n", err ? "failed" : "ok");
+	return err;
+}
+
+/* the code before: UTF_8ToUnicode, then binary search of the sorted pairs */
+static uint16_t s_pair_uni[22000], s_pair_gbk[22000];
+static int s_pairs;
+
+static unsigned short old_search(unsigned short unicode)
+{
+	int mid, start = 0, end = s_pairs - 1;
+	while (start <= end) {
+		mid = (start + end) / 2;
+		if (s_pair_uni[mid] == unicode)
+			return s_pair_gbk[mid];
+		else if (s_pair_uni[mid] < unicode)
+			start = mid + 1;
+		else
+			end = mid - 1;
+	}
 	return 0;
-}
\ No newline at end of file
+}
+
+static int old_utf8_to_gb2312(char *pOut, char *pInput, int pLen)
+{
+	int res, i = 0, j = 0;
+	char tempbuf[10];
+	unsigned short uni, gb;
+	memset(tempbuf, 0, sizeof(tempbuf));
+	while (i < pLen) {
+		res = UTF_8ToUnicode(tempbuf, pInput + i);
+		if (res <= 0)
+			return 0;
+		else if (res == 1) {
+			pOut[j++] = pInput[i];
+		} else {
+			memcpy(&uni, tempbuf, 2);
+			gb = old_search(uni);
+			pOut[j++] = gb >> 8;
+			pOut[j++] = gb;
+		}
+		i += res;
+	}
+	return 1;
+}
+
+/* MB/s of utf-8 input, for ascii, chinese and mixed text */
+static void bench(int mb)
+{
+	static const char *kinds[] = {"ascii", "cjk", "mixed"};
+	size_t len = (size_t)mb << 20, n, consumed, produced, v;
+	uint8_t *text = malloc(len + 4);
+	char *out = malloc(len + 4);
+	double t1, t2;
+	int kind, level;
+	uint32_t u;
+
+	for (u = 0; u < 0x10000; u++) {
+		if (unicode_to_gbk(u)) {
+			s_pair_uni[s_pairs] = u;
+			s_pair_gbk[s_pairs++] = unicode_to_gbk(u);
+		}
+	}
+	printf("\n%8s %8s %10s %10s\n", "text", "level", "validate", "to_gbk");
+	for (kind = 0; kind < 3; kind++) {
+		for (n = 0; n + 4 <= len;) {
+			if (kind == 0)
+				u = 0x20 + rand() % 0x5F;
+			else if (kind == 1)
+				u = 0x4E00 + rand() % (0x9FA5 - 0x4E00);
+			else
+				u = rand() % 8 ? 0x20 + rand() % 0x5F : 0x4E00 + rand() % 0x5000;
+			n += put_utf8(text + n, u);
+		}
+		for (level = -1; level <= UTF2GBK_SIMD_AVX2; level++) {
+			if (level >= 0 && utf2gbk_simd_set(level) < 0)
+				continue;
+			printf("%8s %8s", kinds[kind], level < 0 ? "old" : utf2gbk_simd_name(level));
+			if (level < 0) {
+				printf(" %10s", "-");
+				t1 = epoch_double();
+				old_utf8_to_gb2312(out, (char *)text, n);
+				t2 = epoch_double();
+			} else {
+				t1 = epoch_double();
+				utf8_validate((const char *)text, n, &v);
+				t2 = epoch_double();
+				printf(" %10.1f", n / (t2 - t1) / 1e6);
+				t1 = epoch_double();
+				utf8_to_gbk(out, len, (const char *)text, n, &consumed, &produced);
+				t2 = epoch_double();
+			}
+			printf(" %10.1f\n", n / (t2 - t1) / 1e6);
+		}
+	}
+	printf("(MB/s of utf-8)\n");
+	free(text);
+	free(out);
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+	printf("%15s: %s\n", "simd level", utf2gbk_simd_name(utf2gbk_simd_get()));
+	err += test_known();
+	err += test_validate();
+	err += test_stream();
+	if (argc > 1)
+		bench(atoi(argv[1]));
+	return err;
+}
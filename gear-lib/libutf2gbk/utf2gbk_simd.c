@@ -0,0 +1,327 @@
+#include <string.h>
+#include "libutf2gbk.h"
+#include "utf2gbk_simd.h"
+
+/*
+ * each level is compiled with target attribute, the best one is chosen by
+ * cpuid at first use, or forced by utf2gbk_simd_set().
+ *
+ * validate follows Keiser, Lemire, "Validating UTF-8 In Less Than One
+ * Instruction Per Byte": three nibble lookups classify every byte with
+ * the byte before it, the 3rd/4th bytes of long sequences are checked by
+ * a saturated subtract of the bytes 2 and 3 before.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UTF2GBK_SIMD_X86
+#include <immintrin.h>
+#endif
+
+const struct utf2gbk_simd_ops *_utf2gbk_simd_ops = NULL;
+
+/******************************************************************************
+ * generic, one word at a time
+ ******************************************************************************/
+static size_t generic_ascii(char *out, const uint8_t *in, size_t n)
+{
+	uint64_t w;
+	size_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		memcpy(&w, in + i, 8);
+		if (w & 0x8080808080808080ULL)
+			break;
+		memcpy(out + i, &w, 8);
+	}
+	for (; i < n && in[i] < 0x80; i++)
+		out[i] = (char)in[i];
+	return i;
+}
+
+static size_t generic_validate(const uint8_t *s, size_t len)
+{
+	(void)s;
+	(void)len;
+	return 0;
+}
+
+static const struct utf2gbk_simd_ops generic_ops = {
+	UTF2GBK_SIMD_GENERIC,
+	"generic",
+	generic_ascii,
+	generic_validate,
+};
+
+/* back from i to the lead byte of the sequence which i may be inside */
+static size_t char_boundary(const uint8_t *s, size_t i)
+{
+	size_t b = i;
+
+	while (b > 0 && i - b < 3 && (s[b - 1] & 0xC0) == 0x80)
+		b--;
+	if (b > 0 && s[b - 1] >= 0xC0)
+		b--;
+	return b;
+}
+
+#ifdef UTF2GBK_SIMD_X86
+#define TOO_SHORT	(1 << 0)	/* 11______ 0_______, 11______ 11______ */
+#define TOO_LONG	(1 << 1)	/* 0_______ 10______ */
+#define OVERLONG_3	(1 << 2)	/* 11100000 100_____ */
+#define TOO_LARGE	(1 << 3)	/* 11110100 1001____ and above */
+#define SURROGATE	(1 << 4)	/* 11101101 101_____ */
+#define OVERLONG_2	(1 << 5)	/* 1100000_ 10______ */
+#define TOO_LARGE_1000	(1 << 6)	/* 11110101 1000____ and above */
+#define OVERLONG_4	(1 << 6)	/* 11110000 1000____ */
+#define TWO_CONTS	(1 << 7)	/* 10______ 10______ */
+#define CARRY		(TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+#define BYTE_1_HIGH \
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+	TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS, \
+	TOO_SHORT | OVERLONG_2, \
+	TOO_SHORT, \
+	TOO_SHORT | OVERLONG_3 | SURROGATE, \
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+
+#define BYTE_1_LOW \
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, \
+	CARRY | OVERLONG_2, \
+	CARRY, \
+	CARRY, \
+	CARRY | TOO_LARGE, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000
+
+#define BYTE_2_HIGH \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+
+/******************************************************************************
+ * sse4.2, 128 bits a time
+ ******************************************************************************/
+__attribute__((target("sse4.2")))
+static inline __m128i sse42_nibble_hi(__m128i v)
+{
+	return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+}
+
+__attribute__((target("sse4.2")))
+static inline __m128i sse42_check(__m128i in, __m128i prev)
+{
+	const __m128i t1 = _mm_setr_epi8(BYTE_1_HIGH);
+	const __m128i t2 = _mm_setr_epi8(BYTE_1_LOW);
+	const __m128i t3 = _mm_setr_epi8(BYTE_2_HIGH);
+	__m128i prev1 = _mm_alignr_epi8(in, prev, 15);
+	__m128i prev2 = _mm_alignr_epi8(in, prev, 14);
+	__m128i prev3 = _mm_alignr_epi8(in, prev, 13);
+	__m128i sc, must23;
+
+	sc = _mm_and_si128(_mm_shuffle_epi8(t1, sse42_nibble_hi(prev1)),
+	     _mm_and_si128(_mm_shuffle_epi8(t2, _mm_and_si128(prev1, _mm_set1_epi8(0x0F))),
+			   _mm_shuffle_epi8(t3, sse42_nibble_hi(in))));
+	/* only 111_____ 2 back and 1111____ 3 back keep the high bit */
+	must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80))),
+			      _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80))));
+	return _mm_xor_si128(_mm_and_si128(must23, _mm_set1_epi8((char)0x80)), sc);
+}
+
+__attribute__((target("sse4.2")))
+static size_t sse42_ascii(char *out, const uint8_t *in, size_t n)
+{
+	size_t i;
+	unsigned mask;
+
+	/* out has room for n bytes, bytes after the ascii run are scratch */
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i), v);
+		mask = _mm_movemask_epi8(v);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	for (; i < n && in[i] < 0x80; i++)
+		out[i] = (char)in[i];
+	return i;
+}
+
+__attribute__((target("sse4.2")))
+static size_t sse42_validate(const uint8_t *s, size_t len)
+{
+	__m128i prev = _mm_setzero_si128();
+	__m128i err;
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i in = _mm_loadu_si128((const __m128i *)(s + i));
+		/* ascii after ascii can not be wrong */
+		if (!_mm_movemask_epi8(_mm_or_si128(in, prev))) {
+			prev = in;
+			continue;
+		}
+		err = sse42_check(in, prev);
+		if (!_mm_testz_si128(err, err))
+			break;
+		prev = in;
+	}
+	return char_boundary(s, i);
+}
+
+static const struct utf2gbk_simd_ops sse42_ops = {
+	UTF2GBK_SIMD_SSE42,
+	"sse4.2",
+	sse42_ascii,
+	sse42_validate,
+};
+
+/******************************************************************************
+ * avx2, 256 bits a time
+ ******************************************************************************/
+__attribute__((target("avx2")))
+static inline __m256i avx2_nibble_hi(__m256i v)
+{
+	return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_check(__m256i in, __m256i prev)
+{
+	const __m256i t1 = _mm256_setr_epi8(BYTE_1_HIGH, BYTE_1_HIGH);
+	const __m256i t2 = _mm256_setr_epi8(BYTE_1_LOW, BYTE_1_LOW);
+	const __m256i t3 = _mm256_setr_epi8(BYTE_2_HIGH, BYTE_2_HIGH);
+	/* alignr works in 128 bit lanes, the high half of prev goes below in */
+	__m256i cross = _mm256_permute2x128_si256(prev, in, 0x21);
+	__m256i prev1 = _mm256_alignr_epi8(in, cross, 15);
+	__m256i prev2 = _mm256_alignr_epi8(in, cross, 14);
+	__m256i prev3 = _mm256_alignr_epi8(in, cross, 13);
+	__m256i sc, must23;
+
+	sc = _mm256_and_si256(_mm256_shuffle_epi8(t1, avx2_nibble_hi(prev1)),
+	     _mm256_and_si256(_mm256_shuffle_epi8(t2, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F))),
+			      _mm256_shuffle_epi8(t3, avx2_nibble_hi(in))));
+	must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80))),
+				 _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80))));
+	return _mm256_xor_si256(_mm256_and_si256(must23, _mm256_set1_epi8((char)0x80)), sc);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_ascii(char *out, const uint8_t *in, size_t n)
+{
+	size_t i;
+	uint32_t mask;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+		_mm256_storeu_si256((__m256i *)(out + i), v);
+		mask = _mm256_movemask_epi8(v);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	for (; i < n && in[i] < 0x80; i++)
+		out[i] = (char)in[i];
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_validate(const uint8_t *s, size_t len)
+{
+	__m256i prev = _mm256_setzero_si256();
+	__m256i err;
+	size_t i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m256i in = _mm256_loadu_si256((const __m256i *)(s + i));
+		if (!_mm256_movemask_epi8(_mm256_or_si256(in, prev))) {
+			prev = in;
+			continue;
+		}
+		err = avx2_check(in, prev);
+		if (!_mm256_testz_si256(err, err))
+			break;
+		prev = in;
+	}
+	return char_boundary(s, i);
+}
+
+static const struct utf2gbk_simd_ops avx2_ops = {
+	UTF2GBK_SIMD_AVX2,
+	"avx2",
+	avx2_ascii,
+	avx2_validate,
+};
+#endif
+
+static const struct utf2gbk_simd_ops *simd_ops_of(int level)
+{
+#ifdef UTF2GBK_SIMD_X86
+	__builtin_cpu_init();
+	switch (level) {
+	case UTF2GBK_SIMD_GENERIC:
+		return &generic_ops;
+	case UTF2GBK_SIMD_SSE42:
+		if (__builtin_cpu_supports("sse4.2"))
+			return &sse42_ops;
+		break;
+	case UTF2GBK_SIMD_AVX2:
+		if (__builtin_cpu_supports("avx2"))
+			return &avx2_ops;
+		break;
+	default:
+		break;
+	}
+	return NULL;
+#else
+	return level == UTF2GBK_SIMD_GENERIC ? &generic_ops : NULL;
+#endif
+}
+
+const struct utf2gbk_simd_ops *utf2gbk_simd_detect(void)
+{
+	const struct utf2gbk_simd_ops *ops = NULL;
+	int level;
+
+	for (level = UTF2GBK_SIMD_AVX2; level >= 0 && !ops; level--)
+		ops = simd_ops_of(level);
+	/* every thread detects the same, no lock is needed */
+	_utf2gbk_simd_ops = ops;
+	return ops;
+}
+
+int utf2gbk_simd_get(void)
+{
+	return utf2gbk_simd()->level;
+}
+
+int utf2gbk_simd_supported(int level)
+{
+	return simd_ops_of(level) != NULL;
+}
+
+int utf2gbk_simd_set(int level)
+{
+	const struct utf2gbk_simd_ops *ops = simd_ops_of(level);
+	if (!ops)
+		return -1;
+	_utf2gbk_simd_ops = ops;
+	return 0;
+}
+
+const char *utf2gbk_simd_name(int level)
+{
+	const struct utf2gbk_simd_ops *ops = simd_ops_of(level);
+	return ops ? ops->name : "unsupported";
+}
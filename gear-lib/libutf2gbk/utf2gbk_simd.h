@@ -0,0 +1,80 @@
+#ifndef __UTF2GBK_SIMD_H__
+#define __UTF2GBK_SIMD_H__
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * internal, vector kernels of utf-8 scanning
+ */
+struct utf2gbk_simd_ops {
+	int level;
+	const char *name;
+	/* copy the leading ascii bytes of in[0, n) to out, return the count */
+	size_t (*ascii)(char *out, const uint8_t *in, size_t n);
+	/*
+	 * return a char boundary b, s[0, b) is valid utf-8, the rest is for
+	 * utf8_decode() to check, generic returns 0
+	 */
+	size_t (*validate)(const uint8_t *s, size_t len);
+};
+
+extern const struct utf2gbk_simd_ops *_utf2gbk_simd_ops;
+const struct utf2gbk_simd_ops *utf2gbk_simd_detect(void);
+
+static inline const struct utf2gbk_simd_ops *utf2gbk_simd(void)
+{
+	const struct utf2gbk_simd_ops *ops = _utf2gbk_simd_ops;
+	if (!ops)
+		ops = utf2gbk_simd_detect();
+	return ops;
+}
+
+/*
+ * decode one sequence of RFC 3629 utf-8, no overlong form, no surrogate,
+ * nothing above U+10FFFF. return its length, 0 if s[0, len) is a valid
+ * but truncated sequence, or -1 if invalid.
+ */
+static inline int utf8_decode(const uint8_t *s, size_t len, uint32_t *cp)
+{
+	uint8_t c = s[0], lo = 0x80, hi = 0xBF;
+	int n, i;
+
+	if (c < 0x80) {
+		*cp = c;
+		return 1;
+	} else if (c < 0xC2) {
+		return -1;
+	} else if (c < 0xE0) {
+		n = 2;
+		*cp = c & 0x1F;
+	} else if (c < 0xF0) {
+		n = 3;
+		*cp = c & 0x0F;
+		if (c == 0xE0)
+			lo = 0xA0;
+		else if (c == 0xED)
+			hi = 0x9F;
+	} else if (c < 0xF5) {
+		n = 4;
+		*cp = c & 0x07;
+		if (c == 0xF0)
+			lo = 0x90;
+		else if (c == 0xF4)
+			hi = 0x8F;
+	} else {
+		return -1;
+	}
+	/* only the second byte has a narrower range */
+	for (i = 1; i < n; i++) {
+		if ((size_t)i >= len)
+			return 0;
+		if (s[i] < lo || s[i] > hi)
+			return -1;
+		lo = 0x80;
+		hi = 0xBF;
+		*cp = (*cp << 6) | (s[i] & 0x3F);
+	}
+	return n;
+}
+
+#endif
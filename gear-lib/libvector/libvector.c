@@ -25,33 +25,118 @@
 #include <string.h>
 #include <errno.h>
 
-#define VECTOR_DEFAULT_BUF_LEN  (1024)
+#define VECTOR_MIN_BUF_LEN  (VECTOR_INLINE_LEN * 2)
 
-void _vector_push_back(struct vector *v, void *e, size_t type_size)
+static inline int vector_is_inline(struct vector *v)
+{
+    return v->buf.iov_base == v->inline_buf;
+}
+
+/*
+ * grow capacity geometrically, so n push_back cost O(n) in total,
+ * instead of O(n^2) memcpy by realloc in constant steps
+ */
+static int vector_grow(struct vector *v, size_t need)
 {
     size_t resize;
     void *pnew;
+
+    if (need > v->max_size) {
+        printf("%s: %zu elements exceed max_size!\n", __func__, need);
+        return -1;
+    }
+    need *= v->type_size;
+    if (need <= v->capacity) {
+        return 0;
+    }
+    resize = v->capacity < VECTOR_MIN_BUF_LEN ? VECTOR_MIN_BUF_LEN : v->capacity;
+    while (resize < need) {
+        if (resize > ((size_t)-1) / 2) {
+            resize = need;
+            break;
+        }
+        resize *= 2;
+    }
+    if (vector_is_inline(v)) {
+        pnew = malloc(resize);
+        if (pnew) {
+            memcpy(pnew, v->inline_buf, v->size * v->type_size);
+        }
+    } else {
+        pnew = realloc(v->buf.iov_base, resize);
+    }
+    if (!pnew) {
+        printf("realloc failed!\n");
+        return -1;
+    }
+    v->buf.iov_base = pnew;
+    v->buf.iov_len = resize;
+    v->capacity = resize;
+    return 0;
+}
+
+int vector_reserve(struct vector *v, size_t n)
+{
+    if (!v) {
+        printf("%s: paraments invalid!\n", __func__);
+        return -1;
+    }
+    return vector_grow(v, n);
+}
+
+int _vector_push_back(struct vector *v, void *e, size_t type_size)
+{
     void *ptop;
     if (!v || !e || type_size != v->type_size) {
         printf("%s: paraments invalid!\n", __func__);
-        return;
+        return -1;
     }
-check:
-    if ((v->size + 1) * v->type_size >= v->capacity) {
-        resize = v->capacity + VECTOR_DEFAULT_BUF_LEN;
-        pnew = realloc(v->buf.iov_base, resize);
-        if (!pnew) {
-            printf("realloc failed!\n");
-            return;
+    if ((v->size + 1) * v->type_size > v->capacity) {
+        if (vector_grow(v, v->size + 1) < 0) {
+            return -1;
         }
-        v->buf.iov_base = pnew;
-        v->buf.iov_len = resize;
-        v->capacity = resize;
-        goto check;
     }
     ptop = (uint8_t *)v->buf.iov_base + v->size * v->type_size;
     memcpy(ptop, e, v->type_size);
     v->size++;
+    return 0;
+}
+
+int _vector_push_back_n(struct vector *v, const void *e, size_t n, size_t type_size)
+{
+    void *ptop;
+    if (!v || (!e && n) || type_size != v->type_size) {
+        printf("%s: paraments invalid!\n", __func__);
+        return -1;
+    }
+    if (n > v->max_size - v->size) {
+        printf("%s: %zu elements exceed max_size!\n", __func__, n);
+        return -1;
+    }
+    if (vector_grow(v, v->size + n) < 0) {
+        return -1;
+    }
+    ptop = (uint8_t *)v->buf.iov_base + v->size * v->type_size;
+    memcpy(ptop, e, n * v->type_size);
+    v->size += n;
+    return 0;
+}
+
+void *_vector_emplace(struct vector *v, size_t type_size)
+{
+    void *ptop;
+    if (!v || type_size != v->type_size) {
+        printf("%s: paraments invalid!\n", __func__);
+        return NULL;
+    }
+    if ((v->size + 1) * v->type_size > v->capacity) {
+        if (vector_grow(v, v->size + 1) < 0) {
+            return NULL;
+        }
+    }
+    ptop = (uint8_t *)v->buf.iov_base + v->size * v->type_size;
+    v->size++;
+    return ptop;
 }
 
 void vector_pop_back(struct vector *v)
@@ -73,7 +158,6 @@ int vector_empty(struct vector *v)
         printf("%s: paraments invalid!\n", __func__);
         return -1;
     }
-    v->tmp_cursor = 0;
     return (v->size == 0);
 }
 
@@ -97,53 +181,44 @@ vector_iter vector_end(struct vector *v)
 
 vector_iter vector_last(struct vector *v)
 {
-    if (!v) {
+    if (!v || v->size == 0) {
         printf("%s: paraments invalid!\n", __func__);
         return NULL;
     }
     return (void *)((uint8_t *)v->buf.iov_base + (v->size-1) * v->type_size);
 }
 
-vector_iter vector_next(struct vector *v)
-{
-    if (!v) {
-        printf("%s: paraments invalid!\n", __func__);
-        return NULL;
-    }
-    if (v->tmp_cursor < v->size) {
-        v->tmp_cursor++;
-    } else {
-        return NULL;
-    }
-    return (void *)((uint8_t *)v->buf.iov_base + v->tmp_cursor * v->type_size);
-}
-
-vector_iter vector_prev(struct vector *v)
+void *_vector_iter_value(struct vector *v, vector_iter iter)
 {
-    if (!v) {
+    if (!v || !iter) {
         printf("%s: paraments invalid!\n", __func__);
         return NULL;
     }
-    v->tmp_cursor--;
-    return (void *)((uint8_t *)v->buf.iov_base + v->tmp_cursor * v->type_size);
+    return iter;
 }
 
-void *_vector_iter_value(struct vector *v, vector_iter iter)
+void *_vector_at(struct vector *v, int pos)
 {
-    if (!v || !iter) {
+    if (!v || pos < 0 || (size_t)pos >= v->size) {
         printf("%s: paraments invalid!\n", __func__);
         return NULL;
     }
-    return (void *)((uint8_t *)v->buf.iov_base + v->tmp_cursor * v->type_size);
+    return (void *)((uint8_t *)v->buf.iov_base + pos * v->type_size);
 }
 
-void *_vector_at(struct vector *v, int pos)
+int _vector_init(struct vector *v, size_t size)
 {
-    if (!v || pos < 0) {
+    if (!v || size == 0) {
         printf("%s: paraments invalid!\n", __func__);
-        return NULL;
+        return -1;
     }
-    return (void *)((uint8_t *)v->buf.iov_base + pos * v->type_size);
+    v->size = 0;
+    v->type_size = size;
+    v->max_size = ((size_t)-1) / size;
+    v->capacity = VECTOR_INLINE_LEN;
+    v->buf.iov_len = VECTOR_INLINE_LEN;
+    v->buf.iov_base = v->inline_buf;
+    return 0;
 }
 
 struct vector *_vector_create(size_t size)
@@ -153,32 +228,32 @@ struct vector *_vector_create(size_t size)
         printf("malloc vector failed!\n");
         return NULL;
     }
-    v->size = 0;
-    v->tmp_cursor = 0;
-    v->type_size = size;
-    v->max_size = (size_t)(-1/size);
-    v->capacity = VECTOR_DEFAULT_BUF_LEN;
-    v->buf.iov_len = VECTOR_DEFAULT_BUF_LEN;
-    v->buf.iov_base = calloc(1, v->buf.iov_len);
-    if (!v->buf.iov_base) {
-        printf("malloc vector buf failed!\n");
-        goto failed;
-    }
-    return v;
-failed:
-    if (v) {
+    if (_vector_init(v, size) < 0) {
         free(v);
+        return NULL;
     }
-    return NULL;
+    return v;
 }
 
-void vector_destroy(struct vector *v)
+void vector_deinit(struct vector *v)
 {
     if (!v) {
         return;
     }
-    if (v->buf.iov_base) {
+    if (v->buf.iov_base && !vector_is_inline(v)) {
         free(v->buf.iov_base);
     }
+    v->buf.iov_base = v->inline_buf;
+    v->buf.iov_len = VECTOR_INLINE_LEN;
+    v->capacity = VECTOR_INLINE_LEN;
+    v->size = 0;
+}
+
+void vector_destroy(struct vector *v)
+{
+    if (!v) {
+        return;
+    }
+    vector_deinit(v);
     free(v);
 }
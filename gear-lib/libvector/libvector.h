@@ -26,30 +26,37 @@
 #include <stdint.h>
 #include <unistd.h>
 
-#define LIBVECTOR_VERSION "0.1.0"
+#define LIBVECTOR_VERSION "0.2.0"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* short vectors live in inline_buf, no extra allocation */
+#define VECTOR_INLINE_LEN   (64)
+
 typedef void *vector_iter;
 
 typedef struct vector {
     size_t size;     //number of element
     size_t max_size; //max number of element
-    size_t capacity; //size of allocated storage capacity
+    size_t capacity; //size of allocated storage capacity, in bytes
     size_t type_size;
-    size_t tmp_cursor;
     struct iovec buf;
-    vector_iter iterator;
+    uint8_t inline_buf[VECTOR_INLINE_LEN];
 } vector_t;
 
 /*
  * vector_assign
  * vector_create
+ * vector_init
+ * vector_deinit
  * vector_destroy
  * vector_empty
+ * vector_reserve
  * vector_push_back
+ * vector_push_back_n
+ * vector_emplace
  * vector_pop_back
  * vector_back
  * vector_begin
@@ -65,15 +72,31 @@ typedef struct vector {
  * inner apis
  */
 struct vector *_vector_create(size_t size);
-void _vector_push_back(struct vector *v, void *e, size_t type_size);
+int _vector_init(struct vector *v, size_t size);
+int _vector_push_back(struct vector *v, void *e, size_t type_size);
+int _vector_push_back_n(struct vector *v, const void *e, size_t n, size_t type_size);
+void *_vector_emplace(struct vector *v, size_t type_size);
 vector_iter vector_begin(struct vector *v);
 vector_iter vector_end(struct vector *v);
 vector_iter vector_last(struct vector *v);//last=end-1
-vector_iter vector_next(struct vector *v);
-vector_iter vector_prev(struct vector *v);
 void *_vector_iter_value(struct vector *v, vector_iter iter);
 void *_vector_at(struct vector *v, int pos);
 
+/*
+ * iterator is the address of element, it keeps no state in vector, so
+ * many iterators can walk one vector at the same time.
+ * any push may move elements and invalidate all iterators.
+ */
+static inline vector_iter vector_next(struct vector *v, vector_iter iter)
+{
+    return (vector_iter)((uint8_t *)iter + v->type_size);
+}
+
+static inline vector_iter vector_prev(struct vector *v, vector_iter iter)
+{
+    return (vector_iter)((uint8_t *)iter - v->type_size);
+}
+
 
 #if defined (__linux__) || defined (__CYGWIN__)
 #define vector_create(type_t) \
@@ -81,26 +104,30 @@ void *_vector_at(struct vector *v, int pos);
 #else
 #define vector_create(type_t) _vector_create(sizeof(type_t))
 #endif
+/*
+ * vector_init is for vector embedded in other struct or on stack,
+ * vector must not be moved by memcpy after init while using inline buffer
+ */
+#define vector_init(v, type_t) _vector_init(v, sizeof(type_t))
+void vector_deinit(struct vector *v);
 void vector_destroy(struct vector *v);
 int vector_empty(struct vector *v);
+#define vector_size(v) ((v)->size)
+/* make sure n elements can be stored without reallocation */
+int vector_reserve(struct vector *v, size_t n);
 #define vector_push_back(v, e) _vector_push_back(v, (void *)&e, sizeof(e))
+#define vector_push_back_n(v, array, n) \
+    _vector_push_back_n(v, (const void *)(array), n, sizeof(*(array)))
+/* append an element at back and return its address to write in place */
+#define vector_emplace(v, type_t) ((type_t *)_vector_emplace(v, sizeof(type_t)))
 void vector_pop_back(struct vector *v);
-#if defined (__linux__) || defined (__CYGWIN__)
-#define vector_back(v, type_t) \
-    ({ \
-        type_t __tmp; \
-        memcpy(&__tmp, vector_last(v), v->type_size); \
-        &__tmp; \
-    })
-#else
-#define vector_back(v, type_t) (type_t *)vector_last(v)
-#endif
+#define vector_back(v, type_t) ((type_t *)vector_last(v))
 
 #define vector_iter_valuep(vector, iter, type_t) \
-    (type_t *)_vector_iter_value(vector, iter)
+    ((type_t *)_vector_iter_value(vector, iter))
 
 #define vector_at(v, pos, type_t) \
-    (type_t *)_vector_at(v, pos)
+    ((type_t *)_vector_at(v, pos))
 
 
 #ifdef __cplusplus
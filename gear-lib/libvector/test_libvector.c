@@ -23,8 +23,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 //#include <unistd.h>
 
+static double epoch_double(void)
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + (t.tv_usec * 1.0) / 1000000.0;
+}
+
 struct tmp_box {
     char c;
     int i;
@@ -45,7 +53,7 @@ void mix_struct()
     c = _vector_create(sizeof(struct tmp_box));
 #endif
     vector_push_back(c, tb);
-    for (iter = vector_begin(c); iter != vector_end(c); iter = vector_next(c)) {
+    for (iter = vector_begin(c); iter != vector_end(c); iter = vector_next(c, iter)) {
         struct tmp_box *tt = vector_iter_valuep(c, iter, struct tmp_box);
         printf("vector member.c: %c\n", tt->c);
         printf("vector member.i: %d\n", tt->i);
@@ -79,7 +87,7 @@ void default_struct()
     vector_push_back(a, t1);
     vector_push_back(a, t2);
     vector_push_back(a, t3);
-    for (iter = vector_begin(a); iter != vector_end(a); iter = vector_next(a)) {
+    for (iter = vector_begin(a); iter != vector_end(a); iter = vector_next(a, iter)) {
         printf("vector member: %d\n", *vector_iter_valuep(a, iter, int));
     }
     for (i = 0; i < a->size; i++) {
@@ -90,7 +98,7 @@ void default_struct()
 #if defined (__linux__) || defined (__CYGWIN__)
         memcpy(tmp, vector_back(a, int), sizeof(int));
 #else
-        memcpy(itmp, vector_last(a), a->type_size);
+        memcpy(&itmp, vector_last(a), a->type_size);
         tmp = &itmp;
 #endif
         sum += *tmp;
@@ -105,9 +113,97 @@ void default_struct()
     vector_destroy(a);
 }
 
+void bulk_struct()
+{
+    vector_t v;
+    vector_iter iter;
+    struct tmp_box *tb;
+    int arr[100];
+    int i, sum = 0;
+
+    vector_init(&v, int);
+    for (i = 0; i < 100; i++) {
+        arr[i] = i;
+    }
+    vector_push_back_n(&v, arr, 10);
+    printf("inline capacity = %zu, size = %zu\n", v.capacity, v.size);
+    vector_reserve(&v, 1000);
+    vector_push_back_n(&v, arr + 10, 90);
+    *vector_emplace(&v, int) = 100;
+    for (iter = vector_end(&v); iter != vector_begin(&v); ) {
+        iter = vector_prev(&v, iter);
+        sum += *vector_iter_valuep(&v, iter, int);
+    }
+    printf("sum is %d, expect %d, capacity = %zu\n", sum, 5050, v.capacity);
+    vector_deinit(&v);
+
+    vector_init(&v, struct tmp_box);
+    tb = vector_emplace(&v, struct tmp_box);
+    tb->c = 'b';
+    tb->i = 2;
+    tb->f = 2.5;
+    printf("emplace member.c: %c, back.i: %d\n",
+           vector_at(&v, 0, struct tmp_box)->c, vector_back(&v, struct tmp_box)->i);
+    vector_deinit(&v);
+}
+
+/*
+ * push and iterate throughput, 10^3 to 10^max_exp elements
+ */
+void bench(int max_exp)
+{
+    vector_t *v;
+    vector_iter iter;
+    double t1, t2, t3, t4;
+    size_t n, i;
+    uint64_t sum;
+    int e;
+
+    printf("%12s %12s %12s %12s\n", "elements", "push Mops/s",
+           "push_n Mops/s", "iter Mops/s");
+    for (e = 3, n = 1000; e <= max_exp; e++, n *= 10) {
+        v = vector_create(uint32_t);
+        t1 = epoch_double();
+        for (i = 0; i < n; i++) {
+            uint32_t x = i;
+            vector_push_back(v, x);
+        }
+        t2 = epoch_double();
+        sum = 0;
+        for (iter = vector_begin(v); iter != vector_end(v); iter = vector_next(v, iter)) {
+            sum += *vector_iter_valuep(v, iter, uint32_t);
+        }
+        t3 = epoch_double();
+        vector_destroy(v);
+        if (sum != (uint64_t)n * (n - 1) / 2) {
+            printf("iterate sum mismatch\n");
+        }
+
+        v = vector_create(uint32_t);
+        t4 = epoch_double();
+        vector_reserve(v, n);
+        for (i = 0; i < n; i += 1000) {
+            uint32_t blk[1000];
+            size_t j, m = (n - i < 1000) ? n - i : 1000;
+            for (j = 0; j < m; j++) {
+                blk[j] = i + j;
+            }
+            vector_push_back_n(v, blk, m);
+        }
+        t4 = epoch_double() - t4;
+        vector_destroy(v);
+        printf("%12zu %12.1f %12.1f %12.1f\n", n,
+               n / (t2 - t1) / 1e6, n / t4 / 1e6, n / (t3 - t2) / 1e6);
+    }
+}
+
 int main(int argc, char **argv)
 {
     mix_struct();
     default_struct();
+    bulk_struct();
+    if (argc > 1) {
+        bench(atoi(argv[1]));
+    }
     return 0;
 }
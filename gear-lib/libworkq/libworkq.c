@@ -20,12 +20,16 @@
  * SOFTWARE.
  ******************************************************************************/
 #include "libworkq.h"
+#include <libatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #if defined (OS_LINUX)
 #include <sys/sysinfo.h>
 #endif
+#ifdef ENABLE_MEMPOOL
+#include <libmempool.h>
+#endif
 
 struct task {
     struct list_head entry;
@@ -34,20 +38,37 @@ struct task {
     struct workq *wq;
 };
 
+#ifdef ENABLE_MEMPOOL
+static struct mempool *g_task_pool = NULL;
+static pthread_once_t g_task_pool_once = PTHREAD_ONCE_INIT;
+
+static void task_pool_init(void)
+{
+    g_task_pool = mempool_create("workq_task", 0);
+}
+#endif
 
 static bool is_workq_underload(struct workq_pool *pool, struct workq *wq)
 {
-    return (wq->load == 0 || wq->load < pool->threshold);
+    int load = atomic_int_get(&wq->load);
+    return (load == 0 || load < pool->threshold);
 }
 
 bool is_workq_overload(struct workq_pool *pool, struct workq *wq)
 {
-    return (wq->load == 1 || wq->load > pool->threshold);
+    int load = atomic_int_get(&wq->load);
+    return (load == 1 || load > pool->threshold);
 }
 
 static struct task *task_create(struct workq *wq, task_func_t func, void *data)
 {
-    struct task *t = calloc(1, sizeof(struct task));
+    struct task *t;
+#ifdef ENABLE_MEMPOOL
+    pthread_once(&g_task_pool_once, task_pool_init);
+    t = mempool_calloc(g_task_pool, sizeof(struct task));
+#else
+    t = calloc(1, sizeof(struct task));
+#endif
     if (!t) {
         return NULL;
     }
@@ -56,18 +77,21 @@ static struct task *task_create(struct workq *wq, task_func_t func, void *data)
     t->data = data;
     thread_lock(wq->thread);
     list_add_tail(&t->entry, &wq->wq_list);
+    atomic_int_inc(&wq->load);
     thread_signal(wq->thread);
     thread_unlock(wq->thread);
     return t;
 }
 
+/* t is off the list already, the caller holds no lock */
 static void task_destroy(struct task *t)
 {
-    struct workq *wq = t->wq;
-    thread_lock(wq->thread);
-    list_del_init(&t->entry);
-    thread_unlock(wq->thread);
+    atomic_int_dec(&t->wq->load);
+#ifdef ENABLE_MEMPOOL
+    mempool_free(t);
+#else
     free(t);
+#endif
 }
 
 static void *_task_thread(struct thread *thread, void *arg)
@@ -79,13 +103,18 @@ static void *_task_thread(struct thread *thread, void *arg)
         while (list_empty(&wq->wq_list) && wq->run) {
             thread_wait(thread, 0);
         }
+        /*
+         * dequeue before running, workq_destroy may free what is still
+         * queued as soon as the task has signaled its owner
+         */
         t = list_first_entry_or_null(&wq->wq_list, struct task, entry);
+        if (t) {
+            list_del_init(&t->entry);
+        }
         thread_unlock(thread);
-        if (t && t->func) {
-            wq->load = 1;
+        if (t) {
             t->func(t->data);
             task_destroy(t);
-            wq->load = 0;
         }
     }
     return NULL;
@@ -116,6 +145,7 @@ static void workq_destroy(struct workq *wq)
     thread_lock(wq->thread);
     while (!list_empty(&wq->wq_list)) {
         t = list_first_entry_or_null(&wq->wq_list, struct task, entry);
+        list_del_init(&t->entry);
         task_destroy(t);
     }
     wq->run = 0;
@@ -128,30 +158,40 @@ static void workq_destroy(struct workq *wq)
 
 struct workq_pool *workq_pool_create()
 {
-    int i;
     int cpus = 1;
-    struct workq *wq;
-
-    struct workq_pool *pool = calloc(1, sizeof(struct workq_pool));
-    if (!pool) {
-        printf("malloc workq_pool failed!\n");
-        return NULL;
-    }
 
 #if defined (OS_LINUX)
     cpus = get_nprocs_conf();
 #endif
     if (cpus <= 0) {
         printf("cpu number is invalid!\n");
-        goto failed;
+        return NULL;
     }
     printf("cpu number is %d\n", cpus);
+    return workq_pool_create_n(cpus);
+}
+
+struct workq_pool *workq_pool_create_n(int threads)
+{
+    int i;
+    struct workq *wq;
+    struct workq_pool *pool;
+
+    if (threads <= 0) {
+        printf("invalid paraments!\n");
+        return NULL;
+    }
+    pool = calloc(1, sizeof(struct workq_pool));
+    if (!pool) {
+        printf("malloc workq_pool failed!\n");
+        return NULL;
+    }
 
-    pool->cpus = cpus;
+    pool->cpus = threads;
     pool->threshold = 0;
     da_init(pool->wq_array);
 
-    for (i = 0; i < cpus; ++i) {
+    for (i = 0; i < threads; ++i) {
         wq = workq_create();
         if (!wq) {
             goto failed;
@@ -162,36 +202,26 @@ struct workq_pool *workq_pool_create()
     return pool;
 
 failed:
-    if (pool) {
-        do {
-            wq = pool->wq_array.array[pool->wq_array.num-1];
-            da_erase_item(pool->wq_array, &wq);
-            free(wq);
-        } while (pool->wq_array.num > 0);
-    }
-    if (!pool) {
-        free(pool);
-    }
+    workq_pool_destroy(pool);
     return NULL;
 }
 
+/*
+ * load counts queued and running tasks, so a burst of pushes spreads over
+ * all workq instead of piling on the first one whose task has not started
+ */
 static struct workq *find_underrun_workq(struct workq_pool *pool)
 {
     int i;
-    struct workq *wq;
+    struct workq *wq, *min = NULL;
     for (i = 0; i < pool->wq_array.num; i++) {
         wq = pool->wq_array.array[i];
         if (is_workq_underload(pool, wq))
-            break;
-    }
-    if (i == pool->wq_array.num) {
-        /*
-         * TODO: need do load blance
-         */
-        i = pool->wq_array.num - 1;
-        printf("all workq are overload, need expand, just force to last workq!\n");
+            return wq;
+        if (!min || atomic_int_get(&wq->load) < atomic_int_get(&min->load))
+            min = wq;
     }
-    return pool->wq_array.array[i];
+    return min;
 }
 
 int workq_pool_task_push(struct workq_pool *pool, task_func_t func, void *data)
@@ -44,7 +44,7 @@ extern "C" {
  *   | workq[n] | task[0] | task[1] | ... | task[k] |
  *   +==========+---------+---------+-----+---------+
  *
- *   n = cpu core numbers
+ *   n = cpu core numbers, or the threads given to workq_pool_create_n
  *   suppose each task is not infinite loop
  */
 
@@ -65,6 +65,7 @@ typedef struct workq_pool {
 typedef void (*task_func_t)(void *);
 
 GEAR_API struct workq_pool *workq_pool_create();
+GEAR_API struct workq_pool *workq_pool_create_n(int threads);
 GEAR_API int workq_pool_task_push(struct workq_pool *p, task_func_t f, void *d);
 GEAR_API void workq_pool_destroy(struct workq_pool *pool);
 